@@ -0,0 +1,33 @@
+// Array.sort on random, already sorted and reverse sorted input - integers
+// and floats with the default (string) order and with a compare function,
+// strings, and an ArrayBufferView
+var N = 1000;
+var seed = 1;
+function rand() { seed = (seed*1103515245 + 12345) & 0x7FFFFFFF; return seed / 0x7FFFFFFF; }
+function numeric(a,b) { return a-b; }
+
+var tests = {
+  "ints" : { make : function(v) { return Math.floor(v*100000); } },
+  "ints, compare fn" : { make : function(v) { return Math.floor(v*100000); }, compare : numeric },
+  "floats" : { make : function(v) { return v*1000; } },
+  "strings" : { make : function(v) { return "item"+Math.floor(v*100000); } },
+  "Uint16Array" : { make : function(v) { return Math.floor(v*65536); }, typed : Uint16Array },
+};
+
+function input(test, order) {
+  var a = [];
+  for (var i=0;i<N;i++) a.push(test.make(rand()));
+  if (order!="random") a.sort(test.compare);
+  if (order=="reverse") a.reverse();
+  return test.typed ? new test.typed(a) : a;
+}
+
+["random","sorted","reverse"].forEach(function(order) {
+  for (var name in tests) {
+    var test = tests[name];
+    var a = input(test, order);
+    var t = getTime();
+    a.sort(test.compare);
+    console.log(order, name+":", ((getTime()-t)*1000).toFixed(1), "ms");
+  }
+});
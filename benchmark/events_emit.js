@@ -0,0 +1,27 @@
+// Events per second through emit(), both in small batches (that fit in the
+// native event queue) and in big bursts (that overflow it)
+var o = {}, handled = 0, TOTAL = 20000, batch, start, onDone;
+o.on('data', function(a,b,c) {
+  handled++;
+  if (handled%batch==0 && handled<TOTAL) send();
+  if (handled==TOTAL) onDone();
+});
+
+function send() {
+  for (var i=0;i<batch;i++) o.emit('data', i, "hello", handled);
+}
+
+function run(size, callback) {
+  batch = size;
+  handled = 0;
+  onDone = function() {
+    console.log("batches of", size, ":", Math.round(TOTAL/(getTime()-start)), "events/sec");
+    if (callback) callback();
+  };
+  start = getTime();
+  send();
+}
+
+run(16, function() {
+  run(500);
+});
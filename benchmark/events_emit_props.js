@@ -0,0 +1,35 @@
+// emit() on an object with lots of properties (like a busy stream or
+// connection), both for an event nobody listens to and for one that has a
+// listener - with few and with many arguments
+var PROPS = 200, TOTAL = 5000, BATCH = 32;
+var o = {};
+for (var i=0;i<PROPS;i++) o["prop"+i] = i;
+var handled = 0, send, onDone;
+o.on('data', function() {
+  handled++;
+  if (handled%BATCH==0 && handled<TOTAL) send();
+  if (handled==TOTAL) onDone();
+});
+
+var start = getTime();
+for (var i=0;i<TOTAL;i++) o.emit('end', i);
+console.log("no listener:", Math.round(TOTAL/(getTime()-start)), "emits/sec");
+
+function run(name, fn, callback) {
+  send = function() { for (var i=0;i<BATCH;i++) fn(i); };
+  handled = 0;
+  onDone = function() {
+    console.log(name+":", Math.round(TOTAL/(getTime()-start)), "emits/sec");
+    if (callback) callback();
+  };
+  start = getTime();
+  send();
+}
+
+run("1 argument", function(i) {
+  o.emit('data', i);
+}, function() {
+  run("6 arguments", function(i) {
+    o.emit('data', i, 1, 2, 3, 4, 5);
+  });
+});
@@ -0,0 +1,15 @@
+var a = new Uint8Array(2048);
+for (var i=0;i<a.length;i++) a[i] = i;
+var t = getTime();
+for (i=0;i<10;i++) a.map(E.reverseByte);
+console.log("map(E.reverseByte)", (getTime()-t)*100, "ms");
+t = getTime();
+for (i=0;i<10;i++) a.map(function(v) { return v^255; });
+console.log("map(function)", (getTime()-t)*100, "ms");
+t = getTime();
+var n = 0;
+for (i=0;i<10;i++) a.forEach(function(v) { n += v; });
+console.log("forEach", (getTime()-t)*100, "ms");
+t = getTime();
+for (i=0;i<10;i++) a.reduce(function(p, v) { return p+v; }, 0);
+console.log("reduce", (getTime()-t)*100, "ms");
@@ -0,0 +1,12 @@
+var a = new Float32Array(1024);
+var b = new Float32Array(64);
+for (var i=0;i<a.length;i++) a[i] = Math.sin(i/10);
+for (i=0;i<b.length;i++) b[i] = 1/b.length;
+var t = getTime();
+for (i=0;i<20;i++) {
+  E.sum(a);
+  E.variance(a, 0);
+  E.convolve(a, b, i);
+  E.FFT(a);
+}
+console.log((getTime()-t)*1000/20, "ms per iteration");
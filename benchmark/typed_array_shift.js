@@ -0,0 +1,11 @@
+// Shift a 4KB sample window along by one 256 byte chunk and append new data
+var w = new Uint8Array(4096);
+var chunk = new Uint8Array(256);
+var t = getTime();
+for (var i=0;i<100;i++) {
+  chunk.fill(i);
+  w.set(w.subarray(chunk.length));
+  w.set(chunk, w.length-chunk.length);
+  w.copyWithin(0, 256);
+}
+console.log((getTime()-t)*1000/100, "ms per iteration");
@@ -0,0 +1,25 @@
+// Utility timer jitter on Linux: queue pin changes on a virtual pin and use
+// setWatch to find out when each one actually happened
+var COUNT = 200;
+var INTERVAL = 0.001; // seconds between changes
+var pin = D1;
+var scheduled = [], actual = [];
+
+setWatch(function(e) { actual.push(e.time); }, pin, {repeat:true, edge:'both'});
+var start = getTime()+0.05;
+for (var i=0;i<COUNT;i++) {
+  scheduled.push(start + i*INTERVAL);
+  pin.writeAtTime(!(i&1), scheduled[i]);
+}
+
+setTimeout(function() {
+  clearWatch();
+  var late = [];
+  for (var i=0;i<actual.length;i++) late.push((actual[i]-scheduled[i])*1000000);
+  late.sort(function(a,b) { return a-b; });
+  console.log("fired", actual.length, "of", COUNT);
+  console.log("late (us): min", late[0].toFixed(0),
+              "median", late[late.length>>1].toFixed(0),
+              "99%", late[Math.floor(late.length*0.99)].toFixed(0),
+              "max", late[late.length-1].toFixed(0));
+}, COUNT*INTERVAL*1000 + 200);
@@ -0,0 +1,60 @@
+// Keep the utility timer busy with four fast waveforms while thousands of pin
+// changes are queued in random order on several pins and then retired.
+// Reports time spent queueing and how late the pin changes happened.
+var ROUNDS = 16, TASKS = 200;
+var pins = [D1, D2, D3, D4, D5, D6, D7, D8];
+var seed = 1;
+function rand() { seed = (seed*1103515245 + 12345) & 0x7FFFFFFF; return seed / 0x7FFFFFFF; }
+
+var waveforms = [D10, D11, D12, D13].map(function(pin) {
+  var w = new Waveform(256);
+  w.startInput(pin, 20000, {repeat:true});
+  return w;
+});
+
+var round = 0, queueTime = 0, late = [], expected = {}, changes = 0;
+pins.forEach(function(pin) {
+  setWatch(function(e) {
+    var t = expected[pin].shift();
+    if (t!==undefined) late.push((e.time-t)*1000000);
+  }, pin, {repeat:true, edge:'both'});
+});
+
+function next() {
+  if (round++ == ROUNDS) {
+    waveforms.forEach(function(w) { w.stop(); });
+    clearWatch();
+    late.sort(function(a,b) { return a<b ? -1 : a>b ? 1 : 0; });
+    console.log((queueTime*1000000/(ROUNDS*TASKS)).toFixed(2), "us to queue each task");
+    console.log("fired", late.length, "of", changes);
+    console.log("late (us): median", late[late.length>>1].toFixed(0),
+                "99%", late[Math.floor(late.length*0.99)].toFixed(0),
+                "max", late[late.length-1].toFixed(0));
+    return;
+  }
+  var start = getTime() + 0.02;
+  var times = pins.map(function() { return []; });
+  var t = getTime();
+  for (var i=0;i<TASKS;i++) {
+    var time = start + rand()*0.02;
+    times[i&7].push(time);
+    pins[i&7].writeAtTime((i>>3)&1, time);
+  }
+  queueTime += getTime()-t;
+  // work out what order each pin's changes will happen in - only actual changes fire the watch
+  pins.forEach(function(pin, p) {
+    var tasks = times[p].map(function(time, i) { return {time:time, value:i&1}; });
+    tasks.sort(function(a,b) { return a.time<b.time ? -1 : a.time>b.time ? 1 : 0; });
+    var value = digitalRead(pin);
+    expected[pin] = [];
+    tasks.forEach(function(task) {
+      if (task.value != value) {
+        expected[pin].push(task.time);
+        changes++;
+      }
+      value = task.value;
+    });
+  });
+  setTimeout(next, 50);
+}
+next();
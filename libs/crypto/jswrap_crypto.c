@@ -15,6 +15,7 @@
  */
 #include "jsvar.h"
 #include "jsvariterator.h"
+#include "jsparse.h"
 #include "jswrap_crypto.h"
 
 #include "mbedtls/include/mbedtls/aes.h"
@@ -78,6 +79,28 @@ typedef enum {
   CM_ECB,
 } CryptoMode;
 
+#define CRYPTO_CONTEXT_NAME JS_HIDDEN_CHAR_STR"ctx" // flat string containing JsCryptoHash/JsCryptoAES
+
+/// State of a hash, stored in a Hash object
+typedef struct {
+  mbedtls_md_type_t type;
+  union {
+    mbedtls_sha1_context sha1;
+    mbedtls_sha256_context sha256;
+    mbedtls_sha512_context sha512;
+  } ctx;
+} JsCryptoHash;
+
+/// State of an AES encryption/decryption, stored in a Cipher object
+typedef struct {
+  mbedtls_aes_context aes;
+  CryptoMode mode;
+  bool encrypt;
+  unsigned char iv[16]; ///< IV for CBC/CFB, nonce counter for CTR
+  unsigned char block[16]; ///< partial input block for CBC/ECB, stream block for CTR
+  size_t blockLen; ///< bytes used in 'block' for CBC/ECB, offset in stream block for CTR
+} JsCryptoAES;
+
 CryptoMode jswrap_crypto_getMode(JsVar *mode) {
   if (jsvIsStringEqual(mode, "CBC")) return CM_CBC;
   if (jsvIsStringEqual(mode, "CFB")) return CM_CFB;
@@ -98,28 +121,80 @@ mbedtls_md_type_t jswrap_crypto_getHasher(JsVar *hasher) {
   return MBEDTLS_MD_NONE;
 }
 
-JsVar *jswrap_crypto_SHAx(JsVar *message, int shaNum) {
-  JSV_GET_AS_CHAR_ARRAY(msgPtr, msgLen, message);
-  if (!msgPtr) return 0;
+/// Size of the data that jsvIterateBufferCallback will give us
+static size_t jswrap_crypto_getDataLength(JsVar *data) {
+  if (jsvIsString(data)) return jsvGetStringLength(data);
+  if (jsvIsArrayBuffer(data)) return jsvGetArrayBufferLength(data);
+  return (size_t)jsvIterateCallbackCount(data);
+}
 
-  int bufferSize = 20;
-  if (shaNum>1) bufferSize = shaNum/8;
+/** Get the context stored in a Hash/Cipher object. It's a flat string so the
+ * whole thing can be used in place - the returned var must be kept locked
+ * while the pointer is in use. */
+static JsVar *jswrap_crypto_getContext(JsVar *parent, size_t size, void **ptr) {
+  JsVar *ctx = jsvObjectGetChild(parent, CRYPTO_CONTEXT_NAME, 0);
+  if (!jsvIsFlatString(ctx) || jsvGetStringLength(ctx)!=size) {
+    jsExceptionHere(JSET_ERROR, "Invalid context");
+    jsvUnLock(ctx);
+    *ptr = 0;
+    return 0;
+  }
+  *ptr = jsvGetFlatStringPointer(ctx);
+  return ctx;
+}
 
+static unsigned int jswrap_crypto_getHashSize(mbedtls_md_type_t type) {
+  switch (type) {
+    case MBEDTLS_MD_SHA1: return 20;
+    case MBEDTLS_MD_SHA224: return 28;
+    case MBEDTLS_MD_SHA256: return 32;
+    case MBEDTLS_MD_SHA384: return 48;
+    default: return 64;
+  }
+}
+
+static void jswrap_crypto_hashStarts(JsCryptoHash *h, mbedtls_md_type_t type) {
+  memset(h, 0, sizeof(JsCryptoHash));
+  h->type = type;
+  if (type==MBEDTLS_MD_SHA1) mbedtls_sha1_starts(&h->ctx.sha1);
+  else if (type==MBEDTLS_MD_SHA224 || type==MBEDTLS_MD_SHA256) mbedtls_sha256_starts(&h->ctx.sha256, type==MBEDTLS_MD_SHA224);
+  else mbedtls_sha512_starts(&h->ctx.sha512, type==MBEDTLS_MD_SHA384);
+}
+
+static void jswrap_crypto_hashUpdateCb(const unsigned char *data, size_t len, void *userData) {
+  JsCryptoHash *h = (JsCryptoHash*)userData;
+  if (h->type==MBEDTLS_MD_SHA1) mbedtls_sha1_update(&h->ctx.sha1, data, len);
+  else if (h->type==MBEDTLS_MD_SHA224 || h->type==MBEDTLS_MD_SHA256) mbedtls_sha256_update(&h->ctx.sha256, data, len);
+  else mbedtls_sha512_update(&h->ctx.sha512, data, len);
+}
+
+/// Finish the hash and return it as an ArrayBuffer
+static JsVar *jswrap_crypto_hashFinish(JsCryptoHash *h) {
   char *outPtr = 0;
-  JsVar *outArr = jsvNewArrayBufferWithPtr((unsigned int)bufferSize, &outPtr);
+  JsVar *outArr = jsvNewArrayBufferWithPtr(jswrap_crypto_getHashSize(h->type), &outPtr);
   if (!outPtr) {
     jsError("Not enough memory for result");
     return 0;
   }
-
-  if (shaNum==1) mbedtls_sha1((unsigned char *)msgPtr, msgLen, (unsigned char *)outPtr);
-  else if (shaNum==224) mbedtls_sha256((unsigned char *)msgPtr, msgLen, (unsigned char *)outPtr, true/*224*/);
-  else if (shaNum==256) mbedtls_sha256((unsigned char *)msgPtr, msgLen, (unsigned char *)outPtr, false/*256*/);
-  else if (shaNum==384) mbedtls_sha512((unsigned char *)msgPtr, msgLen, (unsigned char *)outPtr, true/*384*/);
-  else if (shaNum==512) mbedtls_sha512((unsigned char *)msgPtr, msgLen, (unsigned char *)outPtr, false/*512*/);
+  if (h->type==MBEDTLS_MD_SHA1) mbedtls_sha1_finish(&h->ctx.sha1, (unsigned char *)outPtr);
+  else if (h->type==MBEDTLS_MD_SHA224 || h->type==MBEDTLS_MD_SHA256) mbedtls_sha256_finish(&h->ctx.sha256, (unsigned char *)outPtr);
+  else mbedtls_sha512_finish(&h->ctx.sha512, (unsigned char *)outPtr);
   return outArr;
 }
 
+JsVar *jswrap_crypto_SHAx(JsVar *message, int shaNum) {
+  mbedtls_md_type_t type = MBEDTLS_MD_SHA1;
+  if (shaNum==224) type = MBEDTLS_MD_SHA224;
+  else if (shaNum==256) type = MBEDTLS_MD_SHA256;
+  else if (shaNum==384) type = MBEDTLS_MD_SHA384;
+  else if (shaNum==512) type = MBEDTLS_MD_SHA512;
+
+  JsCryptoHash h;
+  jswrap_crypto_hashStarts(&h, type);
+  jsvIterateBufferCallback(message, jswrap_crypto_hashUpdateCb, &h);
+  return jswrap_crypto_hashFinish(&h);
+}
+
 /*JSON{
   "type" : "staticmethod",
   "class" : "crypto",
@@ -197,6 +272,100 @@ Performs a SHA512 hash and returns the result as a 64 byte ArrayBuffer
 */
 
 
+/*JSON{
+  "type" : "class",
+  "library" : "crypto",
+  "class" : "Hash",
+  "ifdef" : "USE_TLS"
+}
+A hash that can be calculated a bit at a time, created with `crypto.createHash`
+*/
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "crypto",
+  "name" : "createHash",
+  "generate" : "jswrap_crypto_createHash",
+  "params" : [
+    ["algorithm","JsVar","The hash to use: 'SHA1'/'SHA224'/'SHA256'/'SHA384'/'SHA512'"]
+  ],
+  "return" : ["JsVar","Returns a Hash object"],
+  "return_object" : "Hash",
+  "ifdef" : "USE_TLS"
+}
+Create an object that calculates a hash of data passed to it with `Hash.update`.
+
+Unlike `crypto.SHA1`/etc the data doesn't have to be in memory all at once,
+so this can be used to hash things much bigger than the available RAM:
+
+```
+var h = require("crypto").createHash("SHA256");
+h.update("Hello ");
+h.update("World");
+console.log(h.digest());
+```
+*/
+JsVar *jswrap_crypto_createHash(JsVar *algorithm) {
+  mbedtls_md_type_t type = jswrap_crypto_getHasher(algorithm);
+  if (type == MBEDTLS_MD_NONE) return 0; // already shown an error
+
+  JsVar *hashObj = jspNewObject(0, "Hash");
+  if (!hashObj) return 0; // out of memory
+  JsVar *ctx = jsvNewFlatStringOfLength(sizeof(JsCryptoHash));
+  if (!ctx) {
+    jsError("Not enough memory for hash");
+    jsvUnLock(hashObj);
+    return 0;
+  }
+  jswrap_crypto_hashStarts((JsCryptoHash*)jsvGetFlatStringPointer(ctx), type);
+  jsvObjectSetChildAndUnLock(hashObj, CRYPTO_CONTEXT_NAME, ctx);
+  return hashObj;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Hash",
+  "name" : "update",
+  "generate" : "jswrap_crypto_Hash_update",
+  "params" : [
+    ["data","JsVar","A String, ArrayBuffer or Array of data to add to the hash"]
+  ],
+  "return" : ["JsVar","This Hash object"],
+  "ifdef" : "USE_TLS"
+}
+Add more data to the hash
+*/
+JsVar *jswrap_crypto_Hash_update(JsVar *parent, JsVar *data) {
+  JsCryptoHash *h;
+  JsVar *ctx = jswrap_crypto_getContext(parent, sizeof(JsCryptoHash), (void**)&h);
+  if (!ctx) return 0;
+  jsvIterateBufferCallback(data, jswrap_crypto_hashUpdateCb, h);
+  jsvUnLock(ctx);
+  return jsvLockAgain(parent);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Hash",
+  "name" : "digest",
+  "generate" : "jswrap_crypto_Hash_digest",
+  "return" : ["JsVar","An ArrayBuffer containing the hash"],
+  "return_object" : "ArrayBuffer",
+  "ifdef" : "USE_TLS"
+}
+Return the hash of all the data added so far. More data can still be added
+with `Hash.update` afterwards.
+*/
+JsVar *jswrap_crypto_Hash_digest(JsVar *parent) {
+  JsCryptoHash *h;
+  JsVar *ctx = jswrap_crypto_getContext(parent, sizeof(JsCryptoHash), (void**)&h);
+  if (!ctx) return 0;
+  // finish a copy, so we can carry on adding data
+  JsCryptoHash hCopy = *h;
+  jsvUnLock(ctx);
+  return jswrap_crypto_hashFinish(&hCopy);
+}
+
+
 /*JSON{
   "type" : "staticmethod",
   "class" : "crypto",
@@ -272,115 +441,152 @@ JsVar *jswrap_crypto_PBKDF2(JsVar *passphrase, JsVar *salt, JsVar *options) {
 }
 
 
-static NO_INLINE JsVar *jswrap_crypto_AEScrypt(JsVar *message, JsVar *key, JsVar *options, bool encrypt) {
-  int err;
-
-  unsigned char iv[16]; // initialisation vector
-  memset(iv, 0, 16);
-
-  CryptoMode mode = CM_CBC;
+/// Set up AES state from a key and options. Returns false on error (which has been reported)
+static NO_INLINE bool jswrap_crypto_AESstarts(JsCryptoAES *s, JsVar *key, JsVar *options, bool encrypt) {
+  memset(s, 0, sizeof(JsCryptoAES));
+  s->mode = CM_CBC;
+  s->encrypt = encrypt;
 
   if (jsvIsObject(options)) {
     JsVar *ivVar = jsvObjectGetChild(options, "iv", 0);
     if (ivVar) {
-      jsvIterateCallbackToBytes(ivVar, iv, sizeof(iv));
+      jsvIterateCallbackToBytes(ivVar, s->iv, sizeof(s->iv));
       jsvUnLock(ivVar);
     }
     JsVar *modeVar = jsvObjectGetChild(options, "mode", 0);
     if (!jsvIsUndefined(modeVar))
-      mode = jswrap_crypto_getMode(modeVar);
+      s->mode = jswrap_crypto_getMode(modeVar);
     jsvUnLock(modeVar);
-    if (mode == CM_NONE) return 0;
+    if (s->mode == CM_NONE) return false;
   } else if (!jsvIsUndefined(options)) {
     jsError("'options' must be undefined, or an Object");
-    return 0;
+    return false;
+  }
+  if (s->mode == CM_CTR) // CTR mode uses a zeroed nonce counter, not the IV
+    memset(s->iv, 0, sizeof(s->iv));
+  if (s->mode == CM_OFB) {
+    jswrap_crypto_error(MBEDTLS_ERR_MD_FEATURE_UNAVAILABLE);
+    return false;
   }
 
+  unsigned char keyBuf[32];
+  unsigned int keyLen = jsvIterateCallbackToBytes(key, keyBuf, sizeof(keyBuf));
+  if (keyLen > sizeof(keyBuf)) keyLen = 0; // too long - let mbedtls report it
 
-
-  mbedtls_aes_context aes;
-  mbedtls_aes_init( &aes );
-
-  JSV_GET_AS_CHAR_ARRAY(messagePtr, messageLen, message);
-  if (!messagePtr) return 0;
-
-  JSV_GET_AS_CHAR_ARRAY(keyPtr, keyLen, key);
-  if (!keyPtr) return 0;
-
-  if (encrypt)
-    err = mbedtls_aes_setkey_enc( &aes, (unsigned char*)keyPtr, (unsigned int)keyLen*8 );
+  mbedtls_aes_init( &s->aes );
+  int err;
+  if (encrypt || s->mode==CM_CFB || s->mode==CM_CTR) // stream modes always use the encryption key
+    err = mbedtls_aes_setkey_enc( &s->aes, keyBuf, keyLen*8 );
   else
-    err = mbedtls_aes_setkey_dec( &aes, (unsigned char*)keyPtr, (unsigned int)keyLen*8 );
+    err = mbedtls_aes_setkey_dec( &s->aes, keyBuf, keyLen*8 );
+  memset(keyBuf, 0, sizeof(keyBuf));
   if (err) {
     jswrap_crypto_error(err);
-    return 0;
-  }
-
-  char *outPtr = 0;
-  JsVar *outVar = jsvNewArrayBufferWithPtr((unsigned int)messageLen, &outPtr);
-  if (!outPtr) {
-    jsError("Not enough memory for result");
-    return 0;
+    return false;
   }
+  return true;
+}
 
-
-
-  switch (mode) {
-  case CM_CBC:
-    err = mbedtls_aes_crypt_cbc( &aes,
-                     encrypt ? MBEDTLS_AES_ENCRYPT : MBEDTLS_AES_DECRYPT,
-                     messageLen,
-                     iv,
-                     (unsigned char*)messagePtr,
-                     (unsigned char*)outPtr );
-    break;
+typedef struct {
+  JsCryptoAES *s;
+  unsigned char *out;
+  size_t outLen;
+  int err;
+} JsCryptoAESUpdate;
+
+static void jswrap_crypto_AESupdateCb(const unsigned char *data, size_t len, void *userData) {
+  JsCryptoAESUpdate *u = (JsCryptoAESUpdate*)userData;
+  JsCryptoAES *s = u->s;
+  int mode = s->encrypt ? MBEDTLS_AES_ENCRYPT : MBEDTLS_AES_DECRYPT;
+  if (u->err) return;
+  switch (s->mode) {
   case CM_CFB:
-    err = mbedtls_aes_crypt_cfb8( &aes,
-                     encrypt ? MBEDTLS_AES_ENCRYPT : MBEDTLS_AES_DECRYPT,
-                     messageLen,
-                     iv,
-                     (unsigned char*)messagePtr,
-                     (unsigned char*)outPtr );
+    u->err = mbedtls_aes_crypt_cfb8( &s->aes, mode, len, s->iv, data, &u->out[u->outLen] );
+    u->outLen += len;
     break;
-  case CM_CTR: {
-    size_t nc_off = 0;
-    unsigned char nonce_counter[16];
-    unsigned char stream_block[16];
-    memset(nonce_counter, 0, sizeof(nonce_counter));
-    memset(stream_block, 0, sizeof(stream_block));
-    err = mbedtls_aes_crypt_ctr( &aes,
-                     messageLen,
-                     &nc_off,
-                     nonce_counter,
-                     stream_block,
-                     (unsigned char*)messagePtr,
-                     (unsigned char*)outPtr );
+  case CM_CTR:
+    u->err = mbedtls_aes_crypt_ctr( &s->aes, len, &s->blockLen, s->iv, s->block, data, &u->out[u->outLen] );
+    u->outLen += len;
     break;
-  }
-  case CM_ECB: {
-    size_t i = 0;
-    while (!err && i+15 < messageLen) {
-      err = mbedtls_aes_crypt_ecb( &aes,
-                       encrypt ? MBEDTLS_AES_ENCRYPT : MBEDTLS_AES_DECRYPT,
-                       (unsigned char*)&messagePtr[i],
-                       (unsigned char*)&outPtr[i] );
-      i += 16;
+  case CM_CBC:
+  case CM_ECB:
+    while (len && !u->err) {
+      const unsigned char *in;
+      size_t l;
+      if (s->blockLen || len<16) {
+        // gather a whole block from the end of the last chunk and the start of this one
+        l = 16 - s->blockLen;
+        if (l > len) l = len;
+        memcpy(&s->block[s->blockLen], data, l);
+        s->blockLen += l;
+        data += l;
+        len -= l;
+        if (s->blockLen < 16) break;
+        s->blockLen = 0;
+        in = s->block;
+        l = 16;
+      } else {
+        in = data;
+        l = len & ~(size_t)15;
+        data += l;
+        len -= l;
+      }
+      if (s->mode == CM_CBC) {
+        u->err = mbedtls_aes_crypt_cbc( &s->aes, mode, l, s->iv, in, &u->out[u->outLen] );
+      } else {
+        size_t i;
+        for (i=0; !u->err && i<l; i+=16)
+          u->err = mbedtls_aes_crypt_ecb( &s->aes, mode, &in[i], &u->out[u->outLen+i] );
+      }
+      u->outLen += l;
     }
     break;
-  }
   default:
-    err = MBEDTLS_ERR_MD_FEATURE_UNAVAILABLE;
+    u->err = MBEDTLS_ERR_MD_FEATURE_UNAVAILABLE;
     break;
   }
+}
 
-  mbedtls_aes_free( &aes );
-  if (!err) {
-    return outVar;
-  } else {
-    jswrap_crypto_error(err);
+/** Run data through AES and return an ArrayBuffer of the result. If padResult
+ * is set the result is as long as the message even in ECB mode, with bytes
+ * from any partial block at the end left as zero */
+static NO_INLINE JsVar *jswrap_crypto_AESupdate(JsCryptoAES *s, JsVar *message, bool padResult) {
+  size_t len = jswrap_crypto_getDataLength(message);
+  if (s->mode == CM_CBC || (s->mode == CM_ECB && !padResult))
+    len = (s->blockLen + len) & ~(size_t)15;
+
+  JsCryptoAESUpdate u;
+  u.s = s;
+  u.out = 0;
+  u.outLen = 0;
+  u.err = 0;
+  JsVar *outVar = jsvNewArrayBufferWithPtr((unsigned int)len, (char**)&u.out);
+  if (!u.out) {
+    jsError("Not enough memory for result");
+    return 0;
+  }
+  jsvIterateBufferCallback(message, jswrap_crypto_AESupdateCb, &u);
+  if (u.err) {
+    jswrap_crypto_error(u.err);
     jsvUnLock(outVar);
     return 0;
   }
+  return outVar;
+}
+
+static NO_INLINE JsVar *jswrap_crypto_AEScrypt(JsVar *message, JsVar *key, JsVar *options, bool encrypt) {
+  JsCryptoAES s;
+  if (!jswrap_crypto_AESstarts(&s, key, options, encrypt)) return 0;
+  JsVar *outVar = jswrap_crypto_AESupdate(&s, message, true);
+  /* CBC can't handle partial blocks. ECB has always returned a result as long
+   * as the message, with zeros in place of the last partial block */
+  if (outVar && s.mode==CM_CBC && s.blockLen) {
+    jswrap_crypto_error(MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH);
+    jsvUnLock(outVar);
+    outVar = 0;
+  }
+  mbedtls_aes_free( &s.aes );
+  return outVar;
 }
 
 /*JSON{
@@ -420,3 +626,129 @@ JsVar *jswrap_crypto_AES_encrypt(JsVar *message, JsVar *key, JsVar *options) {
 JsVar *jswrap_crypto_AES_decrypt(JsVar *message, JsVar *key, JsVar *options) {
   return jswrap_crypto_AEScrypt(message, key, options, false);
 }
+
+
+/*JSON{
+  "type" : "class",
+  "library" : "crypto",
+  "class" : "Cipher",
+  "ifdef" : "USE_TLS"
+}
+AES encryption or decryption that can be done a bit at a time, created with
+`crypto.createCipher` or `crypto.createDecipher`
+*/
+static JsVar *jswrap_crypto_createCipherx(JsVar *key, JsVar *options, bool encrypt) {
+  JsVar *cipherObj = jspNewObject(0, "Cipher");
+  if (!cipherObj) return 0; // out of memory
+  JsVar *ctx = jsvNewFlatStringOfLength(sizeof(JsCryptoAES));
+  if (!ctx) {
+    jsError("Not enough memory for cipher");
+    jsvUnLock(cipherObj);
+    return 0;
+  }
+  if (!jswrap_crypto_AESstarts((JsCryptoAES*)jsvGetFlatStringPointer(ctx), key, options, encrypt)) {
+    jsvUnLock2(ctx, cipherObj);
+    return 0;
+  }
+  jsvObjectSetChildAndUnLock(cipherObj, CRYPTO_CONTEXT_NAME, ctx);
+  return cipherObj;
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "crypto",
+  "name" : "createCipher",
+  "generate" : "jswrap_crypto_createCipher",
+  "params" : [
+    ["key","JsVar","Key to encrypt with - must be an ArrayBuffer of 128, 192, or 256 BITS"],
+    ["options","JsVar","An optional object, may specify `{ iv : new Uint8Array(16), mode : 'CBC|CFB|CTR|ECB' }`"]
+  ],
+  "return" : ["JsVar","Returns a Cipher object"],
+  "return_object" : "Cipher",
+  "ifdef" : "USE_TLS"
+}
+Create an object that AES encrypts data passed to `Cipher.update` a bit at a
+time. The result is the same as calling `AES.encrypt` on all the data at once.
+*/
+JsVar *jswrap_crypto_createCipher(JsVar *key, JsVar *options) {
+  return jswrap_crypto_createCipherx(key, options, true);
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "crypto",
+  "name" : "createDecipher",
+  "generate" : "jswrap_crypto_createDecipher",
+  "params" : [
+    ["key","JsVar","Key to decrypt with - must be an ArrayBuffer of 128, 192, or 256 BITS"],
+    ["options","JsVar","An optional object, may specify `{ iv : new Uint8Array(16), mode : 'CBC|CFB|CTR|ECB' }`"]
+  ],
+  "return" : ["JsVar","Returns a Cipher object"],
+  "return_object" : "Cipher",
+  "ifdef" : "USE_TLS"
+}
+Create an object that AES decrypts data passed to `Cipher.update` a bit at a
+time. The result is the same as calling `AES.decrypt` on all the data at once.
+*/
+JsVar *jswrap_crypto_createDecipher(JsVar *key, JsVar *options) {
+  return jswrap_crypto_createCipherx(key, options, false);
+}
+
+/** Get the AES state from a Cipher object. The round key pointer in the
+ * mbedtls context points inside the context itself, so it has to be
+ * fixed up in case the context has been moved since it was last used. */
+static JsVar *jswrap_crypto_getAESContext(JsVar *parent, JsCryptoAES **s) {
+  JsVar *ctx = jswrap_crypto_getContext(parent, sizeof(JsCryptoAES), (void**)s);
+  if (ctx) (*s)->aes.rk = (*s)->aes.buf;
+  return ctx;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Cipher",
+  "name" : "update",
+  "generate" : "jswrap_crypto_Cipher_update",
+  "params" : [
+    ["data","JsVar","A String, ArrayBuffer or Array of data to encrypt or decrypt"]
+  ],
+  "return" : ["JsVar","An ArrayBuffer containing the result"],
+  "return_object" : "ArrayBuffer",
+  "ifdef" : "USE_TLS"
+}
+Encrypt or decrypt some data. In CBC and ECB modes data is only processed in
+16 byte blocks, so any remaining bytes are kept until the next call.
+*/
+JsVar *jswrap_crypto_Cipher_update(JsVar *parent, JsVar *data) {
+  JsCryptoAES *s;
+  JsVar *ctx = jswrap_crypto_getAESContext(parent, &s);
+  if (!ctx) return 0;
+  JsVar *outVar = jswrap_crypto_AESupdate(s, data, false);
+  jsvUnLock(ctx);
+  return outVar;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Cipher",
+  "name" : "final",
+  "generate" : "jswrap_crypto_Cipher_final",
+  "ifdef" : "USE_TLS"
+}
+Finish encrypting or decrypting. This clears the key from memory, and reports
+an error if data that didn't fill a whole block was left over in CBC mode.
+*/
+void jswrap_crypto_Cipher_final(JsVar *parent) {
+  JsCryptoAES *s;
+  JsVar *ctx = jswrap_crypto_getAESContext(parent, &s);
+  if (!ctx) return;
+  bool partial = s->mode==CM_CBC && s->blockLen;
+  mbedtls_aes_free( &s->aes );
+  memset(s, 0, sizeof(JsCryptoAES));
+  jsvUnLock(ctx);
+  // remove the context so any further use reports an error
+  JsVar *ctxName = jsvFindChildFromString(parent, CRYPTO_CONTEXT_NAME, false);
+  if (ctxName) jsvRemoveChild(parent, ctxName);
+  jsvUnLock(ctxName);
+  if (partial)
+    jswrap_crypto_error(MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH);
+}
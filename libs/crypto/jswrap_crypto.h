@@ -16,6 +16,13 @@
 #include "jsvar.h"
 
 JsVar *jswrap_crypto_SHAx(JsVar *message, int shaNum);
+JsVar *jswrap_crypto_createHash(JsVar *algorithm);
+JsVar *jswrap_crypto_Hash_update(JsVar *parent, JsVar *data);
+JsVar *jswrap_crypto_Hash_digest(JsVar *parent);
 JsVar *jswrap_crypto_PBKDF2(JsVar *passphrase, JsVar *salt, JsVar *options);
 JsVar *jswrap_crypto_AES_encrypt(JsVar *message, JsVar *key, JsVar *options);
 JsVar *jswrap_crypto_AES_decrypt(JsVar *message, JsVar *key, JsVar *options);
+JsVar *jswrap_crypto_createCipher(JsVar *key, JsVar *options);
+JsVar *jswrap_crypto_createDecipher(JsVar *key, JsVar *options);
+JsVar *jswrap_crypto_Cipher_update(JsVar *parent, JsVar *data);
+void jswrap_crypto_Cipher_final(JsVar *parent);
@@ -117,8 +117,9 @@
  * is also safe if 0 is passed in.  */
 #define MBEDTLS_PLATFORM_CALLOC_MACRO(X,Y) jsvGetFlatStringPointer(jsvNewFlatStringOfLength((X)*(Y)))
 
-/** Find the original flat string, and unlock it - freeing the memory. */
-#define MBEDTLS_PLATFORM_FREE_MACRO(X) jsvUnLock(jsvGetFlatStringFromPointer(X))
+/** Find the original flat string, and unlock it - freeing the memory.
+ * mbedtls expects free(0) to do nothing (the session ticket code relies on it). */
+#define MBEDTLS_PLATFORM_FREE_MACRO(X) ((X) ? jsvUnLock(jsvGetFlatStringFromPointer((char*)(X))) : (void)0)
 
 
 #include "mbedtls/check_config.h"
@@ -15,8 +15,11 @@
  */
 #include "jswrap_file.h"
 #include "jsparse.h"
+#include "jsvariterator.h"
 
 #define JS_FS_DATA_NAME JS_HIDDEN_CHAR_STR"FSd" // the data in each file
+#define JS_FS_BUFFER_NAME JS_HIDDEN_CHAR_STR"FSb" // flat string used as a write buffer (if any)
+#define JS_FS_MAX_BUFFER_SIZE 0xFFFF // so bufferUsed fits in an unsigned short
 #define JS_FS_OPEN_FILES_NAME JS_HIDDEN_CHAR_STR"FSo" // the list of open files
 
 #if !defined(LINUX) && !defined(USE_FILESYSTEM_SDIO)
@@ -243,14 +246,18 @@ static bool allocateJsFile(JsFile* file,FileMode mode, FileType type) {
   "generate" : "jswrap_E_openFile",
   "params" : [
     ["path","JsVar","the path to the file to open."],
-    ["mode","JsVar","The mode to use when opening the file. Valid values for mode are 'r' for read, 'w' for write new, 'w+' for write existing, and 'a' for append. If not specified, the default is 'r'."]
+    ["mode","JsVar","The mode to use when opening the file. Valid values for mode are 'r' for read, 'w' for write new, 'w+' for write existing, and 'a' for append. If not specified, the default is 'r'."],
+    ["options","JsVar","An optional object `{ bufferSize : int=0 }` - if bufferSize is set, writes are collected in a buffer of that many bytes and only written to the file when it is full, or on `File.flush()`/`File.close()`"]
   ],
   "return" : ["JsVar","A File object"],
   "return_object" : "File"
 }
-Open a file
+Open a file.
+
+Data written to the file isn't guaranteed to be on the disk until you call
+`File.flush()` or `File.close()`.
 */
-JsVar *jswrap_E_openFile(JsVar* path, JsVar* mode) {
+JsVar *jswrap_E_openFile(JsVar* path, JsVar* mode, JsVar* options) {
   FRESULT res = FR_INVALID_NAME;
   JsFile file;
   file.fileVar = 0;
@@ -307,7 +314,15 @@ JsVar *jswrap_E_openFile(JsVar* path, JsVar* mode) {
           res=FR_OK;
 #endif
           file.data.state = FS_OPEN;
+          file.data.bufferUsed = 0;
           fileSetVar(&file);
+          int bufferSize = jsvIsObject(options) ? jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "bufferSize", 0)) : 0;
+          if (bufferSize>JS_FS_MAX_BUFFER_SIZE) bufferSize = JS_FS_MAX_BUFFER_SIZE;
+          if (bufferSize>0 && fMode!=FM_READ) {
+            JsVar *buf = jsvNewFlatStringOfLength((unsigned int)bufferSize);
+            if (buf) jsvObjectSetChildAndUnLock(file.fileVar, JS_FS_BUFFER_NAME, buf);
+            else jsWarn("Not enough memory for file buffer");
+          }
           // add to list of open files
           jsvArrayPush(arr, file.fileVar);
         } else {
@@ -331,6 +346,48 @@ JsVar *jswrap_E_openFile(JsVar* path, JsVar* mode) {
   return file.fileVar;
 }
 
+/// Write data straight to the file, adding the amount written to 'written'
+static FRESULT fileWriteBytes(JsFile *file, const void *data, size_t len, size_t *written) {
+  FRESULT res = 0;
+  size_t actual = 0;
+#ifndef LINUX
+  res = f_write(&file->data.handle, data, len, &actual);
+#else
+  actual = fwrite(data, 1, len, file->data.handle);
+#endif
+  *written += actual;
+  if (!res && actual!=len)
+    res = FR_DISK_ERR;
+  return res;
+}
+
+/// Read data straight from the file, adding the amount read to 'bytesRead'
+static FRESULT fileReadBytes(JsFile *file, void *data, size_t len, size_t *bytesRead) {
+  FRESULT res = 0;
+  size_t actual = 0;
+#ifndef LINUX
+  res = f_read(&file->data.handle, data, len, &actual);
+#else
+  actual = fread(data, 1, len, file->data.handle);
+#endif
+  *bytesRead += actual;
+  return res;
+}
+
+/// Write out anything in the write buffer. Call fileSetVar afterwards
+static FRESULT fileFlushBuffer(JsFile *file) {
+  FRESULT res = 0;
+  if (file->data.bufferUsed) {
+    size_t written = 0;
+    JsVar *buf = jsvObjectGetChild(file->fileVar, JS_FS_BUFFER_NAME, 0);
+    if (jsvIsFlatString(buf))
+      res = fileWriteBytes(file, jsvGetFlatStringPointer(buf), file->data.bufferUsed, &written);
+    jsvUnLock(buf);
+    file->data.bufferUsed = 0;
+  }
+  return res;
+}
+
 /*JSON{
   "type" : "method",
   "class" : "File",
@@ -343,6 +400,11 @@ void jswrap_file_close(JsVar* parent) {
   if (jsfsInit()) {
     JsFile file;
     if (fileGetFromVar(&file, parent) && file.data.state == FS_OPEN) {
+      FRESULT res = fileFlushBuffer(&file);
+      if (res) jsfsReportError("Unable to write file", res);
+      JsVar *bufName = jsvFindChildFromString(parent, JS_FS_BUFFER_NAME, false);
+      if (bufName) jsvRemoveChild(parent, bufName);
+      jsvUnLock(bufName);
 #ifndef LINUX
       f_close(&file.data.handle);
 #else
@@ -378,53 +440,111 @@ void jswrap_file_close(JsVar* parent) {
 }
 write data to a file
 */
-size_t jswrap_file_write(JsVar* parent, JsVar* buffer) {
-  FRESULT res = 0;
-  size_t bytesWritten = 0;
+typedef struct {
+  JsFile *file;
+  char *buf; ///< the write buffer, or 0
+  size_t bufSize;
+  size_t written;
+  FRESULT res;
+} JsFileWriteData;
+
+static void fileWriteCb(const unsigned char *data, size_t len, void *userData) {
+  JsFileWriteData *w = (JsFileWriteData*)userData;
+  if (w->res) return;
+  if (w->buf) {
+    // if it won't fit, empty the buffer
+    if (w->file->data.bufferUsed + len > w->bufSize) {
+      size_t n = 0;
+      w->res = fileWriteBytes(w->file, w->buf, w->file->data.bufferUsed, &n);
+      w->file->data.bufferUsed = 0;
+      if (w->res) return;
+    }
+    // anything smaller than the buffer goes in it, bigger writes go straight through
+    if (len < w->bufSize) {
+      memcpy(&w->buf[w->file->data.bufferUsed], data, len);
+      w->file->data.bufferUsed = (unsigned short)(w->file->data.bufferUsed + len);
+      w->written += len;
+      return;
+    }
+  }
+  w->res = fileWriteBytes(w->file, data, len, &w->written);
+}
+
+/// Write either the contents of 'buffer', or if that is 0, 'len' bytes of 'data'
+static size_t fileWrite(JsVar* parent, JsVar* buffer, const char *data, size_t len) {
+  JsFileWriteData w;
+  w.res = 0;
+  w.written = 0;
   if (jsfsInit()) {
     JsFile file;
     if (fileGetFromVar(&file, parent)) {
       if(file.data.mode == FM_WRITE || file.data.mode == FM_READ_WRITE) {
-        JsvIterator it;
-        jsvIteratorNew(&it, buffer);
-        char buf[32];
-
-        while (jsvIteratorHasElement(&it)) {
-          // pull in a buffer's worth of data
-          size_t n = 0;
-          while (jsvIteratorHasElement(&it) && n<sizeof(buf)) {
-            buf[n++] = (char)jsvIteratorGetIntegerValue(&it);
-            jsvIteratorNext(&it);
-          }
-          // write it out
-          size_t written = 0;
-#ifndef LINUX
-          res = f_write(&file.data.handle, &buf, n, &written);
-#else
-          written = fwrite(&buf, 1, n, file.data.handle);
-#endif
-          bytesWritten += written;
-          if(written == 0)
-            res = FR_DISK_ERR;
-          if (res) break;
+        w.file = &file;
+        w.buf = 0;
+        w.bufSize = 0;
+        JsVar *buf = jsvObjectGetChild(parent, JS_FS_BUFFER_NAME, 0);
+        if (jsvIsFlatString(buf)) {
+          w.buf = jsvGetFlatStringPointer(buf);
+          w.bufSize = jsvGetStringLength(buf);
         }
-        jsvIteratorFree(&it);
-        // finally, sync - just in case there's a reset or something
-#ifndef LINUX
-        f_sync(&file.data.handle);
-#else
-        fflush(file.data.handle);
-#endif
+        // Strings and ArrayBuffers are written a block at a time, straight from memory
+        if (buffer)
+          jsvIterateBufferCallback(buffer, fileWriteCb, &w);
+        else
+          fileWriteCb((const unsigned char*)data, len, &w);
+        jsvUnLock(buf);
       }
 
       fileSetVar(&file);
     }
   }
 
-  if (res) {
-    jsfsReportError("Unable to write file", res);
+  if (w.res) {
+    jsfsReportError("Unable to write file", w.res);
   }
-  return bytesWritten;
+  return w.written;
+}
+
+size_t jswrap_file_write(JsVar* parent, JsVar* buffer) {
+  return fileWrite(parent, buffer, 0, 0);
+}
+
+/** Write 'len' bytes of 'data' to a File without making a JsVar of them (used
+ * by Pipe). Files don't need to wait for 'drain', so this always returns true */
+bool jswrap_file_writeBytes(JsVar* parent, const char *data, size_t len) {
+  fileWrite(parent, 0, data, len);
+  return true;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "File",
+  "name" : "flush",
+  "generate" : "jswrap_file_flush"
+}
+Write any buffered data to the file, and make sure it has all been written to
+the disk (rather than just being cached).
+
+Data is only written to the disk when this is called or the file is closed,
+so call it periodically if there is a chance of the file not being closed
+properly (eg. power loss).
+*/
+void jswrap_file_flush(JsVar* parent) {
+  FRESULT res = 0;
+  if (jsfsInit()) {
+    JsFile file;
+    if (fileGetFromVar(&file, parent)) {
+      res = fileFlushBuffer(&file);
+#ifndef LINUX
+      FRESULT syncRes = f_sync(&file.data.handle);
+      if (!res) res = syncRes;
+#else
+      fflush(file.data.handle);
+#endif
+      fileSetVar(&file);
+    }
+  }
+  if (res) jsfsReportError("Unable to flush file", res);
 }
 
 /*JSON{
@@ -439,34 +559,68 @@ size_t jswrap_file_write(JsVar* parent, JsVar* buffer) {
 }
 Read data in a file in byte size chunks
 */
+/// How many bytes are left between the current position and the end of the file
+static size_t fileGetBytesLeft(JsFile *file) {
+#ifndef LINUX
+  return (size_t)(file->data.handle.fsize - f_tell(&file->data.handle));
+#else
+  long pos = ftell(file->data.handle);
+  if (pos<0 || fseek(file->data.handle, 0, SEEK_END)) return 0;
+  long end = ftell(file->data.handle);
+  fseek(file->data.handle, pos, SEEK_SET);
+  return (end>pos) ? (size_t)(end-pos) : 0;
+#endif
+}
+
 JsVar *jswrap_file_read(JsVar* parent, int length) {
   JsVar *buffer = 0;
   JsvStringIterator it;
+  bool usedIterator = false;
   FRESULT res = 0;
   size_t bytesRead = 0;
   if (jsfsInit()) {
     JsFile file;
     if (fileGetFromVar(&file, parent)) {
       if(file.data.mode == FM_READ || file.data.mode == FM_READ_WRITE) {
+        res = fileFlushBuffer(&file); // make sure we read back anything we wrote
+        size_t left = fileGetBytesLeft(&file);
+        if (length<0) length = 0;
+        if ((size_t)length > left) length = (int)left;
+        // For bigger reads, try and read straight into a flat string
+        if (!res && length > JSVAR_DATA_STRING_MAX_LEN) {
+          JsVar *flat = jsvNewFlatStringOfLength((unsigned int)length);
+          if (flat) {
+            size_t actual = 0;
+            res = fileReadBytes(&file, jsvGetFlatStringPointer(flat), (size_t)length, &actual);
+            if (actual == (size_t)length) {
+              buffer = flat;
+            } else {
+              if (actual) buffer = jsvNewFromStringVar(flat, 0, actual);
+              jsvUnLock(flat);
+            }
+            bytesRead = (size_t)length; // so we skip the loop below
+          }
+        }
+
         char buf[32];
         size_t actual = 0;
 
-        while (bytesRead < (size_t)length) {
+        while (!res && bytesRead < (size_t)length) {
           size_t requested = (size_t)length - bytesRead;
           if (requested > sizeof( buf ))
             requested = sizeof( buf );
           actual = 0;
-    #ifndef LINUX
-          res = f_read(&file.data.handle, buf, requested, &actual);
+          res = fileReadBytes(&file, buf, requested, &actual);
           if(res) break;
-    #else
-          actual = fread(buf, 1, requested, file.data.handle);
-    #endif
           if (actual>0) {
             if (!buffer) {
               buffer = jsvNewFromEmptyString();
-              if (!buffer) return 0; // out of memory
+              if (!buffer) {
+                jsExceptionHere(JSET_ERROR, "Not enough memory to read file");
+                break; // still save the file state below
+              }
               jsvStringIteratorNew(&it, buffer, 0);
+              usedIterator = true;
             }
             size_t i;
             for (i=0;i<actual;i++)
@@ -481,12 +635,33 @@ JsVar *jswrap_file_read(JsVar* parent, int length) {
   }
   if (res) jsfsReportError("Unable to read file", res);
 
-  if (buffer)
+  if (usedIterator)
     jsvStringIteratorFree(&it);
 
   return buffer;
 }
 
+/** Read up to 'len' bytes from a File straight into 'data' (used by Pipe).
+ * Returns the number of bytes read, or -1 at the end of the file */
+int jswrap_file_readBytes(JsVar* parent, char *data, size_t len) {
+  FRESULT res = 0;
+  size_t bytesRead = 0;
+  if (jsfsInit()) {
+    JsFile file;
+    if (fileGetFromVar(&file, parent)) {
+      if(file.data.mode == FM_READ || file.data.mode == FM_READ_WRITE) {
+        if (file.data.bufferUsed) { // make sure we read back anything we wrote
+          res = fileFlushBuffer(&file);
+          fileSetVar(&file);
+        }
+        if (!res) res = fileReadBytes(&file, data, len, &bytesRead);
+      }
+    }
+  }
+  if (res) jsfsReportError("Unable to read file", res);
+  return bytesRead ? (int)bytesRead : -1;
+}
+
 /*JSON{
   "type" : "method",
   "class" : "File",
@@ -519,8 +694,9 @@ void jswrap_file_skip_or_seek(JsVar* parent, int nBytes, bool is_skip) {
     JsFile file;
     if (fileGetFromVar(&file, parent)) {
       if(file.data.mode == FM_READ || file.data.mode == FM_WRITE || file.data.mode == FM_READ_WRITE) {
+        res = fileFlushBuffer(&file);
   #ifndef LINUX
-        res = (FRESULT)f_lseek(&file.data.handle, (DWORD)(is_skip ? f_tell(&file.data.handle) : 0) + (DWORD)nBytes);
+        if (!res) res = (FRESULT)f_lseek(&file.data.handle, (DWORD)(is_skip ? f_tell(&file.data.handle) : 0) + (DWORD)nBytes);
   #else
         fseek(file.data.handle, nBytes, is_skip ? SEEK_CUR : SEEK_SET);
   #endif
@@ -55,6 +55,7 @@ typedef struct {
   FileType type;
   FileMode mode;
   FileState state;
+  unsigned short bufferUsed; ///< Bytes waiting in the write buffer
 } PACKED_FLAGS JsFileData;
 
 typedef struct JsFile {
@@ -67,10 +68,13 @@ typedef struct JsFile {
 void jswrap_file_kill();
 
 void jswrap_E_connectSDCard(JsVar *spi, Pin csPin);
-JsVar* jswrap_E_openFile(JsVar* path, JsVar* mode);
+JsVar* jswrap_E_openFile(JsVar* path, JsVar* mode, JsVar* options);
 void jswrap_E_unmountSD();
 
 size_t jswrap_file_write(JsVar* parent, JsVar* buffer);
+bool jswrap_file_writeBytes(JsVar* parent, const char *data, size_t len);
 JsVar *jswrap_file_read(JsVar* parent, int length);
+int jswrap_file_readBytes(JsVar* parent, char *data, size_t len);
+void jswrap_file_flush(JsVar* parent);
 void jswrap_file_skip_or_seek(JsVar* parent, int length, bool is_skip);
 void jswrap_file_close(JsVar* parent);
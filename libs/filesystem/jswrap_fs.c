@@ -18,6 +18,7 @@
 #include "jswrap_file.h"
 #include "jsutils.h"
 #include "jsvar.h"
+#include "jsvariterator.h"
 #include "jsparse.h"
 #include "jsinteractive.h"
 #include "jswrap_date.h"
@@ -205,7 +206,7 @@ Append the data to the given file, created a new file if it doesn't exist
 */
 bool jswrap_fs_writeOrAppendFile(JsVar *path, JsVar *data, bool append) {
   JsVar *fMode = jsvNewFromString(append ? "a" : "w");
-  JsVar *f = jswrap_E_openFile(path, fMode);
+  JsVar *f = jswrap_E_openFile(path, fMode, 0);
   jsvUnLock(fMode);
   if (!f) return 0;
   size_t amt = jswrap_file_write(f, data);
@@ -214,6 +215,49 @@ bool jswrap_fs_writeOrAppendFile(JsVar *path, JsVar *data, bool append) {
   return amt>0;
 }
 
+typedef struct {
+  File_Handle handle;
+  bool ok;
+} JsFsQuietWrite;
+
+static void jswrap_fs_writeQuietlyCb(const unsigned char *data, size_t len, void *userData) {
+  JsFsQuietWrite *w = (JsFsQuietWrite*)userData;
+  if (!w->ok) return;
+  size_t actual = 0;
+#ifndef LINUX
+  if (f_write(&w->handle, data, len, &actual) != FR_OK) actual = 0;
+#else
+  actual = fwrite(data, 1, len, w->handle);
+#endif
+  if (actual != len) w->ok = false;
+}
+
+/** Write data to a file without reporting any errors, for things like caches
+ * where it doesn't matter if we can't (eg. on read-only media). Returns false
+ * on failure, in which case anything partly written is deleted. */
+bool jswrap_fs_writeFileQuietly(JsVar *path, JsVar *data) {
+  char pathStr[JS_DIR_BUF_SIZE] = "";
+  if (jsvGetString(path, pathStr, JS_DIR_BUF_SIZE)==JS_DIR_BUF_SIZE) return false; // too long
+  if (!jsfsInit()) return false;
+  JsFsQuietWrite w;
+  w.ok = true;
+#ifndef LINUX
+  if (f_open(&w.handle, pathStr, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return false;
+#else
+  w.handle = fopen(pathStr, "w");
+  if (!w.handle) return false;
+#endif
+  jsvIterateBufferCallback(data, jswrap_fs_writeQuietlyCb, &w);
+#ifndef LINUX
+  if (f_close(&w.handle) != FR_OK) w.ok = false;
+  if (!w.ok) f_unlink(pathStr);
+#else
+  if (fclose(w.handle)) w.ok = false;
+  if (!w.ok) remove(pathStr);
+#endif
+  return w.ok;
+}
+
 /*JSON{
   "type" : "staticmethod",
   "class" : "fs",
@@ -245,7 +289,7 @@ Read all data from a file and return as a string.
 */
 JsVar *jswrap_fs_readFile(JsVar *path) {
   JsVar *fMode = jsvNewFromString("r");
-  JsVar *f = jswrap_E_openFile(path, fMode);
+  JsVar *f = jswrap_E_openFile(path, fMode, 0);
   jsvUnLock(fMode);
   if (!f) return 0;
   JsVar *buffer = jswrap_file_read(f, 0x7FFFFFFF);
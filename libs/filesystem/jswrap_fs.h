@@ -15,6 +15,7 @@
 
 JsVar *jswrap_fs_readdir(JsVar *path);
 bool jswrap_fs_writeOrAppendFile(JsVar *path, JsVar *data, bool append);
+bool jswrap_fs_writeFileQuietly(JsVar *path, JsVar *data);
 JsVar *jswrap_fs_readFile(JsVar *path);
 bool jswrap_fs_unlink(JsVar *path);
 JsVar *jswrap_fs_stat(JsVar *path);
@@ -15,9 +15,10 @@
  */
 #include <string.h>
 #include "jswrap_hashlib.h"
+#include "jsvariterator.h"
 
-const JsHash256 ctx256;
-// const JsHash512 ctx512;
+static JsHash256 ctx256; // scratch space for finishing a hash
+// static JsHash512 ctx512;
 
 JsHashLib hashFunctions[4] = {
   { .name="sha224", .data=(char*)&ctx256.context, .init=sha224_init, .update=sha224_update,
@@ -102,15 +103,15 @@ JsVar *jswrap_hashlib_sha2(JsHashType hash_type) {
     return 0; // out of memory
   }
 
-  JsVar *jsCtx = jsvNewStringOfLength(hashFunctions[hash_type].ctx_size);
+  // Flat so that update can work on the context in place
+  JsVar *jsCtx = jsvNewFlatStringOfLength(hashFunctions[hash_type].ctx_size);
 
   if (!jsCtx) {
+    jsvUnLock(hashobj);
     return 0; // out of memory
   }
 
-  hashFunctions[hash_type].init(hashFunctions[hash_type].data);
-
-  jsvSetString(jsCtx, hashFunctions[hash_type].data, hashFunctions[hash_type].ctx_size);
+  hashFunctions[hash_type].init(jsvGetFlatStringPointer(jsCtx));
 
   jsvObjectSetChildAndUnLock(hashobj, "block_size",  jsvNewFromInteger((JsVarInt)hashFunctions[hash_type].block_size));
   jsvObjectSetChildAndUnLock(hashobj, "context",     jsCtx);
@@ -121,6 +122,25 @@ JsVar *jswrap_hashlib_sha2(JsHashType hash_type) {
   return hashobj;
 }
 
+/// Get the context of a HASH object into hashFunctions[type].data, returning the type
+static int jswrap_hashlib_hash_getContext(JsVar *parent) {
+  int type = jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, "hash_type", 0));
+  JsVar *jsCtx = jsvObjectGetChild(parent, "context", 0);
+  if (jsvIsFlatString(jsCtx))
+    memcpy(hashFunctions[type].data, jsvGetFlatStringPointer(jsCtx), hashFunctions[type].ctx_size);
+  jsvUnLock(jsCtx);
+  return type;
+}
+
+typedef struct {
+  JsHashLib *hash;
+  char *ctx;
+} JsHashLibUpdate;
+
+static void jswrap_hashlib_hash_updateCb(const unsigned char *data, size_t len, void *userData) {
+  JsHashLibUpdate *u = (JsHashLibUpdate*)userData;
+  u->hash->update(u->ctx, data, (unsigned int)len);
+}
 
 /*JSON{
   "type" : "method",
@@ -133,25 +153,15 @@ JsVar *jswrap_hashlib_sha2(JsHashType hash_type) {
 }
 */
 void jswrap_hashlib_hash_update(JsVar *parent, JsVar *message) {
-  int type;
-  char buff[SHA256_DIGEST_SIZE];
-
+  JsHashLibUpdate u;
+  int type = jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, "hash_type", 0));
   JsVar *jsCtx = jsvObjectGetChild(parent, "context", 0);
-  JsVar *child = jsvObjectGetChild(parent, "hash_type", 0);
-
-  type = jsvGetInteger(child);
-  jsvUnLock(child);
 
-  jsvGetString(jsCtx, hashFunctions[type].data, hashFunctions[type].ctx_size + 1);  // trailing zero
-
-  if (jsvIsString(message)) {
-    size_t i;
-    size_t len = jsvGetStringLength(message);
-    for(i = 0; i < len; i += sizeof(buff)) {
-      int read = (int)jsvGetStringChars(message, i, buff, sizeof(buff));
-      hashFunctions[type].update(hashFunctions[type].data, buff, read);
-    }
-    jsvSetString(jsCtx, hashFunctions[type].data, hashFunctions[type].ctx_size);
+  if (jsvIsString(message) && jsvIsFlatString(jsCtx)) {
+    // update the context in place, straight from the string's blocks
+    u.hash = &hashFunctions[type];
+    u.ctx = jsvGetFlatStringPointer(jsCtx);
+    jsvIterateBufferCallback(message, jswrap_hashlib_hash_updateCb, &u);
   }
 
   jsvUnLock(jsCtx);
@@ -169,23 +179,12 @@ void jswrap_hashlib_hash_update(JsVar *parent, JsVar *message) {
 }
 */
 JsVar *jswrap_hashlib_hash_digest(JsVar *parent) {
-  int type;
   char buff[SHA256_DIGEST_SIZE];
-  JsVar *jsCtx = NULL;
-  JsVar *child = NULL;
-
-  child = jsvObjectGetChild(parent, "hash_type", 0);
-  type = jsvGetInteger(child);
-  jsvUnLock(child);
+  int type = jswrap_hashlib_hash_getContext(parent);
 
   JsVar *digest = jsvNewStringOfLength(hashFunctions[type].digest_size);
   if (!digest) return 0; // out of memory
 
-  jsCtx = jsvObjectGetChild(parent, "context", 0);
-
-  jsvGetString(jsCtx, hashFunctions[type].data, hashFunctions[type].ctx_size + 1); // trailing zero
-  jsvUnLock(jsCtx);
-
   hashFunctions[type].final(hashFunctions[type].data, buff);
   jsvSetString(digest, buff, hashFunctions[type].digest_size);
 
@@ -204,24 +203,13 @@ JsVar *jswrap_hashlib_hash_digest(JsVar *parent) {
 }
 */
 JsVar *jswrap_hashlib_hash_hexdigest(JsVar *parent) {
-  int type;
   char buff[SHA256_DIGEST_SIZE];
   char a[] = "0123456789abcdef";
-  JsVar *jsCtx = NULL;
-  JsVar *child = NULL;
-  JsVar *digest = NULL;
-
-  child = jsvObjectGetChild(parent, "hash_type", 0);
-  type = jsvGetInteger(child);
-  jsvUnLock(child);
+  int type = jswrap_hashlib_hash_getContext(parent);
 
-  digest = jsvNewStringOfLength(0); // hashFunctions[type].digest_size*2
+  JsVar *digest = jsvNewStringOfLength(0); // hashFunctions[type].digest_size*2
   if (!digest) return 0; // out of memory
 
-  jsCtx = jsvObjectGetChild(parent, "context", 0);
-  jsvGetString(jsCtx, hashFunctions[type].data, hashFunctions[type].ctx_size + 1); // trailing zero
-  jsvUnLock(jsCtx);
-
   hashFunctions[type].final(hashFunctions[type].data, buff);
 
   unsigned int i;
@@ -221,6 +221,10 @@ Pipe this to a stream (an object with a 'write' method)
 Create an HTTP Server
 
 When a request to the server is made, the callback is called. In the callback you can use the methods on the response (httpSRs) to send data. You can also add `request.on('data',function() { ... })` to listen for POSTed data
+
+If the client sent `Connection: keep-alive` and the response has a `Content-Length` header, the connection
+is kept open once the response has been sent. Further requests on it (even ones that were pipelined behind
+the first) then call the callback again with new request and response objects.
 */
 
 JsVar *jswrap_http_createServer(JsVar *callback) {
@@ -254,7 +258,8 @@ var options = {
     port: 80,            // (optional) port, defaults to 80
     path: '/',           // path sent to server
     method: 'GET',       // HTTP command sent to server (must be uppercase 'GET', 'POST', etc)
-    headers: { key : value, key : value } // (optional) HTTP headers
+    headers: { key : value, key : value }, // (optional) HTTP headers
+    keepAlive: false     // (optional) if true, keep the connection open afterwards and re-use it for the next request to the same host and port
   };
 require("http").request(options, function(res) {
   res.on('data', function(data) {
@@ -266,6 +271,11 @@ require("http").request(options, function(res) {
 });
 ```
 
+With `keepAlive: true` the request asks for `Connection: keep-alive`. If the server agrees and sends a
+`Content-Length`, the connection is kept in a small pool once the response has been received (the response
+emits `close` as usual), and the next request to the same host and port uses it without a DNS lookup or TCP
+connection setup.
+
 You can easily pre-populate `options` from a URL using `var options = url.parse("http://www.example.com/foo.html")`
 
 **Note:** if TLS/HTTPS is enabled, options can have `ca`, `key` and `cert` fields. See `tls.connect` for
@@ -362,11 +372,16 @@ Stop listening for new HTTP connections
   "params" : [
     ["data","JsVar","A string containing data to send"]
   ],
-  "return" : ["bool","For note compatibility, the boolean false. When the send buffer is empty, a `drain` event will be sent"]
+  "return" : ["bool","`true` if more data can be written, or `false` if the send buffer is full. In that case a `drain` event will be sent when it has emptied"]
 }*/
 bool jswrap_httpSRs_write(JsVar *parent, JsVar *data) {
-  serverResponseWrite(parent, data);
-  return false;
+  return serverResponseWrite(parent, data);
+}
+
+/** Write 'len' bytes of 'data' to an httpSRs without making a JsVar of them
+ * (used by Pipe) */
+bool jswrap_httpSRs_writeBytes(JsVar *parent, const char *data, size_t len) {
+  return serverResponseWriteBytes(parent, data, len);
 }
 
 /*JSON{
@@ -410,7 +425,7 @@ void jswrap_httpSRs_writeHead(JsVar *parent, int statusCode, JsVar *headers) {
   "params" : [
     ["data","JsVar","A string containing data to send"]
   ],
-  "return" : ["bool","For note compatibility, the boolean false. When the send buffer is empty, a `drain` event will be sent"]
+  "return" : ["bool","`true` if more data can be written, or `false` if the send buffer is full. In that case a `drain` event will be sent when it has emptied"]
 }*/
 // Re-use existing
 
@@ -20,6 +20,7 @@ JsVar *jswrap_http_get(JsVar *options, JsVar *callback);
 
 void jswrap_httpSRs_writeHead(JsVar *parent, int statusCode, JsVar *headers);
 bool jswrap_httpSRs_write(JsVar *parent, JsVar *data);
+bool jswrap_httpSRs_writeBytes(JsVar *parent, const char *data, size_t len);
 void jswrap_httpSRs_end(JsVar *parent, JsVar *data);
 
 bool jswrap_httpCRq_write(JsVar *parent, JsVar *data);
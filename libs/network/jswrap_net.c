@@ -50,6 +50,7 @@ void jswrap_net_kill() {
     socketKill(&net);
     networkFree(&net);
   }
+  networkFreeCaches();
 }
 
 
@@ -500,14 +501,24 @@ void jswrap_net_server_close(JsVar *parent) {
   "params" : [
     ["data","JsVar","A string containing data to send"]
   ],
-  "return" : ["bool","For note compatibility, the boolean false. When the send buffer is empty, a `drain` event will be sent"]
+  "return" : ["bool","`true` if more data can be written, or `false` if the send buffer is full. In that case a `drain` event will be sent when it has emptied"]
 }*/
 bool jswrap_net_socket_write(JsVar *parent, JsVar *data) {
   JsNetwork net;
   if (!networkGetFromVarIfOnline(&net)) return false;
-  clientRequestWrite(&net, parent, data);
+  bool canWrite = clientRequestWrite(&net, parent, data);
   networkFree(&net);
-  return false;
+  return canWrite;
+}
+
+/** Write 'len' bytes of 'data' to a Socket (or httpCRq) without making a JsVar
+ * of them (used by Pipe) */
+bool jswrap_net_socket_writeBytes(JsVar *parent, const char *data, size_t len) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return false;
+  bool canWrite = clientRequestWriteBytes(&net, parent, data, len);
+  networkFree(&net);
+  return canWrite;
 }
 
 /*JSON{
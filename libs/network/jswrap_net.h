@@ -27,6 +27,7 @@ void jswrap_net_server_listen(JsVar *parent, int port);
 void jswrap_net_server_close(JsVar *parent);
 
 bool jswrap_net_socket_write(JsVar *parent, JsVar *data);
+bool jswrap_net_socket_writeBytes(JsVar *parent, const char *data, size_t len);
 void jswrap_net_socket_end(JsVar *parent, JsVar *data);
 
 
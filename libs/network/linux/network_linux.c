@@ -13,6 +13,8 @@
  */
 #include "network.h"
 #include "network_linux.h"
+#include "jsdevices.h"
+#include "jshardware.h"
 
 #include <string.h> // for memset
 
@@ -33,6 +35,7 @@
  #include <fcntl.h>
  #include <stdio.h>
  #include <resolv.h>
+ #include <pthread.h>
  typedef struct sockaddr_in sockaddr_in;
  typedef int SOCKET;
 #endif
@@ -40,9 +43,92 @@
  #define closesocket(SOCK) close(SOCK)
 
 
-/// Get an IP address from a name. Sets out_ip_addr to 0 on failure
+#ifndef WIN32
+/* Lookups are done on a worker thread so that a slow DNS server doesn't
+ * stop the interpreter. Each one gets a slot here - the worker fills in
+ * 'ip' and sets 'done', and the main thread collects the result the next
+ * time it asks for the same name. */
+#define NET_LINUX_DNS_LOOKUPS 4
+typedef struct {
+  char hostName[128];
+  uint32_t ip;
+  volatile bool done;
+  bool used;
+} NetLinuxDnsLookup;
+static NetLinuxDnsLookup netLinuxDnsLookups[NET_LINUX_DNS_LOOKUPS];
+
+static void *net_linux_dnsThread(void *arg) {
+  NetLinuxDnsLookup *lookup = (NetLinuxDnsLookup*)arg;
+  struct addrinfo hints, *result = 0;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  uint32_t ip = 0;
+  if (getaddrinfo(lookup->hostName, 0, &hints, &result)==0 && result) {
+    ip = ((struct sockaddr_in*)result->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(result);
+  }
+  lookup->ip = ip;
+  __sync_synchronize();
+  lookup->done = true;
+  /* wake up the idle loop so it can pick up the result. The other threads
+   * that push events hold the 'interrupt' lock too, so take it */
+  jshInterruptOff();
+  jshPushIOEvent(EV_NONE, jshGetSystemTime());
+  jshInterruptOn();
+  return 0;
+}
+
+/// Start a lookup on a worker thread. Returns false if we couldn't
+static bool net_linux_dnsStart(char *hostName) {
+  NetLinuxDnsLookup *lookup = 0;
+  int i;
+  // use a free slot, or one whose result was never collected
+  for (i=0;i<NET_LINUX_DNS_LOOKUPS && !lookup;i++)
+    if (!netLinuxDnsLookups[i].used) lookup = &netLinuxDnsLookups[i];
+  for (i=0;i<NET_LINUX_DNS_LOOKUPS && !lookup;i++)
+    if (netLinuxDnsLookups[i].done) lookup = &netLinuxDnsLookups[i];
+  if (!lookup) return false;
+  strncpy(lookup->hostName, hostName, sizeof(lookup->hostName)-1);
+  lookup->hostName[sizeof(lookup->hostName)-1] = 0;
+  lookup->ip = 0;
+  lookup->done = false;
+  lookup->used = true;
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  bool ok = pthread_create(&thread, &attr, net_linux_dnsThread, lookup)==0;
+  pthread_attr_destroy(&attr);
+  if (!ok) lookup->used = false;
+  return ok;
+}
+#endif
+
+/** Get an IP address from a name. Sets out_ip_addr to 0 on failure, or
+ * 0xFFFFFFFF if the lookup has been started but hasn't finished yet */
 void net_linux_gethostbyname(JsNetwork *net, char * hostName, uint32_t* out_ip_addr) {
   NOT_USED(net);
+#ifndef WIN32
+  int i;
+  for (i=0;i<NET_LINUX_DNS_LOOKUPS;i++) {
+    NetLinuxDnsLookup *lookup = &netLinuxDnsLookups[i];
+    if (lookup->used && strcmp(lookup->hostName, hostName)==0) {
+      if (!lookup->done) {
+        *out_ip_addr = 0xFFFFFFFF;
+      } else {
+        __sync_synchronize();
+        *out_ip_addr = lookup->ip;
+        lookup->used = false;
+      }
+      return;
+    }
+  }
+  if (net_linux_dnsStart(hostName)) {
+    *out_ip_addr = 0xFFFFFFFF;
+    return;
+  }
+  // no free slots (or no threads) - just do it here
+#endif
   struct hostent * host_addr_p = gethostbyname(hostName);
   if (host_addr_p)
     *out_ip_addr = *(uint32_t*)*host_addr_p->h_addr_list;
@@ -147,15 +147,57 @@ unsigned long networkFlipIPAddress(unsigned long addr) {
       ((addr&0xFF000000)>>24);
 }
 
+/// Look a hostname up in the cache of resolved addresses. Returns 0 if not found (or expired)
+static uint32_t networkDnsCacheGet(char *hostName) {
+  JsVar *cache = jsvObjectGetChild(execInfo.hiddenRoot, NETWORK_DNS_CACHE_NAME, 0);
+  if (!cache) return 0;
+  uint32_t ip = 0;
+  JsVar *entryName = jsvFindChildFromString(cache, hostName, false);
+  if (entryName) {
+    JsVar *entry = jsvSkipName(entryName);
+    if (jsvGetLongIntegerAndUnLock(jsvObjectGetChild(entry, "exp", 0)) > (long long)jshGetSystemTime())
+      ip = (uint32_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(entry, "ip", 0));
+    else
+      jsvRemoveChild(cache, entryName); // expired
+    jsvUnLock2(entry, entryName);
+  }
+  jsvUnLock(cache);
+  return ip;
+}
+
+/// Remember the address a hostname resolved to, for NETWORK_DNS_CACHE_TTL milliseconds
+static void networkDnsCacheSet(char *hostName, uint32_t ip) {
+  JsVar *cache = jsvObjectGetChild(execInfo.hiddenRoot, NETWORK_DNS_CACHE_NAME, JSV_OBJECT);
+  if (!cache) return;
+  // full? Remove the oldest entry
+  if (jsvGetChildren(cache) >= NETWORK_DNS_CACHE_SIZE) {
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, cache);
+    JsVar *oldest = jsvObjectIteratorGetKey(&it);
+    jsvObjectIteratorFree(&it);
+    if (oldest) jsvRemoveChild(cache, oldest);
+    jsvUnLock(oldest);
+  }
+  JsVar *entry = jsvNewWithFlags(JSV_OBJECT);
+  if (entry) {
+    jsvObjectSetChildAndUnLock(entry, "ip", jsvNewFromInteger((JsVarInt)ip));
+    jsvObjectSetChildAndUnLock(entry, "exp", jsvNewFromLongInteger((long long)(jshGetSystemTime() + jshGetTimeFromMilliseconds(NETWORK_DNS_CACHE_TTL))));
+    jsvObjectSetChildAndUnLock(cache, hostName, entry);
+  }
+  jsvUnLock(cache);
+}
+
 /**
  * Get the IP address of a hostname.
  * Retrieve the IP address of a hostname and return it in the address of the
  * ip address passed in.  If the hostname is as dotted decimal string, we will
- * decode that immediately otherwise we will use the network adapter's `gethostbyname`
- * function to resolve the hostname.
+ * decode that immediately. Otherwise we check our cache of recently resolved
+ * names, and then use the network adapter's `gethostbyname` function to resolve
+ * the hostname.
  *
  * A value of 0 returned for an IP address means we could NOT resolve the hostname.
- * A value of 0xFFFFFFFF for an IP address means that we haven't found it YET.
+ * A value of 0xFFFFFFFF for an IP address means that we haven't found it YET - the
+ * lookup is happening in the background, so call again later.
  */
 void networkGetHostByName(
     JsNetwork *net,        //!< The network we are using for resolution.
@@ -173,8 +215,12 @@ void networkGetHostByName(
 
   // If we did not get an IP address from the string, then try and resolve it by
   // calling the network gethostbyname.
+  if (!*out_ip_addr)
+    *out_ip_addr = networkDnsCacheGet(hostName);
   if (!*out_ip_addr) {
     net->gethostbyname(net, hostName, out_ip_addr);
+    if (*out_ip_addr && *out_ip_addr!=0xFFFFFFFF)
+      networkDnsCacheSet(hostName, *out_ip_addr);
   }
 }
 
@@ -276,15 +322,31 @@ JsNetwork *networkGetCurrent() {
 // ------------------------------------------------------------------------------
 #ifdef USE_TLS
 
+#define SSL_CONFIGS_NAME "sslC" // shared SSLConfigData, with the options they were made from
+#define SSL_SESSIONS_NAME "sslS" // "host:port" -> mbedtls_ssl_session, for resuming sessions
+#define SSL_SESSIONS_MAX 4
+
+/* Everything that can be shared between TLS connections made with the same
+ * ca/cert/key options: the RNG, the parsed certificates and the mbedtls config.
+ * mbedtls keeps pointers into this, so the flat string it lives in stays
+ * locked (which stops it being moved) until it is freed. */
 typedef struct {
-  int sckt;
-  bool connecting; // are we in the process of connecting?
+  int refs; // number of sockets using this
   mbedtls_ctr_drbg_context ctr_drbg;
   mbedtls_pk_context pkey;
   mbedtls_x509_crt owncert;
   mbedtls_x509_crt cacert;
-  mbedtls_ssl_context ssl;
   mbedtls_ssl_config conf;
+} SSLConfigData;
+
+/* Per-socket TLS state. Also kept locked for as long as the socket is open,
+ * as mbedtls has pointers to 'sckt' and 'ssl' */
+typedef struct {
+  int sckt;
+  bool connecting; // are we in the process of connecting?
+  SSLConfigData *config;
+  mbedtls_ssl_context ssl;
+  char sessionKey[64]; // "host:port" - where we store the session for next time
 } SSLSocketData;
 
 BITFIELD_DECL(socketIsHTTPS, 32);
@@ -326,6 +388,20 @@ int ssl_entropy(void *data, unsigned char *output, size_t len ) {
   return 0;
 }
 
+static void ssl_freeConfig(SSLConfigData *cd) {
+  mbedtls_ssl_config_free( &cd->conf );
+  mbedtls_ctr_drbg_free( &cd->ctr_drbg );
+  mbedtls_x509_crt_free( &cd->owncert );
+  mbedtls_x509_crt_free( &cd->cacert );
+  mbedtls_pk_free( &cd->pkey );
+  jsvUnLock(jsvGetFlatStringFromPointer((char*)cd)); // the lock we kept while it was in use
+}
+
+/// A socket has finished with its config. It stays cached so the next connection can use it
+static void ssl_releaseConfig(SSLConfigData *cd) {
+  if (cd && cd->refs>0) cd->refs--;
+}
+
 void ssl_freeSocketData(int sckt) {
   BITFIELD_SET(socketIsHTTPS, sckt, 0);
 
@@ -342,11 +418,8 @@ void ssl_freeSocketData(int sckt) {
   if (jsvIsFlatString(sslData)) {
     sd = (SSLSocketData *)jsvGetFlatStringPointer(sslData);
     mbedtls_ssl_free( &sd->ssl );
-    mbedtls_ssl_config_free( &sd->conf );
-    mbedtls_ctr_drbg_free( &sd->ctr_drbg );
-    mbedtls_x509_crt_free( &sd->owncert );
-    mbedtls_x509_crt_free( &sd->cacert );
-    mbedtls_pk_free( &sd->pkey );
+    ssl_releaseConfig(sd->config);
+    jsvUnLock(sslData); // the lock we kept while the socket was open
   }
   jsvUnLock(sslData);
 }
@@ -396,7 +469,7 @@ JsVar *load_cert_file(JsVar *cert) {
 }
 #endif /* USE_FILESYSTEM */
 
-bool ssl_load_key(SSLSocketData *sd, JsVar *options) {
+bool ssl_load_key(SSLConfigData *sd, JsVar *options) {
   JsVar *keyVar = jsvObjectGetChild(options, "key", 0);
   if (!keyVar) {
     return false;
@@ -433,7 +506,7 @@ bool ssl_load_key(SSLSocketData *sd, JsVar *options) {
 
   return true;
 }
-bool ssl_load_owncert(SSLSocketData *sd, JsVar *options) {
+bool ssl_load_owncert(SSLConfigData *sd, JsVar *options) {
   JsVar *certVar = jsvObjectGetChild(options, "cert", 0);
   if (!certVar) {
     return false;
@@ -469,7 +542,7 @@ bool ssl_load_owncert(SSLSocketData *sd, JsVar *options) {
   }
   return true;
 }
-bool ssl_load_cacert(SSLSocketData *sd, JsVar *options) {
+bool ssl_load_cacert(SSLConfigData *sd, JsVar *options) {
   JsVar *caVar = jsvObjectGetChild(options, "ca", 0);
   if (!caVar) {
     return false;
@@ -507,6 +580,213 @@ bool ssl_load_cacert(SSLSocketData *sd, JsVar *options) {
   return true;
 }
 
+/// Are these two ca/cert/key options the same?
+static bool ssl_isSameOption(JsVar *a, JsVar *b) {
+  if (!a || !b || !jsvIsBasic(a) || !jsvIsBasic(b)) return a==b;
+  return jsvIsBasicVarEqual(a, b);
+}
+
+/// Create a new SSLConfigData for the given options (with refs=0), or return 0
+static SSLConfigData *ssl_newConfig(JsVar *options) {
+  JsVar *configVar = jsvNewFlatStringOfLength(sizeof(SSLConfigData));
+  if (!configVar) {
+    jsError("Not enough memory to allocate SSL config\n");
+    return 0;
+  }
+  // we don't unlock configVar here - see SSLConfigData
+  SSLConfigData *cd = (SSLConfigData *)jsvGetFlatStringPointer(configVar);
+  int ret;
+
+  const char *pers = "ssl_client1";
+  mbedtls_ssl_config_init( &cd->conf );
+  mbedtls_pk_init( &cd->pkey );
+  mbedtls_x509_crt_init( &cd->owncert );
+  mbedtls_x509_crt_init( &cd->cacert );
+  mbedtls_ctr_drbg_init( &cd->ctr_drbg );
+  if (( ret = mbedtls_ctr_drbg_seed( &cd->ctr_drbg, ssl_entropy, 0,
+                             (const unsigned char *) pers,
+                             strlen(pers))) != 0 ) {
+    jsError("HTTPS init failed! mbedtls_ctr_drbg_seed returned -0x%x\n", -ret );
+    ssl_freeConfig(cd);
+    return 0;
+  }
+
+  if (jsvIsObject(options)) {
+    if (!ssl_load_cacert(cd, options) ||
+        !ssl_load_owncert(cd, options) ||
+        !ssl_load_key(cd, options)) {
+      ssl_freeConfig(cd);
+      return 0;
+    }
+  }
+
+  if (( ret = mbedtls_ssl_config_defaults( &cd->conf,
+                  MBEDTLS_SSL_IS_CLIENT, // or MBEDTLS_SSL_IS_SERVER
+                  MBEDTLS_SSL_TRANSPORT_STREAM,
+                  MBEDTLS_SSL_PRESET_DEFAULT )) != 0 ) {
+    jsError("HTTPS init failed! mbedtls_ssl_config_defaults returned -0x%x\n", -ret );
+    ssl_freeConfig(cd);
+    return 0;
+  }
+
+  if (cd->pkey.pk_info) {
+    // this would get set if options.key was set
+    if (( ret = mbedtls_ssl_conf_own_cert(&cd->conf, &cd->owncert, &cd->pkey)) != 0 ) {
+      jsError("HTTPS init failed! mbedtls_ssl_conf_own_cert returned -0x%x\n", -ret );
+      ssl_freeConfig(cd);
+      return 0;
+    }
+  }
+  // FIXME no cert checking!
+  mbedtls_ssl_conf_authmode( &cd->conf, MBEDTLS_SSL_VERIFY_NONE );
+  mbedtls_ssl_conf_ca_chain( &cd->conf, &cd->cacert, NULL );
+  mbedtls_ssl_conf_rng( &cd->conf, mbedtls_ctr_drbg_random, &cd->ctr_drbg );
+  mbedtls_ssl_conf_dbg( &cd->conf, ssl_debug, 0 );
+#ifdef MBEDTLS_SSL_SESSION_TICKETS
+  mbedtls_ssl_conf_session_tickets( &cd->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED );
+#endif
+  return cd;
+}
+
+/** Get the shared config for these options - creating it if there isn't one
+ * already - and add a reference to it. Returns 0 on failure */
+static SSLConfigData *ssl_getConfig(JsVar *options) {
+  JsVar *configs = jsvObjectGetChild(execInfo.hiddenRoot, SSL_CONFIGS_NAME, JSV_ARRAY);
+  if (!configs) return 0; // out of memory
+  JsVar *ca = 0, *cert = 0, *key = 0;
+  if (jsvIsObject(options)) {
+    ca = jsvObjectGetChild(options, "ca", 0);
+    cert = jsvObjectGetChild(options, "cert", 0);
+    key = jsvObjectGetChild(options, "key", 0);
+  }
+  SSLConfigData *cd = 0;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, configs);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *entry = jsvObjectIteratorGetValue(&it);
+    JsVar *configVar = jsvObjectGetChild(entry, "cfg", 0);
+    SSLConfigData *entryConfig = (SSLConfigData *)jsvGetFlatStringPointer(configVar);
+    jsvUnLock(configVar);
+    JsVar *eCa = jsvObjectGetChild(entry, "ca", 0);
+    JsVar *eCert = jsvObjectGetChild(entry, "cert", 0);
+    JsVar *eKey = jsvObjectGetChild(entry, "key", 0);
+    bool same = ssl_isSameOption(ca, eCa) && ssl_isSameOption(cert, eCert) && ssl_isSameOption(key, eKey);
+    jsvUnLock3(eCa, eCert, eKey);
+    jsvUnLock(entry);
+    if (same) {
+      cd = entryConfig;
+      jsvObjectIteratorNext(&it);
+    } else if (entryConfig && entryConfig->refs==0) {
+      // nobody is using this one, and it's not what we want - free it
+      ssl_freeConfig(entryConfig);
+      JsVar *entryName = jsvObjectIteratorGetKey(&it);
+      jsvObjectIteratorNext(&it);
+      jsvRemoveChild(configs, entryName);
+      jsvUnLock(entryName);
+    } else
+      jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  if (!cd) {
+    JsVar *entry = jsvNewWithFlags(JSV_OBJECT);
+    cd = entry ? ssl_newConfig(options) : 0;
+    if (cd) {
+      jsvObjectSetChild(entry, "cfg", jsvGetFlatStringFromPointer((char*)cd)); // keep our lock - see SSLConfigData
+      jsvObjectSetChild(entry, "ca", ca);
+      jsvObjectSetChild(entry, "cert", cert);
+      jsvObjectSetChild(entry, "key", key);
+      jsvArrayPush(configs, entry);
+    }
+    jsvUnLock(entry);
+  }
+  if (cd) cd->refs++;
+  jsvUnLock3(ca, cert, key);
+  jsvUnLock(configs);
+  return cd;
+}
+
+/// Free a session stored in a flat string
+static void ssl_freeSession(JsVar *sessionVar) {
+  if (jsvIsFlatString(sessionVar))
+    mbedtls_ssl_session_free((mbedtls_ssl_session*)jsvGetFlatStringPointer(sessionVar));
+}
+
+/// Once the handshake is done, store the session so the next connection to this host can resume it
+static void ssl_saveSession(SSLSocketData *sd) {
+  if (!sd->sessionKey[0]) return;
+  JsVar *sessions = jsvObjectGetChild(execInfo.hiddenRoot, SSL_SESSIONS_NAME, JSV_OBJECT);
+  if (!sessions) return;
+  JsVar *sessionVar = jsvObjectGetChild(sessions, sd->sessionKey, 0);
+  if (jsvIsFlatString(sessionVar)) {
+    ssl_freeSession(sessionVar);
+  } else {
+    jsvUnLock(sessionVar);
+    // too many? forget the oldest
+    if (jsvGetChildren(sessions) >= SSL_SESSIONS_MAX) {
+      JsvObjectIterator it;
+      jsvObjectIteratorNew(&it, sessions);
+      JsVar *oldestName = jsvObjectIteratorGetKey(&it);
+      JsVar *oldest = jsvObjectIteratorGetValue(&it);
+      jsvObjectIteratorFree(&it);
+      ssl_freeSession(oldest);
+      if (oldestName) jsvRemoveChild(sessions, oldestName);
+      jsvUnLock2(oldest, oldestName);
+    }
+    sessionVar = jsvNewFlatStringOfLength(sizeof(mbedtls_ssl_session));
+    if (sessionVar) jsvObjectSetChild(sessions, sd->sessionKey, sessionVar);
+  }
+  if (sessionVar) {
+    mbedtls_ssl_session *session = (mbedtls_ssl_session*)jsvGetFlatStringPointer(sessionVar);
+    mbedtls_ssl_session_init(session);
+    if (mbedtls_ssl_get_session(&sd->ssl, session) != 0)
+      jsvObjectSetChild(sessions, sd->sessionKey, 0);
+  }
+  jsvUnLock2(sessionVar, sessions);
+}
+
+/// If we have a session stored for this host, ask to resume it
+static void ssl_loadSession(SSLSocketData *sd) {
+  JsVar *sessions = jsvObjectGetChild(execInfo.hiddenRoot, SSL_SESSIONS_NAME, 0);
+  JsVar *sessionVar = sessions ? jsvObjectGetChild(sessions, sd->sessionKey, 0) : 0;
+  if (jsvIsFlatString(sessionVar))
+    mbedtls_ssl_set_session(&sd->ssl, (mbedtls_ssl_session*)jsvGetFlatStringPointer(sessionVar));
+  jsvUnLock2(sessionVar, sessions);
+}
+
+/// Free all the cached configs and sessions (any sockets using them must already be closed)
+static void ssl_freeCaches() {
+  JsVar *configs = jsvObjectGetChild(execInfo.hiddenRoot, SSL_CONFIGS_NAME, 0);
+  if (configs) {
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, configs);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *entry = jsvObjectIteratorGetValue(&it);
+      JsVar *configVar = jsvObjectGetChild(entry, "cfg", 0);
+      if (jsvIsFlatString(configVar))
+        ssl_freeConfig((SSLConfigData *)jsvGetFlatStringPointer(configVar));
+      jsvUnLock2(configVar, entry);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+    jsvUnLock(configs);
+    jsvRemoveNamedChild(execInfo.hiddenRoot, SSL_CONFIGS_NAME);
+  }
+  JsVar *sessions = jsvObjectGetChild(execInfo.hiddenRoot, SSL_SESSIONS_NAME, 0);
+  if (sessions) {
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, sessions);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *sessionVar = jsvObjectIteratorGetValue(&it);
+      ssl_freeSession(sessionVar);
+      jsvUnLock(sessionVar);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+    jsvUnLock(sessions);
+    jsvRemoveNamedChild(execInfo.hiddenRoot, SSL_SESSIONS_NAME);
+  }
+}
+
 bool ssl_newSocketData(int sckt, JsVar *options) {
   /* FIXME Warning:
    *
@@ -535,77 +815,47 @@ bool ssl_newSocketData(int sckt, JsVar *options) {
   }
   jsvSetValueOfName(sslDataVar, sslData);
   jsvUnLock(sslDataVar);
+  // we don't unlock sslData here - see SSLSocketData
   SSLSocketData *sd = (SSLSocketData *)jsvGetFlatStringPointer(sslData);
-  jsvUnLock(sslData);
   assert(sd);
 
   // Now initialise this
   sd->sckt = sckt;
   sd->connecting = true;
+  mbedtls_ssl_init( &sd->ssl );
 
   jsiConsolePrintf( "Connecting with TLS...\n" );
 
   int ret;
 
-  const char *pers = "ssl_client1";
-  mbedtls_ssl_init( &sd->ssl );
-  mbedtls_ssl_config_init( &sd->conf );
-  mbedtls_pk_init( &sd->pkey );
-  mbedtls_x509_crt_init( &sd->owncert );
-  mbedtls_x509_crt_init( &sd->cacert );
-  mbedtls_ctr_drbg_init( &sd->ctr_drbg );
-  if (( ret = mbedtls_ctr_drbg_seed( &sd->ctr_drbg, ssl_entropy, 0,
-                             (const unsigned char *) pers,
-                             strlen(pers))) != 0 ) {
-    jsError("HTTPS init failed! mbedtls_ctr_drbg_seed returned -0x%x\n", -ret );
-    ssl_freeSocketData(sckt);
-    return false;
-  }
-
-  if (jsvIsObject(options)) {
-    if (!ssl_load_cacert(sd, options) ||
-        !ssl_load_owncert(sd, options) ||
-        !ssl_load_key(sd, options)) {
-      ssl_freeSocketData(sckt);
-      return false;
-    }
-  }
-
-  if (( ret = mbedtls_ssl_config_defaults( &sd->conf,
-                  MBEDTLS_SSL_IS_CLIENT, // or MBEDTLS_SSL_IS_SERVER
-                  MBEDTLS_SSL_TRANSPORT_STREAM,
-                  MBEDTLS_SSL_PRESET_DEFAULT )) != 0 ) {
-    jsError("HTTPS init failed! mbedtls_ssl_config_defaults returned -0x%x\n", -ret );
+  sd->config = ssl_getConfig(options);
+  if (!sd->config) {
     ssl_freeSocketData(sckt);
     return false;
   }
 
-  if (sd->pkey.pk_info) {
-    // this would get set if options.key was set
-    if (( ret = mbedtls_ssl_conf_own_cert(&sd->conf, &sd->owncert, &sd->pkey)) != 0 ) {
-      jsError("HTTPS init failed! mbedtls_ssl_conf_own_cert returned -0x%x\n", -ret );
-      ssl_freeSocketData(sckt);
-      return false;
-    }
-  }
-  // FIXME no cert checking!
-  mbedtls_ssl_conf_authmode( &sd->conf, MBEDTLS_SSL_VERIFY_NONE );
-  mbedtls_ssl_conf_ca_chain( &sd->conf, &sd->cacert, NULL );
-  mbedtls_ssl_conf_rng( &sd->conf, mbedtls_ctr_drbg_random, &sd->ctr_drbg );
-  mbedtls_ssl_conf_dbg( &sd->conf, ssl_debug, 0 );
-
-  if (( ret = mbedtls_ssl_setup( &sd->ssl, &sd->conf )) != 0) {
+  if (( ret = mbedtls_ssl_setup( &sd->ssl, &sd->config->conf )) != 0) {
     jsError("Failed! mbedtls_ssl_setup returned -0x%x\n", -ret );
     ssl_freeSocketData(sckt);
     return false;
   }
 
-  if (( ret = mbedtls_ssl_set_hostname( &sd->ssl, "mbed TLS Server 1" )) != 0) {
+  char hostName[64];
+  JsVar *hostVar = jsvIsObject(options) ? jsvObjectGetChild(options, "host", 0) : 0;
+  if (hostVar) jsvGetString(hostVar, hostName, sizeof(hostName));
+  else strncpy(hostName, "localhost", sizeof(hostName));
+  jsvUnLock(hostVar);
+  if (( ret = mbedtls_ssl_set_hostname( &sd->ssl, hostName )) != 0) {
     jsError("HTTPS init failed! mbedtls_ssl_set_hostname returned -0x%x\n", -ret );
     ssl_freeSocketData(sckt);
     return false;
   }
 
+  // If we've talked to this host before, try and resume the session
+  int port = jsvIsObject(options) ? (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0)) : 0;
+  espruino_snprintf(sd->sessionKey, sizeof(sd->sessionKey), "%s:%d", hostName, port);
+  ssl_loadSession(sd);
+
   mbedtls_ssl_set_bio( &sd->ssl, &sd->sckt, ssl_send, ssl_recv, NULL );
 
   jsiConsolePrintf("Performing the SSL/TLS handshake...\n" );
@@ -625,6 +875,7 @@ SSLSocketData *ssl_getSocketData(int sckt) {
   if (jsvIsFlatString(sslData))
     sd = (SSLSocketData *)jsvGetFlatStringPointer(sslData);
   jsvUnLock(sslData);
+  if (!sd) return 0;
 
   // now continue with connection
   if (sd->connecting) {
@@ -649,6 +900,7 @@ SSLSocketData *ssl_getSocketData(int sckt) {
         return 0;
       }
       sd->connecting = false;
+      ssl_saveSession(sd);
     }
   }
 
@@ -659,6 +911,13 @@ SSLSocketData *ssl_getSocketData(int sckt) {
 #endif
 // ------------------------------------------------------------------------------
 
+void networkFreeCaches() {
+  jsvRemoveNamedChild(execInfo.hiddenRoot, NETWORK_DNS_CACHE_NAME);
+#ifdef USE_TLS
+  ssl_freeCaches();
+#endif
+}
+
 bool netCheckError(JsNetwork *net) {
   return net->checkError(net);
 }
@@ -20,6 +20,9 @@
 #include "jshardware.h"
 
 #define NETWORK_VAR_NAME "net"
+#define NETWORK_DNS_CACHE_NAME "DNS" // hostname -> {ip,exp} for names we've resolved
+#define NETWORK_DNS_CACHE_SIZE 8
+#define NETWORK_DNS_CACHE_TTL 60000 // milliseconds we trust a resolved address for
 
 typedef enum {
   NETWORKSTATE_OFFLINE,
@@ -96,6 +99,9 @@ JsVar *networkGetAddressAsString(unsigned char *ip, int nBytes, unsigned int bas
 void networkPutAddressAsString(JsVar *object, const char *name,  unsigned char *ip, int nBytes, unsigned int base, char separator);
 /** Some devices (CC3000) store the IP address with the first element last, so we must flip it */
 unsigned long networkFlipIPAddress(unsigned long addr);
+/** Free cached DNS results and TLS configs/sessions. Called when the network
+ * is killed, so they are never saved (they'd be stale, or hold pointers) */
+void networkFreeCaches();
 
 typedef enum {
   NCF_NORMAL = 0,
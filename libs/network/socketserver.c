@@ -21,8 +21,16 @@
 #define HTTP_NAME_PORT "port"
 #define HTTP_NAME_SOCKET "sckt"
 #define HTTP_NAME_HAD_HEADERS "hdrs"
+#define HTTP_NAME_HEADER_SCAN "hScn" // (bytes scanned<<2) | newline state while looking for the end of the header
+#define HTTP_NAME_CONTENT_LENGTH "cLen" // body bytes still to come
+#define HTTP_NAME_KEEPALIVE "kA" // the connection can be re-used afterwards
+#define HTTP_NAME_NEXT_DATA "dNxt" // data received after this request's body (pipelined requests)
+#define HTTP_NAME_HOST "host"
+#define HTTP_NAME_DNS_WAIT "dns" // waiting for the host name to be resolved before we connect
 #define HTTP_NAME_RECEIVE_DATA "dRcv"
 #define HTTP_NAME_SEND_DATA "dSnd"
+#define HTTP_NAME_SEND_OFFSET "dSnO" // how much of dSnd has already been sent
+#define HTTP_NAME_DRAIN_WAIT "dWt" // true if write returned false, so 'drain' when below the low watermark. false if that 'drain' has been sent
 #define HTTP_NAME_RESPONSE_VAR "res"
 #define HTTP_NAME_OPTIONS_VAR "opt"
 #define HTTP_NAME_SERVER_VAR "svr"
@@ -37,9 +45,20 @@
 #define HTTP_NAME_ON_DRAIN JS_EVENT_PREFIX"drain"
 #define HTTP_NAME_ON_ERROR JS_EVENT_PREFIX"error"
 
+#ifndef SOCKET_SEND_BUFFER_SIZE
+#define SOCKET_SEND_BUFFER_SIZE 256 // bytes handed to netSend at once
+#endif
+#define SOCKET_SEND_MAX_CHUNKS 8 // most netSend calls per connection per idle
+#define SOCKET_SEND_COMPACT_SIZE 1024 // only cut sent data off the send queue after this many bytes
+#define SOCKET_SEND_HIGH_WATERMARK 1024 // write returns false when this much is queued
+#define SOCKET_SEND_LOW_WATERMARK 256 // ... and 'drain' is emitted when it falls below this
+
 #define HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS "HttpCC"
 #define HTTP_ARRAY_HTTP_SERVERS "HttpS"
 #define HTTP_ARRAY_HTTP_SERVER_CONNECTIONS "HttpSC"
+#define HTTP_ARRAY_HTTP_CLIENT_POOL "HttpCP" // idle keep-alive client sockets
+
+#define HTTP_CLIENT_POOL_SIZE 4 // most idle keep-alive client sockets we hold on to
 
 // -----------------------------
 
@@ -62,79 +81,145 @@ static void httpAppendHeaders(JsVar *string, JsVar *headerObject) {
   // free headers
 }
 
-// httpParseHeaders(&receiveData, reqVar, true) // server
-// httpParseHeaders(&receiveData, resVar, false) // client
-bool httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer) {
-  // find /r/n/r/n
-  int newlineIdx = 0;
-  int strIdx = 0;
+/* Look for the end of the HTTP header (\r\n\r\n). How far we got and the
+ * current newline state are stored in HTTP_NAME_HEADER_SCAN so that each
+ * call only has to look at the data that arrived since the last one.
+ * Returns the index just after the header, or -1 if it isn't complete yet */
+static int httpFindHeaderEnd(JsVar *receiveData, JsVar *objectForData) {
+  JsVarInt scan = jsvGetIntegerAndUnLock(jsvObjectGetChild(objectForData, HTTP_NAME_HEADER_SCAN, 0));
+  int newlineIdx = (int)(scan&3);
+  int strIdx = (int)(scan>>2);
   int headerEnd = -1;
   JsvStringIterator it;
-  jsvStringIteratorNew(&it, *receiveData, 0);
-  while (jsvStringIteratorHasChar(&it)) {
+  jsvStringIteratorNew(&it, receiveData, (size_t)strIdx);
+  while (headerEnd<0 && jsvStringIteratorHasChar(&it)) {
     char ch = jsvStringIteratorGetChar(&it);
     if (ch == '\r') {
-      if (newlineIdx==0) newlineIdx=1;
-      else if (newlineIdx==2) newlineIdx=3;
+      newlineIdx = (newlineIdx==2) ? 3 : 1;
     } else if (ch == '\n') {
       if (newlineIdx==1) newlineIdx=2;
-      else if (newlineIdx==3) {
-        headerEnd = strIdx+1;
-      }
+      else if (newlineIdx==3) headerEnd = strIdx+1;
+      else newlineIdx=0;
     } else newlineIdx=0;
     jsvStringIteratorNext(&it);
     strIdx++;
   }
   jsvStringIteratorFree(&it);
+  if (headerEnd<0)
+    jsvObjectSetChildAndUnLock(objectForData, HTTP_NAME_HEADER_SCAN, jsvNewFromInteger((strIdx<<2) | newlineIdx));
+  else
+    jsvObjectSetChild(objectForData, HTTP_NAME_HEADER_SCAN, 0);
+  return headerEnd;
+}
+
+/// Case-insensitive check of a header name against a lowercase string
+static bool httpIsHeaderName(JsVar *name, const char *lowerCaseName) {
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, name, 0);
+  while (jsvStringIteratorHasChar(&it) && *lowerCaseName) {
+    char ch = jsvStringIteratorGetChar(&it);
+    if (ch>='A' && ch<='Z') ch = (char)(ch+'a'-'A');
+    if (ch != *lowerCaseName) break;
+    lowerCaseName++;
+    jsvStringIteratorNext(&it);
+  }
+  bool match = !jsvStringIteratorHasChar(&it) && !*lowerCaseName;
+  jsvStringIteratorFree(&it);
+  return match;
+}
+
+/// Get the value of a header (with a lowercase name) from an object of headers, or 0
+static JsVar *httpGetHeader(JsVar *headerObject, const char *lowerCaseName) {
+  JsVar *value = 0;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, headerObject);
+  while (!value && jsvObjectIteratorHasValue(&it)) {
+    JsVar *k = jsvObjectIteratorGetKey(&it);
+    if (httpIsHeaderName(k, lowerCaseName))
+      value = jsvAsString(jsvObjectIteratorGetValue(&it), true);
+    jsvUnLock(k);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  return value;
+}
+
+static bool httpHasHeader(JsVar *headerObject, const char *lowerCaseName) {
+  JsVar *value = httpGetHeader(headerObject, lowerCaseName);
+  jsvUnLock(value);
+  return value!=0;
+}
+
+// httpParseHeaders(&receiveData, reqVar, true) // server
+// httpParseHeaders(&receiveData, resVar, false) // client
+bool httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer) {
+  // find /r/n/r/n - only looking at data we haven't checked before
+  int headerEnd = httpFindHeaderEnd(*receiveData, objectForData);
   // skip if we have no header
   if (headerEnd<0) return false;
-  // Now parse the header
+  // Now parse the header - just the header, not any body data after it
   JsVar *vHeaders = jsvNewWithFlags(JSV_OBJECT);
   if (!vHeaders) return true;
   jsvUnLock(jsvAddNamedChild(objectForData, vHeaders, "headers"));
-  strIdx = 0;
+  int strIdx = 0;
   int firstSpace = -1;
   int secondSpace = -1;
   int firstEOL = -1;
   int lineNumber = 0;
   int lastLineStart = 0;
-  int colonPos = 0;
-  //jsiConsolePrintStringVar(receiveData);
+  int colonPos = -1;
+  JsVarInt contentLength = -1;
+  bool chunked = false;
+  bool keepAlive = false;
+  JsvStringIterator it;
   jsvStringIteratorNew(&it, *receiveData, 0);
-    while (jsvStringIteratorHasChar(&it)) {
-      char ch = jsvStringIteratorGetChar(&it);
-      if (ch==' ' || ch=='\r') {
-        if (firstSpace<0) firstSpace = strIdx;
-        else if (secondSpace<0) secondSpace = strIdx;
-      }
-      if (ch == ':' && colonPos<0) colonPos = strIdx;
-      if (ch == '\r') {
-        if (firstEOL<0) firstEOL=strIdx;
-        if (lineNumber>0 && colonPos>lastLineStart && lastLineStart<strIdx) {
-          JsVar *hVal = jsvNewFromEmptyString();
-          if (hVal)
-            jsvAppendStringVar(hVal, *receiveData, (size_t)colonPos+2, (size_t)(strIdx-(colonPos+2)));
-          JsVar *hKey = jsvNewFromEmptyString();
-          if (hKey) {
-            jsvMakeIntoVariableName(hKey, hVal);
-            jsvAppendStringVar(hKey, *receiveData, (size_t)lastLineStart, (size_t)(colonPos-lastLineStart));
-            jsvAddName(vHeaders, hKey);
-            jsvUnLock(hKey);
-          }
-          jsvUnLock(hVal);
+  while (strIdx<headerEnd && jsvStringIteratorHasChar(&it)) {
+    char ch = jsvStringIteratorGetChar(&it);
+    if (firstEOL<0 && (ch==' ' || ch=='\r')) {
+      if (firstSpace<0) firstSpace = strIdx;
+      else if (secondSpace<0) secondSpace = strIdx;
+    }
+    if (ch == ':' && colonPos<0) colonPos = strIdx;
+    if (ch == '\r') {
+      if (firstEOL<0) firstEOL=strIdx;
+      if (lineNumber>0 && colonPos>lastLineStart && lastLineStart<strIdx) {
+        int valueStart = colonPos+1;
+        if (valueStart<strIdx && jsvGetCharInString(*receiveData, (size_t)valueStart)==' ')
+          valueStart++;
+        JsVar *hVal = jsvNewFromStringVar(*receiveData, (size_t)valueStart, (size_t)(strIdx-valueStart));
+        JsVar *hKey = jsvNewFromEmptyString();
+        if (hKey) {
+          jsvMakeIntoVariableName(hKey, hVal);
+          jsvAppendStringVar(hKey, *receiveData, (size_t)lastLineStart, (size_t)(colonPos-lastLineStart));
+          if (httpIsHeaderName(hKey, "content-length"))
+            contentLength = jsvGetInteger(hVal);
+          else if (httpIsHeaderName(hKey, "transfer-encoding"))
+            chunked = jsvIsStringEqual(hVal, "chunked");
+          else if (httpIsHeaderName(hKey, "connection"))
+            keepAlive = httpIsHeaderName(hVal, "keep-alive");
+          jsvAddName(vHeaders, hKey);
+          jsvUnLock(hKey);
         }
-        lineNumber++;
-        colonPos=-1;
-      }
-      if (ch == '\r' || ch == '\n') {
-        lastLineStart = strIdx+1;
+        jsvUnLock(hVal);
       }
-
-      jsvStringIteratorNext(&it);
-      strIdx++;
+      lineNumber++;
+      colonPos=-1;
+    }
+    if (ch == '\r' || ch == '\n') {
+      lastLineStart = strIdx+1;
     }
-    jsvStringIteratorFree(&it);
+    jsvStringIteratorNext(&it);
+    strIdx++;
+  }
+  jsvStringIteratorFree(&it);
   jsvUnLock(vHeaders);
+  // remember how the body is delimited
+  if (contentLength>=0)
+    jsvObjectSetChildAndUnLock(objectForData, HTTP_NAME_CONTENT_LENGTH, jsvNewFromInteger(contentLength));
+  if (chunked)
+    jsvObjectSetChildAndUnLock(objectForData, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
+  if (keepAlive)
+    jsvObjectSetChildAndUnLock(objectForData, HTTP_NAME_KEEPALIVE, jsvNewFromBool(true));
   // try and pull out methods/etc
   if (isServer) {
     jsvObjectSetChildAndUnLock(objectForData, "method", jsvNewFromStringVar(*receiveData, 0, (size_t)firstSpace));
@@ -192,6 +277,94 @@ void _socketConnectionKill(JsNetwork *net, JsVar *connection) {
 
 // -----------------------------
 
+/// Get the host name that a client request's options refer to
+static void clientRequestGetHost(JsVar *options, char *hostName, size_t len) {
+  JsVar *hostNameVar = jsvObjectGetChild(options, "host", 0);
+  if (jsvIsUndefined(hostNameVar))
+    strncpy(hostName, "localhost", len);
+  else
+    jsvGetString(hostNameVar, hostName, len);
+  jsvUnLock(hostNameVar);
+}
+
+/** Move the socket of a finished keep-alive client request into the pool of
+ * idle connections (so _socketConnectionKill won't close it) */
+static void socketPoolAdd(JsNetwork *net, JsVar *connection) {
+  JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, true);
+  JsVar *entry = arr ? jsvNewWithFlags(JSV_OBJECT) : 0;
+  if (!entry) { // out of memory - the socket will just get closed
+    jsvUnLock(arr);
+    return;
+  }
+  JsVar *options = jsvObjectGetChild(connection, HTTP_NAME_OPTIONS_VAR, 0);
+  char hostName[128];
+  clientRequestGetHost(options, hostName, sizeof(hostName));
+  jsvObjectSetChildAndUnLock(entry, HTTP_NAME_HOST, jsvNewFromString(hostName));
+  jsvObjectSetChildAndUnLock(entry, HTTP_NAME_PORT, jsvNewFromInteger(jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0))));
+  jsvObjectSetChildAndUnLock(entry, HTTP_NAME_SOCKETTYPE, jsvObjectGetChild(connection, HTTP_NAME_SOCKETTYPE, 0));
+  jsvObjectSetChildAndUnLock(entry, HTTP_NAME_SOCKET, jsvObjectGetChild(connection, HTTP_NAME_SOCKET, 0));
+  jsvObjectSetChild(connection, HTTP_NAME_SOCKET, 0);
+  jsvArrayPush(arr, entry);
+  // Too many? close the one that has been idle the longest
+  if (jsvGetChildren(arr) > HTTP_CLIENT_POOL_SIZE) {
+    JsVar *oldest = jsvSkipNameAndUnLock(jsvArrayPopFirst(arr));
+    _socketConnectionKill(net, oldest);
+    jsvUnLock(oldest);
+  }
+  jsvUnLock3(entry, options, arr);
+}
+
+/// Take an idle socket to the given host out of the pool. Returns -1 if there isn't one
+static int socketPoolGet(const char *hostName, JsVarInt port, SocketType socketType) {
+  JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, false);
+  if (!arr) return -1;
+  int sckt = -1;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, arr);
+  while (sckt<0 && jsvObjectIteratorHasValue(&it)) {
+    JsVar *entry = jsvObjectIteratorGetValue(&it);
+    if (jsvGetIntegerAndUnLock(jsvObjectGetChild(entry, HTTP_NAME_PORT, 0))==port &&
+        socketGetType(entry)==socketType &&
+        jsvIsStringEqualAndUnLock(jsvObjectGetChild(entry, HTTP_NAME_HOST, 0), hostName)) {
+      sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(entry, HTTP_NAME_SOCKET, 0))-1;
+      JsVar *entryName = jsvObjectIteratorGetKey(&it);
+      jsvRemoveChild(arr, entryName);
+      jsvUnLock(entryName);
+    }
+    jsvUnLock(entry);
+    if (sckt<0) jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(arr);
+  return sckt;
+}
+
+/// Close idle pooled sockets that the other end has closed (or unexpectedly sent data on)
+static void socketPoolIdle(JsNetwork *net) {
+  JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, false);
+  if (!arr) return;
+  char buf[8];
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, arr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *entry = jsvObjectIteratorGetValue(&it);
+    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(entry, HTTP_NAME_SOCKET, 0))-1;
+    if (sckt<0 || netRecv(net, sckt, buf, sizeof(buf))!=0) {
+      _socketConnectionKill(net, entry);
+      JsVar *entryName = jsvObjectIteratorGetKey(&it);
+      jsvObjectIteratorNext(&it);
+      jsvRemoveChild(arr, entryName);
+      jsvUnLock(entryName);
+    } else
+      jsvObjectIteratorNext(&it);
+    jsvUnLock(entry);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(arr);
+}
+
+// -----------------------------
+
 NO_INLINE static void _socketCloseAllConnectionsFor(JsNetwork *net, char *name) {
   JsVar *arr = socketGetArray(name, false);
   if (!arr) return;
@@ -213,27 +386,85 @@ NO_INLINE static void _socketCloseAllConnections(JsNetwork *net) {
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_SERVER_CONNECTIONS);
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS);
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_SERVERS);
+  _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_CLIENT_POOL);
+}
+
+/** Return how many bytes of this connection's send queue have yet to be sent */
+static size_t socketGetPendingSendBytes(JsVar *connection, JsVar *sendData) {
+  if (!sendData) return 0;
+  size_t len = jsvGetStringLength(sendData);
+  size_t offset = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_SEND_OFFSET, 0));
+  return (offset < len) ? len-offset : 0;
+}
+
+/** Called after data has been appended to a connection's send queue. Returns
+ * true if more data can be written, or false if the queue is above the high
+ * watermark, in which case a 'drain' event will be emitted once it has fallen
+ * below the low watermark */
+static bool socketQueuedSendData(JsVar *connection, JsVar *sendData) {
+  if (socketGetPendingSendBytes(connection, sendData) < SOCKET_SEND_HIGH_WATERMARK)
+    return true;
+  jsvObjectSetChildAndUnLock(connection, HTTP_NAME_DRAIN_WAIT, jsvNewFromBool(true));
+  return false;
 }
 
+/** Send as much of sendData as the socket will take. sendData is a queue
+ * with a 'consumed' cursor stored on the connection, so we don't have to
+ * copy the unsent data every time a partial send happens. */
 bool socketSendData(JsNetwork *net, JsVar *connection, int sckt, JsVar **sendData) {
-  char buf[64];
+  char buf[SOCKET_SEND_BUFFER_SIZE];
 
   int a=1;
-  if (!jsvIsEmptyString(*sendData)) {
-    size_t bufLen = httpStringGet(*sendData, buf, sizeof(buf));
+  size_t len = jsvGetStringLength(*sendData);
+  size_t offset = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_SEND_OFFSET, 0));
+  int chunks = SOCKET_SEND_MAX_CHUNKS;
+  /* One iterator for all chunks - we stop as soon as a chunk isn't sent in
+   * full, so it always stays at 'offset' */
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, *sendData, offset);
+  while (offset < len && chunks--) {
+    // copy out a block from where we got to
+    size_t bufLen = 0;
+    while (bufLen<sizeof(buf) && jsvStringIteratorHasChar(&it)) {
+      buf[bufLen++] = jsvStringIteratorGetChar(&it);
+      jsvStringIteratorNext(&it);
+    }
     a = netSend(net, sckt, buf, bufLen);
-    // Now cut what we managed to send off the beginning of sendData
-    if (a>0) {
-      JsVar *newSendData = 0;
-      if (a < (int)jsvGetStringLength(*sendData)) {
-        // we didn't send all of it... cut out what we did send
-        newSendData = jsvNewFromStringVar(*sendData, (size_t)a, JSVAPPENDSTRINGVAR_MAXLENGTH);
-      } else {
-        // we sent all of it! Issue a drain event
-        jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_DRAIN, &connection, 1);
+    if (a<=0) break; // busy or error
+    offset += (size_t)a;
+    if ((size_t)a < bufLen) break; // socket buffer full - try again later
+  }
+  jsvStringIteratorFree(&it);
+
+  if (len && offset >= len) {
+    /* we sent all of it! Issue a drain event - unless we already did when
+     * we went below the low watermark */
+    JsVar *drainWait = jsvObjectGetChild(connection, HTTP_NAME_DRAIN_WAIT, 0);
+    if (!drainWait || jsvGetBool(drainWait))
+      jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_DRAIN, &connection, 1);
+    jsvUnLock(drainWait);
+    jsvObjectSetChild(connection, HTTP_NAME_SEND_OFFSET, 0);
+    jsvObjectSetChild(connection, HTTP_NAME_DRAIN_WAIT, 0);
+    jsvUnLock(*sendData);
+    *sendData = 0;
+  } else if (offset) {
+    if (offset >= SOCKET_SEND_COMPACT_SIZE && offset*2 >= len) {
+      /* Most of the string has been sent, so cut it off the front. As we only
+       * do this when over half has gone, copying stays linear overall */
+      JsVar *newSendData = jsvNewFromStringVar(*sendData, offset, JSVAPPENDSTRINGVAR_MAXLENGTH);
+      if (newSendData) {
+        jsvUnLock(*sendData);
+        *sendData = newSendData;
+        len -= offset;
+        offset = 0;
       }
-      jsvUnLock(*sendData);
-      *sendData = newSendData;
+    }
+    jsvObjectSetChildAndUnLock(connection, HTTP_NAME_SEND_OFFSET, jsvNewFromInteger((JsVarInt)offset));
+    // if someone was told to wait, tell them when we're below the low watermark
+    if (len-offset <= SOCKET_SEND_LOW_WATERMARK &&
+        jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_DRAIN_WAIT, 0))) {
+      jsvObjectSetChildAndUnLock(connection, HTTP_NAME_DRAIN_WAIT, jsvNewFromBool(false));
+      jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_DRAIN, &connection, 1);
     }
   }
   if (a<0) { // could just be busy which is ok
@@ -265,6 +496,53 @@ void socketKill(JsNetwork *net) {
 
 // -----------------------------
 
+/// Create a new HTTP request/response pair for the given socket, and add it to the list of server connections
+static JsVar *serverNewRequest(JsVar *server, int sckt) {
+  JsVar *req = jspNewObject(0, "httpSRq");
+  JsVar *res = jspNewObject(0, "httpSRs");
+  if (res && req) { // out of memory?
+    socketSetType(req, ST_HTTP);
+    JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS, true);
+    if (arr) {
+      jsvArrayPush(arr, req);
+      jsvUnLock(arr);
+    }
+    jsvObjectSetChild(req, HTTP_NAME_RESPONSE_VAR, res);
+    jsvObjectSetChild(req, HTTP_NAME_SERVER_VAR, server);
+    jsvObjectSetChildAndUnLock(req, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+    // on response
+    jsvObjectSetChildAndUnLock(res, HTTP_NAME_CODE, jsvNewFromInteger(200));
+    jsvObjectSetChildAndUnLock(res, HTTP_NAME_HEADERS, jsvNewWithFlags(JSV_OBJECT));
+  } else {
+    jsvUnLock(req);
+    req = 0;
+  }
+  jsvUnLock(res);
+  return req;
+}
+
+/** For keep-alive requests, only the first Content-Length bytes after the
+ * header are the body. Anything after that is moved to HTTP_NAME_NEXT_DATA
+ * as it's the start of the next request */
+static void serverSplitRequestBody(JsVar *connection, JsVar **receiveData) {
+  JsVarInt remaining = jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CONTENT_LENGTH, 0));
+  if (remaining<0) remaining=0;
+  if ((JsVarInt)jsvGetStringLength(*receiveData) <= remaining) return;
+  JsVar *nextData = jsvObjectGetChild(connection, HTTP_NAME_NEXT_DATA, 0);
+  if (!nextData) {
+    nextData = jsvNewFromEmptyString();
+    jsvObjectSetChild(connection, HTTP_NAME_NEXT_DATA, nextData);
+  }
+  JsVar *body = jsvNewFromStringVar(*receiveData, 0, (size_t)remaining);
+  if (nextData && body) {
+    jsvAppendStringVar(nextData, *receiveData, (size_t)remaining, JSVAPPENDSTRINGVAR_MAXLENGTH);
+    jsvUnLock(*receiveData);
+    *receiveData = body;
+  } else
+    jsvUnLock(body);
+  jsvUnLock(nextData);
+}
+
 bool socketServerConnectionsIdle(JsNetwork *net) {
   char buf[64];
 
@@ -284,6 +562,7 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
 
     int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
     bool closeConnectionNow = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSENOW, false));
+    bool reuseConnection = false;
 
     if (!closeConnectionNow) {
       int num = netRecv(net, sckt, buf,sizeof(buf));
@@ -291,25 +570,36 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
         // we probably disconnected so just get rid of this
         closeConnectionNow = true;
       } else {
-        // add it to our request string
-        if (num>0) {
-          JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
+        JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
+        bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
+        // add it to our request string - or parse a request that was pipelined behind the last one
+        if (num>0 || (!hadHeaders && !jsvIsEmptyString(receiveData))) {
           JsVar *oldReceiveData = receiveData;
           if (!receiveData) receiveData = jsvNewFromEmptyString();
           if (receiveData) {
-            jsvAppendStringBuf(receiveData, buf, (size_t)num);
-            bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
+            if (num>0) jsvAppendStringBuf(receiveData, buf, (size_t)num);
             if (!hadHeaders && httpParseHeaders(&receiveData, connection, true)) {
               hadHeaders = true;
               jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
+              // the response needs to know if it can keep the connection open
+              if (jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_KEEPALIVE, 0)))
+                jsvObjectSetChildAndUnLock(socket, HTTP_NAME_KEEPALIVE, jsvNewFromBool(true));
               JsVar *server = jsvObjectGetChild(connection,HTTP_NAME_SERVER_VAR,0);
               JsVar *args[2] = { connection, socket };
               jsiQueueObjectCallbacks(server, HTTP_NAME_ON_CONNECT, args, ((socketType&ST_TYPE_MASK)==ST_HTTP) ? 2 : 1);
               jsvUnLock(server);
             }
             if (hadHeaders && !jsvIsEmptyString(receiveData)) {
+              bool keepAlive = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_KEEPALIVE, 0));
+              if (keepAlive)
+                serverSplitRequestBody(connection, &receiveData);
               // execute 'data' callback or save data
-              if (jswrap_stream_pushData(connection, receiveData, false)) {
+              if (jsvIsEmptyString(receiveData) ||
+                  jswrap_stream_pushData(connection, receiveData, false)) {
+                if (keepAlive) { // count down the body
+                  JsVarInt remaining = jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CONTENT_LENGTH, 0));
+                  jsvObjectSetChildAndUnLock(connection, HTTP_NAME_CONTENT_LENGTH, jsvNewFromInteger(remaining - (JsVarInt)jsvGetStringLength(receiveData)));
+                }
                 // clear received data
                 jsvUnLock(receiveData);
                 receiveData = 0;
@@ -318,9 +608,9 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
             // if received data changed, update it
             if (receiveData != oldReceiveData)
               jsvObjectSetChild(connection,HTTP_NAME_RECEIVE_DATA,receiveData);
-            jsvUnLock(receiveData);
           }
         }
+        jsvUnLock(receiveData);
       }
 
       // send data if possible
@@ -331,10 +621,36 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
         jsvObjectSetChild(socket, HTTP_NAME_SEND_DATA, sendData); // socketSendData prob updated sendData
       }
       // only close if we want to close, have no data to send, and aren't receiving data
-      if (jsvGetBoolAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_CLOSE,0)) && !sendData && num<=0)
-        closeConnectionNow = true;
+      if (jsvGetBoolAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_CLOSE,0)) && !sendData && num<=0) {
+        if (jsvGetBoolAndUnLock(jsvObjectGetChild(socket, HTTP_NAME_KEEPALIVE, 0))) {
+          // keep-alive - once the whole request body has arrived, get ready for the next request
+          JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
+          if (jsvIsEmptyString(receiveData) &&
+              jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CONTENT_LENGTH, 0))<=0)
+            reuseConnection = true;
+          jsvUnLock(receiveData);
+        } else
+          closeConnectionNow = true;
+      }
       jsvUnLock(sendData);
     }
+    if (reuseConnection) {
+      jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CLOSE, &connection, 1);
+      jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_CLOSE, &socket, 1);
+      // the socket now belongs to a new request, which gets anything pipelined behind this one
+      JsVar *server = jsvObjectGetChild(connection,HTTP_NAME_SERVER_VAR,0);
+      JsVar *nextRequest = serverNewRequest(server, sckt);
+      if (nextRequest) {
+        jsvObjectSetChildAndUnLock(nextRequest, HTTP_NAME_RECEIVE_DATA, jsvObjectGetChild(connection, HTTP_NAME_NEXT_DATA, 0));
+        jsvObjectSetChild(connection, HTTP_NAME_SOCKET, 0);
+      }
+      jsvUnLock2(nextRequest, server);
+      _socketConnectionKill(net, connection); // only if we couldn't make a new request
+      JsVar *connectionName = jsvObjectIteratorGetKey(&it);
+      jsvObjectIteratorNext(&it);
+      jsvRemoveChild(arr, connectionName);
+      jsvUnLock(connectionName);
+    } else
     if (closeConnectionNow) {
       // send out any data that we were POSTed
       JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
@@ -364,6 +680,17 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
 }
 
 
+/// Can this HTTP client request's socket be used again? (keep-alive agreed, and whole response received)
+static bool httpClientCanReuse(JsVar *connection, JsVar *resVar) {
+  if (!jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_KEEPALIVE, 0)) ||
+      !jsvGetBoolAndUnLock(jsvObjectGetChild(resVar, HTTP_NAME_KEEPALIVE, 0)))
+    return false;
+  JsVar *contentLength = jsvObjectGetChild(resVar, HTTP_NAME_CONTENT_LENGTH, 0);
+  bool done = contentLength && jsvGetInteger(contentLength)<=0;
+  jsvUnLock(contentLength);
+  return done;
+}
+
 void socketClientPushReceiveData(JsVar *connection, JsVar *socket, JsVar **receiveData) {
   if (*receiveData) {
     if (jsvIsEmptyString(*receiveData) ||
@@ -399,6 +726,11 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
     bool errored = false;
     bool closeConnectionNow = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSENOW, false));
     int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+    if (sckt<0 && !closeConnectionNow &&
+        jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_DNS_WAIT, 0))) {
+      // see if the host name has been resolved yet, and connect if so
+      clientRequestConnect(net, connection);
+    }
     if (sckt>=0) {
       if ((socketType&ST_TYPE_MASK)==ST_HTTP)
         hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
@@ -443,15 +775,28 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
               }
               if (receiveData) { // could be out of memory
                 jsvAppendStringBuf(receiveData, buf, (size_t)num);
-                if ((socketType&ST_TYPE_MASK)==ST_HTTP && !hadHeaders) {
-                  JsVar *resVar = jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0);
-                  if (httpParseHeaders(&receiveData, resVar, false)) {
-                    hadHeaders = true;
-                    jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
-                    jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &resVar, 1);
+                if ((socketType&ST_TYPE_MASK)==ST_HTTP) {
+                  JsVarInt bodyBytes = num;
+                  if (!hadHeaders) {
+                    bodyBytes = -1;
+                    if (httpParseHeaders(&receiveData, socket, false)) {
+                      hadHeaders = true;
+                      bodyBytes = (JsVarInt)jsvGetStringLength(receiveData);
+                      jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
+                      jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &socket, 1);
+                    }
+                    jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
+                  }
+                  // Count down the response body, and once it's all here we're done
+                  JsVar *contentLength = (bodyBytes>=0) ? jsvObjectGetChild(socket, HTTP_NAME_CONTENT_LENGTH, 0) : 0;
+                  if (contentLength) {
+                    JsVarInt remaining = jsvGetInteger(contentLength) - bodyBytes;
+                    jsvObjectSetChildAndUnLock(socket, HTTP_NAME_CONTENT_LENGTH, jsvNewFromInteger(remaining));
+                    // close (into the pool) next time around, after the callbacks have had the data
+                    if (remaining<=0 && httpClientCanReuse(connection, socket))
+                      jsvObjectSetChildAndUnLock(connection, HTTP_NAME_CLOSENOW, jsvNewFromBool(true));
+                    jsvUnLock(contentLength);
                   }
-                  jsvUnLock(resVar);
-                  jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
                 }
               }
             }
@@ -473,6 +818,9 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
         if (sendData) errored = true;
         jsvUnLock(sendData);
 
+        // If the whole response arrived on a keep-alive connection, keep the socket for next time
+        if (!errored && sckt>=0 && (socketType&ST_TYPE_MASK)==ST_HTTP && httpClientCanReuse(connection, socket))
+          socketPoolAdd(net, connection);
         _socketConnectionKill(net, connection);
         JsVar *connectionName = jsvObjectIteratorGetKey(&it);
         jsvObjectIteratorNext(&it);
@@ -520,23 +868,7 @@ bool socketIdle(JsNetwork *net) {
       if (theClient >= 0) {
         SocketType socketType = socketGetType(server);
         if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
-          JsVar *req = jspNewObject(0, "httpSRq");
-          JsVar *res = jspNewObject(0, "httpSRs");
-          if (res && req) { // out of memory?
-            socketSetType(req, ST_HTTP);
-            JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS, true);
-            if (arr) {
-              jsvArrayPush(arr, req);
-              jsvUnLock(arr);
-            }
-            jsvObjectSetChild(req, HTTP_NAME_RESPONSE_VAR, res);
-            jsvObjectSetChild(req, HTTP_NAME_SERVER_VAR, server);
-            jsvObjectSetChildAndUnLock(req, HTTP_NAME_SOCKET, jsvNewFromInteger(theClient+1));
-            // on response
-            jsvObjectSetChildAndUnLock(res, HTTP_NAME_CODE, jsvNewFromInteger(200));
-            jsvObjectSetChildAndUnLock(res, HTTP_NAME_HEADERS, jsvNewWithFlags(JSV_OBJECT));
-          }
-          jsvUnLock2(req, res);
+          jsvUnLock(serverNewRequest(server, theClient));
         } else {
           // Normal sockets
           JsVar *sock = jspNewObject(0, "Socket");
@@ -563,6 +895,7 @@ bool socketIdle(JsNetwork *net) {
 
   if (socketServerConnectionsIdle(net)) hadSockets = true;
   if (socketClientConnectionsIdle(net)) hadSockets = true;
+  socketPoolIdle(net);
   netCheckError(net);
   return hadSockets;
 }
@@ -609,6 +942,24 @@ void serverClose(JsNetwork *net, JsVar *server) {
       jsWarn("Server not found!");
     jsvUnLock(arr);
   }
+  // close connections that are just being kept alive, waiting for another request
+  arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS,false);
+  if (arr) {
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, arr);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *connection = jsvObjectIteratorGetValue(&it);
+      JsVar *connectionServer = jsvObjectGetChild(connection, HTTP_NAME_SERVER_VAR, 0);
+      JsVar *receiveData = jsvObjectGetChild(connection, HTTP_NAME_RECEIVE_DATA, 0);
+      if (connectionServer==server && jsvIsEmptyString(receiveData) &&
+          !jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_HAD_HEADERS, 0)))
+        jsvObjectSetChildAndUnLock(connection, HTTP_NAME_CLOSENOW, jsvNewFromBool(true));
+      jsvUnLock3(receiveData, connectionServer, connection);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+    jsvUnLock(arr);
+  }
 }
 
 
@@ -636,7 +987,8 @@ JsVar *clientRequestNew(SocketType socketType, JsVar *options, JsVar *callback)
   return req;
 }
 
-void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
+/// Write either 'data', or if that is 0, 'len' bytes of 'buf'
+static bool clientRequestWriteInternal(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data, const char *buf, size_t len) {
   SocketType socketType = socketGetType(httpClientReqVar);
   // Append data to sendData
   JsVar *sendData = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, 0);
@@ -650,8 +1002,11 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
       // We're an HTTP client - make a header
       JsVar *method = jsvObjectGetChild(options, "method", 0);
       JsVar *path = jsvObjectGetChild(options, "path", 0);
-      sendData = jsvVarPrintf("%v %v HTTP/1.0\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: close\r\n", method, path);
+      bool keepAlive = jsvGetBoolAndUnLock(jsvObjectGetChild(options, "keepAlive", 0));
+      sendData = jsvVarPrintf("%v %v HTTP/1.0\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: %s\r\n", method, path, keepAlive?"keep-alive":"close");
       jsvUnLock2(method, path);
+      if (keepAlive)
+        jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_KEEPALIVE, jsvNewFromBool(true));
       JsVar *headers = jsvObjectGetChild(options, "headers", 0);
       bool hasHostHeader = false;
       if (jsvIsObject(headers)) {
@@ -684,26 +1039,37 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
     jsvUnLock(options);
   }
   // We have data and aren't out of memory...
-  if (data && sendData) {
+  if ((data || buf) && sendData) {
     // append the data to what we want to send
-    JsVar *s = jsvAsString(data, false);
-    if (s) {
-      if ((socketType&ST_TYPE_MASK) == ST_HTTP &&
-          jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_CHUNKED, 0))) {
-        // If we asked to send 'chunked' data, we need to wrap it up,
-        // prefixed with the length
-        jsvAppendPrintf(sendData, "%x\r\n%v\r\n", jsvGetStringLength(s), s);
-      } else {
-        jsvAppendStringVarComplete(sendData,s);
-      }
+    JsVar *s = data ? jsvAsString(data, false) : 0;
+    if (s) len = jsvGetStringLength(s);
+    if (s || buf) {
+      // If we asked to send 'chunked' data, we need to wrap it up,
+      // prefixed with the length
+      bool chunked = (socketType&ST_TYPE_MASK) == ST_HTTP &&
+          jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_CHUNKED, 0));
+      if (chunked) jsvAppendPrintf(sendData, "%x\r\n", (int)len);
+      if (s) jsvAppendStringVarComplete(sendData,s);
+      else jsvAppendStringBuf(sendData, buf, len);
+      if (chunked) jsvAppendString(sendData, "\r\n");
       jsvUnLock(s);
     }
   }
+  bool canWrite = socketQueuedSendData(httpClientReqVar, sendData);
   jsvUnLock(sendData);
   if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
     // on HTTP we connect after the first write
     clientRequestConnect(net, httpClientReqVar);
   }
+  return canWrite;
+}
+
+bool clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
+  return clientRequestWriteInternal(net, httpClientReqVar, data, 0, 0);
+}
+
+bool clientRequestWriteBytes(JsNetwork *net, JsVar *httpClientReqVar, const char *buf, size_t len) {
+  return clientRequestWriteInternal(net, httpClientReqVar, 0, buf, len);
 }
 
 // Connect this connection/socket
@@ -718,16 +1084,31 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
   unsigned short port = (unsigned short)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0));
 
   char hostName[128];
-  JsVar *hostNameVar = jsvObjectGetChild(options, "host", 0);
-  if (jsvIsUndefined(hostNameVar))
-    strncpy(hostName, "localhost", sizeof(hostName));
-  else
-    jsvGetString(hostNameVar, hostName, sizeof(hostName));
-  jsvUnLock(hostNameVar);
+  clientRequestGetHost(options, hostName, sizeof(hostName));
+
+  // Is there an idle keep-alive connection we can use?
+  if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_KEEPALIVE, 0))) {
+    int sckt = socketPoolGet(hostName, port, socketType);
+    if (sckt>=0) {
+      jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+      if ((socketType&ST_TYPE_MASK) != ST_HTTP)
+        jsiQueueObjectCallbacks(httpClientReqVar, HTTP_NAME_ON_CONNECT, &httpClientReqVar, 1);
+      jsvUnLock(options);
+      return;
+    }
+  }
 
   uint32_t host_addr = 0;
   networkGetHostByName(net, hostName, &host_addr);
 
+  if (host_addr==0xFFFFFFFF) {
+    // The lookup is still happening - the idle loop will call us again
+    jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_DNS_WAIT, jsvNewFromBool(true));
+    jsvUnLock(options);
+    return;
+  }
+  jsvObjectSetChild(httpClientReqVar, HTTP_NAME_DNS_WAIT, 0);
+
   if(!host_addr) {
     jsError("Unable to locate host\n");
     // As this is already in the list of connections, an error will be thrown on idle anyway
@@ -812,7 +1193,8 @@ void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar
 }
 
 
-void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
+/// Write either 'data', or if that is undefined, 'len' bytes of 'buf' (if 'buf' is set)
+static bool serverResponseWriteInternal(JsVar *httpServerResponseVar, JsVar *data, const char *buf, size_t len) {
   // Append data to sendData
   JsVar *sendData = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, 0);
   if (!sendData) {
@@ -821,11 +1203,23 @@ void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
     if (sendHeaders) {
       sendData = jsvVarPrintf("HTTP/1.0 %d OK\r\nServer: Espruino "JS_VERSION"\r\n", jsvGetIntegerAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CODE, 0)));
       httpAppendHeaders(sendData, sendHeaders);
+      /* We can only keep the connection open if the client asked for it, and
+       * it can tell where the response ends without us closing it */
+      if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_KEEPALIVE, 0))) {
+        JsVar *connectionHeader = httpGetHeader(sendHeaders, "connection");
+        bool keepAlive = httpHasHeader(sendHeaders, "content-length") &&
+                         (!connectionHeader || httpIsHeaderName(connectionHeader, "keep-alive"));
+        if (keepAlive && !connectionHeader)
+          jsvAppendString(sendData, "Connection: keep-alive\r\n");
+        if (!keepAlive)
+          jsvObjectSetChild(httpServerResponseVar, HTTP_NAME_KEEPALIVE, 0);
+        jsvUnLock(connectionHeader);
+      }
       jsvObjectSetChild(httpServerResponseVar, HTTP_NAME_HEADERS, 0);
       jsvUnLock(sendHeaders);
       // finally add ending newline
       jsvAppendString(sendData, "\r\n");
-    } else if (!jsvIsUndefined(data)) {
+    } else if (!jsvIsUndefined(data) || buf) {
       // we have already sent headers, but want to send more
       sendData = jsvNewFromEmptyString();
     }
@@ -835,8 +1229,20 @@ void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
     JsVar *s = jsvAsString(data, false);
     if (s) jsvAppendStringVarComplete(sendData,s);
     jsvUnLock(s);
+  } else if (sendData && buf) {
+    jsvAppendStringBuf(sendData, buf, len);
   }
+  bool canWrite = socketQueuedSendData(httpServerResponseVar, sendData);
   jsvUnLock(sendData);
+  return canWrite;
+}
+
+bool serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
+  return serverResponseWriteInternal(httpServerResponseVar, data, 0, 0);
+}
+
+bool serverResponseWriteBytes(JsVar *httpServerResponseVar, const char *buf, size_t len) {
+  return serverResponseWriteInternal(httpServerResponseVar, 0, buf, len);
 }
 
 void serverResponseEnd(JsVar *httpServerResponseVar) {
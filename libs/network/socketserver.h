@@ -41,12 +41,14 @@ void serverListen(JsNetwork *net, JsVar *httpServerVar, int port);
 void serverClose(JsNetwork *net, JsVar *server);
 
 JsVar *clientRequestNew(SocketType socketType, JsVar *options, JsVar *callback);
-void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data);
+bool clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data);
+bool clientRequestWriteBytes(JsNetwork *net, JsVar *httpClientReqVar, const char *buf, size_t len); ///< write from memory without making a JsVar first
 void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar);
 void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar);
 
 void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar *headers);
-void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data);
+bool serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data);
+bool serverResponseWriteBytes(JsVar *httpServerResponseVar, const char *buf, size_t len); ///< write from memory without making a JsVar first
 void serverResponseEnd(JsVar *httpServerResponseVar);
 
 #endif // SOCKETSERVER_H
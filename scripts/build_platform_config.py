@@ -296,7 +296,7 @@ codeOut("");
 if LINUX:
   bufferSizeIO = 256
   bufferSizeTX = 256
-  bufferSizeTimer = 16
+  bufferSizeTimer = 256
 else:
   bufferSizeIO = 64 if board.chip["ram"]<20 else 128
   bufferSizeTX = 32 if board.chip["ram"]<20 else 128
@@ -307,7 +307,7 @@ if 'util_timer_tasks' in board.info:
 
 codeOut("#define IOBUFFERMASK "+str(bufferSizeIO-1)+" // (max 255) amount of items in event buffer - events take ~9 bytes each")
 codeOut("#define TXBUFFERMASK "+str(bufferSizeTX-1)+" // (max 255)")
-codeOut("#define UTILTIMERTASK_TASKS ("+str(bufferSizeTimer)+") // Must be power of 2 - and max 256")
+codeOut("#define UTILTIMERTASK_TASKS ("+str(bufferSizeTimer)+") // max 256")
 
 codeOut("");
 
@@ -308,6 +308,9 @@ def get_ifdef_description(d):
   if d=="RELEASE": return "release builds"
   if d=="LINUX": return "Linux-based builds"
   if d=="USE_USB_HID": return "devices that support USB HID (Espruino Espruino Pico)"
+  if d=="USE_PROFILER": return "builds with the profiler compiled in (Linux by default)"
+  if d=="USE_PROFILER_SAMPLING": return "Linux builds with the profiler compiled in"
+  if d=="USE_PROFILER_ALLOC_TRACE": return "Linux builds with the profiler compiled in"
   print("WARNING: Unknown ifdef '"+d+"' in common.get_ifdef_description")
   return d
 
@@ -398,15 +398,25 @@ unsigned int jshGetRandomNumber();
 #define WAIT_UNTIL_N_CYCLES 2000000
 #elif defined(STM32F4)
 #define WAIT_UNTIL_N_CYCLES 5000000
+#elif defined(LINUX)
+#define WAIT_UNTIL_N_CYCLES 200000
 #else
 #define WAIT_UNTIL_N_CYCLES 2000000
 #endif
 
+/* On Linux we're normally waiting for another thread (eg. the utility timer)
+ * so give it time to run rather than spinning - this makes the wait >2s */
+#ifdef LINUX
+#define WAIT_UNTIL_DELAY() jshDelayMicroseconds(10)
+#else
+#define WAIT_UNTIL_DELAY()
+#endif
+
 /** Wait for the condition to become true, checking a certain amount of times
  * (or until interrupted by Ctrl-C) before leaving and writing a message. */
 #define WAIT_UNTIL(CONDITION, REASON) { \
     int timeout = WAIT_UNTIL_N_CYCLES;                                              \
-    while (!(CONDITION) && !jspIsInterrupted() && (timeout--)>0);                  \
+    while (!(CONDITION) && !jspIsInterrupted() && (timeout--)>0) WAIT_UNTIL_DELAY(); \
     if (timeout<=0 || jspIsInterrupted()) { jsExceptionHere(JSET_INTERNALERROR, "Timeout on "REASON); }  \
 }
 
@@ -30,6 +30,9 @@
 #endif
 
 #define CTRL_C_TIME_FOR_BREAK jshGetTimeFromMilliseconds(100)
+#define DEFRAG_FRAGMENTATION_THRESHOLD 50 // % of free memory not in the largest free block before we defragment when idle
+#define DEFRAG_HYSTERESIS 10 // % fragmentation must rise above what the last idle defrag left before we try again
+#define DEFRAG_MIN_FREE_VARS 32 // with fewer free variables than this, fragmentation doesn't mean much
 
 #ifdef ESP8266
 extern void jshPrintBanner(void); // prints a debugging banner while we're in beta
@@ -45,7 +48,28 @@ typedef enum {
   IS_HAD_27_91_NUMBER, ///< Esc [ then 0-9
 } PACKED_FLAGS InputState;
 
-JsVar *events = 0; // Array of events to execute
+/** Events waiting to be executed. Most go in eventRing, but if that is full
+ * (or an event doesn't fit in it) they go in 'events' - and so do all
+ * events after that until it's empty, so they still execute in order. */
+#ifdef LINUX
+#define JSI_EVENT_RING_SIZE 64 ///< Must be a power of 2
+#else
+#define JSI_EVENT_RING_SIZE 8 ///< Must be a power of 2
+#endif
+#define JSI_EVENT_ARGS 4 ///< Arguments that can be stored in a JsiEvent
+#define JSI_EVENT_MAX_LOCKS 8 ///< Don't put a variable in the ring if it has this many locks already
+typedef struct {
+  JsVar *func; ///< All of these are locked while the event is in the ring
+  JsVar *thisVar;
+  JsVar *args[JSI_EVENT_ARGS];
+  unsigned char argCount;
+} JsiEvent;
+static JsiEvent eventRing[JSI_EVENT_RING_SIZE];
+static unsigned int eventRingHead = 0; ///< where the next event goes
+static unsigned int eventRingTail = 0; ///< the next event to execute
+/// Fragmentation left behind by the last idle defrag - locked variables can stop it getting any lower
+static unsigned int defragResidual = 0;
+JsVar *events = 0; // Array of events to execute that didn't fit in eventRing
 JsVarRef timerArray = 0; // Linked List of timers to check and run
 JsVarRef watchArray = 0; // Linked List of input watches to check and run
 // ----------------------------------------------------------------------------
@@ -675,6 +699,13 @@ void jsiSoftKill() {
   // Stop all active timer tasks
   jstReset();
   // Unref Watches/etc
+  while (eventRingTail != eventRingHead) {
+    JsiEvent *event = &eventRing[eventRingTail];
+    jsvUnLockMany(event->argCount, event->args);
+    jsvUnLock2(event->func, event->thisVar);
+    eventRingTail = (eventRingTail+1) & (JSI_EVENT_RING_SIZE-1);
+  }
+  eventRingHead = eventRingTail = 0;
   if (events) {
     jsvUnLock(events);
     events=0;
@@ -766,6 +797,7 @@ void jsiInit(bool autoLoad) {
 #else
   consoleDevice = EV_LIMBO;
 #endif
+  loopsIdling = 0;
 
 #ifndef RELEASE
   jsnSanityTest();
@@ -1424,9 +1456,35 @@ void jsiHandleChar(char ch) {
   }
 }
 
+/// Can this variable be kept (locked) in eventRing?
+static bool jsiCanLockForEvent(JsVar *v) {
+  return !v || jsvGetLocks(v) < JSI_EVENT_MAX_LOCKS;
+}
+
+/// Are there any events waiting to be executed?
+static bool jsiHasEvents() {
+  return eventRingHead!=eventRingTail || (events && !jsvArrayIsEmpty(events));
+}
+
 /// Queue a function, string, or array (of funcs/strings) to be executed next time around the idle loop
 void jsiQueueEvents(JsVar *object, JsVar *callback, JsVar **args, int argCount) { // an array of functions, a string, or a single function
-  assert(argCount<10);
+  unsigned int nextHead = (eventRingHead+1) & (JSI_EVENT_RING_SIZE-1);
+  bool useRing = nextHead!=eventRingTail && argCount<=JSI_EVENT_ARGS &&
+                 (!events || jsvArrayIsEmpty(events)) && // keep events in order
+                 jsiCanLockForEvent(object) && jsiCanLockForEvent(callback);
+  int i;
+  for (i=0;useRing && i<argCount;i++)
+    useRing = jsiCanLockForEvent(args[i]);
+  if (useRing) {
+    JsiEvent *event = &eventRing[eventRingHead];
+    event->func = jsvLockAgainSafe(callback);
+    event->thisVar = jsvLockAgainSafe(object);
+    for (i=0;i<argCount;i++)
+      event->args[i] = jsvLockAgainSafe(args[i]);
+    event->argCount = (unsigned char)argCount;
+    eventRingHead = nextHead;
+    return;
+  }
 
   JsVar *event = jsvNewWithFlags(JSV_OBJECT);
   if (event) { // Could be out of memory error!
@@ -1444,31 +1502,46 @@ void jsiQueueEvents(JsVar *object, JsVar *callback, JsVar **args, int argCount)
   }
 }
 
+/// Get the listeners for callbackName (JS_EVENT_PREFIX+event name) on the object
+static JsVar *jsiGetObjectCallbacks(JsVar *object, const char *callbackName) {
+  if (!object) return 0;
+  return jsvSkipNameAndUnLock(jsvFindEventListenersFromString(object, callbackName));
+}
+
 bool jsiObjectHasCallbacks(JsVar *object, const char *callbackName) {
-  JsVar *callback = jsvObjectGetChild(object, callbackName, 0);
+  JsVar *callback = jsiGetObjectCallbacks(object, callbackName);
   bool hasCallbacks = !jsvIsUndefined(callback);
   jsvUnLock(callback);
   return hasCallbacks;
 }
 
 void jsiQueueObjectCallbacks(JsVar *object, const char *callbackName, JsVar **args, int argCount) {
-  JsVar *callback = jsvObjectGetChild(object, callbackName, 0);
+  JsVar *callback = jsiGetObjectCallbacks(object, callbackName);
   if (!callback) return;
   jsiQueueEvents(object, callback, args, argCount);
   jsvUnLock(callback);
 }
 
 void jsiExecuteObjectCallbacks(JsVar *object, const char *callbackName, JsVar **args, int argCount) {
-  JsVar *callback = jsvObjectGetChild(object, callbackName, 0);
+  JsVar *callback = jsiGetObjectCallbacks(object, callbackName);
   if (!callback) return;
   jsiExecuteEventCallback(object, callback, (unsigned int)argCount, args);
   jsvUnLock(callback);
 }
 
 void jsiExecuteEvents() {
-  bool hasEvents = !jsvArrayIsEmpty(events);
+  bool hasEvents = jsiHasEvents();
   if (hasEvents) jsiSetBusy(BUSY_INTERACTIVE, true);
-  while (!jsvArrayIsEmpty(events)) {
+  while (jsiHasEvents()) {
+    // events in the ring are always older than ones in 'events'
+    if (eventRingHead!=eventRingTail) {
+      JsiEvent event = eventRing[eventRingTail];
+      eventRingTail = (eventRingTail+1) & (JSI_EVENT_RING_SIZE-1);
+      jsiExecuteEventCallback(event.thisVar, event.func, event.argCount, event.args);
+      jsvUnLockMany(event.argCount, event.args);
+      jsvUnLock2(event.func, event.thisVar);
+      continue;
+    }
     JsVar *event = jsvSkipNameAndUnLock(jsvArrayPopFirst(events));
     // Get function to execute
     JsVar *func = jsvObjectGetChild(event, "func", 0);
@@ -1889,7 +1962,7 @@ void jsiIdle() {
   if (jswIdle()) wasBusy = true;
 
   // Just in case we got any events to do and didn't clear loopsIdling before
-  if (wasBusy || !jsvArrayIsEmpty(events) )
+  if (wasBusy || jsiHasEvents())
     loopsIdling = 0;
 
   if (wasBusy)
@@ -1953,6 +2026,17 @@ void jsiIdle() {
       minTimeUntilNext > jshGetTimeFromMilliseconds(10)) {
     jsiSetBusy(BUSY_INTERACTIVE, true);
     jsvGarbageCollect();
+    // If free memory is split up, flat strings (and so big ArrayBuffers) can't be allocated
+    unsigned int fragmentation = 0;
+    if (jsvGetMemoryTotal()-jsvGetMemoryUsage() >= DEFRAG_MIN_FREE_VARS)
+      fragmentation = jsvGetMemoryFragmentation();
+    if (fragmentation <= DEFRAG_FRAGMENTATION_THRESHOLD) {
+      defragResidual = 0;
+    } else if (fragmentation > defragResidual+DEFRAG_HYSTERESIS) {
+      // if the last defrag couldn't get below the threshold, only try again when things get worse
+      jsvDefragment();
+      defragResidual = jsvGetMemoryFragmentation();
+    }
     jsiSetBusy(BUSY_INTERACTIVE, false);
   }
 
@@ -12,6 +12,7 @@
  * ----------------------------------------------------------------------------
  */
 #include "jslex.h"
+#include "jsprofiler.h"
 
 void jslCharPosFree(JslCharPos *pos) {
   jsvStringIteratorFree(&pos->it);
@@ -201,6 +202,11 @@ static ALWAYS_INLINE void jslSingleChar(JsLex *lex) {
 }
 
 void jslGetNextToken(JsLex *lex) {
+  JSPR_SUBSYSTEM(JSPS_LEX);
+  JSPR_CHECK_SAMPLE();
+#ifdef LINUX
+  jsStats.tokens++;
+#endif
   jslGetNextToken_start:
   // Skip whitespace
   while (isWhitespace(lex->currCh))
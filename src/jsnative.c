@@ -15,6 +15,7 @@
 #include "jsnative.h"
 #include "jshardware.h"
 #include "jsinteractive.h"
+#include "jsprofiler.h"
 
 // none of this is used at the moment
 
@@ -43,6 +44,7 @@
 
 /** Call a function with the given argument specifiers */
 JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar *thisParam, JsVar **paramData, int paramCount) {
+  JSPR_SUBSYSTEM(JSPS_NATIVE);
   JsnArgumentType returnType = (JsnArgumentType)(argumentSpecifier&JSWAT_MASK);
   JsVar *argsArray = 0; // if JSWAT_ARGUMENT_ARRAY is ever used (note it'll only ever be used once)
   int paramNumber = 0; // how many parameters we have
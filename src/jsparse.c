@@ -18,6 +18,7 @@
 #include "jswrap_object.h" // for function_replacewith
 #include "jswrap_functions.h" // insane check for eval in jspeFunctionCall
 #include "jswrap_json.h" // for jsfPrintJSON
+#include "jsprofiler.h"
 
 /* Info about execution when Parsing - this saves passing it on the stack
  * for each call */
@@ -144,6 +145,7 @@ void jspeiRemoveScope() {
 }
 
 JsVar *jspeiFindInScopes(const char *name) {
+  JSPR_SUBSYSTEM(JSPS_SCOPE);
   int i;
   for (i=execInfo.scopeCount-1;i>=0;i--) {
     JsVar *ref = jsvFindChildFromString(execInfo.scopes[i], name, false);
@@ -568,7 +570,13 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
 
       if (nativePtr) {
+#ifdef USE_PROFILER_ALLOC_TRACE
+        JsProfileNative profileNative = jsprNativeStart(nativePtr, functionName);
+#endif
         returnVar = jsnCallFunction(nativePtr, function->varData.native.argTypes, thisVar, argPtr, argCount);
+#ifdef USE_PROFILER_ALLOC_TRACE
+        jsprNativeEnd(&profileNative);
+#endif
       } else {
         assert(0); // in case something went horribly wrong
         returnVar = 0;
@@ -756,6 +764,11 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
             oldLex = execInfo.lex;
             execInfo.lex = &newLex;
+#ifdef USE_PROFILER
+            /* Only after execInfo.lex has changed - jslInit lexes a token,
+             * which may take a sample of where the *caller* is */
+            JsProfileCall profileCall = jsprFunctionStart(function, functionCode, functionName);
+#endif
             JSP_SAVE_EXECUTE();
             // force execute without any previous state
 #ifdef USE_DEBUGGER
@@ -806,6 +819,9 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
             jslKill(&newLex);
             execInfo.lex = oldLex;
+#ifdef USE_PROFILER
+            jsprFunctionEnd(&profileCall);
+#endif
 
             if (hasError) {
               execInfo.execute |= hasError; // propogate error
@@ -1378,14 +1394,17 @@ NO_INLINE JsVar *__jspePostfixExpression(JsVar *a) {
     int op = execInfo.lex->tk;
     JSP_ASSERT_MATCH(op);
     if (JSP_SHOULD_EXECUTE) {
-      JsVar *one = jsvNewFromInteger(1);
-      JsVar *oldValue = jsvAsNumberAndUnLock(jsvSkipName(a)); // keep the old value (but convert to number)
-      JsVar *res = jsvMathsOpSkipNames(oldValue, one, op==LEX_PLUSPLUS ? '+' : '-');
+      JsVar *one = jsvNewSharedFromLongInteger(1);
+      JsVar *oldValue = 0;
+      // try and modify the number directly, which doesn't need any allocation
+      if (!jsvMathsOpInPlace(a, one, op==LEX_PLUSPLUS ? '+' : '-', &oldValue)) {
+        oldValue = jsvAsNumberAndUnLock(jsvSkipName(a)); // keep the old value (but convert to number)
+        JsVar *res = jsvMathsOpSkipNames(oldValue, one, op==LEX_PLUSPLUS ? '+' : '-');
+        // in-place add/subtract
+        jspReplaceWith(a, res);
+        jsvUnLock(res);
+      }
       jsvUnLock(one);
-
-      // in-place add/subtract
-      jspReplaceWith(a, res);
-      jsvUnLock(res);
       // but then use the old value
       jsvUnLock(a);
       a = oldValue;
@@ -1402,12 +1421,14 @@ NO_INLINE JsVar *jspePostfixExpression() {
     JSP_ASSERT_MATCH(op);
     a = jspePostfixExpression();
     if (JSP_SHOULD_EXECUTE) {
-      JsVar *one = jsvNewFromInteger(1);
-      JsVar *res = jsvMathsOpSkipNames(a, one, op==LEX_PLUSPLUS ? '+' : '-');
+      JsVar *one = jsvNewSharedFromLongInteger(1);
+      if (!jsvMathsOpInPlace(a, one, op==LEX_PLUSPLUS ? '+' : '-', 0)) {
+        JsVar *res = jsvMathsOpSkipNames(a, one, op==LEX_PLUSPLUS ? '+' : '-');
+        // in-place add/subtract
+        jspReplaceWith(a, res);
+        jsvUnLock(res);
+      }
       jsvUnLock(one);
-      // in-place add/subtract
-      jspReplaceWith(a, res);
-      jsvUnLock(res);
     }
   } else
     a = jspeFactorFunctionCall();
@@ -1637,7 +1658,10 @@ NO_INLINE JsVar *__jspeAssignmentExpression(JsVar *lhs) {
         else if (op==LEX_RSHIFTEQUAL) op=LEX_RSHIFT;
         else if (op==LEX_LSHIFTEQUAL) op=LEX_LSHIFT;
         else if (op==LEX_RSHIFTUNSIGNEDEQUAL) op=LEX_RSHIFTUNSIGNED;
-        if (op=='+' && jsvIsName(lhs)) {
+        if (jsvMathsOpInPlace(lhs, rhs, op, 0)) {
+          // a number we could just modify directly
+          op = 0;
+        } else if (op=='+' && jsvIsName(lhs)) {
           JsVar *currentValue = jsvSkipName(lhs);
           if (jsvIsString(currentValue) && !jsvIsFlatString(currentValue) && jsvGetRefs(currentValue)==1) {
             /* A special case for string += where this is the only use of the string,
@@ -2439,9 +2463,14 @@ void jspSoftInit() {
   // Root now has a lock and a ref
   execInfo.hiddenRoot = jsvObjectGetChild(execInfo.root, JS_HIDDEN_CHAR_STR, JSV_OBJECT);
   execInfo.execute = EXEC_YES;
+  jsvInitSharedValues();
 }
 
 void jspSoftKill() {
+#ifdef USE_PROFILER
+  jsprKill(); // release the functions it was keeping
+#endif
+  jsvKillSharedValues();
   jsvUnLock(execInfo.hiddenRoot);
   execInfo.hiddenRoot = 0;
   jsvUnLock(execInfo.root);
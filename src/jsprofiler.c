@@ -0,0 +1,1017 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Optional interpreter profiler (compiled in with USE_PROFILER)
+ * ----------------------------------------------------------------------------
+ */
+#include "jsprofiler.h"
+#include "jsparse.h"
+#include "jshardware.h"
+#ifdef LINUX
+#include <time.h>
+#endif
+#ifdef USE_PROFILER_SAMPLING
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#define JSPR_MAX_FUNCTIONS 64 ///< after this, calls are counted as '(other)'
+#define JSPR_MAX_NODES 256 ///< distinct call stacks we keep time for
+#define JSPR_MAX_DEPTH 64 ///< calls deeper than this are only counted
+#define JSPR_NAME_LEN 16
+#define JSPR_NONE 0xFFFF
+
+typedef struct {
+  JsVarRef code; ///< The function's code - this is what we look functions up by. Not locked, so see jsprVarMoved
+  JsVarRef function; ///< The function itself. We keep it locked so 'code' can't be freed and reused
+  char name[JSPR_NAME_LEN]; ///< The first name the function was called with
+  unsigned int calls;
+  unsigned int active; ///< How many calls are executing right now (it could be recursive)
+  JsProfileTicks start; ///< When the outermost call started
+  JsProfileTicks time; ///< Total time spent in the function, including what it called
+} JsProfileFunction;
+
+/// One of these for each different call stack we've seen - the root is node 0
+typedef struct {
+  uint16_t parent, firstChild, nextSibling;
+  uint16_t function; ///< index in jsprFunctions
+  unsigned int calls;
+  JsProfileTicks time; ///< Total time spent in this node
+  JsProfileTicks childTime; ///< Of which, time spent in nodes below this one
+} JsProfileNode;
+
+typedef struct {
+  uint16_t node, function;
+  JsProfileTicks start;
+} JsProfileFrame;
+
+bool jsprRunning = false;
+static JsProfileTicks jsprStartTicks; ///< When profiling was started
+static JsProfileTicks jsprLastTicks; ///< When we last changed subsystem
+static JsProfileSubsystem jsprCurrent;
+static unsigned int jsprSubsystemCount[JSPS_COUNT];
+static JsProfileTicks jsprSubsystemTime[JSPS_COUNT];
+/// The last entry is for any functions that didn't fit
+static JsProfileFunction jsprFunctions[JSPR_MAX_FUNCTIONS+1];
+static unsigned int jsprFunctionCount;
+static JsProfileNode jsprNodes[JSPR_MAX_NODES];
+static unsigned int jsprNodeCount;
+static JsProfileFrame jsprFrames[JSPR_MAX_DEPTH];
+static int jsprDepth;
+
+static const char *jsprSubsystemNames[JSPS_COUNT] = {
+    "other", "lex", "scope", "alloc", "gc", "native"
+};
+
+static JsProfileTicks jsprGetTicks() {
+#ifdef LINUX
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (JsProfileTicks)ts.tv_sec*1000000000ULL + (JsProfileTicks)ts.tv_nsec;
+#else
+  return (JsProfileTicks)jshGetSystemTime();
+#endif
+}
+
+static JsVarFloat jsprTicksToMs(JsProfileTicks ticks) {
+#ifdef LINUX
+  return (JsVarFloat)ticks / 1000000.0;
+#else
+  return jshGetMillisecondsFromTime((JsSysTime)ticks);
+#endif
+}
+
+/// Charge the time since we last changed subsystem to the current subsystem
+static ALWAYS_INLINE void jsprUpdateSubsystemTime() {
+  JsProfileTicks now = jsprGetTicks();
+  jsprSubsystemTime[jsprCurrent] += now - jsprLastTicks;
+  jsprLastTicks = now;
+}
+
+JsProfileSubsystem jsprSubsystemStartInternal(JsProfileSubsystem s) {
+  jsprUpdateSubsystemTime();
+  jsprSubsystemCount[s]++;
+  JsProfileSubsystem previous = jsprCurrent;
+  jsprCurrent = s;
+  return previous;
+}
+
+void jsprSubsystemEndInternal(JsProfileSubsystem *previous) {
+  if (!jsprRunning) return; // profiling was stopped while we were in here
+  jsprUpdateSubsystemTime();
+  jsprCurrent = *previous;
+}
+
+int jsprFunctionStartInternal(JsVar *function, JsVar *functionCode, JsVar *functionName) {
+  JsVarRef code = jsvGetRef(functionCode);
+  unsigned int f;
+  for (f=0;f<jsprFunctionCount;f++)
+    if (jsprFunctions[f].code == code) break;
+  if (f==jsprFunctionCount) {
+    if (f<JSPR_MAX_FUNCTIONS) {
+      jsprFunctionCount++;
+      jsprFunctions[f].code = code;
+      jsprFunctions[f].function = jsvGetRef(jsvLockAgain(function));
+    } else
+      f = JSPR_MAX_FUNCTIONS;
+  }
+  JsProfileFunction *fn = &jsprFunctions[f];
+  if (!fn->name[0] && f<JSPR_MAX_FUNCTIONS && jsvIsString(functionName))
+    jsvGetString(functionName, fn->name, sizeof(fn->name));
+  fn->calls++;
+  if (jsprDepth >= JSPR_MAX_DEPTH)
+    return ++jsprDepth;
+
+  JsProfileTicks now = jsprGetTicks();
+  if (!fn->active++) fn->start = now;
+  // Find the node for this call stack, or add one
+  uint16_t parent = jsprDepth ? jsprFrames[jsprDepth-1].node : 0;
+  uint16_t node = JSPR_NONE;
+  if (parent!=JSPR_NONE) {
+    node = jsprNodes[parent].firstChild;
+    while (node!=JSPR_NONE && jsprNodes[node].function!=f)
+      node = jsprNodes[node].nextSibling;
+    if (node==JSPR_NONE && jsprNodeCount<JSPR_MAX_NODES) {
+      node = (uint16_t)jsprNodeCount++;
+      jsprNodes[node].parent = parent;
+      jsprNodes[node].firstChild = JSPR_NONE;
+      jsprNodes[node].nextSibling = jsprNodes[parent].firstChild;
+      jsprNodes[node].function = (uint16_t)f;
+      jsprNodes[parent].firstChild = node;
+    }
+  }
+  if (node!=JSPR_NONE) jsprNodes[node].calls++;
+  jsprFrames[jsprDepth].node = node;
+  jsprFrames[jsprDepth].function = (uint16_t)f;
+  jsprFrames[jsprDepth].start = now;
+  return ++jsprDepth;
+}
+
+void jsprFunctionEndInternal(int depth) {
+  if (depth != jsprDepth) return; // profile was reset while this function was running
+  jsprDepth--;
+  if (depth > JSPR_MAX_DEPTH) return;
+  JsProfileFrame *frame = &jsprFrames[jsprDepth];
+  JsProfileTicks now = jsprGetTicks();
+  JsProfileFunction *fn = &jsprFunctions[frame->function];
+  if (!--fn->active) fn->time += now - fn->start;
+  /* If there was no room for a node, this time just ends up counted
+   * as the caller's own time */
+  if (frame->node!=JSPR_NONE) {
+    JsProfileNode *node = &jsprNodes[frame->node];
+    node->time += now - frame->start;
+    jsprNodes[node->parent].childTime += now - frame->start;
+  }
+}
+
+void jsprReset(bool start) {
+  unsigned int f;
+  for (f=0;f<jsprFunctionCount;f++) {
+    JsVar *function = jsvLock(jsprFunctions[f].function);
+    jsvUnLock2(function, function); // unlock the lock we added in jsprFunctionStartInternal
+  }
+  memset(jsprSubsystemCount, 0, sizeof(jsprSubsystemCount));
+  memset(jsprSubsystemTime, 0, sizeof(jsprSubsystemTime));
+  memset(jsprFunctions, 0, sizeof(jsprFunctions));
+  memset(jsprNodes, 0, sizeof(jsprNodes));
+  jsprFunctionCount = 0;
+  jsprNodes[0].parent = JSPR_NONE;
+  jsprNodes[0].firstChild = JSPR_NONE;
+  jsprNodes[0].nextSibling = JSPR_NONE;
+  jsprNodes[0].function = JSPR_NONE;
+  jsprNodeCount = 1;
+  jsprDepth = 0;
+  jsprCurrent = JSPS_OTHER;
+  jsprStartTicks = jsprLastTicks = jsprGetTicks();
+  jsprRunning = start;
+}
+
+/// Get a name we can show for a function - 'name' is what it was called with (if anything)
+static JsVar *jsprGetNameOf(JsVarRef functionRef, const char *name) {
+  if (!functionRef) return jsvNewFromString("(other)");
+  if (name[0]) return jsvNewFromString(name);
+  // it was never called by name - see if we can find where it's stored
+  JsVar *function = jsvLock(functionRef);
+  JsVar *path = jsvGetPathTo(execInfo.root, function, 3, 0);
+  jsvUnLock(function);
+  return path ? path : jsvNewFromString("(anonymous)");
+}
+
+static JsVar *jsprGetFunctionName(unsigned int f) {
+  return jsprGetNameOf(jsprFunctions[f].function, jsprFunctions[f].name);
+}
+
+JsVar *jsprGetProfile() {
+  if (jsprRunning) jsprUpdateSubsystemTime();
+  JsVar *profile = jsvNewWithFlags(JSV_OBJECT);
+  if (!profile) return 0;
+  JsProfileTicks time = jsprRunning ? jsprGetTicks() - jsprStartTicks : 0;
+  jsvObjectSetChildAndUnLock(profile, "time", jsvNewFromFloat(jsprTicksToMs(time)));
+  int s;
+  for (s=0;s<JSPS_COUNT;s++) {
+    JsVar *o = jsvNewWithFlags(JSV_OBJECT);
+    if (!o) break;
+    if (s!=JSPS_OTHER)
+      jsvObjectSetChildAndUnLock(o, "count", jsvNewFromInteger((JsVarInt)jsprSubsystemCount[s]));
+    jsvObjectSetChildAndUnLock(o, "time", jsvNewFromFloat(jsprTicksToMs(jsprSubsystemTime[s])));
+    jsvObjectSetChildAndUnLock(profile, jsprSubsystemNames[s], o);
+  }
+  JsVar *functions = jsvNewWithFlags(JSV_ARRAY);
+  if (!functions) return profile;
+  unsigned int f;
+  for (f=0;f<=JSPR_MAX_FUNCTIONS;f++) {
+    if (f>=jsprFunctionCount && f<JSPR_MAX_FUNCTIONS) continue;
+    if (!jsprFunctions[f].calls) continue;
+    JsVar *o = jsvNewWithFlags(JSV_OBJECT);
+    if (!o) break;
+    jsvObjectSetChildAndUnLock(o, "name", jsprGetFunctionName(f));
+    jsvObjectSetChildAndUnLock(o, "calls", jsvNewFromInteger((JsVarInt)jsprFunctions[f].calls));
+    jsvObjectSetChildAndUnLock(o, "time", jsvNewFromFloat(jsprTicksToMs(jsprFunctions[f].time)));
+    jsvArrayPushAndUnLock(functions, o);
+  }
+  jsvObjectSetChildAndUnLock(profile, "functions", functions);
+  return profile;
+}
+
+JsVar *jsprGetFoldedStacks() {
+  JsVar *names[JSPR_MAX_FUNCTIONS+1];
+  memset(names, 0, sizeof(names));
+  JsVar *str = jsvNewFromEmptyString();
+  if (!str) return 0;
+  unsigned int n;
+  for (n=1;n<jsprNodeCount;n++) {
+    JsProfileNode *node = &jsprNodes[n];
+    JsVarFloat self = jsprTicksToMs(node->time - node->childTime)*1000;
+    if (self<1) continue;
+    // work out the call stack, from the top down
+    uint16_t stack[JSPR_MAX_DEPTH];
+    int depth = 0;
+    uint16_t i = (uint16_t)n;
+    while (i && depth<JSPR_MAX_DEPTH) {
+      stack[depth++] = i;
+      i = jsprNodes[i].parent;
+    }
+    while (depth--) {
+      uint16_t f = jsprNodes[stack[depth]].function;
+      if (!names[f]) names[f] = jsprGetFunctionName(f);
+      jsvAppendPrintf(str, depth ? "%v;" : "%v", names[f]);
+    }
+    jsvAppendPrintf(str, " %d\n", (int)self);
+  }
+  for (n=0;n<=JSPR_MAX_FUNCTIONS;n++)
+    jsvUnLock(names[n]);
+  return str;
+}
+
+#ifdef USE_PROFILER_SAMPLING
+// ----------------------------------------------------------------------------
+// Sampling profiler - SIGALRM says when a sample is due, and the next token
+// lexed records where execInfo.lex is and what functions we're in.
+
+#define JSPR_MAX_SOURCES 64 ///< strings containing code that we have samples in
+#define JSPR_MAX_POSITIONS 512 ///< different token positions we have samples for
+#define JSPR_MAX_SAMPLE_NODES 256
+
+typedef struct {
+  JsVar *function;
+  JsVar *name; ///< May be 0
+} JsSampleFrame;
+
+typedef struct {
+  JsVarRef function; ///< Locked so it can't be freed and reused
+  char name[JSPR_NAME_LEN];
+} JsSampleFunction;
+
+typedef struct {
+  JsVarRef code;
+  bool locked; ///< Did we lock 'code'? We don't need to if it's the code of a function we locked (see jsprVarMoved)
+  uint16_t lineNumberOffset; ///< from JsLex
+  uint16_t function; ///< the function the code is in, or JSPR_NONE for the top level
+} JsSampleSource;
+
+typedef struct {
+  uint16_t source; ///< JSPR_NONE if the entry is unused
+  uint32_t position; ///< character index in the source
+  unsigned int samples;
+} JsSamplePosition;
+
+typedef struct {
+  uint16_t parent, firstChild, nextSibling;
+  uint16_t function;
+  unsigned int samples; ///< samples with exactly this call stack
+} JsSampleNode;
+
+bool jsprSampling = false;
+volatile int jsprSignals = 0;
+static int jsprSampleRate; ///< in Hz
+static unsigned int jsprSampleCount; ///< total samples
+static unsigned int jsprSamplesDropped; ///< samples we didn't have space to record the position of
+static JsSampleFrame jsprSampleFrames[JSPR_MAX_DEPTH];
+static int jsprSampleDepth;
+static JsSampleFunction jsprSampleFunctions[JSPR_MAX_FUNCTIONS+1]; ///< last is '(other)'
+static unsigned int jsprSampleFunctionCount;
+static JsSampleSource jsprSampleSources[JSPR_MAX_SOURCES];
+static unsigned int jsprSampleSourceCount;
+static JsSamplePosition jsprSamplePositions[JSPR_MAX_POSITIONS]; ///< hash table
+static JsSampleNode jsprSampleNodes[JSPR_MAX_SAMPLE_NODES];
+static unsigned int jsprSampleNodeCount;
+
+static void jsprSignalHandler(int sig) {
+  NOT_USED(sig);
+  // only count time when we're executing JS, not when we're idle
+  if (execInfo.lex) jsprSignals++;
+}
+
+int jsprSampleFunctionStart(JsVar *function, JsVar *functionName) {
+  if (jsprSampleDepth < JSPR_MAX_DEPTH) {
+    jsprSampleFrames[jsprSampleDepth].function = function;
+    jsprSampleFrames[jsprSampleDepth].name = functionName;
+  }
+  return ++jsprSampleDepth;
+}
+
+void jsprSampleFunctionEnd(int depth) {
+  if (depth == jsprSampleDepth) jsprSampleDepth--;
+}
+
+/// Find the function in our table, or add it
+static uint16_t jsprSampleGetFunction(JsSampleFrame *frame) {
+  JsVarRef ref = jsvGetRef(frame->function);
+  unsigned int f;
+  for (f=0;f<jsprSampleFunctionCount;f++)
+    if (jsprSampleFunctions[f].function == ref) break;
+  if (f==jsprSampleFunctionCount) {
+    if (f>=JSPR_MAX_FUNCTIONS) return JSPR_MAX_FUNCTIONS;
+    jsprSampleFunctionCount++;
+    jsprSampleFunctions[f].function = jsvGetRef(jsvLockAgain(frame->function));
+  }
+  if (!jsprSampleFunctions[f].name[0] && jsvIsString(frame->name))
+    jsvGetString(frame->name, jsprSampleFunctions[f].name, JSPR_NAME_LEN);
+  return (uint16_t)f;
+}
+
+static void jsprSampleAddPosition(JsLex *lex, uint16_t function, unsigned int samples) {
+  JsVarRef code = jsvGetRef(lex->sourceVar);
+  unsigned int s;
+  for (s=0;s<jsprSampleSourceCount;s++)
+    if (jsprSampleSources[s].code == code) break;
+  if (s==jsprSampleSourceCount) {
+    if (s>=JSPR_MAX_SOURCES) {
+      jsprSamplesDropped += samples;
+      return;
+    }
+    jsprSampleSourceCount++;
+    /* Keep the code from being freed. Locks are precious for recursive
+     * functions, so we only add one if the function we've locked doesn't
+     * already keep the code around (eg. eval) */
+    bool isFunctionCode = false;
+    if (function!=JSPR_NONE && function<JSPR_MAX_FUNCTIONS) {
+      JsVar *f = jsvLock(jsprSampleFunctions[function].function);
+      JsVar *functionCode = jsvObjectGetChild(f, JSPARSE_FUNCTION_CODE_NAME, 0);
+      isFunctionCode = functionCode==lex->sourceVar;
+      jsvUnLock2(functionCode, f);
+    }
+    jsprSampleSources[s].code = jsvGetRef(lex->sourceVar);
+    jsprSampleSources[s].locked = !isFunctionCode;
+    if (!isFunctionCode) jsvLockAgain(lex->sourceVar);
+    jsprSampleSources[s].lineNumberOffset = lex->lineNumberOffset;
+    jsprSampleSources[s].function = function;
+  }
+  uint32_t position = (uint32_t)jsvStringIteratorGetIndex(&lex->tokenStart.it)-1;
+  unsigned int h = (position*31 + s) % JSPR_MAX_POSITIONS;
+  unsigned int i;
+  for (i=0;i<JSPR_MAX_POSITIONS;i++) {
+    JsSamplePosition *p = &jsprSamplePositions[h];
+    if (p->source==JSPR_NONE) {
+      p->source = (uint16_t)s;
+      p->position = position;
+    }
+    if (p->source==s && p->position==position) {
+      p->samples += samples;
+      return;
+    }
+    h = (h+1) % JSPR_MAX_POSITIONS;
+  }
+  jsprSamplesDropped += samples;
+}
+
+void jsprTakeSample() {
+  unsigned int samples = (unsigned int)__sync_lock_test_and_set(&jsprSignals, 0);
+  JsLex *lex = execInfo.lex;
+  if (!jsprSampling || !samples || !lex || !lex->sourceVar) return;
+  jsprSampleCount += samples;
+  // Add to the node for the current call stack
+  uint16_t node = 0, function = JSPR_NONE;
+  int depth = jsprSampleDepth<JSPR_MAX_DEPTH ? jsprSampleDepth : JSPR_MAX_DEPTH;
+  int i;
+  for (i=0;i<depth;i++) {
+    function = jsprSampleGetFunction(&jsprSampleFrames[i]);
+    uint16_t child = jsprSampleNodes[node].firstChild;
+    while (child!=JSPR_NONE && jsprSampleNodes[child].function!=function)
+      child = jsprSampleNodes[child].nextSibling;
+    if (child==JSPR_NONE) {
+      if (jsprSampleNodeCount>=JSPR_MAX_SAMPLE_NODES) break; // just count it against the caller
+      child = (uint16_t)jsprSampleNodeCount++;
+      jsprSampleNodes[child].parent = node;
+      jsprSampleNodes[child].firstChild = JSPR_NONE;
+      jsprSampleNodes[child].nextSibling = jsprSampleNodes[node].firstChild;
+      jsprSampleNodes[child].function = function;
+      jsprSampleNodes[node].firstChild = child;
+    }
+    node = child;
+  }
+  jsprSampleNodes[node].samples += samples;
+  jsprSampleAddPosition(lex, function, samples);
+}
+
+static void jsprClearSamples() {
+  unsigned int i;
+  for (i=0;i<jsprSampleFunctionCount;i++) {
+    JsVar *v = jsvLock(jsprSampleFunctions[i].function);
+    jsvUnLock2(v, v); // unlock the lock we added in jsprSampleGetFunction
+  }
+  for (i=0;i<jsprSampleSourceCount;i++) {
+    if (!jsprSampleSources[i].locked) continue;
+    JsVar *v = jsvLock(jsprSampleSources[i].code);
+    jsvUnLock2(v, v); // unlock the lock we added in jsprSampleAddPosition
+  }
+  memset(jsprSampleFunctions, 0, sizeof(jsprSampleFunctions));
+  memset(jsprSampleNodes, 0, sizeof(jsprSampleNodes));
+  jsprSampleFunctionCount = 0;
+  jsprSampleSourceCount = 0;
+  for (i=0;i<JSPR_MAX_POSITIONS;i++) {
+    jsprSamplePositions[i].source = JSPR_NONE;
+    jsprSamplePositions[i].samples = 0;
+  }
+  jsprSampleNodes[0].parent = JSPR_NONE;
+  jsprSampleNodes[0].firstChild = JSPR_NONE;
+  jsprSampleNodes[0].nextSibling = JSPR_NONE;
+  jsprSampleNodes[0].function = JSPR_NONE;
+  jsprSampleNodeCount = 1;
+  jsprSampleCount = 0;
+  jsprSamplesDropped = 0;
+}
+
+void jsprStartSampling(int hz) {
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  if (hz<=0) {
+    jsprSampling = false;
+    setitimer(ITIMER_REAL, &timer, 0);
+    return;
+  }
+  jsprClearSamples();
+  if (hz>1000000) hz=1000000;
+  jsprSampleRate = hz;
+  jsprSampleDepth = 0;
+  jsprSignals = 0;
+  jsprSampling = true;
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = jsprSignalHandler;
+  sa.sa_flags = SA_RESTART; // so the IO threads' reads aren't interrupted
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGALRM, &sa, 0);
+  /* ITIMER_PROF would only count CPU time, but on most kernels it can't go
+   * faster than the scheduler tick - so use real time and ignore the signal
+   * when we're idle */
+  timer.it_interval.tv_usec = 1000000 / hz;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_REAL, &timer, 0);
+}
+
+/// One line of code, and how many samples were on it
+typedef struct {
+  uint16_t source;
+  unsigned int line; ///< in the source
+  unsigned int samples;
+} JsSampleLine;
+
+static int jsprComparePositions(const void *a, const void *b) {
+  const JsSamplePosition *pa = (const JsSamplePosition*)a, *pb = (const JsSamplePosition*)b;
+  if (pa->source != pb->source) return (int)pa->source - (int)pb->source;
+  return (pa->position > pb->position) - (pa->position < pb->position);
+}
+
+static int jsprCompareLines(const void *a, const void *b) {
+  const JsSampleLine *la = (const JsSampleLine*)a, *lb = (const JsSampleLine*)b;
+  return (la->samples < lb->samples) - (la->samples > lb->samples);
+}
+
+/** Work out which line each sampled position is on, and return how many
+ * lines there were. 'lines' should have space for JSPR_MAX_POSITIONS */
+static unsigned int jsprGetSampleLines(JsSampleLine *lines) {
+  JsSamplePosition positions[JSPR_MAX_POSITIONS];
+  unsigned int i, count = 0;
+  for (i=0;i<JSPR_MAX_POSITIONS;i++)
+    if (jsprSamplePositions[i].source!=JSPR_NONE && jsprSamplePositions[i].samples)
+      positions[count++] = jsprSamplePositions[i];
+  qsort(positions, count, sizeof(JsSamplePosition), jsprComparePositions);
+  // Now go through each source once, counting newlines
+  unsigned int lineCount = 0;
+  i = 0;
+  while (i<count) {
+    uint16_t source = positions[i].source;
+    JsVar *code = jsvLock(jsprSampleSources[source].code);
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, code, 0);
+    unsigned int line = 1;
+    size_t idx = 0;
+    while (i<count && positions[i].source==source) {
+      while (idx<positions[i].position && jsvStringIteratorHasChar(&it)) {
+        if (jsvStringIteratorGetChar(&it)=='\n') line++;
+        jsvStringIteratorNext(&it);
+        idx++;
+      }
+      if (!lineCount || lines[lineCount-1].source!=source || lines[lineCount-1].line!=line) {
+        lines[lineCount].source = source;
+        lines[lineCount].line = line;
+        lines[lineCount].samples = 0;
+        lineCount++;
+      }
+      lines[lineCount-1].samples += positions[i].samples;
+      i++;
+    }
+    jsvStringIteratorFree(&it);
+    jsvUnLock(code);
+  }
+  qsort(lines, lineCount, sizeof(JsSampleLine), jsprCompareLines);
+  return lineCount;
+}
+
+/// Line number to show the user - relative to the function if we don't know where it is in the file
+static unsigned int jsprGetSampleLineNumber(JsSampleLine *line) {
+  uint16_t offset = jsprSampleSources[line->source].lineNumberOffset;
+  return offset ? line->line + offset - 1 : line->line;
+}
+
+static JsVar *jsprGetSampleFunctionName(uint16_t f) {
+  if (f==JSPR_NONE) return jsvNewFromString("(top level)");
+  return jsprGetNameOf(jsprSampleFunctions[f].function, jsprSampleFunctions[f].name);
+}
+
+/// Get the source code on the given line (trimmed)
+static JsVar *jsprGetSampleLineCode(JsSampleLine *line) {
+  JsVar *code = jsvLock(jsprSampleSources[line->source].code);
+  size_t start = jsvGetIndexFromLineAndCol(code, line->line, 1);
+  size_t len = jsvGetCharsOnLine(code, line->line);
+  while (len && isWhitespace(jsvGetCharInString(code, start))) {
+    start++;
+    len--;
+  }
+  if (len>40) len=40;
+  JsVar *str = jsvNewFromStringVar(code, start, len);
+  jsvUnLock(code);
+  return str;
+}
+
+JsVar *jsprGetSamples() {
+  JsSampleLine lines[JSPR_MAX_POSITIONS];
+  unsigned int count = jsprGetSampleLines(lines);
+  JsVar *arr = jsvNewWithFlags(JSV_ARRAY);
+  unsigned int i;
+  for (i=0;arr && i<count;i++) {
+    JsVar *o = jsvNewWithFlags(JSV_OBJECT);
+    if (!o) break;
+    jsvObjectSetChildAndUnLock(o, "samples", jsvNewFromInteger((JsVarInt)lines[i].samples));
+    jsvObjectSetChildAndUnLock(o, "line", jsvNewFromInteger((JsVarInt)jsprGetSampleLineNumber(&lines[i])));
+    jsvObjectSetChildAndUnLock(o, "function", jsprGetSampleFunctionName(jsprSampleSources[lines[i].source].function));
+    jsvObjectSetChildAndUnLock(o, "code", jsprGetSampleLineCode(&lines[i]));
+    jsvArrayPushAndUnLock(arr, o);
+  }
+  return arr;
+}
+
+JsVar *jsprGetSampleFoldedStacks() {
+  JsVar *str = jsvNewFromEmptyString();
+  unsigned int n;
+  for (n=1;str && n<jsprSampleNodeCount;n++) {
+    if (!jsprSampleNodes[n].samples) continue;
+    uint16_t stack[JSPR_MAX_DEPTH];
+    int depth = 0;
+    uint16_t i = (uint16_t)n;
+    while (i && depth<JSPR_MAX_DEPTH) {
+      stack[depth++] = i;
+      i = jsprSampleNodes[i].parent;
+    }
+    while (depth--) {
+      JsVar *name = jsprGetSampleFunctionName(jsprSampleNodes[stack[depth]].function);
+      jsvAppendPrintf(str, depth ? "%v;" : "%v", name);
+      jsvUnLock(name);
+    }
+    jsvAppendPrintf(str, " %d\n", jsprSampleNodes[n].samples);
+  }
+  return str;
+}
+
+void jsprDumpSamples(vcbprintf_callback user_callback, void *user_data) {
+  JsSampleLine lines[JSPR_MAX_POSITIONS];
+  unsigned int count = jsprGetSampleLines(lines);
+  cbprintf(user_callback, user_data, "%d samples at %dHz", jsprSampleCount, jsprSampleRate);
+  if (jsprSamplesDropped)
+    cbprintf(user_callback, user_data, " (%d not recorded)", jsprSamplesDropped);
+  cbprintf(user_callback, user_data, "\nsamples  line  function: code\n");
+  unsigned int i;
+  for (i=0;i<count;i++) {
+    JsVar *name = jsprGetSampleFunctionName(jsprSampleSources[lines[i].source].function);
+    JsVar *code = jsprGetSampleLineCode(&lines[i]);
+    cbprintf(user_callback, user_data, "%d  %d  %v: %v\n", lines[i].samples, jsprGetSampleLineNumber(&lines[i]), name, code);
+    jsvUnLock2(name, code);
+  }
+}
+
+static void jsprWriteToFile(const char *str, void *file) {
+  fputs(str, (FILE*)file);
+}
+
+bool jsprWriteSamples(const char *filename) {
+  FILE *file = fopen(filename, "w");
+  if (!file) return false;
+  jsprDumpSamples(jsprWriteToFile, file);
+  fclose(file);
+  return true;
+}
+#endif
+
+#ifdef USE_PROFILER_ALLOC_TRACE
+// ----------------------------------------------------------------------------
+// Allocation tracer - remember where each variable was allocated (the native
+// function and line of JS that was executing) so that we can say where the
+// variables that are still in use, or have leaked, came from.
+
+#define JSPR_MAX_ALLOC_SITES 1024 ///< hash table of allocation sites - must be less than JSPR_ALLOC_SOURCE
+#define JSPR_MAX_ALLOC_SOURCES 256 ///< strings containing code that we know where the lines are in
+#define JSPR_MAX_ALLOC_GROUPS 256 ///< different site and type pairs in a report
+#define JSPR_ALLOC_SOURCE 0x8000 ///< Set in jsprAllocSites if the variable is one of jsprAllocSources
+#define JSPR_ALLOC_UNTRACED 0 ///< Site for variables allocated while we weren't tracing
+#define JSPR_ALLOC_OTHER 1 ///< Site for allocations after the table filled up
+#define JSPR_CODE_LEN 24
+
+typedef struct {
+  bool used;
+  uint16_t source; ///< id of the source code that was executing, or 0
+  uint16_t line; ///< line in that code, or 0
+  uint16_t lineNumber; ///< line to show the user (see jsprGetSampleLineNumber)
+  void *native; ///< native function that was executing, or 0
+  char name[JSPR_NAME_LEN]; ///< what the native function was called
+  char code[JSPR_CODE_LEN]; ///< the start of the line of code (trimmed)
+} JsAllocSite;
+
+typedef struct {
+  JsVarRef code; ///< The string containing code, or 0 if unused
+  uint16_t id; ///< So sites in code that has been freed don't get muddled with code that reuses this entry
+  uint16_t lineNumberOffset; ///< from JsLex
+  uint32_t *lineStarts; ///< Character index of the start of each line (malloc'd)
+  unsigned int lineCount;
+} JsAllocSource;
+
+typedef struct {
+  uint16_t site;
+  uint8_t type; ///< index in jsprAllocTypeNames
+  unsigned int count; ///< number of variables
+} JsAllocGroup;
+
+bool jsprTracing = false;
+uint16_t *jsprAllocSites = 0;
+JsProfileNative jsprNative;
+static unsigned int jsprAllocSitesSize; ///< how many entries in jsprAllocSites
+static JsAllocSite jsprAllocSiteTable[JSPR_MAX_ALLOC_SITES];
+static unsigned int jsprAllocSiteCount;
+static JsAllocSource jsprAllocSources[JSPR_MAX_ALLOC_SOURCES];
+static JsAllocSource *jsprAllocLastSource; ///< we usually allocate from the same code as last time
+static uint16_t jsprAllocLastSourceId;
+
+static const char *jsprAllocTypeNames[] = {
+    "Name", "FlatString", "StringExt", "String", "NativeFunction", "Function",
+    "Array", "ArrayBuffer", "Object", "Integer", "Float", "Boolean", "Pin",
+    "Root", "Other"
+};
+
+static uint8_t jsprGetAllocType(JsVar *v) {
+  if (jsvIsName(v)) return 0;
+  if (jsvIsFlatString(v)) return 1;
+  if (jsvIsStringExt(v)) return 2;
+  if (jsvIsString(v)) return 3;
+  if (jsvIsNativeFunction(v)) return 4;
+  if (jsvIsFunction(v)) return 5;
+  if (jsvIsArray(v)) return 6;
+  if (jsvIsArrayBuffer(v)) return 7;
+  if (jsvIsObject(v)) return 8;
+  if (jsvIsPin(v)) return 12;
+  if (jsvIsInt(v)) return 9;
+  if (jsvIsFloat(v)) return 10;
+  if (jsvIsBoolean(v)) return 11;
+  if (jsvIsRoot(v)) return 13;
+  return 14;
+}
+
+/// Make sure jsprAllocSites has an entry for the given variable
+static bool jsprAllocSitesEnsure(JsVarRef ref) {
+  if (ref < jsprAllocSitesSize) return true;
+  unsigned int size = jsvGetMemoryTotal()+1;
+  if (size <= ref) size = (unsigned int)ref+1;
+  uint16_t *sites = realloc(jsprAllocSites, size*sizeof(uint16_t));
+  if (!sites) return false;
+  memset(&sites[jsprAllocSitesSize], 0, (size-jsprAllocSitesSize)*sizeof(uint16_t));
+  jsprAllocSites = sites;
+  jsprAllocSitesSize = size;
+  return true;
+}
+
+/// Find the lexer's code in our list of sources, or add it
+static JsAllocSource *jsprAllocGetSource(JsLex *lex) {
+  JsVarRef code = jsvGetRef(lex->sourceVar);
+  if (jsprAllocLastSource && jsprAllocLastSource->code==code)
+    return jsprAllocLastSource;
+  JsAllocSource *source = 0;
+  unsigned int i;
+  if (code<jsprAllocSitesSize && (jsprAllocSites[code]&JSPR_ALLOC_SOURCE)) {
+    for (i=0;i<JSPR_MAX_ALLOC_SOURCES;i++)
+      if (jsprAllocSources[i].code==code)
+        return jsprAllocLastSource = &jsprAllocSources[i];
+  }
+  for (i=0;i<JSPR_MAX_ALLOC_SOURCES && !source;i++)
+    if (!jsprAllocSources[i].code) source = &jsprAllocSources[i];
+  if (!source || !jsprAllocSitesEnsure(code)) return 0;
+  // Work out where each line starts, so we don't have to count newlines every time
+  unsigned int lineCount = 1;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, lex->sourceVar, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    if (jsvStringIteratorGetChar(&it)=='\n') lineCount++;
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  uint32_t *lineStarts = malloc(lineCount*sizeof(uint32_t));
+  if (!lineStarts) return 0;
+  lineStarts[0] = 0;
+  lineCount = 1;
+  jsvStringIteratorNew(&it, lex->sourceVar, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    if (jsvStringIteratorGetChar(&it)=='\n')
+      lineStarts[lineCount++] = (uint32_t)jsvStringIteratorGetIndex(&it)+1;
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  if (!++jsprAllocLastSourceId) jsprAllocLastSourceId++; // 0 means no source
+  source->code = code;
+  source->id = jsprAllocLastSourceId;
+  source->lineNumberOffset = lex->lineNumberOffset;
+  source->lineStarts = lineStarts;
+  source->lineCount = lineCount;
+  jsprAllocSites[code] |= JSPR_ALLOC_SOURCE;
+  return jsprAllocLastSource = source;
+}
+
+/// Called when a variable in jsprAllocSources is freed
+static void jsprAllocFreeSource(JsVarRef code) {
+  unsigned int i;
+  for (i=0;i<JSPR_MAX_ALLOC_SOURCES;i++) {
+    JsAllocSource *source = &jsprAllocSources[i];
+    if (source->code!=code) continue;
+    free(source->lineStarts);
+    memset(source, 0, sizeof(JsAllocSource));
+    if (jsprAllocLastSource==source) jsprAllocLastSource = 0;
+  }
+}
+
+/// Copy the start of the given line of code into the site (trimmed)
+static void jsprAllocSetCode(JsAllocSite *site, JsVar *code, uint32_t start) {
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, code, start);
+  while (jsvStringIteratorHasChar(&it) && isWhitespace(jsvStringIteratorGetChar(&it)))
+    jsvStringIteratorNext(&it);
+  unsigned int len = 0;
+  while (len<JSPR_CODE_LEN-1 && jsvStringIteratorHasChar(&it)) {
+    char ch = jsvStringIteratorGetChar(&it);
+    if (ch=='\n' || ch=='\r') break;
+    site->code[len++] = ch;
+    jsvStringIteratorNext(&it);
+  }
+  site->code[len] = 0;
+  jsvStringIteratorFree(&it);
+}
+
+/// Work out where we are, and find (or add) the allocation site for it
+static uint16_t jsprAllocGetSite() {
+  JsLex *lex = execInfo.lex;
+  JsAllocSource *source = (lex && lex->sourceVar) ? jsprAllocGetSource(lex) : 0;
+  uint16_t sourceId = 0, line = 0;
+  if (source) {
+    uint32_t position = (uint32_t)jsvStringIteratorGetIndex(&lex->tokenStart.it)-1;
+    // binary search for the line that position is on
+    unsigned int lo = 0, hi = source->lineCount;
+    while (hi-lo > 1) {
+      unsigned int mid = (lo+hi)/2;
+      if (source->lineStarts[mid] <= position) lo = mid;
+      else hi = mid;
+    }
+    sourceId = source->id;
+    line = (uint16_t)(lo+1);
+  }
+  void *native = jsprNative.ptr;
+  unsigned int h = (unsigned int)(((size_t)native>>2)*31 + sourceId*17 + line);
+  unsigned int i;
+  for (i=0;i<JSPR_MAX_ALLOC_SITES;i++) {
+    h = h % JSPR_MAX_ALLOC_SITES;
+    JsAllocSite *site = &jsprAllocSiteTable[h];
+    if (site->used) {
+      if (site->native==native && site->source==sourceId && site->line==line)
+        return (uint16_t)h;
+      h++;
+      continue;
+    }
+    // not found - add it if we've got space
+    if (jsprAllocSiteCount >= JSPR_MAX_ALLOC_SITES*3/4) break;
+    jsprAllocSiteCount++;
+    site->used = true;
+    site->native = native;
+    site->source = sourceId;
+    site->line = line;
+    if (jsvIsString(jsprNative.name))
+      jsvGetString(jsprNative.name, site->name, JSPR_NAME_LEN);
+    if (source) {
+      site->lineNumber = source->lineNumberOffset ? (uint16_t)(line + source->lineNumberOffset - 1) : line;
+      jsprAllocSetCode(site, lex->sourceVar, source->lineStarts[line-1]);
+    }
+    return (uint16_t)h;
+  }
+  return JSPR_ALLOC_OTHER;
+}
+
+void jsprTraceAllocInternal(JsVar *v) {
+  JsVarRef ref = jsvGetRef(v);
+  if (jsprAllocSitesEnsure(ref))
+    jsprAllocSites[ref] = jsprAllocGetSite();
+}
+
+void jsprTraceFreeInternal(JsVarRef ref) {
+  if (ref>=jsprAllocSitesSize) return;
+  if (jsprAllocSites[ref] & JSPR_ALLOC_SOURCE)
+    jsprAllocFreeSource(ref);
+  jsprAllocSites[ref] = 0;
+}
+
+void jsprTraceMoveInternal(JsVarRef from, JsVarRef to) {
+  if (from>=jsprAllocSitesSize || !jsprAllocSitesEnsure(to)) return;
+  uint16_t site = jsprAllocSites[from];
+  jsprAllocSites[from] = 0;
+  jsprAllocSites[to] = site;
+  if (site & JSPR_ALLOC_SOURCE) {
+    unsigned int i;
+    for (i=0;i<JSPR_MAX_ALLOC_SOURCES;i++)
+      if (jsprAllocSources[i].code==from)
+        jsprAllocSources[i].code = to;
+  }
+}
+
+void jsprKillAllocationTrace() {
+  jsprTracing = false;
+  unsigned int i;
+  for (i=0;i<JSPR_MAX_ALLOC_SOURCES;i++)
+    free(jsprAllocSources[i].lineStarts);
+  memset(jsprAllocSources, 0, sizeof(jsprAllocSources));
+  memset(jsprAllocSiteTable, 0, sizeof(jsprAllocSiteTable));
+  jsprAllocSiteCount = 0;
+  jsprAllocLastSource = 0;
+  free(jsprAllocSites);
+  jsprAllocSites = 0;
+  jsprAllocSitesSize = 0;
+}
+
+void jsprTraceAllocations(bool start) {
+  if (start) {
+    jsprKillAllocationTrace();
+    if (!jsprAllocSitesEnsure((JsVarRef)jsvGetMemoryTotal())) return;
+    jsprAllocSiteTable[JSPR_ALLOC_UNTRACED].used = true;
+    jsprAllocSiteTable[JSPR_ALLOC_OTHER].used = true;
+    jsprAllocSiteCount = 2;
+  }
+  jsprTracing = start;
+}
+
+static int jsprCompareAllocGroups(const void *a, const void *b) {
+  const JsAllocGroup *ga = (const JsAllocGroup*)a, *gb = (const JsAllocGroup*)b;
+  return (ga->count < gb->count) - (ga->count > gb->count);
+}
+
+/** Group all used variables by site and type, and return how many groups
+ * there were. 'groups' should have space for JSPR_MAX_ALLOC_GROUPS.
+ * Variables that don't fit in a group are counted in 'dropped' */
+static unsigned int jsprGetAllocGroups(JsAllocGroup *groups, unsigned int *dropped) {
+  unsigned int count = 0;
+  *dropped = 0;
+  JsVarRef i;
+  JsVarRef size = (JsVarRef)jsvGetMemoryTotal();
+  for (i=1;i<=size;i++) {
+    JsVar *v = _jsvGetAddressOf(i);
+    if ((v->flags&JSV_VARTYPEMASK) == JSV_UNUSED) continue;
+    unsigned int vars = 1;
+    if (jsvIsFlatString(v)) vars += (unsigned int)jsvGetFlatStringBlocks(v);
+    uint16_t site = JSPR_ALLOC_UNTRACED;
+    if (i<jsprAllocSitesSize)
+      site = jsprAllocSites[i] & (JSPR_ALLOC_SOURCE-1);
+    uint8_t type = jsprGetAllocType(v);
+    unsigned int g;
+    for (g=0;g<count;g++)
+      if (groups[g].site==site && groups[g].type==type) break;
+    if (g==count) {
+      if (count<JSPR_MAX_ALLOC_GROUPS) {
+        groups[count].site = site;
+        groups[count].type = type;
+        groups[count].count = 0;
+        count++;
+      } else {
+        *dropped += vars;
+        g = JSPR_MAX_ALLOC_GROUPS;
+      }
+    }
+    if (g<count) groups[g].count += vars;
+    i = (JsVarRef)(i+vars-1);
+  }
+  qsort(groups, count, sizeof(JsAllocGroup), jsprCompareAllocGroups);
+  return count;
+}
+
+/// Describe where the site is, eg. 'push() line 3'
+static JsVar *jsprGetAllocSiteName(uint16_t s) {
+  if (s==JSPR_ALLOC_UNTRACED) return jsvNewFromString("(untraced)");
+  if (s==JSPR_ALLOC_OTHER) return jsvNewFromString("(other)");
+  JsAllocSite *site = &jsprAllocSiteTable[s];
+  if (!site->native && !site->source) return jsvNewFromString("(system)");
+  JsVar *str = jsvNewFromEmptyString();
+  if (!str) return 0;
+  if (site->native)
+    jsvAppendPrintf(str, site->source ? "%s() " : "%s()", site->name[0] ? site->name : "(native)");
+  if (site->source)
+    jsvAppendPrintf(str, "line %d", site->lineNumber);
+  return str;
+}
+
+JsVar *jsprGetAllocations() {
+  JsAllocGroup groups[JSPR_MAX_ALLOC_GROUPS];
+  unsigned int dropped;
+  unsigned int count = jsprGetAllocGroups(groups, &dropped);
+  JsVar *arr = jsvNewWithFlags(JSV_ARRAY);
+  unsigned int i;
+  for (i=0;arr && i<count;i++) {
+    JsVar *o = jsvNewWithFlags(JSV_OBJECT);
+    if (!o) break;
+    JsAllocSite *site = &jsprAllocSiteTable[groups[i].site];
+    jsvObjectSetChildAndUnLock(o, "count", jsvNewFromInteger((JsVarInt)groups[i].count));
+    jsvObjectSetChildAndUnLock(o, "type", jsvNewFromString(jsprAllocTypeNames[groups[i].type]));
+    jsvObjectSetChildAndUnLock(o, "site", jsprGetAllocSiteName(groups[i].site));
+    if (groups[i].site>JSPR_ALLOC_OTHER && site->source)
+      jsvObjectSetChildAndUnLock(o, "code", jsvNewFromString(site->code));
+    jsvArrayPushAndUnLock(arr, o);
+  }
+  return arr;
+}
+
+void jsprDumpAllocations(vcbprintf_callback user_callback, void *user_data) {
+  JsAllocGroup groups[JSPR_MAX_ALLOC_GROUPS];
+  unsigned int dropped;
+  unsigned int count = jsprGetAllocGroups(groups, &dropped);
+  cbprintf(user_callback, user_data, "vars  type  allocated by: code\n");
+  unsigned int i;
+  for (i=0;i<count;i++) {
+    JsAllocSite *site = &jsprAllocSiteTable[groups[i].site];
+    JsVar *name = jsprGetAllocSiteName(groups[i].site);
+    cbprintf(user_callback, user_data, "%d  %s  %v", groups[i].count, jsprAllocTypeNames[groups[i].type], name);
+    if (groups[i].site>JSPR_ALLOC_OTHER && site->source)
+      cbprintf(user_callback, user_data, ": %s", site->code);
+    cbprintf(user_callback, user_data, "\n");
+    jsvUnLock(name);
+  }
+  if (dropped)
+    cbprintf(user_callback, user_data, "%d more vars not shown\n", dropped);
+}
+#endif
+
+void jsprKill() {
+  jsprReset(false);
+#ifdef USE_PROFILER_SAMPLING
+  jsprStartSampling(0);
+  jsprClearSamples();
+#endif
+}
+
+void jsprVarMoved(JsVarRef from, JsVarRef to) {
+  /* Function code is kept by the function, which we lock. Locking the code
+   * too would make recursive functions run out of locks sooner */
+  unsigned int f;
+  for (f=0;f<jsprFunctionCount;f++)
+    if (jsprFunctions[f].code == from) jsprFunctions[f].code = to;
+#ifdef USE_PROFILER_SAMPLING
+  unsigned int s;
+  for (s=0;s<jsprSampleSourceCount;s++)
+    if (jsprSampleSources[s].code == from) jsprSampleSources[s].code = to;
+#endif
+}
@@ -0,0 +1,194 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Optional interpreter profiler (compiled in with USE_PROFILER)
+ * ----------------------------------------------------------------------------
+ */
+#ifndef JSPROFILER_H_
+#define JSPROFILER_H_
+
+#include "jsutils.h"
+#include "jsvar.h"
+
+#ifdef USE_PROFILER
+
+/** The parts of the interpreter that we keep time for. Time is only ever
+ * charged to one of these at once, so a GC that happens during an allocation
+ * counts as GC and not allocation, and JS code run from a native function
+ * doesn't count as native. */
+typedef enum {
+  JSPS_OTHER, ///< Parsing and executing - anything not listed below
+  JSPS_LEX,   ///< jslGetNextToken
+  JSPS_SCOPE, ///< jspeiFindInScopes
+  JSPS_ALLOC, ///< jsvNewWithFlags
+  JSPS_GC,    ///< jsvGarbageCollect
+  JSPS_NATIVE,///< jsnCallFunction
+  JSPS_COUNT,
+  JSPS_NONE = 0xFF, ///< Returned by jsprSubsystemStart when not profiling
+} PACKED_FLAGS JsProfileSubsystem;
+
+typedef uint64_t JsProfileTicks;
+
+extern bool jsprRunning;
+
+JsProfileSubsystem jsprSubsystemStartInternal(JsProfileSubsystem s);
+void jsprSubsystemEndInternal(JsProfileSubsystem *previous);
+
+/// Start charging time to the given subsystem, returns what was running before
+static ALWAYS_INLINE JsProfileSubsystem jsprSubsystemStart(JsProfileSubsystem s) {
+  return jsprRunning ? jsprSubsystemStartInternal(s) : JSPS_NONE;
+}
+/// Go back to charging time to the subsystem that was returned by jsprSubsystemStart
+static ALWAYS_INLINE void jsprSubsystemEnd(JsProfileSubsystem *previous) {
+  if (*previous!=JSPS_NONE) jsprSubsystemEndInternal(previous);
+}
+/** Charge time to subsystem S until the end of the current block - however it
+ * is left. Put this at the very start of a function. */
+#define JSPR_SUBSYSTEM(S) JsProfileSubsystem jsprPrevious __attribute__((cleanup(jsprSubsystemEnd))) = jsprSubsystemStart(S)
+
+#ifdef USE_PROFILER_SAMPLING
+extern bool jsprSampling;
+/// Incremented from the SIGALRM handler each time a sample is due
+extern volatile int jsprSignals;
+#endif
+
+#ifdef USE_PROFILER_ALLOC_TRACE
+/// The native function that's executing, so allocations can be blamed on it
+typedef struct {
+  void *ptr; ///< 0 if we're in JS code
+  JsVar *name; ///< What the function was called with - may be 0
+} JsProfileNative;
+
+extern bool jsprTracing;
+/// Allocation site for each variable (indexed by JsVarRef), or 0 if not tracing
+extern uint16_t *jsprAllocSites;
+extern JsProfileNative jsprNative;
+
+/// Called before a native function is called, returns what was running before
+static ALWAYS_INLINE JsProfileNative jsprNativeStart(void *ptr, JsVar *name) {
+  JsProfileNative previous = jsprNative;
+  jsprNative.ptr = ptr;
+  jsprNative.name = name;
+  return previous;
+}
+/// Called after a native function has been called, with what jsprNativeStart returned
+static ALWAYS_INLINE void jsprNativeEnd(JsProfileNative *previous) {
+  jsprNative = *previous;
+}
+
+void jsprTraceAllocInternal(JsVar *v);
+void jsprTraceFreeInternal(JsVarRef ref);
+void jsprTraceMoveInternal(JsVarRef from, JsVarRef to);
+/// Record where a newly allocated variable came from
+#define JSPR_TRACE_ALLOC(V) do { if (jsprTracing) jsprTraceAllocInternal(V); } while(0)
+/// Forget where a variable that's being freed came from
+#define JSPR_TRACE_FREE(REF) do { if (jsprAllocSites) jsprTraceFreeInternal(REF); } while(0)
+/// A variable has been moved by jsvDefragment
+#define JSPR_TRACE_MOVE(FROM, TO) do { if (jsprAllocSites) jsprTraceMoveInternal(FROM, TO); } while(0)
+
+/** Clear all allocation sites and start recording them (or stop recording
+ * but keep them if start is false). Variables allocated before this are
+ * reported as '(untraced)' */
+void jsprTraceAllocations(bool start);
+/// Stop tracing and free all the memory used for it
+void jsprKillAllocationTrace();
+/// Return used variables grouped by allocation site and type, most first (see E.getAllocations)
+JsVar *jsprGetAllocations();
+/// Print used variables grouped by allocation site and type, most first
+void jsprDumpAllocations(vcbprintf_callback user_callback, void *user_data);
+#else
+#define JSPR_TRACE_ALLOC(V)
+#define JSPR_TRACE_FREE(REF)
+#define JSPR_TRACE_MOVE(FROM, TO)
+#endif
+
+/// What we were doing when a JS function was called - pass it to jsprFunctionEnd
+typedef struct {
+  int depth; ///< Depth in the profiler's call stack, or 0
+#ifdef USE_PROFILER_SAMPLING
+  int sampleDepth; ///< Depth in the sampler's call stack, or 0
+#endif
+#ifdef USE_PROFILER_ALLOC_TRACE
+  JsProfileNative native; ///< The native function that called this one (if any)
+#endif
+} JsProfileCall;
+
+int jsprFunctionStartInternal(JsVar *function, JsVar *functionCode, JsVar *functionName);
+void jsprFunctionEndInternal(int depth);
+#ifdef USE_PROFILER_SAMPLING
+int jsprSampleFunctionStart(JsVar *function, JsVar *functionName);
+void jsprSampleFunctionEnd(int depth);
+#endif
+/// Called when a JS function starts executing
+static ALWAYS_INLINE JsProfileCall jsprFunctionStart(JsVar *function, JsVar *functionCode, JsVar *functionName) {
+  JsProfileCall call;
+  call.depth = jsprRunning ? jsprFunctionStartInternal(function, functionCode, functionName) : 0;
+#ifdef USE_PROFILER_SAMPLING
+  call.sampleDepth = jsprSampling ? jsprSampleFunctionStart(function, functionName) : 0;
+#endif
+#ifdef USE_PROFILER_ALLOC_TRACE
+  call.native = jsprNativeStart(0, 0);
+#endif
+  return call;
+}
+/// Called when a JS function has finished executing
+static ALWAYS_INLINE void jsprFunctionEnd(JsProfileCall *call) {
+  if (call->depth) jsprFunctionEndInternal(call->depth);
+#ifdef USE_PROFILER_SAMPLING
+  if (call->sampleDepth) jsprSampleFunctionEnd(call->sampleDepth);
+#endif
+#ifdef USE_PROFILER_ALLOC_TRACE
+  jsprNativeEnd(&call->native);
+#endif
+}
+
+/// Clear all profile data, and start (or stop) profiling
+void jsprReset(bool start);
+/// Return the profile as an object (see E.getProfile)
+JsVar *jsprGetProfile();
+/// Return the profile as one 'fn1;fn2 time' line per call stack (see E.getProfile)
+JsVar *jsprGetFoldedStacks();
+/// Stop profiling and sampling, and release all the variables they kept
+void jsprKill();
+void jsprVarMoved(JsVarRef from, JsVarRef to);
+/// A variable has been moved by jsvDefragment - update the references we keep without a lock
+#define JSPR_VAR_MOVED(FROM, TO) jsprVarMoved(FROM, TO)
+
+#ifdef USE_PROFILER_SAMPLING
+void jsprTakeSample();
+/** If the sampling timer has fired since the last token, record where we are.
+ * Doing this here rather than in the signal handler means we never look at
+ * the interpreter's state while it's half-way through changing it */
+#define JSPR_CHECK_SAMPLE() do { if (jsprSignals) jsprTakeSample(); } while(0)
+
+/// Clear all samples and start sampling at the given rate (or stop sampling but keep the samples if hz<=0)
+void jsprStartSampling(int hz);
+/// Return the samples as an array of lines, busiest first (see E.getSamples)
+JsVar *jsprGetSamples();
+/// Return the samples as one 'fn1;fn2 samples' line per call stack
+JsVar *jsprGetSampleFoldedStacks();
+/// Print the busiest lines
+void jsprDumpSamples(vcbprintf_callback user_callback, void *user_data);
+/// Write the busiest lines to a file, return false on failure
+bool jsprWriteSamples(const char *filename);
+#else
+#define JSPR_CHECK_SAMPLE()
+#endif
+
+#else
+#define JSPR_SUBSYSTEM(S)
+#define JSPR_CHECK_SAMPLE()
+#define JSPR_TRACE_ALLOC(V)
+#define JSPR_TRACE_FREE(REF)
+#define JSPR_TRACE_MOVE(FROM, TO)
+#define JSPR_VAR_MOVED(FROM, TO)
+#endif
+
+#endif /* JSPROFILER_H_ */
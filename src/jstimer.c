@@ -15,14 +15,34 @@
 #include "jsparse.h"
 #include "jsinteractive.h"
 
+/* Tasks stay in the same slot of utilTimerTasks while they are queued. The queue
+ * itself is a binary min-heap of slot numbers, ordered by time and then by the
+ * order they were queued in, so the next task due is always utilTimerHeap[0].
+ * Entries past utilTimerHeapSize (up to utilTimerSlotsUsed) are free slots. */
 UtilTimerTask utilTimerTasks[UTILTIMERTASK_TASKS];
-volatile unsigned char utilTimerTasksHead = 0;
-volatile unsigned char utilTimerTasksTail = 0;
+volatile unsigned char utilTimerHeap[UTILTIMERTASK_TASKS];
+volatile unsigned char utilTimerHeapSize = 0;
+unsigned char utilTimerSlotsUsed = 0; ///< how many slots have ever been used
+unsigned char utilTimerHeapPos[UTILTIMERTASK_TASKS]; ///< where each slot is in utilTimerHeap
+unsigned int utilTimerTaskOrder[UTILTIMERTASK_TASKS]; ///< when each slot was queued (for tasks at the same time)
+unsigned int utilTimerOrderCounter = 0;
+/* Indexes so we don't have to search the queue. Both store slot+1, or 0 for none */
+unsigned char utilTimerPinTask[JSH_PIN_COUNT]; ///< the last task to set each pin
+#ifndef SAVE_ON_FLASH
+unsigned char utilTimerBufferTasks = 0; ///< first buffer (waveform) task
+unsigned char utilTimerNextBufferTask[UTILTIMERTASK_TASKS]; ///< the buffer task after this one
+#endif
 
 
 volatile bool utilTimerOn = false;
 unsigned int utilTimerBit;
+#ifdef LINUX
+/* On Linux the 'IRQ' is a separate thread - only that thread is in it.
+ * jshInterruptOff is a recursive lock there, so nesting it is fine. */
+__thread bool utilTimerInIRQ = false;
+#else
 bool utilTimerInIRQ = false;
+#endif
 unsigned int utilTimerData;
 uint16_t utilTimerReload0H, utilTimerReload0L, utilTimerReload1H, utilTimerReload1L;
 
@@ -75,13 +95,119 @@ static inline unsigned char *jstUtilTimerInterruptHandlerByte(UtilTimerTask *tas
 }
 #endif
 
+/// Is the task in slot a due before the one in slot b?
+static bool utilTimerTaskBefore(unsigned int a, unsigned int b) {
+  if (utilTimerTasks[a].time != utilTimerTasks[b].time)
+    return utilTimerTasks[a].time < utilTimerTasks[b].time;
+  return (int)(utilTimerTaskOrder[a] - utilTimerTaskOrder[b]) < 0;
+}
+
+static void utilTimerHeapSet(unsigned int pos, unsigned int slot) {
+  utilTimerHeap[pos] = (unsigned char)slot;
+  utilTimerHeapPos[slot] = (unsigned char)pos;
+}
+
+static void utilTimerHeapSiftUp(unsigned int pos) {
+  unsigned int slot = utilTimerHeap[pos];
+  while (pos>0) {
+    unsigned int parent = (pos-1)>>1;
+    if (!utilTimerTaskBefore(slot, utilTimerHeap[parent])) break;
+    utilTimerHeapSet(pos, utilTimerHeap[parent]);
+    pos = parent;
+  }
+  utilTimerHeapSet(pos, slot);
+}
+
+static void utilTimerHeapSiftDown(unsigned int pos) {
+  unsigned int slot = utilTimerHeap[pos];
+  while (true) {
+    unsigned int child = pos*2+1;
+    if (child >= utilTimerHeapSize) break;
+    if (child+1 < utilTimerHeapSize && utilTimerTaskBefore(utilTimerHeap[child+1], utilTimerHeap[child]))
+      child++;
+    if (!utilTimerTaskBefore(utilTimerHeap[child], slot)) break;
+    utilTimerHeapSet(pos, utilTimerHeap[child]);
+    pos = child;
+  }
+  utilTimerHeapSet(pos, slot);
+}
+
+/// Remove whatever is at 'pos' in the heap, leaving its slot free
+static void utilTimerHeapRemove(unsigned int pos) {
+  unsigned int slot = utilTimerHeap[pos];
+  unsigned int last = --utilTimerHeapSize;
+  if (pos == last) return;
+  utilTimerHeapSet(pos, utilTimerHeap[last]);
+  utilTimerHeapSet(last, slot); // keep the free slot just past the end of the heap
+  if (pos>0 && utilTimerTaskBefore(utilTimerHeap[pos], utilTimerHeap[(pos-1)>>1]))
+    utilTimerHeapSiftUp(pos);
+  else
+    utilTimerHeapSiftDown(pos);
+}
+
+/// A SET task has been queued or moved later - update the pin index
+static void utilTimerIndexPins(unsigned int slot) {
+  UtilTimerTask *task = &utilTimerTasks[slot];
+  if (task->type != UET_SET) return;
+  int i;
+  for (i=0;i<UTILTIMERTASK_PIN_COUNT;i++) {
+    Pin pin = task->data.set.pins[i];
+    if (pin == PIN_UNDEFINED) break;
+    if (pin >= JSH_PIN_COUNT) continue;
+    unsigned int last = utilTimerPinTask[pin];
+    if (!last || !utilTimerTaskBefore(slot, last-1))
+      utilTimerPinTask[pin] = (unsigned char)(slot+1);
+  }
+}
+
+/** Remove a task from the indexes. If it is the next task due (as it is when
+ * it is retired from the IRQ) and it was the last task for a pin, it must also
+ * be the only one - otherwise we have to search for the new last task */
+static void utilTimerUnindexTask(unsigned int slot, bool isNext) {
+  UtilTimerTask *task = &utilTimerTasks[slot];
+  if (task->type == UET_SET) {
+    int i;
+    for (i=0;i<UTILTIMERTASK_PIN_COUNT;i++) {
+      Pin pin = task->data.set.pins[i];
+      if (pin == PIN_UNDEFINED) break;
+      if (pin >= JSH_PIN_COUNT || utilTimerPinTask[pin] != slot+1) continue;
+      utilTimerPinTask[pin] = 0;
+      if (isNext) continue;
+      unsigned int h, j;
+      for (h=0;h<utilTimerHeapSize;h++) {
+        unsigned int other = utilTimerHeap[h];
+        if (other == slot || utilTimerTasks[other].type != UET_SET) continue;
+        for (j=0;j<UTILTIMERTASK_PIN_COUNT && utilTimerTasks[other].data.set.pins[j]!=PIN_UNDEFINED;j++)
+          if (utilTimerTasks[other].data.set.pins[j] == pin &&
+              (!utilTimerPinTask[pin] || utilTimerTaskBefore(utilTimerPinTask[pin]-1, other)))
+            utilTimerPinTask[pin] = (unsigned char)(other+1);
+      }
+    }
+  }
+#ifndef SAVE_ON_FLASH
+  if (UET_IS_BUFFER_EVENT(task->type)) {
+    unsigned char *ptr = &utilTimerBufferTasks;
+    while (*ptr && *ptr != slot+1)
+      ptr = &utilTimerNextBufferTask[*ptr-1];
+    if (*ptr) *ptr = utilTimerNextBufferTask[slot];
+  }
+#endif
+}
+
+/// Remove the task in the given slot from the queue
+static void utilTimerRemoveSlot(unsigned int slot, bool isNext) {
+  utilTimerUnindexTask(slot, isNext);
+  utilTimerHeapRemove(utilTimerHeapPos[slot]);
+}
+
 void jstUtilTimerInterruptHandler() {
   if (utilTimerOn) {
     utilTimerInIRQ = true;
     JsSysTime time = jshGetSystemTime();
     // execute any timers that are due
-    while (utilTimerTasksTail!=utilTimerTasksHead && utilTimerTasks[utilTimerTasksTail].time <= time) {
-      UtilTimerTask *task = &utilTimerTasks[utilTimerTasksTail];
+    while (utilTimerHeapSize && utilTimerTasks[utilTimerHeap[0]].time <= time) {
+      unsigned int slot = utilTimerHeap[0];
+      UtilTimerTask *task = &utilTimerTasks[slot];
       void (*executeFn)(JsSysTime time) = 0;
 
       // actually perform the task
@@ -127,11 +253,11 @@ void jstUtilTimerInterruptHandler() {
         jstUtilTimerInterruptHandlerNextByte(task);
         task->data.buffer.currentValue = (unsigned short)sum;
         // now search for other tasks writing to this pin... (polyphony)
-        int t = (utilTimerTasksTail+1) & (UTILTIMERTASK_TASKS-1);
-        while (t!=utilTimerTasksHead) {
-          if (UET_IS_BUFFER_WRITE_EVENT(utilTimerTasks[t].type))
-            sum += ((int)(unsigned int)utilTimerTasks[t].data.buffer.currentValue) - 32768;
-          t = (t+1) & (UTILTIMERTASK_TASKS-1);
+        unsigned int t = utilTimerBufferTasks;
+        while (t) {
+          if (t!=slot+1 && UET_IS_BUFFER_WRITE_EVENT(utilTimerTasks[t-1].type))
+            sum += ((int)(unsigned int)utilTimerTasks[t-1].data.buffer.currentValue) - 32768;
+          t = utilTimerNextBufferTask[t-1];
         }
         // saturate
         if (sum<0) sum = 0;
@@ -150,21 +276,13 @@ void jstUtilTimerInterruptHandler() {
         unsigned int t = ((unsigned int)(time+task->repeatInterval - task->time)) / task->repeatInterval;
         if (t<1) t=1;
         task->time = task->time + (JsSysTime)task->repeatInterval*t;
-        // do an in-place bubble sort to ensure that times are still in the right order
-        unsigned char ta = utilTimerTasksTail;
-        unsigned char tb = (ta+1) & (UTILTIMERTASK_TASKS-1);
-        while (tb != utilTimerTasksHead) {
-          if (utilTimerTasks[ta].time > utilTimerTasks[tb].time) {
-            UtilTimerTask task = utilTimerTasks[ta];
-            utilTimerTasks[ta] = utilTimerTasks[tb];
-            utilTimerTasks[tb] = task;
-          }
-          ta = tb;
-          tb = (tb+1) & (UTILTIMERTASK_TASKS-1);
-        }
+        // it's now later, so move it down the heap to where it belongs
+        utilTimerTaskOrder[slot] = utilTimerOrderCounter++;
+        utilTimerHeapSiftDown(0);
+        utilTimerIndexPins(slot);
       } else {
         // Otherwise no repeat - just go straight to the next one!
-        utilTimerTasksTail = (utilTimerTasksTail+1) & (UTILTIMERTASK_TASKS-1);
+        utilTimerRemoveSlot(slot, true);
       }
 
       // execute the function if we had one (we do this now, because if we did it earlier we'd have to cope with everything changing)
@@ -172,8 +290,8 @@ void jstUtilTimerInterruptHandler() {
     }
 
     // re-schedule the timer if there is something left to do
-    if (utilTimerTasksTail != utilTimerTasksHead) {
-      jshUtilTimerReschedule(utilTimerTasks[utilTimerTasksTail].time - time);
+    if (utilTimerHeapSize) {
+      jshUtilTimerReschedule(utilTimerTasks[utilTimerHeap[0]].time - time);
     } else {
       utilTimerOn = false;
       jshUtilTimerDisable();
@@ -196,8 +314,7 @@ void jstUtilTimerWaitEmpty() {
 
 /// Is the timer full - can it accept any other signals?
 static bool utilTimerIsFull() {
-  unsigned char nextHead = (utilTimerTasksHead+1) & (UTILTIMERTASK_TASKS-1);
-  return nextHead == utilTimerTasksTail;
+  return utilTimerHeapSize >= UTILTIMERTASK_TASKS-1;
 }
 
 // Queue a task up to be executed when a timer fires... return false on failure
@@ -208,114 +325,87 @@ bool utilTimerInsertTask(UtilTimerTask *task) {
 
   if (!utilTimerInIRQ) jshInterruptOff();
 
-  // find out where to insert
-  unsigned char insertPos = utilTimerTasksTail;
-  while (insertPos != utilTimerTasksHead && utilTimerTasks[insertPos].time < task->time)
-    insertPos = (insertPos+1) & (UTILTIMERTASK_TASKS-1);
-
-  bool haveChangedTimer = insertPos==utilTimerTasksTail;
-  //jsiConsolePrintf("Insert at %d, Tail is %d\n",insertPos,utilTimerTasksTail);
-  // shift items forward
-  int i = utilTimerTasksHead;
-  while (i != insertPos) {
-    unsigned char next = (i+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-    utilTimerTasks[i] = utilTimerTasks[next];
-    i = next;
+  // get a free slot - either one that was used before, or a new one
+  unsigned int pos = utilTimerHeapSize;
+  if (pos == utilTimerSlotsUsed)
+    utilTimerHeap[utilTimerSlotsUsed++] = (unsigned char)pos;
+  unsigned int slot = utilTimerHeap[pos];
+  // add new item, and move it up the heap to where it belongs
+  utilTimerTasks[slot] = *task;
+  utilTimerTaskOrder[slot] = utilTimerOrderCounter++;
+  utilTimerHeapSize++;
+  utilTimerHeapSiftUp(pos);
+  utilTimerIndexPins(slot);
+#ifndef SAVE_ON_FLASH
+  if (UET_IS_BUFFER_EVENT(task->type)) {
+    utilTimerNextBufferTask[slot] = utilTimerBufferTasks;
+    utilTimerBufferTasks = (unsigned char)(slot+1);
   }
-  // add new item
-  utilTimerTasks[insertPos] = *task;
-  // increase task list size
-  utilTimerTasksHead = (utilTimerTasksHead+1) & (UTILTIMERTASK_TASKS-1);
+#endif
 
-  //jsiConsolePrint("Head is %d\n", utilTimerTasksHead);
+  bool haveChangedTimer = utilTimerHeap[0]==slot;
   // now set up timer if not already set up...
   if (!utilTimerOn || haveChangedTimer) {
     utilTimerOn = true;
-    jshUtilTimerStart(utilTimerTasks[utilTimerTasksTail].time - jshGetSystemTime());
+    jshUtilTimerStart(utilTimerTasks[utilTimerHeap[0]].time - jshGetSystemTime());
   }
 
   if (!utilTimerInIRQ) jshInterruptOn();
   return true;
 }
 
+/// Find the last task due that 'checkCallback' returns true for, or -1
+static int utilTimerFindLastTask(bool (checkCallback)(UtilTimerTask *task, void* data), void *checkCallbackData) {
+  int found = -1;
+  unsigned int i;
+  for (i=0;i<utilTimerHeapSize;i++) {
+    unsigned int slot = utilTimerHeap[i];
+    if ((found<0 || utilTimerTaskBefore((unsigned int)found, slot)) &&
+        checkCallback(&utilTimerTasks[slot], checkCallbackData))
+      found = (int)slot;
+  }
+  return found;
+}
+
 /// Remove the task that that 'checkCallback' returns true for. Returns false if none found
 bool utilTimerRemoveTask(bool (checkCallback)(UtilTimerTask *task, void* data), void *checkCallbackData) {
   jshInterruptOff();
-  unsigned char ptr = utilTimerTasksHead;
-  if (ptr != utilTimerTasksTail) {
-    unsigned char endPtr = ((utilTimerTasksTail+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1));
-    ptr = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-    // now we're at the last timer task - work back until we've just gone back past utilTimerTasksTail
-    while (ptr != endPtr) {
-      if (checkCallback(&utilTimerTasks[ptr], checkCallbackData)) {
-        // shift tail back along
-        unsigned char next = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-        while (next!=endPtr) {
-          utilTimerTasks[ptr] = utilTimerTasks[next];
-          ptr = next;
-          next = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-        }
-        // move 'end' pointer back
-        utilTimerTasksTail = (utilTimerTasksTail+1) & (UTILTIMERTASK_TASKS-1);
-        jshInterruptOn();
-        return true;
-      }
-      ptr = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-    }
-  }
+  int slot = utilTimerFindLastTask(checkCallback, checkCallbackData);
+  if (slot>=0) utilTimerRemoveSlot((unsigned int)slot, false);
   jshInterruptOn();
-  return false;
+  return slot>=0;
 }
 
 /// If 'checkCallback' returns true for a task, set 'task' to it and return true. Returns false if none found
 bool utilTimerGetLastTask(bool (checkCallback)(UtilTimerTask *task, void* data), void *checkCallbackData, UtilTimerTask *task) {
   jshInterruptOff();
-  unsigned char ptr = utilTimerTasksHead;
-  if (ptr != utilTimerTasksTail) {
-    ptr = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-    // now we're at the last timer task - work back until we've just gone back past utilTimerTasksTail
-    while (ptr != ((utilTimerTasksTail+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1))) {
-      if (checkCallback(&utilTimerTasks[ptr], checkCallbackData)) {
-        *task = utilTimerTasks[ptr];
-        jshInterruptOn();
-        return true;
-      }
-      ptr = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-    }
-  }
+  int slot = utilTimerFindLastTask(checkCallback, checkCallbackData);
+  if (slot>=0) *task = utilTimerTasks[slot];
   jshInterruptOn();
-  return false;
+  return slot>=0;
 }
 
-// --------------------------------------------------------------------------------------------
-// --------------------------------------------------------------------------------------------
-
 #ifndef SAVE_ON_FLASH
-// data = *JsVarRef
-static bool jstBufferTaskChecker(UtilTimerTask *task, void *data) {
-  if (!UET_IS_BUFFER_EVENT(task->type)) return false;
-  JsVarRef ref = *(JsVarRef*)data;
-  return task->data.buffer.currentBuffer==ref || task->data.buffer.nextBuffer==ref;
+/// Find the buffer task using the given variable, or -1
+static int utilTimerFindBufferTask(JsVarRef ref) {
+  unsigned int t = utilTimerBufferTasks;
+  while (t) {
+    UtilTimerTask *task = &utilTimerTasks[t-1];
+    if (task->data.buffer.currentBuffer==ref || task->data.buffer.nextBuffer==ref)
+      return (int)t-1;
+    t = utilTimerNextBufferTask[t-1];
+  }
+  return -1;
 }
 #endif
 
-// data = *Pin
-static bool jstPinTaskChecker(UtilTimerTask *task, void *data) {
-  if (task->type != UET_SET) return false;
-  Pin pin = *(Pin*)data;
-  int i;
-  for (i=0;i<UTILTIMERTASK_PIN_COUNT;i++)
-    if (task->data.set.pins[i] == pin) {
-      return true;
-    } else if (task->data.set.pins[i]==PIN_UNDEFINED)
-      return false;
-  return false;
-}
+// --------------------------------------------------------------------------------------------
+// --------------------------------------------------------------------------------------------
 
 // data = *fn
 static bool jstExecuteTaskChecker(UtilTimerTask *task, void *data) {
   if (task->type != UET_EXECUTE) return false;
-  return task->data.execute = data;
+  return task->data.execute == data;
 }
 
 // --------------------------------------------------------------------------------------------
@@ -323,17 +413,35 @@ static bool jstExecuteTaskChecker(UtilTimerTask *task, void *data) {
 
 /// Return the latest task for a pin (false if not found)
 bool jstGetLastPinTimerTask(Pin pin, UtilTimerTask *task) {
-  return utilTimerGetLastTask(jstPinTaskChecker, (void*)&pin, task);
+  if (pin >= JSH_PIN_COUNT) return false;
+  jshInterruptOff();
+  unsigned int t = utilTimerPinTask[pin];
+  if (t) *task = utilTimerTasks[t-1];
+  jshInterruptOn();
+  return t!=0;
 }
 
 #ifndef SAVE_ON_FLASH
 /// Return true if a timer task for the given variable exists (and set 'task' to it)
 bool jstGetLastBufferTimerTask(JsVar *var, UtilTimerTask *task) {
   JsVarRef ref = jsvGetRef(var);
-  return utilTimerGetLastTask(jstBufferTaskChecker, (void*)&ref, task);
+  jshInterruptOff();
+  int slot = utilTimerFindBufferTask(ref);
+  if (slot>=0) *task = utilTimerTasks[slot];
+  jshInterruptOn();
+  return slot>=0;
 }
 #endif
 
+/// Return true if any timer task is reading from or writing to a variable's data
+bool jstHasBufferTimerTasks() {
+#ifndef SAVE_ON_FLASH
+  return utilTimerBufferTasks!=0;
+#else
+  return false;
+#endif
+}
+
 bool jstPinOutputAtTime(JsSysTime time, Pin *pins, int pinCount, uint8_t value) {
   assert(pinCount<=UTILTIMERTASK_PIN_COUNT);
   UtilTimerTask task;
@@ -352,7 +460,12 @@ bool jstPinOutputAtTime(JsSysTime time, Pin *pins, int pinCount, uint8_t value)
 // Do software PWM on the given pin, using the timer IRQs
 bool jstPinPWM(JsVarFloat freq, JsVarFloat dutyCycle, Pin pin) {
   /// Remove any tasks using the given pin
-  while (utilTimerRemoveTask(jstPinTaskChecker, (void*)&pin));
+  if (pin < JSH_PIN_COUNT) {
+    jshInterruptOff();
+    while (utilTimerPinTask[pin])
+      utilTimerRemoveSlot(utilTimerPinTask[pin]-1, false);
+    jshInterruptOn();
+  }
   // if anything is wrong, exit now
   if (dutyCycle<=0 || dutyCycle>=1 || freq<=0) {
     jshPinSetValue(pin, dutyCycle >= 0.5);
@@ -417,9 +530,9 @@ bool jstSetWakeUp(JsSysTime period) {
   // work out if we're waiting for a timer,
   // and if so, when it's going to be
   jshInterruptOff();
-  if (utilTimerTasksTail!=utilTimerTasksHead) {
+  if (utilTimerHeapSize) {
     hasTimer = true;
-    nextTime = utilTimerTasks[utilTimerTasksTail].time;
+    nextTime = utilTimerTasks[utilTimerHeap[0]].time;
   }
   jshInterruptOn();
 
@@ -441,13 +554,13 @@ void jstClearWakeUp() {
   bool removedTimer = false;
   jshInterruptOff();
   // while the first item is a wakeup, remove it
-  while (utilTimerTasksTail!=utilTimerTasksHead &&
-      utilTimerTasks[utilTimerTasksTail].type == UET_WAKEUP) {
-    utilTimerTasksTail = (utilTimerTasksTail+1) & (UTILTIMERTASK_TASKS-1);
+  while (utilTimerHeapSize &&
+      utilTimerTasks[utilTimerHeap[0]].type == UET_WAKEUP) {
+    utilTimerRemoveSlot(utilTimerHeap[0], true);
     removedTimer = true;
   }
   // if the queue is now empty, and we stop the timer
-  if (utilTimerTasksTail==utilTimerTasksHead && removedTimer)
+  if (!utilTimerHeapSize && removedTimer)
     jshUtilTimerDisable();
   jshInterruptOn();
 }
@@ -492,29 +605,55 @@ bool jstStartSignal(JsSysTime startTime, JsSysTime period, Pin pin, JsVar *curre
 /// Remove the task that uses the buffer 'var'
 bool jstStopBufferTimerTask(JsVar *var) {
   JsVarRef ref = jsvGetRef(var);
-  return utilTimerRemoveTask(jstBufferTaskChecker, (void*)&ref);
+  jshInterruptOff();
+  int slot = utilTimerFindBufferTask(ref);
+  if (slot>=0) utilTimerRemoveSlot((unsigned int)slot, false);
+  jshInterruptOn();
+  return slot>=0;
 }
 
 #endif
 
 void jstReset() {
   jshUtilTimerDisable();
-  utilTimerTasksTail = utilTimerTasksHead = 0;
+  utilTimerHeapSize = 0;
+  int i;
+  for (i=0;i<JSH_PIN_COUNT;i++)
+    utilTimerPinTask[i] = 0;
+#ifndef SAVE_ON_FLASH
+  utilTimerBufferTasks = 0;
+#endif
 }
 
 void jstDumpUtilityTimers() {
-  int i;
+  int i, j;
   UtilTimerTask uTimerTasks[UTILTIMERTASK_TASKS];
+  unsigned int uTimerTaskOrder[UTILTIMERTASK_TASKS];
   jshInterruptOff();
-  for (i=0;i<UTILTIMERTASK_TASKS;i++)
-    uTimerTasks[i] = utilTimerTasks[i];
-  unsigned char uTimerTasksHead = utilTimerTasksHead;
-  unsigned char uTimerTasksTail = utilTimerTasksTail;
+  int uTimerTaskCount = utilTimerHeapSize;
+  for (i=0;i<uTimerTaskCount;i++) {
+    uTimerTasks[i] = utilTimerTasks[utilTimerHeap[i]];
+    uTimerTaskOrder[i] = utilTimerTaskOrder[utilTimerHeap[i]];
+  }
   jshInterruptOn();
+  // The heap is only partly sorted - sort it into the order the tasks will happen in
+  for (i=1;i<uTimerTaskCount;i++) {
+    for (j=i;j>0;j--) {
+      if (uTimerTasks[j-1].time < uTimerTasks[j].time ||
+          (uTimerTasks[j-1].time == uTimerTasks[j].time && (int)(uTimerTaskOrder[j-1]-uTimerTaskOrder[j]) < 0))
+        break;
+      UtilTimerTask task = uTimerTasks[j];
+      uTimerTasks[j] = uTimerTasks[j-1];
+      uTimerTasks[j-1] = task;
+      unsigned int order = uTimerTaskOrder[j];
+      uTimerTaskOrder[j] = uTimerTaskOrder[j-1];
+      uTimerTaskOrder[j-1] = order;
+    }
+  }
 
-  unsigned char t = uTimerTasksTail;
+  int t;
   bool hadTimers = false;
-  while (t!=uTimerTasksHead) {
+  for (t=0;t<uTimerTaskCount;t++) {
     hadTimers = true;
 
     UtilTimerTask task = uTimerTasks[t];
@@ -538,8 +677,6 @@ void jstDumpUtilityTimers() {
     case UET_EXECUTE : jsiConsolePrintf("EXECUTE %x\n", task.data.execute); break;
     default : jsiConsolePrintf("Unknown type %d\n", task.type); break;
     }
-
-    t = (t+1) & (UTILTIMERTASK_TASKS-1);
   }
   if (!hadTimers)
       jsiConsolePrintf("No Timers found.\n");
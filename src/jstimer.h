@@ -102,6 +102,10 @@ bool jstGetLastPinTimerTask(Pin pin, UtilTimerTask *task);
 /// Return true if a timer task for the given variable exists (and set 'task' to it)
 bool jstGetLastBufferTimerTask(JsVar *var, UtilTimerTask *task);
 
+/** Return true if any timer task is reading from or writing to a variable's data.
+ * These tasks hold direct pointers into the variable, so it must not be moved */
+bool jstHasBufferTimerTasks();
+
 /// returns false if timer queue was full... Changes the state of one or more pins at a certain time (using a timer)
 bool jstPinOutputAtTime(JsSysTime time, Pin *pins, int pinCount, uint8_t value);
 
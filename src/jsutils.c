@@ -23,6 +23,10 @@
  * but which are good to know about */
 JsErrorFlags jsErrorFlags;
 
+#ifdef LINUX
+JsStats jsStats;
+#endif
+
 bool isIDString(const char *s) {
   if (!isAlpha(*s))
     return false;
@@ -366,6 +366,21 @@ typedef enum {
  * but which are good to know about */
 extern JsErrorFlags jsErrorFlags;
 
+#ifdef LINUX
+/** Interpreter counters, so the Linux build can measure what a script does
+ * (see '--bench' in targets/linux/main.c) */
+typedef struct {
+  unsigned int varsAllocated; ///< JsVars allocated (a flat string counts all its blocks)
+  unsigned int varsFreed; ///< JsVars freed
+  unsigned int varsUsed; ///< JsVars in use right now
+  unsigned int varsPeak; ///< The most JsVars that were in use at once
+  unsigned int gcPasses; ///< Garbage collection passes
+  JsSysTime gcTime; ///< Time spent collecting garbage
+  unsigned int tokens; ///< Tokens read by the lexer
+} JsStats;
+extern JsStats jsStats;
+#endif
+
 
 #ifdef FAKE_STDLIB
 char *strncat(char *dst, const char *src, size_t c);
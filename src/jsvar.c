@@ -20,6 +20,8 @@
 #include "jswrap_math.h" // for jswrap_math_mod
 #include "jswrap_object.h" // for jswrap_object_toString
 #include "jswrap_arraybuffer.h" // for jsvNewTypedArray
+#include "jstimer.h" // for jstHasBufferTimerTasks
+#include "jsprofiler.h"
 
 /** Basically, JsVars are stored in one big array, so save the need for
  * lots of memory allocation. On Linux, the arrays are in blocks, so that
@@ -40,6 +42,10 @@ unsigned int jsVarsSize = JSVAR_CACHE_SIZE;
 
 JsVarRef jsVarFirstEmpty; ///< reference of first unused variable (variables are in a linked list)
 
+/** How many runs of moved variables jsvDefragment remembers before rewriting
+ * references to them. Each gap in memory starts a new run */
+#define JSV_DEFRAG_RUNS 64
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 
@@ -348,14 +354,28 @@ void jsvResetVariable(JsVar *v, JsVarFlags flags) {
   v->flags = flags | JSV_LOCK_ONE;
 }
 
+#ifdef LINUX
+static void jsvStatsAllocated(unsigned int count) {
+  jsStats.varsAllocated += count;
+  jsStats.varsUsed += count;
+  if (jsStats.varsUsed > jsStats.varsPeak)
+    jsStats.varsPeak = jsStats.varsUsed;
+}
+#endif
+
 JsVar *jsvNewWithFlags(JsVarFlags flags) {
+  JSPR_SUBSYSTEM(JSPS_ALLOC);
   if (jsVarFirstEmpty!=0) {
     assert(jsvGetAddressOf(jsVarFirstEmpty)->flags == JSV_UNUSED);
     jshInterruptOff(); // to allow this to be used from an IRQ
     JsVar *v = jsvLock(jsVarFirstEmpty);
     jsVarFirstEmpty = jsvGetNextSibling(v); // move our reference to the next in the free list
+#ifdef LINUX
+    jsvStatsAllocated(1);
+#endif
     jshInterruptOn();
     jsvResetVariable(v, flags); // setup variable, and add one lock
+    JSPR_TRACE_ALLOC(v);
     // return pointer
     return v;
   }
@@ -384,10 +404,15 @@ JsVar *jsvNewWithFlags(JsVarFlags flags) {
 ALWAYS_INLINE void jsvFreePtrInternal(JsVar *var) {
   assert(jsvGetLocks(var)==0);
   var->flags = JSV_UNUSED;
+  JSPR_TRACE_FREE(jsvGetRef(var));
   // add this to our free list
   jshInterruptOff(); // to allow this to be used from an IRQ
   jsvSetNextSibling(var, jsVarFirstEmpty);
   jsVarFirstEmpty = jsvGetRef(var);
+#ifdef LINUX
+  jsStats.varsFreed++;
+  jsStats.varsUsed--;
+#endif
   jshInterruptOn();
 }
 
@@ -624,6 +649,10 @@ JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
         var->varData.integer = (JsVarInt)byteLength;
         // clear data
         memset((char*)&var[1], 0, sizeof(JsVar)*(blocks-1));
+#ifdef LINUX
+        jsvStatsAllocated((unsigned int)blocks);
+#endif
+        JSPR_TRACE_ALLOC(var);
         // Now re-link all the free variables
         jsvCreateEmptyVarList();
         return var;
@@ -745,10 +774,95 @@ JsVar *jsvNewFromLongInteger(long long value) {
     return jsvNewFromFloat((JsVarFloat)value);
 }
 
+/* Shared, read-only booleans and small integers. jsvMathsOp hands these out
+ * (locked again) rather than allocating a new JsVar for every result. They are
+ * allocated in jspSoftInit and each keeps a lock of its own, so they can't be
+ * freed, garbage collected or moved by defrag. Anything that changes a
+ * variable in place must check jsvIsShared first. */
+#define JSV_SHARED_INT_MIN (-1)
+#ifdef RESIZABLE_JSVARS
+#define JSV_SHARED_INT_MAX 15
+#else
+#define JSV_SHARED_INT_MAX 7
+#endif
+#define JSV_SHARED_INT_COUNT (JSV_SHARED_INT_MAX+1-JSV_SHARED_INT_MIN)
+// Only hand out a shared var while it has plenty of lock/ref headroom left
+#define JSV_SHARED_LOCKS_MAX (JSV_LOCK_MAX/2)
+#define JSV_SHARED_REFS_MAX 127
+
+static JsVarRef jsvSharedBools[2];
+static JsVarRef jsvSharedInts[JSV_SHARED_INT_COUNT];
+
+static JsVarRef jsvNewSharedValue(JsVarFlags flags, JsVarInt value) {
+  JsVar *v = jsvNewWithFlags(flags);
+  if (!v) return 0; // no memory - we just won't share this one
+  v->varData.integer = value;
+  return jsvGetRef(v); // we keep this lock
+}
+
+/// Allocate the shared values - called from jspSoftInit
+void jsvInitSharedValues() {
+  unsigned int i;
+  for (i=0;i<2;i++)
+    jsvSharedBools[i] = jsvNewSharedValue(JSV_BOOLEAN, (JsVarInt)i);
+  for (i=0;i<JSV_SHARED_INT_COUNT;i++)
+    jsvSharedInts[i] = jsvNewSharedValue(JSV_INTEGER, (JsVarInt)i+JSV_SHARED_INT_MIN);
+}
+
+/// Release the shared values - called from jspSoftKill, so none end up saved or leaked
+void jsvKillSharedValues() {
+  unsigned int i;
+  for (i=0;i<2;i++) {
+    if (jsvSharedBools[i]) jsvUnLock(jsvGetAddressOf(jsvSharedBools[i]));
+    jsvSharedBools[i] = 0;
+  }
+  for (i=0;i<JSV_SHARED_INT_COUNT;i++) {
+    if (jsvSharedInts[i]) jsvUnLock(jsvGetAddressOf(jsvSharedInts[i]));
+    jsvSharedInts[i] = 0;
+  }
+}
+
+/// Lock and return the shared var with this ref, or return 0 if it can't be shared right now
+static JsVar *jsvGetSharedValue(JsVarRef ref) {
+  if (!ref) return 0;
+  JsVar *v = jsvGetAddressOf(ref);
+  if (jsvGetLocks(v) >= JSV_SHARED_LOCKS_MAX || jsvGetRefs(v) >= JSV_SHARED_REFS_MAX)
+    return 0;
+  return jsvLockAgain(v);
+}
+
+JsVar *jsvNewSharedFromBool(bool value) {
+  JsVar *v = jsvGetSharedValue(jsvSharedBools[value?1:0]);
+  return v ? v : jsvNewFromBool(value);
+}
+
+JsVar *jsvNewSharedFromLongInteger(long long value) {
+  if (value>=JSV_SHARED_INT_MIN && value<=JSV_SHARED_INT_MAX) {
+    JsVar *v = jsvGetSharedValue(jsvSharedInts[value-JSV_SHARED_INT_MIN]);
+    if (v) return v;
+  }
+  return jsvNewFromLongInteger(value);
+}
+
+bool jsvIsShared(JsVar *v) {
+  if (!v) return false;
+  JsVarFlags t = v->flags & JSV_VARTYPEMASK;
+  JsVarRef ref = 0;
+  if (t==JSV_BOOLEAN) {
+    ref = jsvSharedBools[v->varData.integer?1:0];
+  } else if (t==JSV_INTEGER) {
+    JsVarInt i = v->varData.integer;
+    if (i>=JSV_SHARED_INT_MIN && i<=JSV_SHARED_INT_MAX)
+      ref = jsvSharedInts[i-JSV_SHARED_INT_MIN];
+  }
+  return ref && jsvGetAddressOf(ref)==v;
+}
+
 
 JsVar *jsvMakeIntoVariableName(JsVar *var, JsVar *valueOrZero) {
   if (!var) return 0;
   assert(jsvGetRefs(var)==0); // make sure it's unused
+  assert(!jsvIsShared(var));
   assert(jsvIsSimpleInt(var) || jsvIsString(var));
   JsVarFlags varType = (var->flags & JSV_VARTYPEMASK);
   if (varType==JSV_INTEGER) {
@@ -1497,7 +1611,7 @@ long long jsvGetLongIntegerAndUnLock(JsVar *v) {
 
 
 void jsvSetInteger(JsVar *v, JsVarInt value) {
-  assert(jsvIsInt(v));
+  assert(jsvIsInt(v) && !jsvIsShared(v));
   v->varData.integer  = value;
 }
 
@@ -1576,6 +1690,24 @@ JsVarFloat jsvGetFloatAndUnLock(JsVar *v) { return _jsvGetFloatAndUnLock(v); }
 bool jsvGetBoolAndUnLock(JsVar *v) { return _jsvGetBoolAndUnLock(v); }
 #endif
 
+JsVar *jsvGetArrayBufferFlatString(JsVar *arrayBuffer, char **ptr) {
+  JsVar *str = jsvGetArrayBufferBackingString(arrayBuffer);
+  if (!jsvIsFlatString(str)) {
+    jsvUnLock(str);
+    return 0;
+  }
+  size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(arrayBuffer->varData.arraybuffer.type);
+  size_t byteOffset = arrayBuffer->varData.arraybuffer.byteOffset;
+  char *p = jsvGetFlatStringPointer(str) + byteOffset;
+  if (((size_t)p & (elementSize-1)) || // not aligned (sizes are all powers of 2)
+      byteOffset + jsvGetArrayBufferLength(arrayBuffer)*elementSize > jsvGetStringLength(str)) {
+    jsvUnLock(str);
+    return 0;
+  }
+  *ptr = p;
+  return str;
+}
+
 /** Get the item at the given location in the array buffer and return the result */
 size_t jsvGetArrayBufferLength(JsVar *arrayBuffer) {
   assert(jsvIsArrayBuffer(arrayBuffer));
@@ -2142,8 +2274,8 @@ JsVar *jsvCreateNewChild(JsVar *parent, JsVar *index, JsVar *child) {
 
 /** Try and turn the supplied variable into a name. If not, make a new one. This locks again. */
 JsVar *jsvAsName(JsVar *var) {
-  if (jsvGetRefs(var) == 0) {
-    // Not reffed - great! let's just use it
+  if (jsvGetRefs(var) == 0 && !jsvIsShared(var)) {
+    // Not reffed (or shared) - great! let's just use it
     if (!jsvIsName(var))
       var = jsvMakeIntoVariableName(var, 0);
     return jsvLockAgain(var);
@@ -2175,6 +2307,44 @@ JsVar *jsvFindChildFromVar(JsVar *parent, JsVar *childName, bool addIfNotFound)
   return child;
 }
 
+/// Is this the name of an object's event listeners (does it start with JS_EVENT_PREFIX)?
+static bool jsvIsEventListenerName(JsVar *v) {
+  return jsvIsString(v) && jsvGetCharactersInVar(v)>=3 &&
+         v->varData.str[0]==JS_EVENT_PREFIX[0] &&
+         v->varData.str[1]==JS_EVENT_PREFIX[1] &&
+         v->varData.str[2]==JS_EVENT_PREFIX[2];
+}
+
+/* Look for the child containing the listeners for an event - either 'event'
+ * (without JS_EVENT_PREFIX) or 'eventName' (with it). Most names are
+ * rejected on their first character, so we only compare the whole string
+ * for ones that start with JS_EVENT_PREFIX. */
+static JsVar *jsvFindEventListenersInternal(JsVar *parent, JsVar *event, const char *eventName) {
+  assert(jsvHasChildren(parent));
+  JsVarRef childref = jsvGetFirstChild(parent);
+  while (childref) {
+    // Don't Lock here, just use GetAddressOf - as in jsvFindChildFromString
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsEventListenerName(child) &&
+        (event ?
+         jsvCompareString(child, event, strlen(JS_EVENT_PREFIX), 0, false)==0 :
+         jsvIsStringEqual(child, eventName)))
+      return jsvLockAgain(child);
+    childref = jsvGetNextSibling(child);
+  }
+  return 0;
+}
+
+JsVar *jsvFindEventListeners(JsVar *parent, JsVar *event) {
+  return jsvFindEventListenersInternal(parent, event, 0);
+}
+
+JsVar *jsvFindEventListenersFromString(JsVar *parent, const char *eventName) {
+  if (strncmp(eventName, JS_EVENT_PREFIX, strlen(JS_EVENT_PREFIX))!=0)
+    return jsvFindChildFromString(parent, eventName, false);
+  return jsvFindEventListenersInternal(parent, 0, eventName);
+}
+
 void jsvRemoveChild(JsVar *parent, JsVar *child) {
   assert(jsvHasChildren(parent));
   assert(jsvIsName(child));
@@ -2702,9 +2872,9 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
   if (op == LEX_TYPEEQUAL || op == LEX_NTYPEEQUAL) {
     bool eql = jsvMathsOpTypeEqual(a,b);
     if (op == LEX_TYPEEQUAL)
-      return jsvNewFromBool(eql);
+      return jsvNewSharedFromBool(eql);
     else
-      return jsvNewFromBool(!eql);
+      return jsvNewSharedFromBool(!eql);
   }
 
   bool needsInt = op=='&' || op=='|' || op=='^' || op==LEX_LSHIFT || op==LEX_RSHIFT || op==LEX_RSHIFTUNSIGNED;
@@ -2723,9 +2893,9 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
   // do maths...
   if (jsvIsUndefined(a) && jsvIsUndefined(b)) {
     if (op == LEX_EQUAL)
-      return jsvNewFromBool(true);
+      return jsvNewSharedFromBool(true);
     else if (op == LEX_NEQUAL)
-      return jsvNewFromBool(false);
+      return jsvNewSharedFromBool(false);
     else
       return 0; // undefined
   } else if (needsNumeric ||
@@ -2737,23 +2907,23 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
       JsVarInt da = jsvGetInteger(a);
       JsVarInt db = jsvGetInteger(b);
       switch (op) {
-      case '+': return jsvNewFromLongInteger((long long)da + (long long)db);
-      case '-': return jsvNewFromLongInteger((long long)da - (long long)db);
-      case '*': return jsvNewFromLongInteger((long long)da * (long long)db);
+      case '+': return jsvNewSharedFromLongInteger((long long)da + (long long)db);
+      case '-': return jsvNewSharedFromLongInteger((long long)da - (long long)db);
+      case '*': return jsvNewSharedFromLongInteger((long long)da * (long long)db);
       case '/': return jsvNewFromFloat((JsVarFloat)da/(JsVarFloat)db);
-      case '&': return jsvNewFromInteger(da&db);
-      case '|': return jsvNewFromInteger(da|db);
-      case '^': return jsvNewFromInteger(da^db);
-      case '%': return db ? jsvNewFromInteger(da%db) : jsvNewFromFloat(NAN);
-      case LEX_LSHIFT: return jsvNewFromInteger(da << db);
-      case LEX_RSHIFT: return jsvNewFromInteger(da >> db);
-      case LEX_RSHIFTUNSIGNED: return jsvNewFromInteger((JsVarInt)(((JsVarIntUnsigned)da) >> db));
-      case LEX_EQUAL:     return jsvNewFromBool(da==db && jsvIsNull(a)==jsvIsNull(b));
-      case LEX_NEQUAL:    return jsvNewFromBool(da!=db || jsvIsNull(a)!=jsvIsNull(b));
-      case '<':           return jsvNewFromBool(da<db);
-      case LEX_LEQUAL:    return jsvNewFromBool(da<=db);
-      case '>':           return jsvNewFromBool(da>db);
-      case LEX_GEQUAL:    return jsvNewFromBool(da>=db);
+      case '&': return jsvNewSharedFromLongInteger(da&db);
+      case '|': return jsvNewSharedFromLongInteger(da|db);
+      case '^': return jsvNewSharedFromLongInteger(da^db);
+      case '%': return db ? jsvNewSharedFromLongInteger(da%db) : jsvNewFromFloat(NAN);
+      case LEX_LSHIFT: return jsvNewSharedFromLongInteger(da << db);
+      case LEX_RSHIFT: return jsvNewSharedFromLongInteger(da >> db);
+      case LEX_RSHIFTUNSIGNED: return jsvNewSharedFromLongInteger((JsVarInt)(((JsVarIntUnsigned)da) >> db));
+      case LEX_EQUAL:     return jsvNewSharedFromBool(da==db && jsvIsNull(a)==jsvIsNull(b));
+      case LEX_NEQUAL:    return jsvNewSharedFromBool(da!=db || jsvIsNull(a)!=jsvIsNull(b));
+      case '<':           return jsvNewSharedFromBool(da<db);
+      case LEX_LEQUAL:    return jsvNewSharedFromBool(da<=db);
+      case '>':           return jsvNewSharedFromBool(da>db);
+      case LEX_GEQUAL:    return jsvNewSharedFromBool(da>=db);
       default: return jsvMathsOpError(op, "Integer");
       }
     } else {
@@ -2770,12 +2940,12 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
       case LEX_NEQUAL:  { bool equal = da==db;
       if ((jsvIsNull(a) && jsvIsUndefined(b)) ||
           (jsvIsNull(b) && jsvIsUndefined(a))) equal = true; // JS quirk :)
-      return jsvNewFromBool((op==LEX_EQUAL) ? equal : ((bool)!equal));
+      return jsvNewSharedFromBool((op==LEX_EQUAL) ? equal : ((bool)!equal));
       }
-      case '<':           return jsvNewFromBool(da<db);
-      case LEX_LEQUAL:    return jsvNewFromBool(da<=db);
-      case '>':           return jsvNewFromBool(da>db);
-      case LEX_GEQUAL:    return jsvNewFromBool(da>=db);
+      case '<':           return jsvNewSharedFromBool(da<db);
+      case LEX_LEQUAL:    return jsvNewSharedFromBool(da<=db);
+      case '>':           return jsvNewSharedFromBool(da>db);
+      case LEX_GEQUAL:    return jsvNewSharedFromBool(da>=db);
       default: return jsvMathsOpError(op, "Double");
       }
     }
@@ -2794,8 +2964,8 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
 
     /* Just check pointers */
     switch (op) {
-    case LEX_EQUAL:  return jsvNewFromBool(equal);
-    case LEX_NEQUAL: return jsvNewFromBool(!equal);
+    case LEX_EQUAL:  return jsvNewSharedFromBool(equal);
+    case LEX_NEQUAL: return jsvNewSharedFromBool(!equal);
     default: return jsvMathsOpError(op, jsvIsArray(a)?"Array":"Object");
     }
   } else {
@@ -2818,17 +2988,53 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
     jsvUnLock2(da, db);
     // use strings
     switch (op) {
-    case LEX_EQUAL:     return jsvNewFromBool(cmp==0);
-    case LEX_NEQUAL:    return jsvNewFromBool(cmp!=0);
-    case '<':           return jsvNewFromBool(cmp<0);
-    case LEX_LEQUAL:    return jsvNewFromBool(cmp<=0);
-    case '>':           return jsvNewFromBool(cmp>0);
-    case LEX_GEQUAL:    return jsvNewFromBool(cmp>=0);
+    case LEX_EQUAL:     return jsvNewSharedFromBool(cmp==0);
+    case LEX_NEQUAL:    return jsvNewSharedFromBool(cmp!=0);
+    case '<':           return jsvNewSharedFromBool(cmp<0);
+    case LEX_LEQUAL:    return jsvNewSharedFromBool(cmp<=0);
+    case '>':           return jsvNewSharedFromBool(cmp>0);
+    case LEX_GEQUAL:    return jsvNewSharedFromBool(cmp>=0);
     default: return jsvMathsOpError(op, "String");
     }
   }
 }
 
+bool jsvMathsOpInPlace(JsVar *a, JsVar *b, int op, JsVar **oldValue) {
+  if ((op!='+' && op!='-') || !jsvIsName(a) || jsvIsArrayBufferName(a) || jsvIsNewChild(a))
+    return false;
+  bool bIsInt = jsvIsSimpleInt(b);
+  if (!bIsInt && !jsvIsFloat(b)) return false;
+  if (jsvIsNameInt(a)) {
+    // the value is stored in the name itself
+    if (!bIsInt) return false; // result would be a float
+    JsVarInt va = (JsVarInt)jsvGetFirstChildSigned(a);
+    long long r = (op=='+') ? (long long)va + b->varData.integer : (long long)va - b->varData.integer;
+    if (r<JSVARREF_MIN || r>JSVARREF_MAX) return false; // won't fit back in the name
+    if (oldValue && !(*oldValue = jsvNewSharedFromLongInteger(va))) return false;
+    jsvSetFirstChild(a, (JsVarRef)(JsVarRefSigned)r);
+    return true;
+  }
+  if (jsvIsNameWithValue(a) || !jsvGetFirstChild(a)) return false;
+  JsVar *v = jsvLock(jsvGetFirstChild(a));
+  // we can only change the value if nothing else can see it
+  bool ok = jsvGetRefs(v)==1 && jsvGetLocks(v)==1;
+  if (ok && jsvIsFloat(v)) {
+    JsVarFloat vv = v->varData.floating;
+    JsVarFloat vb = bIsInt ? (JsVarFloat)b->varData.integer : b->varData.floating;
+    if (oldValue) ok = (*oldValue = jsvNewFromFloat(vv))!=0;
+    if (ok) v->varData.floating = (op=='+') ? vv+vb : vv-vb;
+  } else if (ok && jsvIsSimpleInt(v) && bIsInt) {
+    JsVarInt vv = v->varData.integer;
+    long long r = (op=='+') ? (long long)vv + b->varData.integer : (long long)vv - b->varData.integer;
+    ok = r>=-2147483648LL && r<=2147483647LL; // otherwise it'd become a float
+    if (ok && oldValue) ok = (*oldValue = jsvNewSharedFromLongInteger(vv))!=0;
+    if (ok) v->varData.integer = (JsVarInt)r;
+  } else
+    ok = false;
+  jsvUnLock(v);
+  return ok;
+}
+
 JsVar *jsvNegateAndUnLock(JsVar *v) {
   JsVar *zero = jsvNewFromInteger(0);
   JsVar *res = jsvMathsOpSkipNames(zero, v, '-');
@@ -3035,7 +3241,11 @@ static void jsvGarbageCollectMarkUsed(JsVar *var) {
 
 /** Run a garbage collection sweep - return true if things have been freed */
 bool jsvGarbageCollect() {
+  JSPR_SUBSYSTEM(JSPS_GC);
   JsVarRef i;
+#ifdef LINUX
+  JsSysTime startTime = jshGetSystemTime();
+#endif
   // clear garbage collect flags
   for (i=1;i<=jsVarsSize;i++)  {
     JsVar *var = jsvGetAddressOf(i);
@@ -3066,9 +3276,14 @@ bool jsvGarbageCollect() {
         // if we're a flat string, there are more blocks to free
         // work backwards, so our free list is in the right order
         unsigned int count = 1 + (unsigned int)jsvGetFlatStringBlocks(var);
+#ifdef LINUX
+        jsStats.varsFreed += count;
+        jsStats.varsUsed -= count;
+#endif
         while (count-- > 0) {
           var = jsvGetAddressOf(i+count);
           var->flags = JSV_UNUSED;
+          JSPR_TRACE_FREE((JsVarRef)(i+count));
           // add this to our free list
           jsvSetNextSibling(var, jsVarFirstEmpty);
           jsVarFirstEmpty = jsvGetRef(var);
@@ -3077,6 +3292,11 @@ bool jsvGarbageCollect() {
         // otherwise just free 1 block
         // free!
         var->flags = JSV_UNUSED;
+        JSPR_TRACE_FREE(i);
+#ifdef LINUX
+        jsStats.varsFreed++;
+        jsStats.varsUsed--;
+#endif
         // add this to our free list
         jsvSetNextSibling(var, jsVarFirstEmpty);
         jsVarFirstEmpty = jsvGetRef(var);
@@ -3086,9 +3306,156 @@ bool jsvGarbageCollect() {
       i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
     }
   }
+#ifdef LINUX
+  jsStats.gcPasses++;
+  jsStats.gcTime += jshGetSystemTime() - startTime;
+#endif
   return freedSomething;
 }
 
+/** Get the percentage of free memory that is NOT part of the largest
+ * contiguous run of free variables. 0 means all free memory could be used
+ * for one flat string, 100 means none of it could. */
+unsigned int jsvGetMemoryFragmentation() {
+  unsigned int freeVars = 0;
+  unsigned int run = 0, largestRun = 0;
+  JsVarRef i;
+  for (i=1;i<=jsVarsSize;i++) {
+    JsVar *var = jsvGetAddressOf(i);
+#ifdef RESIZABLE_JSVARS
+    // flat strings can't span the separate blocks of variables
+    if (((i-1)&(JSVAR_BLOCK_SIZE-1))==0) run = 0;
+#endif
+    if ((var->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
+      freeVars++;
+      run++;
+      if (run>largestRun) largestRun = run;
+    } else {
+      run = 0;
+      if (jsvIsFlatString(var))
+        i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    }
+  }
+  if (!freeVars) return 0;
+  return 100 - (largestRun*100 / freeVars);
+}
+
+/** Given a sorted list of runs of variables that have just been moved (run
+ * n moved len[n] variables from from[n] to to[n]), return where 'ref' has
+ * been moved to (or 'ref' itself if it wasn't moved) */
+static JsVarRef jsvDefragGetNewRef(JsVarRef ref, const JsVarRef *from, const JsVarRef *to, const JsVarRef *len, unsigned int count) {
+  if (!ref || ref<from[0] || ref>=from[count-1]+len[count-1]) return ref;
+  // find the last run that starts at or before ref
+  unsigned int lo = 0, hi = count;
+  while (hi-lo > 1) {
+    unsigned int mid = (lo+hi)>>1;
+    if (from[mid] <= ref) lo = mid;
+    else hi = mid;
+  }
+  return (ref < from[lo]+len[lo]) ? (JsVarRef)(to[lo] + (ref-from[lo])) : ref;
+}
+
+/** After moving some variables, rewrite every reference to them - in all
+ * variables' sibling/child links, and in the few references we keep outside
+ * of the variable store. Any other C code that keeps a JsVarRef between
+ * calls must either keep it locked (so it never moves) or be updated here. */
+static void jsvDefragUpdateRefs(const JsVarRef *from, const JsVarRef *to, const JsVarRef *len, unsigned int count) {
+  JsVarRef i;
+  for (i=1;i<=jsVarsSize;i++) {
+    JsVar *var = jsvGetAddressOf(i);
+    if ((var->flags&JSV_VARTYPEMASK) == JSV_UNUSED) continue;
+    if (jsvIsFlatString(var)) {
+      // flat strings contain only character data
+      i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+      continue;
+    }
+    if (jsvHasCharacterData(var))
+      jsvSetLastChild(var, jsvDefragGetNewRef(jsvGetLastChild(var), from, to, len, count));
+    if (jsvIsName(var)) {
+      jsvSetNextSibling(var, jsvDefragGetNewRef(jsvGetNextSibling(var), from, to, len, count));
+      jsvSetPrevSibling(var, jsvDefragGetNewRef(jsvGetPrevSibling(var), from, to, len, count));
+    }
+    if (jsvHasSingleChild(var)) {
+      jsvSetFirstChild(var, jsvDefragGetNewRef(jsvGetFirstChild(var), from, to, len, count));
+    } else if (jsvHasChildren(var)) {
+      jsvSetFirstChild(var, jsvDefragGetNewRef(jsvGetFirstChild(var), from, to, len, count));
+      jsvSetLastChild(var, jsvDefragGetNewRef(jsvGetLastChild(var), from, to, len, count));
+    }
+  }
+  timerArray = jsvDefragGetNewRef(timerArray, from, to, len, count);
+  watchArray = jsvDefragGetNewRef(watchArray, from, to, len, count);
+}
+
+/** Slide all unlocked variables (including flat strings) down towards the
+ * start of memory so that free memory ends up contiguous. Locked variables
+ * may have pointers to them held in C code, so they are pinned and never
+ * move. Variables between two gaps all move by the same amount, so moves
+ * are remembered as runs. After JSV_DEFRAG_RUNS runs (and at the end) all
+ * references are rewritten with one pass over memory - but only the references that
+ * jsvDefragUpdateRefs knows about, so C code must not hold on to the
+ * JsVarRef of an unlocked variable.
+ *
+ * Anything the interpreter is using right now is locked, so this can be
+ * called from idle or from JS (E.defrag) - but not from an IRQ. */
+void jsvDefragment() {
+  // get rid of anything unreferenced first, so we don't move it
+  jsvGarbageCollect();
+  // Buffer tasks in the utility timer point directly at string data
+  if (jstHasBufferTimerTasks()) return;
+
+  JsVarRef from[JSV_DEFRAG_RUNS], to[JSV_DEFRAG_RUNS], len[JSV_DEFRAG_RUNS];
+  JsVarRef dst = 1; // everything from here up to 'i' is free
+  JsVarRef i = 1;
+  while (i<=jsVarsSize) {
+    unsigned int count = 0;
+    jshInterruptOff();
+    // IRQs may have allocated a variable in the free area since our last batch
+    JsVarRef j;
+    for (j=dst;j<i;j++)
+      if ((jsvGetAddressOf(j)->flags&JSV_VARTYPEMASK) != JSV_UNUSED)
+        dst = (JsVarRef)(j+1);
+    while (i<=jsVarsSize && count<JSV_DEFRAG_RUNS) {
+      JsVar *var = jsvGetAddressOf(i);
+      if ((var->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
+        i++;
+        continue;
+      }
+      JsVarRef blocks = (JsVarRef)(jsvIsFlatString(var) ? 1+jsvGetFlatStringBlocks(var) : 1);
+      JsVarRef target = dst;
+#ifdef RESIZABLE_JSVARS
+      // flat strings can't span the separate blocks of variables
+      if (((target-1)>>JSVAR_BLOCK_SHIFT) != ((target+blocks-2)>>JSVAR_BLOCK_SHIFT))
+        target = (JsVarRef)(((((target-1)>>JSVAR_BLOCK_SHIFT)+1)<<JSVAR_BLOCK_SHIFT) + 1);
+#endif
+      if (target<i && jsvGetLocks(var)==0) {
+        memmove(jsvGetAddressOf(target), var, sizeof(JsVar)*blocks);
+        JSPR_TRACE_MOVE(i, target);
+        JSPR_VAR_MOVED(i, target);
+        // free whatever part of the old position we didn't move on top of
+        for (j=(JsVarRef)((target+blocks > i) ? target+blocks : i);j<i+blocks;j++)
+          jsvGetAddressOf(j)->flags = JSV_UNUSED;
+        if (count && from[count-1]+len[count-1]==i && to[count-1]+len[count-1]==target) {
+          len[count-1] = (JsVarRef)(len[count-1]+blocks); // carry on with the last run
+        } else {
+          from[count] = i;
+          to[count] = target;
+          len[count] = blocks;
+          count++;
+        }
+        dst = (JsVarRef)(target+blocks);
+      } else {
+        dst = (JsVarRef)(i+blocks);
+      }
+      i = (JsVarRef)(i+blocks);
+    }
+    if (count) {
+      jsvDefragUpdateRefs(from, to, len, count);
+      jsvCreateEmptyVarList();
+    }
+    jshInterruptOn();
+  }
+}
+
 /** Remove whitespace to the right of a string - on MULTIPLE LINES */
 JsVar *jsvStringTrimRight(JsVar *srcString) {
   JsvStringIterator src, dst;
@@ -306,6 +306,12 @@ JsVar *jsvNewFromBool(bool value);
 JsVar *jsvNewFromFloat(JsVarFloat value);
 // Create an integer (or float) from this value, depending on whether it'll fit in 32 bits or not.
 JsVar *jsvNewFromLongInteger(long long value);
+// Like jsvNewFromBool/jsvNewFromLongInteger, but may return a shared read-only var. Use only for values that won't be modified in place.
+JsVar *jsvNewSharedFromBool(bool value);
+JsVar *jsvNewSharedFromLongInteger(long long value);
+bool jsvIsShared(JsVar *v); ///< Is this one of the shared read-only values? If so, it mustn't be modified
+void jsvInitSharedValues(); ///< Allocate the shared values - called from jspSoftInit
+void jsvKillSharedValues(); ///< Release the shared values - called from jspSoftKill
 // Turns var into a Variable name that links to the given value... No locking so no need to unlock var
 JsVar *jsvMakeIntoVariableName(JsVar *var, JsVar *valueOrZero);
 void jsvMakeFunctionParameter(JsVar *v);
@@ -558,6 +564,11 @@ long long jsvGetLongIntegerAndUnLock(JsVar *v);
 size_t jsvGetArrayBufferLength(JsVar *arrayBuffer);
 /** Get the String the contains the data for this arrayBuffer */
 JsVar *jsvGetArrayBufferBackingString(JsVar *arrayBuffer);
+/** If the data for this ArrayBuffer view is all in one flat string (with its
+ * elements suitably aligned), return that string and set ptr to the first
+ * element. Otherwise return 0. The string stays locked (so can't be moved)
+ * until you unlock it - don't use ptr after that. */
+JsVar *jsvGetArrayBufferFlatString(JsVar *arrayBuffer, char **ptr);
 /** Get the item at the given location in the array buffer and return the result */
 JsVar *jsvArrayBufferGet(JsVar *arrayBuffer, size_t index);
 /** Set the item at the given location in the array buffer */
@@ -612,6 +623,11 @@ JsVar *jsvAsName(JsVar *var);
 JsVar *jsvMathsOpSkipNames(JsVar *a, JsVar *b, int op);
 bool jsvMathsOpTypeEqual(JsVar *a, JsVar *b);
 JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op);
+/** Apply '+' or '-' with the number b to the number that the name a refers to,
+ * in place and without allocating. Returns false (having changed nothing) if
+ * that isn't possible, in which case use jsvMathsOp. If oldValue isn't 0 it is
+ * set to the value from before. */
+bool jsvMathsOpInPlace(JsVar *a, JsVar *b, int op, JsVar **oldValue);
 /// Negates an integer/double value
 JsVar *jsvNegateAndUnLock(JsVar *v);
 
@@ -632,6 +648,11 @@ JsVar *jsvSetNamedChild(JsVar *parent, JsVar *child, const char *name); // Add a
 JsVar *jsvSetValueOfName(JsVar *name, JsVar *src); // Set the value of a child created with jsvAddName,jsvAddNamedChild. Returns the UNLOCKED name argument
 JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool createIfNotFound); // Non-recursive finding of child with name. Returns a LOCKED var
 JsVar *jsvFindChildFromVar(JsVar *parent, JsVar *childName, bool addIfNotFound); // Non-recursive finding of child with name. Returns a LOCKED var
+/** Find the child of parent containing the listeners for 'event' (for instance 'data' for
+ * JS_EVENT_PREFIX"data"), without allocating any memory. Returns a LOCKED name or 0 */
+JsVar *jsvFindEventListeners(JsVar *parent, JsVar *event);
+/// Like jsvFindEventListeners, but eventName includes JS_EVENT_PREFIX. Other names are found with jsvFindChildFromString
+JsVar *jsvFindEventListenersFromString(JsVar *parent, const char *eventName);
 
 /// Remove a child - note that the child MUST ACTUALLY BE A CHILD! and should be a name, not a value.
 void jsvRemoveChild(JsVar *parent, JsVar *child);
@@ -672,6 +693,16 @@ void jsvTrace(JsVar *var, int indent);
 /** Run a garbage collection sweep - return true if things have been freed */
 bool jsvGarbageCollect();
 
+/** Get the percentage of free memory that is not part of the largest contiguous
+ * run of free variables (eg. that couldn't be used for a single flat string) */
+unsigned int jsvGetMemoryFragmentation();
+
+/** Move unlocked variables down in memory so that free memory is contiguous. Only
+ * call this when no code is executing. Only references inside variables (and
+ * timerArray/watchArray) are updated, so any JsVarRef kept in C code must be
+ * locked or added to jsvDefragUpdateRefs */
+void jsvDefragment();
+
 /** Remove whitespace to the right of a string - on MULTIPLE LINES */
 JsVar *jsvStringTrimRight(JsVar *srcString);
 
@@ -138,6 +138,61 @@ unsigned int jsvIterateCallbackToBytes(JsVar *var, unsigned char *data, unsigned
   return cbData.idx;
 }
 
+/// Call callback with the raw data in a string from startIdx, one block at a time
+static void jsvIterateBufferCallbackString(JsVar *str, size_t startIdx, size_t len, void (*callback)(const unsigned char *data, size_t len, void *callbackData), void *callbackData) {
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, startIdx);
+  while (len && it.var && it.charIdx < it.charsInVar) {
+    size_t l = it.charsInVar - it.charIdx;
+    if (l > len) l = len;
+    /* For flat strings charIdx is offset so this points past the
+     * header var into the data blocks that follow it */
+    callback((unsigned char*)&it.var->varData.str[it.charIdx], l, callbackData);
+    len -= l;
+    // skip to the start of the next StringExt
+    it.charIdx = it.charsInVar-1;
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+}
+
+typedef struct {
+  unsigned char buf[32];
+  size_t idx;
+  void (*callback)(const unsigned char *data, size_t len, void *callbackData);
+  void *callbackData;
+} JsvIterateBufferCallbackData;
+
+static void jsvIterateBufferCallbackCb(int data, void *userData) {
+  JsvIterateBufferCallbackData *cbData = (JsvIterateBufferCallbackData*)userData;
+  cbData->buf[cbData->idx++] = (unsigned char)data;
+  if (cbData->idx == sizeof(cbData->buf)) {
+    cbData->callback(cbData->buf, cbData->idx, cbData->callbackData);
+    cbData->idx = 0;
+  }
+}
+
+bool jsvIterateBufferCallback(JsVar *data, void (*callback)(const unsigned char *data, size_t len, void *callbackData), void *callbackData) {
+  if (jsvIsString(data)) {
+    jsvIterateBufferCallbackString(data, 0, jsvGetStringLength(data), callback, callbackData);
+    return true;
+  }
+  if (jsvIsArrayBuffer(data) && JSV_ARRAYBUFFER_GET_SIZE(data->varData.arraybuffer.type)==1) {
+    JsVar *backingString = jsvGetArrayBufferBackingString(data);
+    jsvIterateBufferCallbackString(backingString, data->varData.arraybuffer.byteOffset, jsvGetArrayBufferLength(data), callback, callbackData);
+    jsvUnLock(backingString);
+    return true;
+  }
+  // Everything else goes via jsvIterateCallback, buffered up
+  JsvIterateBufferCallbackData cbData;
+  cbData.idx = 0;
+  cbData.callback = callback;
+  cbData.callbackData = callbackData;
+  bool ok = jsvIterateCallback(data, jsvIterateBufferCallbackCb, (void*)&cbData);
+  if (cbData.idx) callback(cbData.buf, cbData.idx, callbackData);
+  return ok;
+}
+
 // --------------------------------------------------------------------------------------------
 
 void jsvStringIteratorNew(JsvStringIterator *it, JsVar *str, size_t startIdx) {
@@ -362,6 +417,26 @@ void jsvArrayBufferIteratorSetIntegerValue(JsvArrayBufferIterator *it, JsVarInt
   if (dataLen!=1) it->hasAccessedElement = true;
 }
 
+void jsvArrayBufferIteratorSetFloatValue(JsvArrayBufferIterator *it, JsVarFloat v) {
+  if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return;
+  assert(!it->hasAccessedElement); // we just haven't implemented this case yet
+  char data[8];
+  unsigned int i,dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+
+  if (JSV_ARRAYBUFFER_IS_FLOAT(it->type)) {
+    jsvArrayBufferIteratorFloatToData(data, dataLen, it->type, v);
+  } else {
+    // same conversion as jsvGetInteger
+    jsvArrayBufferIteratorIntToData(data, dataLen, it->type, isfinite(v) ? (JsVarInt)(long long)v : 0);
+  }
+
+  for (i=0;i<dataLen;i++) {
+    jsvStringIteratorSetChar(&it->it, data[i]);
+    if (dataLen!=1) jsvStringIteratorNext(&it->it);
+  }
+  if (dataLen!=1) it->hasAccessedElement = true;
+}
+
 void   jsvArrayBufferIteratorSetValue(JsvArrayBufferIterator *it, JsVar *value) {
   if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return;
   assert(!it->hasAccessedElement); // we just haven't implemented this case yet
@@ -30,6 +30,12 @@ int jsvIterateCallbackCount(JsVar *var);
 /** Write all data in array to the data pointer (of size dataSize bytes) */
 unsigned int jsvIterateCallbackToBytes(JsVar *var, unsigned char *data, unsigned int dataSize);
 
+/** Like jsvIterateCallback, but calls callback with chunks of bytes. Strings
+ * and byte ArrayBuffers are passed a block at a time straight from the
+ * variables that store them (without copying), anything else is converted a
+ * few bytes at a time. */
+bool jsvIterateBufferCallback(JsVar *var, void (*callback)(const unsigned char *data, size_t len, void *callbackData), void *callbackData);
+
 // --------------------------------------------------------------------------------------------
 typedef struct JsvStringIterator {
   size_t charIdx; ///< index of character in var
@@ -215,6 +221,7 @@ JsVarFloat jsvArrayBufferIteratorGetFloatValue(JsvArrayBufferIterator *it);
 void   jsvArrayBufferIteratorSetValue(JsvArrayBufferIterator *it, JsVar *value);
 void   jsvArrayBufferIteratorSetValueAndRewind(JsvArrayBufferIterator *it, JsVar *value);
 void   jsvArrayBufferIteratorSetIntegerValue(JsvArrayBufferIterator *it, JsVarInt value);
+void   jsvArrayBufferIteratorSetFloatValue(JsvArrayBufferIterator *it, JsVarFloat value);
 void   jsvArrayBufferIteratorSetByteValue(JsvArrayBufferIterator *it, char c); ///< special case for when we know we're writing to a byte array
 JsVar* jsvArrayBufferIteratorGetIndex(JsvArrayBufferIterator *it);
 bool   jsvArrayBufferIteratorHasElement(JsvArrayBufferIterator *it);
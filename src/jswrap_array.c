@@ -601,87 +601,231 @@ Returns true if the provided object is an array
  */
 
 
-NO_INLINE static JsVarInt _jswrap_array_sort_compare(JsVar *a, JsVar *b, JsVar *compareFn) {
-  if (compareFn) {
-    JsVar *args[2] = {a,b};
-    return jsvGetIntegerAndUnLock(jspeFunctionCall(compareFn, 0, 0, false, 2, args));
-  } else {
-    JsVar *sa = jsvAsString(a, false);
-    JsVar *sb = jsvAsString(b, false);
-    JsVarInt r = jsvCompareString(sa,sb, 0, 0, false);
+/// Index of an element in the array being sorted
+#if JSVARREF_SIZE<=2
+typedef uint16_t JswArraySortIndex; // ArrayBufferViews can have more elements than there are variables
+#else
+typedef JsVarRef JswArraySortIndex;
+#endif
+
+/// What all the elements being sorted are, so they can be compared without making strings of them
+typedef enum {
+  JSWAS_INT,    ///< All integers
+  JSWAS_NUMBER, ///< Integers and floats
+  JSWAS_STRING, ///< All strings
+  JSWAS_OTHER,  ///< Anything else - converted to strings to be compared
+} JswArraySortType;
+
+typedef struct {
+  JsVar *compareFn; ///< The function to compare elements with, or 0 to compare them as strings
+  JswArraySortType type;
+  JsVar **names; ///< Arrays: the (locked) names of each element, in their original order
+  JsVarFloat *values; ///< ArrayBufferViews: the value of each element, in the original order
+  bool isFloat; ///< ArrayBufferViews: is this a Float32Array/Float64Array?
+} JswArraySort;
+
+/// Work out what sort of value an array element's name points to
+static JswArraySortType _jswrap_array_sort_type(JsVar *name) {
+  if (jsvIsNameIntInt(name)) return JSWAS_INT;
+  if (jsvIsNameIntBool(name) || !jsvGetFirstChild(name)) return JSWAS_OTHER;
+  JsVar *v = jsvLock(jsvGetFirstChild(name));
+  JswArraySortType t = JSWAS_OTHER;
+  if ((v->flags&JSV_VARTYPEMASK)==JSV_INTEGER) t = JSWAS_INT;
+  else if (jsvIsFloat(v)) t = JSWAS_NUMBER;
+  else if (jsvIsString(v)) t = JSWAS_STRING;
+  jsvUnLock(v);
+  return t;
+}
+
+/// Get element i of the array being sorted. This may allocate a new variable
+static JsVar *_jswrap_array_sort_get(JswArraySort *s, JswArraySortIndex i) {
+  if (s->names) return jsvSkipName(s->names[i]);
+  if (s->isFloat) return jsvNewFromFloat(s->values[i]);
+  return jsvNewFromLongInteger((long long)s->values[i]);
+}
+
+/// Get element i of the array being sorted, when all elements are JSWAS_INT
+static JsVarInt _jswrap_array_sort_get_int(JswArraySort *s, JswArraySortIndex i) {
+  if (!s->names) return (JsVarInt)s->values[i];
+  JsVar *name = s->names[i];
+  if (jsvIsNameIntInt(name)) return (JsVarInt)jsvGetFirstChildSigned(name);
+  return jsvGetIntegerAndUnLock(jsvLock(jsvGetFirstChild(name)));
+}
+
+/// Write element i of the array being sorted (which is a number) into buf the same way jsvAsString would
+static void _jswrap_array_sort_get_number_string(JswArraySort *s, JswArraySortIndex i, char *buf) {
+  if (s->names) {
+    JsVar *name = s->names[i];
+    JsVar *v = jsvIsNameIntInt(name) ? 0 : jsvLock(jsvGetFirstChild(name));
+    if (jsvIsFloat(v))
+      ftoa_bounded(v->varData.floating, buf, JS_NUMBER_BUFFER_SIZE);
+    else
+      itostr(_jswrap_array_sort_get_int(s, i), buf, 10);
+    jsvUnLock(v);
+  } else if (!s->isFloat && s->values[i]<=(JsVarFloat)0x7FFFFFFF) {
+    itostr((JsVarInt)s->values[i], buf, 10);
+  } else { // Uint32Array values that don't fit in a JsVarInt become floats
+    ftoa_bounded(s->values[i], buf, JS_NUMBER_BUFFER_SIZE);
+  }
+}
+
+/// Compare two integers in the order their decimal strings would be in, without making the strings
+static int _jswrap_array_sort_compare_int_strings(JsVarInt a, JsVarInt b) {
+  if ((a<0) != (b<0)) return (a<0) ? -1 : 1; // '-' comes before any digit
+  long long ma = (a<0) ? -(long long)a : a;
+  long long mb = (b<0) ? -(long long)b : b;
+  // work out how many more digits a has than b, and pad the shorter one with zeros
+  int d = 0;
+  long long t;
+  for (t=ma;t>=10;t/=10) d++;
+  for (t=mb;t>=10;t/=10) d--;
+  for (t=d;t<0;t++) ma*=10;
+  for (t=d;t>0;t--) mb*=10;
+  if (ma != mb) return (ma<mb) ? -1 : 1;
+  return d; // one is the start of the other, so the shortest is first
+}
+
+/// Compare elements a and b of the array being sorted
+static int _jswrap_array_sort_compare(JswArraySort *s, JswArraySortIndex a, JswArraySortIndex b) {
+  if (s->compareFn) {
+    JsVar *args[2] = { _jswrap_array_sort_get(s, a), _jswrap_array_sort_get(s, b) };
+    JsVarFloat r = jsvGetFloatAndUnLock(jspeFunctionCall(s->compareFn, 0, 0, false, 2, args));
+    jsvUnLockMany(2, args);
+    return (r<0) ? -1 : ((r>0) ? 1 : 0); // NaN counts as equal
+  }
+  switch (s->type) {
+  case JSWAS_INT:
+    return _jswrap_array_sort_compare_int_strings(_jswrap_array_sort_get_int(s, a), _jswrap_array_sort_get_int(s, b));
+  case JSWAS_NUMBER: {
+    char bufa[JS_NUMBER_BUFFER_SIZE], bufb[JS_NUMBER_BUFFER_SIZE];
+    _jswrap_array_sort_get_number_string(s, a, bufa);
+    _jswrap_array_sort_get_number_string(s, b, bufb);
+    return strcmp(bufa, bufb);
+  }
+  case JSWAS_STRING: {
+    JsVar *va = jsvLock(jsvGetFirstChild(s->names[a]));
+    JsVar *vb = jsvLock(jsvGetFirstChild(s->names[b]));
+    int r = jsvCompareString(va, vb, 0, 0, false);
+    jsvUnLock2(va, vb);
+    return r;
+  }
+  default: {
+    JsVar *sa = jsvAsString(_jswrap_array_sort_get(s, a), true);
+    JsVar *sb = jsvAsString(_jswrap_array_sort_get(s, b), true);
+    int r = jsvCompareString(sa, sb, 0, 0, false);
     jsvUnLock2(sa, sb);
     return r;
   }
+  }
 }
 
-NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compareFn) {
-  if (n < 2) return; // sort done!
-
-  JsvIterator pivot = jsvIteratorClone(head);
-  bool pivotLowest = true; // is the pivot the lowest value in here?
-  JsVar *pivotValue = jsvIteratorGetValue(&pivot);
-  /* We're just going to use the first entry (head) as the pivot...
-   * We'll move along with our iterator 'it', and if it < pivot then we'll
-   * swap the values over (hence moving pivot forwards)  */
-
-  int nlo = 0, nhigh = 0;
-  JsvIterator it = jsvIteratorClone(head); //
-  jsvIteratorNext(&it);
-
-
-  /* Partition and count sizes. */
-  while (--n && !jspIsInterrupted()) {
-    JsVar *itValue = jsvIteratorGetValue(&it);
-    JsVarInt cmp = _jswrap_array_sort_compare(itValue, pivotValue, compareFn);
-    if (cmp<=0) {
-      if (cmp<0) pivotLowest = false;
-      nlo++;
-      /* 'it' <= 'pivot', so we need to move it behind.
-         In this diagram, P=pivot, L=it
-
-               l l l l l P h h h h h L
-                         |  \       /
-                          \  \_____/_
-                          _\______/  \
-                         / |         |
-                         | |         |
-               l l l l l L P h h h h h
-
-         It makes perfect sense now...
-       */
-      // first, get the old pivot value and overwrite it with the iterator value
-      jsvIteratorSetValue(&pivot, itValue); // no unlock needed
-      // now move pivot forwards, and set 'it' to the value the new pivot has
-      jsvIteratorNext(&pivot);
-      jsvUnLock(jsvIteratorSetValue(&it, jsvIteratorGetValue(&pivot)));
-      // finally set the pivot iterator to the pivot's value again
-      jsvIteratorSetValue(&pivot, pivotValue); // no unlock needed
-    } else {
-      nhigh++;
-      // Great, 'it' > 'pivot' so it's in the right place
+/** Stable sort of the n element indices in 'order', using 'tmp' (which must
+ * also have space for n indices). This is a bottom-up merge sort, so it
+ * doesn't recurse and is O(n log n) whatever order the elements start in.
+ * Returns false if it was interrupted. */
+static bool _jswrap_array_sort_indices(JswArraySort *s, JswArraySortIndex *order, JswArraySortIndex *tmp, unsigned int n) {
+  const unsigned int RUN = 8;
+  unsigned int start, width, i, j;
+  // Insertion sort small runs first - this is faster than merging them
+  for (start=0; start<n; start+=RUN) {
+    unsigned int end = min(start+RUN, n);
+    for (i=start+1; i<end; i++) {
+      JswArraySortIndex v = order[i];
+      for (j=i; j>start && _jswrap_array_sort_compare(s, order[j-1], v)>0; j--)
+        order[j] = order[j-1];
+      order[j] = v;
     }
-    jsvUnLock(itValue);
-    jsvIteratorNext(&it);
+    if (jspHasError()) return false;
   }
-  jsvIteratorFree(&it);
-  jsvUnLock(pivotValue);
+  // Now merge runs together, back and forth between order and tmp
+  JswArraySortIndex *from = order, *to = tmp;
+  for (width=RUN; width<n; width*=2) {
+    for (start=0; start<n; start+=2*width) {
+      unsigned int mid = min(start+width, n);
+      unsigned int end = min(start+2*width, n);
+      i = start;
+      j = mid;
+      // If the two runs are already in order (eg. the input was sorted) we can just copy them
+      if (mid<end && _jswrap_array_sort_compare(s, from[mid-1], from[mid])>0) {
+        unsigned int k = start;
+        while (i<mid && j<end)
+          to[k++] = (_jswrap_array_sort_compare(s, from[i], from[j])<=0) ? from[i++] : from[j++];
+        memcpy(&to[k], &from[i], (mid-i)*sizeof(JswArraySortIndex));
+        memcpy(&to[k+mid-i], &from[j], (end-j)*sizeof(JswArraySortIndex));
+      } else {
+        memcpy(&to[start], &from[start], (end-start)*sizeof(JswArraySortIndex));
+      }
+      if (jspHasError()) return false;
+    }
+    JswArraySortIndex *t = from;
+    from = to;
+    to = t;
+  }
+  if (from != order)
+    memcpy(order, from, n*sizeof(JswArraySortIndex));
+  return true;
+}
 
-  if (jspIsInterrupted()) {
-    jsvIteratorFree(&pivot);
-    return;
+/** Sort the n elements of an array, whose names are already in s->names.
+ * 'payloads' and 'types' are filled with what each name points to, and then
+ * when sorted the names are all updated in one pass - so nothing is allocated
+ * and refs don't change. If compareFn modified an element, the array is left
+ * as it is and an exception is thrown. */
+static void _jswrap_array_sort_array(JswArraySort *s, unsigned int n, JsVarRef *payloads, unsigned char *types, JswArraySortIndex *order, JswArraySortIndex *tmp) {
+  unsigned int i;
+  for (i=0;i<n;i++) {
+    JsVar *name = s->names[i];
+    payloads[i] = jsvGetFirstChild(name);
+    types[i] = (unsigned char)(name->flags & JSV_VARTYPEMASK);
+    order[i] = (JswArraySortIndex)i;
+    JswArraySortType t = _jswrap_array_sort_type(name);
+    if (i==0 || t==s->type) s->type = t;
+    else if (t<=JSWAS_NUMBER && s->type<=JSWAS_NUMBER) s->type = JSWAS_NUMBER;
+    else s->type = JSWAS_OTHER;
+  }
+  bool ok = _jswrap_array_sort_indices(s, order, tmp, n);
+  /* If compareFn changed any of the elements we can't put them back, as
+   * what we know about the element might have been freed */
+  for (i=0;ok && i<n;i++) {
+    JsVar *name = s->names[i];
+    ok = jsvGetFirstChild(name)==payloads[i] && (name->flags & JSV_VARTYPEMASK)==types[i];
+    if (!ok) jsExceptionHere(JSET_ERROR, "Array was modified while sorting");
   }
+  for (i=0;i<n;i++) {
+    JsVar *name = s->names[i];
+    if (ok) {
+      // move the value (or reference to it) from the element that should be here
+      JswArraySortIndex from = order[i];
+      name->flags = (JsVarFlags)((name->flags & ~JSV_VARTYPEMASK) | types[from]);
+      jsvSetFirstChild(name, payloads[from]);
+    }
+    jsvUnLock(name);
+  }
+}
 
-  // now recurse. Do RHS first because we can
-  // free the pivot early if we do this
-  jsvIteratorNext(&pivot);
-  _jswrap_array_sort(&pivot, nhigh, compareFn);
-  jsvIteratorFree(&pivot);
-  // LHS
-  /* If the pivot is the lowest number in this chunk of numbers, then
-   * we know that anything to the left of it must be joint equal to it.
-   * In that casem there's no need to sort it. */
-  if (!pivotLowest)
-    _jswrap_array_sort(head, nlo, compareFn);
+/// Sort the n elements of an ArrayBufferView
+static void _jswrap_array_sort_arraybuffer(JswArraySort *s, JsVar *array, unsigned int n, JswArraySortIndex *order, JswArraySortIndex *tmp) {
+  JsVarDataArrayBufferViewType type = array->varData.arraybuffer.type;
+  s->isFloat = JSV_ARRAYBUFFER_IS_FLOAT(type);
+  s->type = (s->isFloat || type==ARRAYBUFFERVIEW_UINT32) ? JSWAS_NUMBER : JSWAS_INT;
+  unsigned int i;
+  JsvArrayBufferIterator it;
+  jsvArrayBufferIteratorNew(&it, array, 0);
+  for (i=0;i<n && jsvArrayBufferIteratorHasElement(&it);i++) {
+    s->values[i] = jsvArrayBufferIteratorGetFloatValue(&it);
+    if (type==ARRAYBUFFERVIEW_UINT32 && s->values[i]<0)
+      s->values[i] += 4294967296.0; // the iterator reads Uint32 as signed
+    order[i] = (JswArraySortIndex)i;
+    jsvArrayBufferIteratorNext(&it);
+  }
+  jsvArrayBufferIteratorFree(&it);
+  if (!_jswrap_array_sort_indices(s, order, tmp, n)) return;
+  jsvArrayBufferIteratorNew(&it, array, 0);
+  for (i=0;i<n && jsvArrayBufferIteratorHasElement(&it);i++) {
+    jsvArrayBufferIteratorSetFloatValue(&it, s->values[order[i]]);
+    jsvArrayBufferIteratorNext(&it);
+  }
+  jsvArrayBufferIteratorFree(&it);
 }
 
 /*JSON{
@@ -695,39 +839,123 @@ NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compar
   ],
   "return" : ["JsVar","This array object"]
 }
-Do an in-place quicksort of the array
+Sort the array in place. The sort is stable, so elements that compare as equal stay in the same order.
  */
 JsVar *jswrap_array_sort (JsVar *array, JsVar *compareFn) {
   if (!jsvIsUndefined(compareFn) && !jsvIsFunction(compareFn)) {
     jsExceptionHere(JSET_ERROR, "Expecting compare function, got %t", compareFn);
     return 0;
   }
-  JsvIterator it;
-
-  /* Arrays can be sparse and the iterators don't handle this
-    (we're not going to mess with indices) so we have to count
-     up the number of elements manually.
-
-     FIXME: sort is broken for sparse arrays anyway (it basically
-     ignores all the 'undefined' entries). I wonder whether just
-     compacting the array down to start from 0 before we start would
-     fix this?
-   */
-  int n=0;
-  if (jsvIsArray(array) || jsvIsObject(array)) {
-    jsvIteratorNew(&it, array);
-    while (jsvIteratorHasElement(&it)) {
-      n++;
-      jsvIteratorNext(&it);
+  JswArraySort s;
+  s.compareFn = compareFn;
+  s.type = JSWAS_OTHER;
+  s.names = 0;
+  s.values = 0;
+  s.isFloat = false;
+
+  /* Work out how many elements there are. Arrays can be sparse, so we only
+   * sort the elements that exist - missing elements stay where they are. */
+  unsigned int n = 0;
+  size_t elementSize;
+  if (jsvIsArray(array)) {
+    JsVarRef childRef = jsvGetFirstChild(array);
+    while (childRef) {
+      JsVar *child = jsvLock(childRef);
+      if (jsvIsInt(child)) n++; // not other properties of the array
+      childRef = jsvGetNextSibling(child);
+      jsvUnLock(child);
     }
-    jsvIteratorFree(&it);
+    elementSize = sizeof(JsVar*) + sizeof(JsVarRef) + sizeof(unsigned char);
+  } else if (jsvIsArrayBuffer(array)) {
+    n = (unsigned int)jsvGetLength(array);
+    elementSize = sizeof(JsVarFloat);
   } else {
-    n = (int)jsvGetLength(array);
+    if (jsvHasChildren(array)) {
+      // Objects: sort an array of their values, then put them back in that order
+      JsVar *values = jsvNewWithFlags(JSV_ARRAY);
+      if (!values) return 0; // out of memory
+      JsvObjectIterator it;
+      jsvObjectIteratorNew(&it, array);
+      while (jsvObjectIteratorHasValue(&it)) {
+        jsvArrayPushAndUnLock(values, jsvObjectIteratorGetValue(&it));
+        jsvObjectIteratorNext(&it);
+      }
+      jsvObjectIteratorFree(&it);
+      jsvUnLock(jswrap_array_sort(values, compareFn));
+      JsvObjectIterator src;
+      jsvObjectIteratorNew(&src, values);
+      jsvObjectIteratorNew(&it, array);
+      while (jsvObjectIteratorHasValue(&src) && jsvObjectIteratorHasValue(&it)) {
+        JsVar *value = jsvObjectIteratorGetValue(&src);
+        jsvObjectIteratorSetValue(&it, value);
+        jsvUnLock(value);
+        jsvObjectIteratorNext(&src);
+        jsvObjectIteratorNext(&it);
+      }
+      jsvObjectIteratorFree(&src);
+      jsvObjectIteratorFree(&it);
+      jsvUnLock(values);
+    }
+    return jsvLockAgain(array);
+  }
+  if (n<2) return jsvLockAgain(array);
+
+  // Each element needs its names/values, as well as two indices for sorting
+  size_t bytes = n*(elementSize + 2*sizeof(JswArraySortIndex));
+  char *buffer;
+#ifdef LINUX
+  /* jsuGetFreeStack doesn't know how much stack we really have, and flat
+   * strings can't be bigger than one block of variables */
+  buffer = (char*)malloc(bytes);
+  if (!buffer) {
+    jsExceptionHere(JSET_ERROR, "Not enough memory to sort %d elements", n);
+    return 0;
+  }
+#else
+  JsVar *bufferVar = 0;
+  if (jsuGetFreeStack() < 256+bytes) {
+    // Not enough stack - try and use a flat string instead
+    bufferVar = jsvNewFlatStringOfLength((unsigned int)bytes);
+    if (!bufferVar) {
+      jsExceptionHere(JSET_ERROR, "Not enough memory to sort %d elements", n);
+      return 0;
+    }
+    buffer = jsvGetFlatStringPointer(bufferVar);
+  } else {
+    buffer = (char*)alloca(bytes);
+  }
+#endif
+
+  if (jsvIsArray(array)) {
+    // names, order, tmp, payloads, types - biggest first to keep them aligned
+    s.names = (JsVar**)buffer;
+    JswArraySortIndex *order = (JswArraySortIndex*)&s.names[n];
+    JswArraySortIndex *tmp = &order[n];
+    JsVarRef *payloads = (JsVarRef*)&tmp[n];
+    unsigned char *types = (unsigned char*)&payloads[n];
+    // Lock every element's name so it can't be freed while we sort, even if compareFn removes it
+    unsigned int i = 0;
+    JsVarRef childRef = jsvGetFirstChild(array);
+    while (childRef && i<n) {
+      JsVar *child = jsvLock(childRef);
+      childRef = jsvGetNextSibling(child);
+      if (jsvIsInt(child))
+        s.names[i++] = child;
+      else
+        jsvUnLock(child);
+    }
+    _jswrap_array_sort_array(&s, n, payloads, types, order, tmp);
+  } else {
+    s.values = (JsVarFloat*)buffer;
+    JswArraySortIndex *order = (JswArraySortIndex*)&s.values[n];
+    _jswrap_array_sort_arraybuffer(&s, array, n, order, &order[n]);
   }
 
-  jsvIteratorNew(&it, array);
-  _jswrap_array_sort(&it, n, compareFn);
-  jsvIteratorFree(&it);
+#ifdef LINUX
+  free(buffer);
+#else
+  jsvUnLock(bufferVar);
+#endif
   return jsvLockAgain(array);
 }
 
@@ -16,6 +16,7 @@
 #include "jswrap_arraybuffer.h"
 #include "jsparse.h"
 #include "jsinteractive.h"
+#include "jswrapper.h"
 
 /*JSON{
   "type" : "class",
@@ -345,7 +346,10 @@ JsVar *jswrap_typedarray_constructor(JsVarDataArrayBufferViewType type, JsVar *a
     typedArr->varData.arraybuffer.length = (unsigned short)length;
     jsvSetFirstChild(typedArr, jsvGetRef(jsvRef(arrayBuffer)));
 
-    if (copyData) {
+    if (copyData && jsvIsArrayBuffer(arr)) {
+      // copying another view - this can often be done with memmove
+      jswrap_arraybufferview_set(typedArr, arr, 0);
+    } else if (copyData) {
       // if we were given an array, populate this ArrayBuffer
       JsvIterator it;
       jsvIteratorNew(&it, arr);
@@ -396,6 +400,28 @@ The length, in bytes, of the view
 The offset, in bytes, to the first byte of the view within the ArrayBuffer
  */
 
+/* If both views are flat strings and store their elements in the same way,
+ * copy 'count' elements from src[srcIndex] to dst[dstIndex] with memmove and
+ * return true. Otherwise return false and leave the copy to the caller. */
+static bool jswrap_arraybufferview_move(JsVar *dst, size_t dstIndex, JsVar *src, size_t srcIndex, size_t count) {
+  JsVarDataArrayBufferViewType dstType = dst->varData.arraybuffer.type;
+  JsVarDataArrayBufferViewType srcType = src->varData.arraybuffer.type;
+  size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(dstType);
+  /* Integers of the same size wrap to the same bytes whatever their sign,
+   * but clamping a negative value doesn't */
+  if (elementSize != JSV_ARRAYBUFFER_GET_SIZE(srcType) ||
+      JSV_ARRAYBUFFER_IS_FLOAT(dstType) != JSV_ARRAYBUFFER_IS_FLOAT(srcType) ||
+      (JSV_ARRAYBUFFER_IS_CLAMPED(dstType) && JSV_ARRAYBUFFER_IS_SIGNED(srcType)))
+    return false;
+  char *dstPtr, *srcPtr;
+  JsVar *dstStr = jsvGetArrayBufferFlatString(dst, &dstPtr);
+  JsVar *srcStr = dstStr ? jsvGetArrayBufferFlatString(src, &srcPtr) : 0;
+  if (srcStr)
+    memmove(&dstPtr[dstIndex*elementSize], &srcPtr[srcIndex*elementSize], count*elementSize);
+  jsvUnLock2(dstStr, srcStr);
+  return srcStr!=0;
+}
+
 /*JSON{
   "type" : "method",
   "class" : "ArrayBufferView",
@@ -413,6 +439,14 @@ void jswrap_arraybufferview_set(JsVar *parent, JsVar *arr, int offset) {
     jsExceptionHere(JSET_ERROR, "Expecting first argument to be an array, not %t", arr);
     return;
   }
+  if (jsvIsArrayBuffer(arr) && offset>=0) {
+    size_t dstLength = jsvGetArrayBufferLength(parent);
+    size_t count = jsvGetArrayBufferLength(arr);
+    if ((size_t)offset > dstLength) return;
+    if (count > dstLength-(size_t)offset) count = dstLength-(size_t)offset;
+    if (jswrap_arraybufferview_move(parent, (size_t)offset, arr, 0, count))
+      return;
+  }
   JsvIterator itsrc;
   jsvIteratorNew(&itsrc, arr);
   JsvArrayBufferIterator itdst;
@@ -436,6 +470,259 @@ void jswrap_arraybufferview_set(JsVar *parent, JsVar *arr, int offset) {
 }
 
 
+/// Turn a (possibly negative) index into one that is in range for an array of the given length
+static JsVarInt jswrap_arraybufferview_clampIndex(JsVarInt index, JsVarInt length) {
+  if (index < 0) index += length;
+  if (index < 0) return 0;
+  if (index > length) return length;
+  return index;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "ArrayBufferView",
+  "name" : "fill",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_arraybufferview_fill",
+  "params" : [
+    ["value","JsVar","The value to fill the array with"],
+    ["start","int","Optional. The index to start from (or 0). If start is negative, it is treated as length+start where length is the length of the array"],
+    ["end","JsVar","Optional. The index to end at (or the array length). If end is negative, it is treated as length+end."]
+  ],
+  "return" : ["JsVar","This array"],
+  "return_object" : "ArrayBufferView"
+}
+Fill this array with the given value, for every index `>= start` and `< end`
+ */
+JsVar *jswrap_arraybufferview_fill(JsVar *parent, JsVar *value, JsVarInt start, JsVar *endVar) {
+  JsVarInt length = (JsVarInt)jsvGetArrayBufferLength(parent);
+  start = jswrap_arraybufferview_clampIndex(start, length);
+  JsVarInt end = jswrap_arraybufferview_clampIndex(jsvIsNumeric(endVar) ? jsvGetInteger(endVar) : length, length);
+  if (start >= end) return jsvLockAgain(parent);
+
+  // Convert the value once, into the first element
+  JsvArrayBufferIterator it;
+  jsvArrayBufferIteratorNew(&it, parent, (size_t)start);
+  jsvArrayBufferIteratorSetValue(&it, value);
+  jsvArrayBufferIteratorNext(&it);
+  char *ptr;
+  JsVar *str = jsvGetArrayBufferFlatString(parent, &ptr);
+  if (str) {
+    // then keep doubling the filled area by copying it
+    size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(parent->varData.arraybuffer.type);
+    char *first = &ptr[(size_t)start*elementSize];
+    size_t filled = elementSize;
+    size_t total = (size_t)(end-start)*elementSize;
+    while (filled < total) {
+      size_t n = (total-filled < filled) ? total-filled : filled;
+      memcpy(&first[filled], first, n);
+      filled += n;
+    }
+    jsvUnLock(str);
+  } else {
+    while (it.index < (size_t)end && jsvArrayBufferIteratorHasElement(&it)) {
+      jsvArrayBufferIteratorSetValue(&it, value);
+      jsvArrayBufferIteratorNext(&it);
+    }
+  }
+  jsvArrayBufferIteratorFree(&it);
+  return jsvLockAgain(parent);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "ArrayBufferView",
+  "name" : "copyWithin",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_arraybufferview_copyWithin",
+  "params" : [
+    ["target","int","The index to copy elements to. If negative, it is treated as length+target"],
+    ["start","int","Optional. The index to start copying from (or 0). If negative, it is treated as length+start"],
+    ["end","JsVar","Optional. The index to stop copying at (or the array length). If negative, it is treated as length+end"]
+  ],
+  "return" : ["JsVar","This array"],
+  "return_object" : "ArrayBufferView"
+}
+Copy the elements from `start` up to `end` to the position `target` in this array. The areas may overlap.
+ */
+JsVar *jswrap_arraybufferview_copyWithin(JsVar *parent, JsVarInt target, JsVarInt start, JsVar *endVar) {
+  JsVarInt length = (JsVarInt)jsvGetArrayBufferLength(parent);
+  target = jswrap_arraybufferview_clampIndex(target, length);
+  start = jswrap_arraybufferview_clampIndex(start, length);
+  JsVarInt end = jswrap_arraybufferview_clampIndex(jsvIsNumeric(endVar) ? jsvGetInteger(endVar) : length, length);
+  JsVarInt count = end-start;
+  if (count > length-target) count = length-target;
+  if (count <= 0 || target==start) return jsvLockAgain(parent);
+
+  if (!jswrap_arraybufferview_move(parent, (size_t)target, parent, (size_t)start, (size_t)count)) {
+    // Copy in whichever direction won't overwrite elements before they're read
+    JsVarInt i;
+    for (i=0;i<count;i++) {
+      JsVarInt n = (target < start) ? i : count-(i+1);
+      JsVar *v = jsvArrayBufferGet(parent, (size_t)(start+n));
+      jsvArrayBufferSet(parent, (size_t)(target+n), v);
+      jsvUnLock(v);
+    }
+  }
+  return jsvLockAgain(parent);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "ArrayBufferView",
+  "name" : "subarray",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_arraybufferview_subarray",
+  "params" : [
+    ["begin","int","Element to begin at, inclusive. If negative, it is treated as length+begin"],
+    ["end","JsVar","Optional. Element to end at, exclusive (or the array length). If negative, it is treated as length+end"]
+  ],
+  "return" : ["JsVar","A new view of the same type, referencing the same ArrayBuffer"],
+  "return_object" : "ArrayBufferView"
+}
+Return a new view of part of this array. No data is copied - writing to the new view changes this one too.
+ */
+JsVar *jswrap_arraybufferview_subarray(JsVar *parent, JsVarInt begin, JsVar *endVar) {
+  JsVarInt length = (JsVarInt)jsvGetArrayBufferLength(parent);
+  begin = jswrap_arraybufferview_clampIndex(begin, length);
+  JsVarInt end = jswrap_arraybufferview_clampIndex(jsvIsNumeric(endVar) ? jsvGetInteger(endVar) : length, length);
+  if (end < begin) end = begin;
+
+  JsVarDataArrayBufferViewType type = parent->varData.arraybuffer.type;
+  JsVar *view = jsvNewWithFlags(JSV_ARRAYBUFFER);
+  if (!view) return 0;
+  view->varData.arraybuffer.type = type;
+  view->varData.arraybuffer.byteOffset = (unsigned short)(parent->varData.arraybuffer.byteOffset + (size_t)begin*JSV_ARRAYBUFFER_GET_SIZE(type));
+  view->varData.arraybuffer.length = (unsigned short)(end-begin);
+  JsVar *arrayBuffer = jsvLock(jsvGetFirstChild(parent));
+  jsvSetFirstChild(view, jsvGetRef(jsvRef(arrayBuffer)));
+  jsvUnLock(arrayBuffer);
+  return view;
+}
+
+static bool jswrap_arraybufferview_checkCallback(const char *name, JsVar *parent, JsVar *funcVar, JsVar *thisVar) {
+  if (!jsvIsArrayBuffer(parent)) {
+    jsExceptionHere(JSET_ERROR, "ArrayBufferView.%s can only be called on an ArrayBufferView", name);
+    return false;
+  }
+  if (!jsvIsFunction(funcVar)) {
+    jsExceptionHere(JSET_ERROR, "ArrayBufferView.%s's first argument should be a function", name);
+    return false;
+  }
+  if (!jsvIsUndefined(thisVar) && !jsvIsObject(thisVar)) {
+    jsExceptionHere(JSET_ERROR, "ArrayBufferView.%s's second argument should be undefined, or an object", name);
+    return false;
+  }
+  return true;
+}
+
+/// Can we change the value of 'v' without anyone else noticing?
+static bool jswrap_arraybufferview_isUnused(JsVar *v) {
+  return v && jsvGetRefs(v)==0 && jsvGetLocks(v)==1;
+}
+
+/* Return a variable containing the current element. The one from last time
+ * is reused if the callback didn't keep hold of it, otherwise it's unlocked. */
+static JsVar *jswrap_arraybufferview_getValue(JsvArrayBufferIterator *it, JsVar *v) {
+  if (jswrap_arraybufferview_isUnused(v)) {
+    if (JSV_ARRAYBUFFER_IS_FLOAT(it->type) && jsvIsFloat(v)) {
+      v->varData.floating = jsvArrayBufferIteratorGetFloatValue(it);
+      return v;
+    }
+    if (!JSV_ARRAYBUFFER_IS_FLOAT(it->type) && it->type!=ARRAYBUFFERVIEW_UINT32 && jsvIsSimpleInt(v)) {
+      jsvSetInteger(v, jsvArrayBufferIteratorGetIntegerValue(it));
+      return v;
+    }
+  }
+  jsvUnLock(v);
+  return jsvArrayBufferIteratorGetValue(it);
+}
+
+/// As jswrap_arraybufferview_getValue, but for the current index
+static JsVar *jswrap_arraybufferview_getIndex(JsvArrayBufferIterator *it, JsVar *v) {
+  if (jswrap_arraybufferview_isUnused(v)) {
+    jsvSetInteger(v, (JsVarInt)it->index);
+    return v;
+  }
+  jsvUnLock(v);
+  return jsvNewFromInteger((JsVarInt)it->index);
+}
+
+/* If funcVar is a native function that takes one number and returns one
+ * (like E.reverseByte or Math.sqrt) return a pointer to it, so it can be
+ * called without creating any JsVars at all. */
+static void *jswrap_arraybufferview_getNumberFunction(JsVar *funcVar, bool *isFloat) {
+  // children would be bound arguments or 'this'
+  if (!jsvIsNativeFunction(funcVar) || jsvGetFirstChild(funcVar)) return 0;
+  JsnArgumentType argTypes = funcVar->varData.native.argTypes;
+  if (argTypes == (JSWAT_INT32 | (JSWAT_INT32<<JSWAT_BITS)))
+    *isFloat = false;
+  else if (argTypes == (JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT<<JSWAT_BITS)))
+    *isFloat = true;
+  else
+    return 0;
+  return jsvGetNativeFunctionPtr(funcVar);
+}
+
+/* Call funcVar(value, index, parent) for each element, writing what it returns
+ * into 'result' (if set). If previousValue is set this is a reduce, and we call
+ * funcVar(previousValue, value, index, parent) instead. */
+static void jswrap_arraybufferview_iterate(JsVar *parent, JsVar *funcVar, JsVar *thisVar, JsVar *result, JsVar **previousValue) {
+  JsvArrayBufferIterator it, itdst;
+  jsvArrayBufferIteratorNew(&it, parent, 0);
+  if (result) jsvArrayBufferIteratorNew(&itdst, result, 0);
+  if (previousValue && !*previousValue) {
+    if (jsvArrayBufferIteratorHasElement(&it)) {
+      *previousValue = jsvArrayBufferIteratorGetValue(&it);
+      jsvArrayBufferIteratorNext(&it);
+    } else {
+      jsExceptionHere(JSET_ERROR, "ArrayBufferView.reduce without initial value required non-empty array");
+    }
+  }
+
+  bool nativeIsFloat = false;
+  void *nativePtr = previousValue ? 0 : jswrap_arraybufferview_getNumberFunction(funcVar, &nativeIsFloat);
+  JsVar *value = 0, *index = 0;
+  while (jsvArrayBufferIteratorHasElement(&it) && !jspIsInterrupted() && !jspHasError()) {
+    if (nativePtr && nativeIsFloat) {
+      JsVarFloat v = (it.type==ARRAYBUFFERVIEW_UINT32) ?
+          (JsVarFloat)(uint32_t)jsvArrayBufferIteratorGetIntegerValue(&it) :
+          jsvArrayBufferIteratorGetFloatValue(&it);
+      v = ((JsVarFloat (*)(JsVarFloat))nativePtr)(v);
+      if (result) jsvArrayBufferIteratorSetFloatValue(&itdst, v);
+    } else if (nativePtr) {
+      int v = ((int (*)(int))nativePtr)((int)jsvArrayBufferIteratorGetIntegerValue(&it));
+      if (result) jsvArrayBufferIteratorSetIntegerValue(&itdst, v);
+    } else {
+      value = jswrap_arraybufferview_getValue(&it, value);
+      index = jswrap_arraybufferview_getIndex(&it, index);
+      JsVar *args[4];
+      if (previousValue) {
+        args[0] = *previousValue;
+        args[1] = value;
+        args[2] = index;
+        args[3] = parent;
+        JsVar *v = jspeFunctionCall(funcVar, 0, 0, false, 4, args);
+        jsvUnLock(*previousValue);
+        *previousValue = v;
+      } else {
+        args[0] = value;
+        args[1] = index;
+        args[2] = parent;
+        JsVar *mapped = jspeFunctionCall(funcVar, 0, thisVar, false, 3, args);
+        if (mapped && result)
+          jsvArrayBufferIteratorSetValue(&itdst, mapped);
+        jsvUnLock(mapped);
+      }
+    }
+    jsvArrayBufferIteratorNext(&it);
+    if (result) jsvArrayBufferIteratorNext(&itdst);
+  }
+  jsvUnLock2(value, index);
+  jsvArrayBufferIteratorFree(&it);
+  if (result) jsvArrayBufferIteratorFree(&itdst);
+}
+
 // 'special' ArrayBufferView.map as it needs to return an ArrayBuffer
 /*JSON{
   "type" : "method",
@@ -454,54 +741,54 @@ Return an array which is made from the following: ```A.map(function) = [function
  **Note:** This returns an ArrayBuffer of the same type it was called on. To get an Array, use `Array.prototype.map`
  */
 JsVar *jswrap_arraybufferview_map(JsVar *parent, JsVar *funcVar, JsVar *thisVar) {
-  if (!jsvIsArrayBuffer(parent)) {
-    jsExceptionHere(JSET_ERROR, "ArrayBufferView.map can only be called on an ArrayBufferView");
-    return 0;
-  }
-  if (!jsvIsFunction(funcVar)) {
-    jsExceptionHere(JSET_ERROR, "ArrayBufferView.map's first argument should be a function");
+  if (!jswrap_arraybufferview_checkCallback("map", parent, funcVar, thisVar))
     return 0;
-  }
-  if (!jsvIsUndefined(thisVar) && !jsvIsObject(thisVar)) {
-    jsExceptionHere(JSET_ERROR, "ArrayBufferView.map's second argument should be undefined, or an object");
-    return 0;
-  }
 
   // create ArrayBuffer result
   JsVarDataArrayBufferViewType arrayBufferType = parent->varData.arraybuffer.type;
   JsVar *array = jsvNewTypedArray(arrayBufferType, (JsVarInt)jsvGetArrayBufferLength(parent));
   if (!array) return 0;
+  jswrap_arraybufferview_iterate(parent, funcVar, thisVar, array, 0);
+  return array;
+}
 
-  // now iterate
-  JsvIterator it; // TODO: if we really are limited to ArrayBuffers, this could be an ArrayBufferIterator.
-  jsvIteratorNew(&it, parent);
-  JsvArrayBufferIterator itdst;
-  jsvArrayBufferIteratorNew(&itdst, array, 0);
-
-  while (jsvIteratorHasElement(&it)) {
-    JsVar *index = jsvIteratorGetKey(&it);
-    if (jsvIsInt(index)) {
-      JsVarInt idxValue = jsvGetInteger(index);
-
-      JsVar *args[3], *mapped;
-      args[0] = jsvIteratorGetValue(&it);
-      args[1] = jsvNewFromInteger(idxValue); // child is a variable name, create a new variable for the index
-      args[2] = parent;
-      mapped = jspeFunctionCall(funcVar, 0, thisVar, false, 3, args);
-      jsvUnLockMany(2,args);
-      if (mapped) {
-        jsvArrayBufferIteratorSetValue(&itdst, mapped);
-        jsvUnLock(mapped);
-      }
-    }
-    jsvUnLock(index);
-    jsvIteratorNext(&it);
-    jsvArrayBufferIteratorNext(&itdst);
-  }
-  jsvIteratorFree(&it);
-  jsvArrayBufferIteratorFree(&itdst);
+/*JSON{
+  "type" : "method",
+  "class" : "ArrayBufferView",
+  "name" : "forEach",
+  "generate" : "jswrap_arraybufferview_forEach",
+  "params" : [
+    ["function","JsVar","Function to be executed"],
+    ["thisArg","JsVar","if specified, the function is called with 'this' set to thisArg (optional)"]
+  ]
+}
+Executes a provided function once per array element.
+ */
+void jswrap_arraybufferview_forEach(JsVar *parent, JsVar *funcVar, JsVar *thisVar) {
+  if (jswrap_arraybufferview_checkCallback("forEach", parent, funcVar, thisVar))
+    jswrap_arraybufferview_iterate(parent, funcVar, thisVar, 0, 0);
+}
 
-  return array;
+/*JSON{
+  "type" : "method",
+  "class" : "ArrayBufferView",
+  "name" : "reduce",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_arraybufferview_reduce",
+  "params" : [
+    ["callback","JsVar","Function used to reduce the array"],
+    ["initialValue","JsVar","if specified, the initial value to pass to the function"]
+  ],
+  "return" : ["JsVar","The value returned by the last function called"]
+}
+Execute `previousValue=initialValue` and then `previousValue = callback(previousValue, currentValue, index, array)` for each element in the array, and finally return previousValue.
+ */
+JsVar *jswrap_arraybufferview_reduce(JsVar *parent, JsVar *funcVar, JsVar *initialValue) {
+  if (!jswrap_arraybufferview_checkCallback("reduce", parent, funcVar, 0))
+    return 0;
+  JsVar *previousValue = jsvLockAgainSafe(initialValue);
+  jswrap_arraybufferview_iterate(parent, funcVar, 0, 0, &previousValue);
+  return previousValue;
 }
 
 
@@ -545,49 +832,7 @@ Join all elements of this array together into one string, using 'separator' betw
   "return" : ["JsVar","This array object"],
   "return_object" : "ArrayBufferView"
 }
-Do an in-place quicksort of the array
- */
-/*JSON{
-  "type" : "method",
-  "class" : "ArrayBufferView",
-  "name" : "forEach",
-  "generate" : "jswrap_array_forEach",
-  "params" : [
-    ["function","JsVar","Function to be executed"],
-    ["thisArg","JsVar","if specified, the function is called with 'this' set to thisArg (optional)"]
-  ]
-}
-Executes a provided function once per array element.
- */
-/*JSON{
-  "type" : "method",
-  "class" : "ArrayBufferView",
-  "name" : "reduce",
-  "ifndef" : "SAVE_ON_FLASH",
-  "generate" : "jswrap_array_reduce",
-  "params" : [
-    ["callback","JsVar","Function used to reduce the array"],
-    ["initialValue","JsVar","if specified, the initial value to pass to the function"]
-  ],
-  "return" : ["JsVar","The value returned by the last function called"]
-}
-Execute `previousValue=initialValue` and then `previousValue = callback(previousValue, currentValue, index, array)` for each element in the array, and finally return previousValue.
- */
-/*JSON{
-  "type" : "method",
-  "class" : "ArrayBufferView",
-  "name" : "fill",
-  "ifndef" : "SAVE_ON_FLASH",
-  "generate" : "jswrap_array_fill",
-  "params" : [
-    ["value","JsVar","The value to fill the array with"],
-    ["start","int","Optional. The index to start from (or 0). If start is negative, it is treated as length+start where length is the length of the array"],
-    ["end","JsVar","Optional. The index to end at (or the array length). If end is negative, it is treated as length+end."]
-  ],
-  "return" : ["JsVar","This array"],
-  "return_object" : "ArrayBufferView"
-}
-Fill this array with the given value, for every index `>= start` and `< end`
+Sort the contents of this arraybuffer in place. The sort is stable, so elements that compare as equal stay in the same order.
  */
 /*JSON{
   "type" : "method",
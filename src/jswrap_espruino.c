@@ -187,6 +187,48 @@ JsVarFloat jswrap_espruino_clip(JsVarFloat x, JsVarFloat min, JsVarFloat max) {
 }
 
 
+#ifndef SAVE_ON_FLASH
+/* Run the given code with ELEMENT typedef'd to the C type of the elements of
+ * a typed array of the given type. Having a separate loop for each type means
+ * the compiler can make each one fast (and vectorise it if it can).
+ * INT_TYPED_ARRAY_SWITCH only handles the integer types */
+#define INT_TYPED_ARRAY_CASES(...) \
+    case ARRAYBUFFERVIEW_UINT8:   { typedef uint8_t ELEMENT;  __VA_ARGS__; break; } \
+    case ARRAYBUFFERVIEW_INT8:    { typedef int8_t ELEMENT;   __VA_ARGS__; break; } \
+    case ARRAYBUFFERVIEW_UINT16:  { typedef uint16_t ELEMENT; __VA_ARGS__; break; } \
+    case ARRAYBUFFERVIEW_INT16:   { typedef int16_t ELEMENT;  __VA_ARGS__; break; } \
+    case ARRAYBUFFERVIEW_UINT32:  { typedef uint32_t ELEMENT; __VA_ARGS__; break; } \
+    case ARRAYBUFFERVIEW_INT32:   { typedef int32_t ELEMENT;  __VA_ARGS__; break; }
+#define TYPED_ARRAY_SWITCH(TYPE, ...) \
+  switch ((TYPE) & (ARRAYBUFFERVIEW_MASK_SIZE|ARRAYBUFFERVIEW_SIGNED|ARRAYBUFFERVIEW_FLOAT)) { \
+    INT_TYPED_ARRAY_CASES(__VA_ARGS__) \
+    case ARRAYBUFFERVIEW_FLOAT32: { typedef float ELEMENT;    __VA_ARGS__; break; } \
+    case ARRAYBUFFERVIEW_FLOAT64: { typedef double ELEMENT;   __VA_ARGS__; break; } \
+    default: assert(0); \
+  }
+#define INT_TYPED_ARRAY_SWITCH(TYPE, ...) \
+  switch ((TYPE) & (ARRAYBUFFERVIEW_MASK_SIZE|ARRAYBUFFERVIEW_SIGNED|ARRAYBUFFERVIEW_FLOAT)) { \
+    INT_TYPED_ARRAY_CASES(__VA_ARGS__) \
+    default: assert(0); \
+  }
+
+/// If arr is an ArrayBuffer view with its data in a flat string, return that (see jsvGetArrayBufferFlatString)
+static JsVar *jswrap_espruino_getFlatData(JsVar *arr, char **ptr, size_t *length, JsVarDataArrayBufferViewType *type) {
+  if (!jsvIsArrayBuffer(arr)) return 0;
+  JsVar *str = jsvGetArrayBufferFlatString(arr, ptr);
+  if (!str) return 0;
+  *length = jsvGetArrayBufferLength(arr);
+  *type = arr->varData.arraybuffer.type;
+  return str;
+}
+
+/// Get the element at the given index of the typed array data as a float
+static JsVarFloat jswrap_espruino_getFlatElement(JsVarDataArrayBufferViewType type, char *ptr, size_t i) {
+  TYPED_ARRAY_SWITCH(type, return (JsVarFloat)((ELEMENT*)ptr)[i]);
+  return 0;
+}
+#endif
+
 /*JSON{
   "type" : "staticmethod",
   "ifndef" : "SAVE_ON_FLASH",
@@ -207,6 +249,30 @@ JsVarFloat jswrap_espruino_sum(JsVar *arr) {
   }
   JsVarFloat sum = 0;
 
+  char *ptr;
+  size_t length, i;
+  JsVarDataArrayBufferViewType type;
+  JsVar *data = jswrap_espruino_getFlatData(arr, &ptr, &length, &type);
+  if (data) {
+    if (type==ARRAYBUFFERVIEW_FLOAT32) {
+      float *p = (float*)ptr;
+      for (i=0;i<length;i++) sum += p[i];
+    } else if (type==ARRAYBUFFERVIEW_FLOAT64) {
+      double *p = (double*)ptr;
+      for (i=0;i<length;i++) sum += p[i];
+    } else {
+      // integers can be added exactly (and quickly) without using floats
+      long long isum = 0;
+      INT_TYPED_ARRAY_SWITCH(type,
+        ELEMENT *p = (ELEMENT*)ptr;
+        for (i=0;i<length;i++) isum += p[i]
+      );
+      sum = (JsVarFloat)isum;
+    }
+    jsvUnLock(data);
+    return sum;
+  }
+
   JsvIterator itsrc;
   jsvIteratorNew(&itsrc, arr);
   while (jsvIteratorHasElement(&itsrc)) {
@@ -238,6 +304,22 @@ JsVarFloat jswrap_espruino_variance(JsVar *arr, JsVarFloat mean) {
   }
   JsVarFloat variance = 0;
 
+  char *ptr;
+  size_t length, i;
+  JsVarDataArrayBufferViewType type;
+  JsVar *data = jswrap_espruino_getFlatData(arr, &ptr, &length, &type);
+  if (data) {
+    TYPED_ARRAY_SWITCH(type,
+      ELEMENT *p = (ELEMENT*)ptr;
+      for (i=0;i<length;i++) {
+        JsVarFloat val = (JsVarFloat)p[i] - mean;
+        variance += val*val;
+      }
+    );
+    jsvUnLock(data);
+    return variance;
+  }
+
   JsvIterator itsrc;
   jsvIteratorNew(&itsrc, arr);
   while (jsvIteratorHasElement(&itsrc)) {
@@ -273,15 +355,46 @@ JsVarFloat jswrap_espruino_convolve(JsVar *arr1, JsVar *arr2, int offset) {
   }
   JsVarFloat conv = 0;
 
+  // get the offset into arr2 that we start at
+  int l = (int)jsvGetLength(arr2);
+  offset = offset % l;
+  if (offset<0) offset += l;
+
+  char *ptr1, *ptr2;
+  size_t len1, len2, i;
+  JsVarDataArrayBufferViewType type1, type2;
+  JsVar *data1 = jswrap_espruino_getFlatData(arr1, &ptr1, &len1, &type1);
+  JsVar *data2 = data1 ? jswrap_espruino_getFlatData(arr2, &ptr2, &len2, &type2) : 0;
+  if (data1 && data2) {
+    /* Go through in runs where arr2 doesn't wrap around, so that each
+     * run is just a simple multiply-accumulate over two arrays */
+    size_t idx1 = 0, idx2 = (size_t)offset;
+    while (idx1 < len1) {
+      size_t n = len2-idx2;
+      if (n > len1-idx1) n = len1-idx1;
+      if (type1==type2) {
+        TYPED_ARRAY_SWITCH(type1,
+          ELEMENT *p1 = ((ELEMENT*)ptr1) + idx1;
+          ELEMENT *p2 = ((ELEMENT*)ptr2) + idx2;
+          for (i=0;i<n;i++) conv += (JsVarFloat)p1[i] * (JsVarFloat)p2[i]
+        );
+      } else {
+        for (i=0;i<n;i++)
+          conv += jswrap_espruino_getFlatElement(type1, ptr1, idx1+i) *
+                  jswrap_espruino_getFlatElement(type2, ptr2, idx2+i);
+      }
+      idx1 += n;
+      idx2 = 0;
+    }
+    jsvUnLock2(data1, data2);
+    return conv;
+  }
+  jsvUnLock(data1);
+
   JsvIterator it1;
   jsvIteratorNew(&it1, arr1);
   JsvIterator it2;
   jsvIteratorNew(&it2, arr2);
-
-  // get iterator2 at the correct offset
-  int l = (int)jsvGetLength(arr2);
-  offset = offset % l;
-  if (offset<0) offset += l;
   while (offset-->0)
     jsvIteratorNext(&it2);
 
@@ -378,6 +491,122 @@ short FFT(short int dir,long m,double *x,double *y)
   return(TRUE);
 }
 
+/* The same FFT for Float32Arrays, so they can be transformed in place.
+   The maths is still done with doubles - only the results are stored as floats */
+static short FFT_float(short int dir,long m,float *x,float *y)
+{
+  long n,i,i1,j,k,i2,l,l1,l2;
+  double c1,c2,t1,t2,u1,u2,z;
+  float tx,ty;
+
+  /* Calculate the number of points */
+  n = 1;
+  for (i=0;i<m;i++)
+    n *= 2;
+
+  /* Do the bit reversal */
+  i2 = n >> 1;
+  j = 0;
+  for (i=0;i<n-1;i++) {
+    if (i < j) {
+      tx = x[i];
+      ty = y[i];
+      x[i] = x[j];
+      y[i] = y[j];
+      x[j] = tx;
+      y[j] = ty;
+    }
+    k = i2;
+    while (k <= j) {
+      j -= k;
+      k >>= 1;
+    }
+    j += k;
+  }
+
+  /* Compute the FFT */
+  c1 = -1.0;
+  c2 = 0.0;
+  l2 = 1;
+  for (l=0;l<m;l++) {
+    l1 = l2;
+    l2 <<= 1;
+    u1 = 1.0;
+    u2 = 0.0;
+    for (j=0;j<l1;j++) {
+      for (i=j;i<n;i+=l2) {
+        i1 = i + l1;
+        t1 = u1 * x[i1] - u2 * y[i1];
+        t2 = u1 * y[i1] + u2 * x[i1];
+        x[i1] = (float)(x[i] - t1);
+        y[i1] = (float)(y[i] - t2);
+        x[i] = (float)(x[i] + t1);
+        y[i] = (float)(y[i] + t2);
+      }
+      z =  u1 * c1 - u2 * c2;
+      u2 = u1 * c2 + u2 * c1;
+      u1 = z;
+    }
+    c2 = jswrap_math_sqrt((1.0 - c1) / 2.0);
+    if (dir == 1)
+      c2 = -c2;
+    c1 = jswrap_math_sqrt((1.0 + c1) / 2.0);
+  }
+
+  /* Scaling for forward transform */
+  if (dir == 1) {
+    for (i=0;i<n;i++) {
+      x[i] = (float)(x[i] / (double)n);
+      y[i] = (float)(y[i] / (double)n);
+    }
+  }
+
+  return(TRUE);
+}
+
+/// Try and do an FFT directly on the data in Float32Arrays or Float64Arrays. Returns false if we can't
+static bool jswrap_espruino_FFT_inPlace(JsVar *arrReal, JsVar *arrImag, bool inverse, int order, size_t pow2) {
+  char *ptrReal, *ptrImag;
+  size_t lenReal, lenImag;
+  JsVarDataArrayBufferViewType typeReal, typeImag;
+  JsVar *dataReal = jswrap_espruino_getFlatData(arrReal, &ptrReal, &lenReal, &typeReal);
+  if (!dataReal) return false;
+  JsVar *dataImag = 0;
+  if (lenReal==pow2 && (typeReal==ARRAYBUFFERVIEW_FLOAT32 || typeReal==ARRAYBUFFERVIEW_FLOAT64)) {
+    if (jsvIsUndefined(arrImag)) {
+      // no imaginary values, so use zeros - from a flat string rather than the stack
+      dataImag = jsvNewFlatStringOfLength((unsigned int)(pow2*JSV_ARRAYBUFFER_GET_SIZE(typeReal)));
+      if (dataImag) ptrImag = jsvGetFlatStringPointer(dataImag);
+    } else {
+      dataImag = jswrap_espruino_getFlatData(arrImag, &ptrImag, &lenImag, &typeImag);
+      if (dataImag && (lenImag!=pow2 || typeImag!=typeReal)) {
+        jsvUnLock(dataImag);
+        dataImag = 0;
+      }
+    }
+  }
+  if (!dataImag) {
+    jsvUnLock(dataReal);
+    return false;
+  }
+
+  bool useModulus = jsvIsIterable(arrImag);
+  size_t i;
+  if (typeReal==ARRAYBUFFERVIEW_FLOAT32) {
+    float *x = (float*)ptrReal, *y = (float*)ptrImag;
+    FFT_float(inverse ? -1 : 1, order, x, y);
+    if (useModulus)
+      for (i=0;i<pow2;i++) x[i] = (float)jswrap_math_sqrt((double)x[i]*x[i] + (double)y[i]*y[i]);
+  } else {
+    double *x = (double*)ptrReal, *y = (double*)ptrImag;
+    FFT(inverse ? -1 : 1, order, x, y);
+    if (useModulus)
+      for (i=0;i<pow2;i++) x[i] = jswrap_math_sqrt(x[i]*x[i] + y[i]*y[i]);
+  }
+  jsvUnLock2(dataReal, dataImag);
+  return true;
+}
+
 /*JSON{
   "type" : "staticmethod",
   "ifndef" : "SAVE_ON_FLASH",
@@ -408,13 +637,24 @@ void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
     order++;
   }
 
-  if (jsuGetFreeStack() < 100+sizeof(double)*pow2*2) {
-    jsExceptionHere(JSET_ERROR, "Insufficient stack for computing FFT");
+  // Float32Array/Float64Array can be done without copying
+  if (jswrap_espruino_FFT_inPlace(arrReal, arrImag, inverse, order, pow2))
     return;
-  }
 
-  double *vReal = (double*)alloca(sizeof(double)*pow2);
-  double *vImag = (double*)alloca(sizeof(double)*pow2);
+  double *vReal, *vImag;
+  JsVar *buffer = 0;
+  if (jsuGetFreeStack() < 100+sizeof(double)*pow2*2) {
+    // Not enough stack - try and use a flat string instead
+    buffer = jsvNewFlatStringOfLength((unsigned int)(sizeof(double)*pow2*2));
+    if (!buffer) {
+      jsExceptionHere(JSET_ERROR, "Insufficient stack for computing FFT");
+      return;
+    }
+    vReal = (double*)jsvGetFlatStringPointer(buffer);
+  } else {
+    vReal = (double*)alloca(sizeof(double)*pow2*2);
+  }
+  vImag = &vReal[pow2];
 
   unsigned int i;
   for (i=0;i<pow2;i++) {
@@ -471,6 +711,7 @@ void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
     }
     jsvIteratorFree(&it);
   }
+  jsvUnLock(buffer);
 }
 
 /*JSON{
@@ -805,6 +1046,23 @@ JsVar *jswrap_espruino_getSizeOf(JsVar *v, int depth) {
   return jsvNewFromInteger((JsVarInt)jsvCountJsVarsUsed(v));
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "defrag",
+  "generate_full" : "jsvDefragment()"
+}
+Perform a garbage collection and then move variables in memory so that free
+memory is in one contiguous area. This allows large `ArrayBuffer`s and
+`Graphics` buffers to be allocated as flat strings.
+
+This is done automatically when Espruino is idle and `process.memory().fragmentation`
+is high, so you'd usually only call this before trying to allocate a large buffer.
+
+**Note:** Variables that are in use when this is called cannot be moved.
+ */
+
 /*JSON{
   "type" : "staticmethod",
     "ifndef" : "SAVE_ON_FLASH",
@@ -973,6 +1231,208 @@ JsVarInt jswrap_espruino_HSBtoRGB(JsVarFloat hue, JsVarFloat sat, JsVarFloat bri
   }
 }
 
+// ----------------------------------------- Profiler
+
+#ifdef USE_PROFILER
+#include "jsprofiler.h"
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_PROFILER",
+  "class" : "E",
+  "name" : "resetProfile",
+  "generate" : "jswrap_espruino_resetProfile",
+  "params" : [
+    ["start","JsVar","If `false`, stop profiling. Otherwise start (or restart) it"]
+  ]
+}
+Clear everything the profiler has recorded and start profiling. Use
+`E.getProfile()` to see the results.
+
+While profiling, the interpreter keeps count of (and time for) lexing,
+scope lookups, allocations, garbage collection and native function calls,
+as well as the number of calls and total time for each JavaScript function.
+Profiling slows execution down, so call `E.resetProfile(false)` when you're
+done.
+ */
+void jswrap_espruino_resetProfile(JsVar *start) {
+  jsprReset(jsvIsUndefined(start) || jsvGetBool(start));
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_PROFILER",
+  "class" : "E",
+  "name" : "getProfile",
+  "generate" : "jswrap_espruino_getProfile",
+  "params" : [
+    ["format","JsVar","If `\"folded\"`, return folded call stacks (see below). Otherwise return an object"]
+  ],
+  "return" : ["JsVar","The profile recorded since `E.resetProfile()` was called"]
+}
+Return what the profiler has recorded since `E.resetProfile()` was called.
+Times are in milliseconds:
+
+```
+{ time : 123.4, // time since E.resetProfile()
+  other : { time : 50.1 }, // executing JS
+  lex : { count : 10234, time : 30.2 },
+  scope : { count : 2345, time : 10.5 },
+  alloc : { count : 3456, time : 8.1 },
+  gc : { count : 1, time : 0.9 },
+  native : { count : 345, time : 23.6 },
+  functions : [ { name : "foo", calls : 12, time : 54.3 }, ... ] }
+```
+
+Time is only ever counted against one of `other`/`lex`/`scope`/`alloc`/`gc`/`native`,
+so they add up to `time`. The time for each function includes the time for
+everything it called.
+
+`E.getProfile("folded")` returns a String with a line for each different call
+stack, containing the function names separated by `;` and the time in
+microseconds spent in the last function. This can be turned into a flame graph
+with tools like `flamegraph.pl`.
+ */
+JsVar *jswrap_espruino_getProfile(JsVar *format) {
+  if (jsvIsString(format) && jsvIsStringEqual(format, "folded"))
+    return jsprGetFoldedStacks();
+  return jsprGetProfile();
+}
+
+#ifdef USE_PROFILER_SAMPLING
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_PROFILER_SAMPLING",
+  "class" : "E",
+  "name" : "startSampling",
+  "generate" : "jswrap_espruino_startSampling",
+  "params" : [
+    ["hz","JsVar","How many samples to take per second (default 1000). If 0, stop sampling"]
+  ]
+}
+**Linux only.** Clear any samples and start the sampling profiler. Every
+`1/hz` seconds that JavaScript is executing, it records the line of code being
+executed and the functions that were called to get there. This slows execution much less
+than `E.resetProfile()`, so is better for long-running code.
+
+Call `E.startSampling(0)` to stop, then `E.dumpSamples()` or
+`E.getSamples()` to see the results. Time spent in native functions is
+counted against the code that follows the call. On Linux you can also run
+`espruino --sample hz file.txt script.js`, which writes the results to
+`file.txt` when Espruino exits.
+ */
+void jswrap_espruino_startSampling(JsVar *hz) {
+  jsprStartSampling(jsvIsUndefined(hz) ? 1000 : (int)jsvGetInteger(hz));
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_PROFILER_SAMPLING",
+  "class" : "E",
+  "name" : "getSamples",
+  "generate" : "jswrap_espruino_getSamples",
+  "params" : [
+    ["format","JsVar","If `\"folded\"`, return folded call stacks (see `E.getProfile`). Otherwise return an array"]
+  ],
+  "return" : ["JsVar","The samples taken since `E.startSampling()`"]
+}
+**Linux only.** Return the samples taken since `E.startSampling()` was called,
+as an array of lines of code with the busiest first:
+
+```
+[ { samples : 412, line : 3, function : "add", code : "return a+b;" }, ... ]
+```
+
+`line` is the line number in the file. If it isn't known where the function
+was in the file, it's the line number in the function instead.
+
+`E.getSamples("folded")` returns one line per call stack containing the function
+names separated by `;` and the number of samples, for use with flame graph tools.
+ */
+JsVar *jswrap_espruino_getSamples(JsVar *format) {
+  if (jsvIsString(format) && jsvIsStringEqual(format, "folded"))
+    return jsprGetSampleFoldedStacks();
+  return jsprGetSamples();
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_PROFILER_SAMPLING",
+  "class" : "E",
+  "name" : "dumpSamples",
+  "generate" : "jswrap_espruino_dumpSamples"
+}
+**Linux only.** Print the lines of code that the most samples were taken on
+since `E.startSampling()` was called.
+ */
+void jswrap_espruino_dumpSamples() {
+  jsprDumpSamples((vcbprintf_callback)jsiConsolePrintString, 0);
+}
+#endif
+
+#ifdef USE_PROFILER_ALLOC_TRACE
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_PROFILER_ALLOC_TRACE",
+  "class" : "E",
+  "name" : "traceAllocations",
+  "generate" : "jswrap_espruino_traceAllocations",
+  "params" : [
+    ["enable","JsVar","If true (or undefined), forget any allocations traced so far and start tracing. If false, stop tracing"]
+  ]
+}
+**Linux only.** Record where each variable is allocated from - the native function and
+line of JavaScript that were executing. Use `E.getAllocations()` or
+`E.dumpAllocations()` to see where the variables that are still in use came
+from.
+
+When running tests with `espruino --test`, allocations are always traced and
+are listed if any memory is left unfreed at the end of the test.
+ */
+void jswrap_espruino_traceAllocations(JsVar *enable) {
+  jsprTraceAllocations(jsvIsUndefined(enable) || jsvGetBool(enable));
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_PROFILER_ALLOC_TRACE",
+  "class" : "E",
+  "name" : "getAllocations",
+  "generate" : "jswrap_espruino_getAllocations",
+  "return" : ["JsVar","Variables in use, grouped by where they were allocated"]
+}
+**Linux only.** Return all the variables that are in use, grouped by where they
+were allocated (see `E.traceAllocations()`) and their type, most first:
+
+```
+[ { count : 12, type : "Object", site : "line 3", code : "var o = {a:1};" },
+  { count : 4, type : "String", site : "JSON.stringify() line 7", code : "s = JSON.stringify(o);" }, ... ]
+```
+
+`count` is the number of variables used. Variables allocated before tracing
+was started have a site of `"(untraced)"`, and ones allocated from outside
+of any JavaScript have a site of `"(system)"`.
+ */
+JsVar *jswrap_espruino_getAllocations() {
+  return jsprGetAllocations();
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_PROFILER_ALLOC_TRACE",
+  "class" : "E",
+  "name" : "dumpAllocations",
+  "generate" : "jswrap_espruino_dumpAllocations"
+}
+**Linux only.** Print all the variables that are in use, grouped by where they
+were allocated (see `E.traceAllocations()`) and their type.
+ */
+void jswrap_espruino_dumpAllocations() {
+  jsprDumpAllocations((vcbprintf_callback)jsiConsolePrintString, 0);
+}
+#endif
+#endif
+
 // ----------------------------------------- USB Specific Stuff
 
 #ifdef USE_USB_HID
@@ -38,5 +38,14 @@ void jswrap_espruino_mapInPlace(JsVar *from, JsVar *to, JsVar *map, JsVarInt bit
 JsVar *jswrap_e_dumpStr();
 JsVarInt jswrap_espruino_HSBtoRGB(JsVarFloat hue, JsVarFloat sat, JsVarFloat bri);
 
+void jswrap_espruino_resetProfile(JsVar *start);
+JsVar *jswrap_espruino_getProfile(JsVar *format);
+void jswrap_espruino_startSampling(JsVar *hz);
+JsVar *jswrap_espruino_getSamples(JsVar *format);
+void jswrap_espruino_dumpSamples();
+void jswrap_espruino_traceAllocations(JsVar *enable);
+JsVar *jswrap_espruino_getAllocations();
+void jswrap_espruino_dumpAllocations();
+
 void jswrap_espruino_setUSBHID(JsVar *arr);
 bool jswrap_espruino_sendUSBHID(JsVar *arr);
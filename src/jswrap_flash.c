@@ -17,12 +17,19 @@
 #include "jshardware.h"
 #include "jsvariterator.h"
 #include "jsinteractive.h"
+#include "jsprofiler.h"
 
 #ifdef LINUX
 // file IO for load/save
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define JSF_STATE_FILE "espruino.state"
 #endif
 
 /*JSON{
@@ -231,6 +238,251 @@ void jsfSaveToFlash_writecb(unsigned char ch, uint32_t *cbdata) {
 #endif
 
 
+#ifdef LINUX
+// ------------------------------------------------------------------------
+// ------------------------------------------------------------------------
+//                                                      Linux state snapshots
+// ------------------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+/* Snapshots contain just the used variables, so they can be written and
+ * loaded with a few big copies rather than one byte at a time. The file is
+ * a JsfSnapshotHeader, then 'runCount' JsfSnapshotRuns, then the contents of
+ * the variables in each run one after the other. Any variable that isn't in
+ * a run is unused. */
+
+#define JSF_SNAPSHOT_MAGIC 0x53505345 // "ESPS" - never a multiple of 4096 like the var count at the start of an RLE file
+#define JSF_SNAPSHOT_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t varSize; ///< sizeof(JsVar) - so we don't load a snapshot from a different build
+  uint32_t varCount; ///< jsvGetMemoryTotal() when it was saved
+  uint32_t runCount;
+  uint32_t checksum; ///< of the runs and the variable data
+} JsfSnapshotHeader;
+
+typedef struct {
+  uint32_t start; ///< JsVarRef of the first variable
+  uint32_t count;
+} JsfSnapshotRun;
+
+static uint32_t jsfChecksum(uint32_t sum, const unsigned char *data, size_t len) {
+  // FNV-1a, but a word at a time
+  while (len>=4) {
+    uint32_t w;
+    memcpy(&w, data, 4);
+    sum = (sum ^ w) * 16777619;
+    data += 4;
+    len -= 4;
+  }
+  while (len--)
+    sum = (sum ^ *(data++)) * 16777619;
+  return sum;
+}
+
+/** Copy 'count' variables starting at 'ref' to or from 'data' (or zero
+ * them if data==0). With RESIZABLE_JSVARS variables are in separate blocks
+ * that may not be next to each other, so this copies each contiguous part
+ * separately */
+static void jsfCopyVars(JsVarRef ref, uint32_t count, unsigned char *data, bool toVars) {
+  while (count) {
+    JsVar *v = _jsvGetAddressOf(ref);
+    uint32_t n = 1;
+    while (n<count && _jsvGetAddressOf((JsVarRef)(ref+n))==v+n) n++;
+    size_t bytes = n*sizeof(JsVar);
+    if (!data) memset(v, 0, bytes);
+    else if (toVars) memcpy(v, data, bytes);
+    else memcpy(data, v, bytes);
+    if (data) data += bytes;
+    ref = (JsVarRef)(ref+n);
+    count -= n;
+  }
+}
+
+/** Work out the runs of used variables, and return them (malloc'd). A run
+ * never crosses from one block of variables to another, so each one is
+ * contiguous in memory. */
+static JsfSnapshotRun *jsfGetSnapshotRuns(uint32_t *runCount) {
+  uint32_t count = 0, size = 64;
+  JsfSnapshotRun *runs = malloc(size*sizeof(JsfSnapshotRun));
+  uint32_t varCount = jsvGetMemoryTotal();
+  JsVar *last = 0; // the last used variable
+  uint32_t i = 1;
+  while (runs && i<=varCount) {
+    JsVar *v = _jsvGetAddressOf((JsVarRef)i);
+    if ((v->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
+      i++;
+      continue;
+    }
+    uint32_t blocks = jsvIsFlatString(v) ? 1+(uint32_t)jsvGetFlatStringBlocks(v) : 1;
+    if (count && runs[count-1].start+runs[count-1].count==i && last+1==v) {
+      runs[count-1].count += blocks;
+    } else {
+      if (count==size) {
+        size *= 2;
+        JsfSnapshotRun *r = realloc(runs, size*sizeof(JsfSnapshotRun));
+        if (!r) free(runs);
+        runs = r;
+        if (!runs) break;
+      }
+      runs[count].start = i;
+      runs[count].count = blocks;
+      count++;
+    }
+    last = v+blocks-1;
+    i += blocks;
+  }
+  *runCount = count;
+  return runs;
+}
+
+static bool jsfSaveSnapshot(FILE *f) {
+  JsfSnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = JSF_SNAPSHOT_MAGIC;
+  header.version = JSF_SNAPSHOT_VERSION;
+  header.varSize = sizeof(JsVar);
+  header.varCount = jsvGetMemoryTotal();
+  JsfSnapshotRun *runs = jsfGetSnapshotRuns(&header.runCount);
+  if (!runs) return false;
+  size_t runBytes = header.runCount*sizeof(JsfSnapshotRun);
+  header.checksum = jsfChecksum(2166136261u, (unsigned char*)runs, runBytes);
+  bool ok = fwrite(&header, sizeof(header), 1, f)==1 &&
+            (!runBytes || fwrite(runs, runBytes, 1, f)==1);
+  uint32_t r;
+  for (r=0;ok && r<header.runCount;r++) {
+    unsigned char *data = (unsigned char*)_jsvGetAddressOf((JsVarRef)runs[r].start);
+    size_t bytes = runs[r].count*sizeof(JsVar);
+    header.checksum = jsfChecksum(header.checksum, data, bytes);
+    ok = fwrite(data, bytes, 1, f)==1;
+  }
+  free(runs);
+  // now we know the checksum, write the header again
+  return ok && fseek(f, 0, SEEK_SET)==0 && fwrite(&header, sizeof(header), 1, f)==1;
+}
+
+/** Check the snapshot is complete and matches this build, and if so copy it
+ * into our variables. Returns false (without changing anything) if not */
+static bool jsfLoadSnapshot(const unsigned char *file, size_t fileSize) {
+  JsfSnapshotHeader header;
+  if (fileSize<sizeof(header)) return false;
+  memcpy(&header, file, sizeof(header));
+  if (header.magic!=JSF_SNAPSHOT_MAGIC ||
+      header.version!=JSF_SNAPSHOT_VERSION ||
+      header.varSize!=sizeof(JsVar) ||
+      !header.varCount ||
+      header.runCount > (fileSize-sizeof(header))/sizeof(JsfSnapshotRun))
+    return false;
+  const JsfSnapshotRun *runs = (const JsfSnapshotRun*)(file+sizeof(header));
+  size_t offset = sizeof(header) + header.runCount*sizeof(JsfSnapshotRun);
+  // runs must be in order, not overlap, and fit in varCount
+  uint64_t varsUsed = 0;
+  uint32_t r, next = 1;
+  for (r=0;r<header.runCount;r++) {
+    if (runs[r].start<next || !runs[r].count ||
+        (uint64_t)runs[r].start+runs[r].count-1 > header.varCount)
+      return false;
+    next = runs[r].start+runs[r].count;
+    varsUsed += runs[r].count;
+  }
+  if (offset + varsUsed*sizeof(JsVar) != fileSize ||
+      jsfChecksum(jsfChecksum(2166136261u, file+sizeof(header), offset-sizeof(header)), file+offset, fileSize-offset) != header.checksum)
+    return false;
+  // It's ok - copy it in
+  jsvSetMemoryTotal(header.varCount);
+  unsigned char *data = (unsigned char*)file+offset;
+  next = 1;
+  for (r=0;r<header.runCount;r++) {
+    jsfCopyVars((JsVarRef)next, runs[r].start-next, 0, true); // unused
+    jsfCopyVars((JsVarRef)runs[r].start, runs[r].count, data, true);
+    data += runs[r].count*sizeof(JsVar);
+    next = runs[r].start+runs[r].count;
+  }
+  jsfCopyVars((JsVarRef)next, jsvGetMemoryTotal()+1-next, 0, true); // unused
+  return true;
+}
+
+/// Load a file saved in the old format - RLE compressed, with the number of variables first
+static bool jsfLoadRLE(FILE *f) {
+  unsigned int varCount;
+  if (fread(&varCount, sizeof(unsigned int), 1, f)!=1 || !varCount) return false;
+  size_t length = varCount*sizeof(JsVar), pos = 0;
+  unsigned char *data = malloc(length);
+  if (!data) return false;
+  // like rle_decode, but stop if the data is the wrong length
+  int ch, lastCh = -256;
+  while (pos<length && (ch = fgetc(f))!=EOF) {
+    data[pos++] = (unsigned char)ch;
+    if (ch==lastCh) {
+      int cnt = fgetc(f);
+      if (cnt==EOF || pos+(size_t)cnt>length) break;
+      memset(&data[pos], ch, (size_t)cnt);
+      pos += (size_t)cnt;
+    }
+    lastCh = ch;
+  }
+  if (pos!=length || fgetc(f)!=EOF) {
+    free(data);
+    return false;
+  }
+  jsvSetMemoryTotal(varCount);
+  jsfCopyVars(1, varCount, data, true);
+  if (jsvGetMemoryTotal() > varCount)
+    jsfCopyVars((JsVarRef)(varCount+1), jsvGetMemoryTotal()-varCount, 0, true);
+  free(data);
+  return true;
+}
+
+bool jsfSaveToFile(const char *filename, bool rle) {
+  FILE *f = fopen(filename,"wb");
+  if (!f) return false;
+  bool ok = true;
+  if (rle) {
+    unsigned int varCount = jsvGetMemoryTotal();
+    unsigned char *data = malloc(varCount*sizeof(JsVar));
+    ok = data && fwrite(&varCount, sizeof(unsigned int), 1, f)==1;
+    if (ok) {
+      jsfCopyVars(1, varCount, data, false);
+      rle_encode(data, varCount*sizeof(JsVar), jsfSaveToFlash_writecb, (uint32_t*)f);
+    }
+    free(data);
+  } else {
+    ok = jsfSaveSnapshot(f);
+  }
+  if (fclose(f)) ok = false;
+  return ok;
+}
+
+bool jsfLoadFromFile(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd<0) return false;
+  struct stat st;
+  bool ok = false;
+  uint32_t magic = 0;
+  if (fstat(fd, &st)==0 && read(fd, &magic, sizeof(magic))==sizeof(magic)) {
+    if (magic==JSF_SNAPSHOT_MAGIC) {
+      void *file = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (file!=MAP_FAILED) {
+        ok = jsfLoadSnapshot((const unsigned char*)file, (size_t)st.st_size);
+        munmap(file, (size_t)st.st_size);
+      }
+    } else {
+      FILE *f = fdopen(fd, "rb");
+      if (f) {
+        fseek(f, 0, SEEK_SET);
+        ok = jsfLoadRLE(f);
+        fclose(f); // closes fd too
+        return ok;
+      }
+    }
+  }
+  close(fd);
+  return ok;
+}
+#endif
+
 // ------------------------------------------------------------------------
 // ------------------------------------------------------------------------
 //                                                  Global flash read/write
@@ -239,39 +491,11 @@ void jsfSaveToFlash_writecb(unsigned char ch, uint32_t *cbdata) {
 
 void jsfSaveToFlash() {
 #ifdef LINUX
-  FILE *f = fopen("espruino.state","wb");
-  if (f) {
-    unsigned int jsVarCount = jsvGetMemoryTotal();
-    jsiConsolePrintf("\nSaving %d bytes...", jsVarCount*sizeof(JsVar));
-    fwrite(&jsVarCount, sizeof(unsigned int), 1, f);
-    /*JsVarRef i;
-    for (i=1;i<=jsVarCount;i++) {
-      fwrite(_jsvGetAddressOf(i),1,sizeof(JsVar),f);
-    }*/
-    rle_encode((unsigned char*)_jsvGetAddressOf(1), jsVarCount*sizeof(JsVar), jsfSaveToFlash_writecb, (uint32_t*)f);
-    fclose(f);
+  jsiConsolePrintf("\nSaving %d bytes...", jsvGetMemoryTotal()*sizeof(JsVar));
+  if (jsfSaveToFile(JSF_STATE_FILE, false))
     jsiConsolePrint("\nDone!\n");
-
-#ifdef DEBUG
-    jsiConsolePrint("Checking...\n");
-    FILE *f = fopen("espruino.state","rb");
-    fread(&jsVarCount, sizeof(unsigned int), 1, f);
-    if (jsVarCount != jsvGetMemoryTotal())
-      jsiConsolePrint("Error: memory sizes different\n");
-    unsigned char *decomp = (unsigned char*)malloc(jsVarCount*sizeof(JsVar));
-    rle_decode(jsfLoadFromFlash_readcb, f, decomp);
-    fclose(f);
-    unsigned char *comp = _jsvGetAddressOf(1);
-    int j;
-    for (j=0;j<jsVarCount*sizeof(JsVar);j++)
-      if (decomp[j]!=comp[j])
-        jsiConsolePrintf("Error at %d: original %d, decompressed %d\n", j, comp[j], decomp[j]);  
-    free(decomp);
-    jsiConsolePrint("Done!\n>");
-#endif
-  } else {
+  else
     jsiConsolePrint("\nFile Open Failed... \n>");
-  }
 #else // !LINUX
   unsigned int dataSize = jsvGetMemoryTotal() * sizeof(JsVar);
   uint32_t *basePtr = (uint32_t *)_jsvGetAddressOf(1);
@@ -333,22 +557,16 @@ void jsfSaveToFlash() {
 
 void jsfLoadFromFlash() {
 #ifdef LINUX
-  FILE *f = fopen("espruino.state","rb");
-  if (f) {
-    unsigned int jsVarCount;
-    fread(&jsVarCount, sizeof(unsigned int), 1, f);
-
-    jsiConsolePrintf("\nDecompressing to %d bytes...", jsVarCount*sizeof(JsVar));
-    jsvSetMemoryTotal(jsVarCount);
-    /*JsVarRef i;
-    for (i=1;i<=jsVarCount;i++) {
-      fread(_jsvGetAddressOf(i),1,sizeof(JsVar),f);
-    }*/
-    rle_decode(jsfLoadFromFlash_readcb, (uint32_t*)f, (unsigned char*)_jsvGetAddressOf(1));
-    fclose(f);
-  } else {
-    jsiConsolePrint("\nFile Open Failed... \n");
+  jsiConsolePrint("\nLoading "JSF_STATE_FILE"...");
+  if (!jsfLoadFromFile(JSF_STATE_FILE)) {
+    jsiConsolePrint("\nUnable to load "JSF_STATE_FILE"\n");
+    return;
   }
+#ifdef USE_PROFILER_ALLOC_TRACE
+  // every variable has been replaced, so we no longer know where any came from
+  if (jsprTracing) jsprTraceAllocations(true);
+  else jsprKillAllocationTrace();
+#endif
 #else // !LINUX
   if (!jsfFlashContainsCode()) {
     jsiConsolePrintf("No code in flash!\n");
@@ -368,7 +586,7 @@ void jsfLoadFromFlash() {
 
 bool jsfFlashContainsCode() {
 #ifdef LINUX
-  FILE *f = fopen("espruino.state","rb");
+  FILE *f = fopen(JSF_STATE_FILE,"rb");
   if (f) fclose(f);
   return f!=0;
 #else // !LINUX
@@ -24,3 +24,10 @@ void jsfSaveToFlash();
 void jsfLoadFromFlash();
 /// Returns true if flash contains something useful
 bool jsfFlashContainsCode();
+
+#ifdef LINUX
+/// Save the contents of JsVars to a file as a snapshot, or in the older RLE compressed format. Returns false on failure
+bool jsfSaveToFile(const char *filename, bool rle);
+/// Load the contents of JsVars from a file written by jsfSaveToFile. Returns false if it couldn't be loaded
+bool jsfLoadFromFile(const char *filename);
+#endif
@@ -503,12 +503,14 @@ void jswrap_object_on(JsVar *parent, JsVar *event, JsVar *listener) {
     jsWarn("Second argument to EventEmitter.on(..) must be a function or a String (containing code)");
     return;
   }
-  JsVar *eventName = jsvNewFromString(JS_EVENT_PREFIX);
-  if (!eventName) return; // no memory
-  jsvAppendStringVarComplete(eventName, event);
-
-  JsVar *eventList = jsvFindChildFromVar(parent, eventName, true);
-  jsvUnLock(eventName);
+  JsVar *eventList = jsvFindEventListeners(parent, event);
+  if (!eventList) {
+    JsVar *eventName = jsvNewFromString(JS_EVENT_PREFIX);
+    if (!eventName) return; // no memory
+    jsvAppendStringVarComplete(eventName, event);
+    eventList = jsvMakeIntoVariableName(eventName, 0);
+    jsvAddName(parent, eventList);
+  }
   JsVar *eventListeners = jsvSkipName(eventList);
   if (jsvIsUndefined(eventListeners)) {
     // just add
@@ -560,30 +562,18 @@ void jswrap_object_emit(JsVar *parent, JsVar *event, JsVar *argArray) {
     jsWarn("First argument to EventEmitter.emit(..) must be a string");
     return;
   }
-  JsVar *eventName = jsvNewFromString(JS_EVENT_PREFIX);
-  if (!eventName) return; // no memory
-  jsvAppendStringVarComplete(eventName, event);
+  JsVar *callback = jsvSkipNameAndUnLock(jsvFindEventListeners(parent, event));
+  if (!callback) return;
 
   // extract data
-  const unsigned int MAX_ARGS = 4;
-  JsVar *args[MAX_ARGS];
-  unsigned int n = 0;
-  JsvObjectIterator it;
-  jsvObjectIteratorNew(&it, argArray);
-  while (jsvObjectIteratorHasValue(&it)) {
-    if (n>=MAX_ARGS) {
-      jsWarn("Too many arguments");
-      break;
-    }
-    args[n++] = jsvObjectIteratorGetValue(&it);
-    jsvObjectIteratorNext(&it);
+  unsigned int n = (unsigned int)jsvGetArrayLength(argArray);
+  JsVar **args = 0;
+  if (n) {
+    args = (JsVar**)alloca(n * sizeof(JsVar*));
+    jsvGetArrayItems(argArray, n, args);
   }
-  jsvObjectIteratorFree(&it);
-
 
-  JsVar *callback = jsvSkipNameAndUnLock(jsvFindChildFromVar(parent, eventName, 0));
-  jsvUnLock(eventName);
-  if (callback) jsiQueueEvents(parent, callback, args, (int)n);
+  jsiQueueEvents(parent, callback, args, (int)n);
   jsvUnLock(callback);
 
   // unlock
@@ -608,12 +598,7 @@ void jswrap_object_removeAllListeners(JsVar *parent, JsVar *event) {
   }
   if (jsvIsString(event)) {
     // remove the whole child containing listeners
-    JsVar *eventName = jsvNewFromString(JS_EVENT_PREFIX);
-    if (!eventName) return; // no memory
-    jsvAppendStringVarComplete(eventName, event);
-
-    JsVar *eventList = jsvFindChildFromVar(parent, eventName, true);
-    jsvUnLock(eventName);
+    JsVar *eventList = jsvFindEventListeners(parent, event);
     if (eventList) {
       jsvRemoveChild(parent, eventList);
       jsvUnLock(eventList);
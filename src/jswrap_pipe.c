@@ -22,6 +22,13 @@
  *    * If the destination emits a 'close' signal we close the pipe
  *    * When the pipe closes, unless 'end=false' on initialisation, we call
  *      'end' on destination, and 'close' on source.
+ *    * If both 'read' and 'write' are native functions (File, Socket, etc)
+ *      then they can't run any JS, so we use bigger chunks and move several
+ *      of them each idle loop.
+ *    * If we know how to read the source and write the destination from C
+ *      (see pipeGetNativeRead/pipeGetNativeWrite) the data is copied straight
+ *      from one to the other through a buffer on the stack, without making
+ *      a String for each chunk or calling 'read' and 'write'.
  *
  * ----------------------------------------------------------------------------
  */
@@ -29,6 +36,18 @@
 #include "jswrap_pipe.h"
 #include "jswrap_object.h"
 #include "jswrap_stream.h"
+#include "jswrap_serial.h"
+#ifdef USE_FILESYSTEM
+#include "jswrap_file.h"
+#endif
+#ifdef USE_NET
+#include "jswrap_net.h"
+#include "jswrap_http.h"
+#endif
+
+#define PIPE_DEFAULT_CHUNK_SIZE 64
+#define PIPE_NATIVE_CHUNK_SIZE 512 // default chunk size when both ends of the pipe are native
+#define PIPE_NATIVE_MAX_CHUNKS 16 // max chunks moved in one idle loop when both ends are native
 
 /*JSON{
   "type" : "library",
@@ -43,6 +62,65 @@ static JsVar* pipeGetArray(bool create) {
 }
 
 
+/** Are both ends of the pipe native, so can't execute any JS? Serial is left
+ * out as it has no 'drain' event and only a small transmit buffer, so we
+ * can't give it lots of data at once */
+static bool pipeIsNative(JsVar *readFunc, JsVar *writeFunc) {
+  return jsvIsNativeFunction(readFunc) && jsvIsNativeFunction(writeFunc) &&
+         writeFunc->varData.native.ptr != (void (*)(void))jswrap_serial_write;
+}
+
+/// Read up to 'len' bytes into 'data'. Return the amount read, 0 if waiting for more, or -1 when finished
+typedef int (*PipeNativeRead)(JsVar *source, char *data, size_t len);
+/// Write 'len' bytes from 'data'. Return false if we should wait for a 'drain' event
+typedef bool (*PipeNativeWrite)(JsVar *destination, const char *data, size_t len);
+
+/// If 'read' is one we can call directly from C, return the function to use
+static PipeNativeRead pipeGetNativeRead(JsVar *readFunc) {
+  if (!jsvIsNativeFunction(readFunc)) return 0;
+#ifdef USE_FILESYSTEM
+  if (readFunc->varData.native.ptr == (void (*)(void))jswrap_file_read) return jswrap_file_readBytes;
+#endif
+  return 0;
+}
+
+/// If 'write' is one we can call directly from C, return the function to use
+static PipeNativeWrite pipeGetNativeWrite(JsVar *writeFunc) {
+  if (!jsvIsNativeFunction(writeFunc)) return 0;
+  void (*ptr)(void) = writeFunc->varData.native.ptr;
+  if (ptr == (void (*)(void))jswrap_serial_write) return jswrap_serial_writeBytes;
+#ifdef USE_FILESYSTEM
+  if (ptr == (void (*)(void))jswrap_file_write) return jswrap_file_writeBytes;
+#endif
+#ifdef USE_NET
+  if (ptr == (void (*)(void))jswrap_net_socket_write) return jswrap_net_socket_writeBytes; // Socket and httpCRq
+  if (ptr == (void (*)(void))jswrap_httpSRs_write) return jswrap_httpSRs_writeBytes;
+#endif
+  return 0;
+}
+
+/** Copy up to 'chunks' chunks straight from source to destination. Returns
+ * false if the source has finished */
+static bool handlePipeNative(JsVar *pipe, JsVar *source, JsVar *destination, PipeNativeRead nativeRead, PipeNativeWrite nativeWrite, JsVar *position, size_t chunkSize, int chunks) {
+  char buf[PIPE_NATIVE_CHUNK_SIZE];
+  size_t bytesLeft = chunkSize*(size_t)chunks;
+  bool dataTransferred = false;
+  while (bytesLeft) {
+    int len = nativeRead(source, buf, (bytesLeft < sizeof(buf)) ? bytesLeft : sizeof(buf));
+    if (len<0) break; // finished
+    dataTransferred = true; // so we don't close the pipe if there was nothing to read yet
+    if (!len) break; // waiting for data
+    bytesLeft -= (size_t)len;
+    jsvSetInteger(position, jsvGetInteger(position) + len);
+    if (!nativeWrite(destination, buf, (size_t)len)) {
+      // wait for drain event
+      jsvObjectSetChildAndUnLock(pipe,"drainWait",jsvNewFromBool(true));
+      break;
+    }
+  }
+  return dataTransferred;
+}
+
 static void handlePipeClose(JsVar *arr, JsvObjectIterator *it, JsVar* pipe) {
   jsiQueueObjectCallbacks(pipe, JS_EVENT_PREFIX"complete", &pipe, 1);
   // Check the source to see if there was more data... It may not be a stream,
@@ -118,21 +196,30 @@ static bool handlePipe(JsVar *arr, JsvObjectIterator *it, JsVar* pipe) {
   if(source && destination && chunkSize && position) {
     JsVar *readFunc = jspGetNamedField(source, "read", false);
     JsVar *writeFunc = jspGetNamedField(destination, "write", false);
-    if (jsvIsFunction(readFunc) && jsvIsFunction(writeFunc)) { // do the objects have the necessary methods on them?
-      JsVar *buffer = jspExecuteFunction(readFunc, source, 1, &chunkSize);
-      if(buffer) {
+    PipeNativeRead nativeRead = pipeGetNativeRead(readFunc);
+    PipeNativeWrite nativeWrite = pipeGetNativeWrite(writeFunc);
+    int chunks = pipeIsNative(readFunc, writeFunc) ? PIPE_NATIVE_MAX_CHUNKS : 1;
+    if (nativeRead && nativeWrite) {
+      dataTransferred = handlePipeNative(pipe, source, destination, nativeRead, nativeWrite, position, (size_t)jsvGetInteger(chunkSize), chunks);
+    } else if (jsvIsFunction(readFunc) && jsvIsFunction(writeFunc)) { // do the objects have the necessary methods on them?
+      while (chunks--) {
+        JsVar *buffer = jspExecuteFunction(readFunc, source, 1, &chunkSize);
+        if (!buffer) break;
+        bool wait = true; // if we got "", the source is waiting for data
         JsVarInt bufferSize = jsvGetLength(buffer);
         if (bufferSize>0) {
           JsVar *response = jspExecuteFunction(writeFunc, destination, 1, &buffer);
           if (jsvIsBoolean(response) && jsvGetBool(response)==false) {
             // If boolean false was returned, wait for drain event (http://nodejs.org/api/stream.html#stream_writable_write_chunk_encoding_callback)
             jsvObjectSetChildAndUnLock(pipe,"drainWait",jsvNewFromBool(true));
-          }
+          } else
+            wait = false;
           jsvUnLock(response);
           jsvSetInteger(position, jsvGetInteger(position) + bufferSize);
         }
         jsvUnLock(buffer);
         dataTransferred = true; // so we don't close the pipe if we get an empty string
+        if (wait) break;
       }
     } else {
       if(!jsvIsFunction(readFunc))
@@ -250,7 +337,7 @@ static void jswrap_pipe_dst_close_listener(JsVar *destination) {
   "params" : [
     ["source","JsVar","The source file/stream that will send content."],
     ["destination","JsVar","The destination file/stream that will receive content from the source."],
-    ["options","JsVar",["An optional object `{ chunkSize : int=64, end : bool=true, complete : function }`","chunkSize : The amount of data to pipe from source to destination at a time","complete : a function to call when the pipe activity is complete","end : call the 'end' function on the destination when the source is finished"]]
+    ["options","JsVar",["An optional object `{ chunkSize : int=64, end : bool=true, complete : function }`","chunkSize : The amount of data to pipe from source to destination at a time (512 if both source and destination are built-in streams like File or Socket)","complete : a function to call when the pipe activity is complete","end : call the 'end' function on the destination when the source is finished"]]
   ]
 }*/
 void jswrap_pipe(JsVar* source, JsVar* dest, JsVar* options) {
@@ -263,7 +350,7 @@ void jswrap_pipe(JsVar* source, JsVar* dest, JsVar* options) {
     JsVar *writeFunc = jspGetNamedField(dest, "write", false);
     if(jsvIsFunction(readFunc)) {
       if(jsvIsFunction(writeFunc)) {
-        JsVarInt chunkSize = 64;
+        JsVarInt chunkSize = pipeIsNative(readFunc, writeFunc) ? PIPE_NATIVE_CHUNK_SIZE : PIPE_DEFAULT_CHUNK_SIZE;
         bool callEnd = true;
         // parse Options Object
         if (jsvIsObject(options)) {
@@ -107,6 +107,7 @@ Run a Garbage Collection pass, and return an object containing information on me
 * `usage` : Memory that has been used (in blocks)
 * `total` : Total memory (in blocks)
 * `history` : Memory used for command history - that is freed if memory is low. Note that this is INCLUDED in the figure for 'free'
+* `fragmentation` : The percentage of free memory that is not in the largest contiguous free area. If this is high, large ArrayBuffers may not be allocatable even if there is enough free memory - see `E.defrag()`
 * `stackEndAddress` : (on ARM) the address (that can be used with peek/poke/etc) of the END of the stack. The stack grows down, so unless you do a lot of recursion the bytes above this can be used.
 * `flash_start` : (on ARM) the address of the start of flash memory (usually `0x8000000`)
 * `flash_binary_end` : (on ARM) the address in flash memory of the end of Espruino's firmware.
@@ -135,6 +136,7 @@ JsVar *jswrap_process_memory() {
     jsvObjectSetChildAndUnLock(obj, "usage", jsvNewFromInteger((JsVarInt)usage));
     jsvObjectSetChildAndUnLock(obj, "total", jsvNewFromInteger((JsVarInt)total));
     jsvObjectSetChildAndUnLock(obj, "history", jsvNewFromInteger((JsVarInt)history));
+    jsvObjectSetChildAndUnLock(obj, "fragmentation", jsvNewFromInteger((JsVarInt)jsvGetMemoryFragmentation()));
 
 #ifdef ARM
     jsvObjectSetChildAndUnLock(obj, "stackEndAddress", jsvNewFromInteger((JsVarInt)(unsigned int)&LINKER_END_VAR));
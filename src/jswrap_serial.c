@@ -327,6 +327,17 @@ void jswrap_serial_write(JsVar *parent, JsVar *args) {
   _jswrap_serial_print(parent, args, false, false);
 }
 
+/** Write 'len' bytes of 'data' to the serial port without making a JsVar of
+ * them (used by Pipe). Always returns true, as there is no 'drain' event */
+bool jswrap_serial_writeBytes(JsVar *parent, const char *data, size_t len) {
+  IOEventFlags device = jsiGetDeviceFromClass(parent);
+  if (!DEVICE_IS_USART(device)) return true;
+  size_t i;
+  for (i=0;i<len;i++)
+    jshTransmit(device, (unsigned char)data[i]);
+  return true;
+}
+
 /*JSON{
   "type" : "method",
   "class" : "Serial",
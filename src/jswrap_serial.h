@@ -18,4 +18,5 @@ void jswrap_serial_setup(JsVar *parent, JsVar *baud, JsVar *options);
 void jswrap_serial_print(JsVar *parent, JsVar *str);
 void jswrap_serial_println(JsVar *parent, JsVar *str);
 void jswrap_serial_write(JsVar *parent, JsVar *data);
+bool jswrap_serial_writeBytes(JsVar *parent, const char *data, size_t len);
 void jswrap_serial_onData(JsVar *parent, JsVar *funcVar);
@@ -30,8 +30,12 @@
 #include "jsutils.h"
 #include "jsparse.h"
 #include "jsinteractive.h"
+#include "jstimer.h"
 
 #include <pthread.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 #ifdef USE_WIRINGPI
 // see http://wiringpi.com/download-and-install/
@@ -48,6 +52,13 @@
 int ioDevices[EV_DEVICE_MAX+1]; // list of open IO devices (or 0)
 JshPinState gpioState[JSH_PIN_COUNT]; // will be set to UNDEFINED if it isn't exported
 
+#if !defined(SYSFS_GPIO_DIR) && !defined(USE_WIRINGPI)
+/* No real GPIO - pins are 'virtual'. We remember what was written so it can
+ * be read back, and watched pins get an event (with its time) on each edge */
+#define VIRTUAL_PINS
+bool gpioValue[JSH_PIN_COUNT];
+#endif
+
 #ifdef SYSFS_GPIO_DIR
 
 #include <unistd.h>
@@ -223,6 +234,8 @@ int getch()
     unsigned char c;
     if ((r = (int)read(STDIN_FILENO, &c, sizeof(c))) < 0) {
         return r;
+    } else if (r == 0) {
+        return -1; // end of file - don't fill the event queue with zeros
     } else {
         return c;
     }
@@ -232,6 +245,58 @@ int getch()
 pthread_t inputThread;
 bool isInitialised;
 
+/* Interrupts are emulated with threads, so 'disabling interrupts' stops the
+ * input and utility timer threads from doing anything at the same time. It
+ * has to be recursive as IRQ handlers can call jshInterruptOff too. */
+pthread_mutex_t interruptMutex;
+
+/* The utility timer runs in its own thread, which sleeps until the time the
+ * next task is due and then calls jstUtilTimerInterruptHandler - like the
+ * timer IRQ on a microcontroller. */
+pthread_t utilTimerThread;
+pthread_mutex_t utilTimerMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t utilTimerCond = PTHREAD_COND_INITIALIZER;
+bool utilTimerActive; ///< is the timer counting down?
+bool utilTimerThreadRunning;
+JsSysTime utilTimerDeadline; ///< when the timer is next due
+JsSysTime utilTimerFiredTime; ///< when the handler was last called
+
+void *jshUtilTimerThread(void *arg) {
+  NOT_USED(arg);
+#ifdef PR_SET_TIMERSLACK
+  prctl(PR_SET_TIMERSLACK, 1); // don't let the kernel delay wakeups by the usual 50us
+#endif
+  pthread_mutex_lock(&utilTimerMutex);
+  while (utilTimerThreadRunning) {
+    if (!utilTimerActive) {
+      pthread_cond_wait(&utilTimerCond, &utilTimerMutex);
+      continue;
+    }
+    JsSysTime now = jshGetSystemTime();
+    if (now < utilTimerDeadline) {
+      // Sleep until the absolute deadline, or until the timer is changed
+      struct timeval tv;
+      gettimeofday(&tv, 0);
+      long long wake = (long long)tv.tv_sec*1000000 + tv.tv_usec + (utilTimerDeadline-now);
+      struct timespec ts;
+      ts.tv_sec = (time_t)(wake / 1000000);
+      ts.tv_nsec = (long)(wake % 1000000)*1000;
+      pthread_cond_timedwait(&utilTimerCond, &utilTimerMutex, &ts);
+      continue;
+    }
+    // The handler will reschedule us if there's more to do
+    utilTimerActive = false;
+    pthread_mutex_unlock(&utilTimerMutex);
+    jshInterruptOff();
+    utilTimerFiredTime = jshGetSystemTime();
+    jstUtilTimerInterruptHandler();
+    jshInterruptOn();
+    pthread_mutex_lock(&utilTimerMutex);
+  }
+  pthread_mutex_unlock(&utilTimerMutex);
+  return 0;
+}
+
 void jshInputThread() {
   while (isInitialised) {
     bool shortSleep = false;
@@ -282,7 +347,9 @@ void jshInputThread() {
         shortSleep = true;
         bool state = jshPinGetValue(pin);
         if (state != gpioLastState[pin]) {
+          jshInterruptOff(); // the utility timer thread may be pushing events too
           jshPushIOEvent(pinToEVEXTI(pin) | (state?EV_EXTI_IS_HIGH:0), jshGetSystemTime());
+          jshInterruptOn();
           gpioLastState[pin] = state;
         }
       }
@@ -306,6 +373,16 @@ void jshInit() {
   }
 #endif
 
+  static bool interruptMutexInitialised = false;
+  if (!interruptMutexInitialised) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&interruptMutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    interruptMutexInitialised = true;
+  }
+
   int i;
   for (i=0;i<=EV_DEVICE_MAX;i++)
     ioDevices[i] = 0;
@@ -329,6 +406,9 @@ void jshInit() {
   for (i=0;i<JSH_PIN_COUNT;i++) {
     gpioState[i] = JSHPINSTATE_UNDEFINED;
     gpioEventFlags[i] = 0;
+#ifdef VIRTUAL_PINS
+    gpioValue[i] = false;
+#endif
   }
 #ifdef SYSFS_GPIO_DIR
   for (i=0;i<JSH_PIN_COUNT;i++) {
@@ -340,6 +420,11 @@ void jshInit() {
   int err = pthread_create(&inputThread, NULL, &jshInputThread, NULL);
   if (err != 0)
       printf("Unable to create input thread, %s", strerror(err));
+  utilTimerActive = false;
+  utilTimerThreadRunning = true;
+  err = pthread_create(&utilTimerThread, NULL, &jshUtilTimerThread, NULL);
+  if (err != 0)
+      printf("Unable to create utility timer thread, %s", strerror(err));
 }
 
 void jshReset() {
@@ -350,6 +435,12 @@ void jshKill() {
 
   isInitialised = false;
 
+  pthread_mutex_lock(&utilTimerMutex);
+  utilTimerThreadRunning = false;
+  pthread_cond_signal(&utilTimerCond);
+  pthread_mutex_unlock(&utilTimerMutex);
+  pthread_join(utilTimerThread, NULL);
+
   for (i=0;i<=EV_DEVICE_MAX;i++)
     if (ioDevices[i]) {
       close(ioDevices[i]);
@@ -412,9 +503,11 @@ void jshSetRegistrationCode(unsigned int code) {
 // ----------------------------------------------------------------------------
 
 void jshInterruptOff() {
+  pthread_mutex_lock(&interruptMutex);
 }
 
 void jshInterruptOn() {
+  pthread_mutex_unlock(&interruptMutex);
 }
 
 void jshDelayMicroseconds(int microsec) {
@@ -465,6 +558,17 @@ void jshPinSetValue(Pin pin, bool value) {
 #ifdef USE_WIRINGPI
   digitalWrite(pin,value);
 #endif
+#ifdef VIRTUAL_PINS
+  if (gpioValue[pin] != value) {
+    gpioValue[pin] = value;
+    if (gpioEventFlags[pin]) {
+      // we could be on the main thread, racing the utility timer thread
+      jshInterruptOff();
+      jshPushIOEvent(pinToEVEXTI(pin) | (value?EV_EXTI_IS_HIGH:0), jshGetSystemTime());
+      jshInterruptOn();
+    }
+  }
+#endif
 }
 
 bool jshPinGetValue(Pin pin) {
@@ -476,7 +580,7 @@ bool jshPinGetValue(Pin pin) {
 #elif defined(USE_WIRINGPI)
   return digitalRead(pin);
 #else
-  return false;
+  return gpioValue[pin];
 #endif
 }
 
@@ -546,13 +650,25 @@ JshPinFunction jshPinAnalogOutput(Pin pin, JsVarFloat value, JsVarFloat freq, Js
   return JSH_NOTHING;
 }
 
-void jshPinPulse(Pin pin, bool value, JsVarFloat time) {
-  if (jshIsPinValid(pin)) {
-    jshPinSetState(pin, JSHPINSTATE_GPIO_OUT);
-    jshPinSetValue(pin, value);
-    usleep(time*1000000);
-    jshPinSetValue(pin, !value);
-  } else jsError("Invalid pin!");
+void jshPinPulse(Pin pin, bool pulsePolarity, JsVarFloat pulseTime) {
+  if (!jshIsPinValid(pin)) {
+    jsExceptionHere(JSET_ERROR, "Invalid pin!");
+    return;
+  }
+  if (pulseTime<=0) {
+    // just wait for everything to complete
+    jstUtilTimerWaitEmpty();
+    return;
+  }
+  // find out if we already had a timer scheduled
+  UtilTimerTask task;
+  if (!jstGetLastPinTimerTask(pin, &task)) {
+    // no timer - just start the pulse now!
+    jshPinOutput(pin, pulsePolarity);
+    task.time = jshGetSystemTime();
+  }
+  // Now set the end of the pulse to happen on a timer
+  jstPinOutputAtTime(task.time + jshGetTimeFromMilliseconds(pulseTime), &pin, 1, !pulsePolarity);
 }
 
 bool jshCanWatch(Pin pin) {
@@ -773,12 +889,25 @@ bool jshSleep(JsSysTime timeUntilWake) {
 }
 
 void jshUtilTimerDisable() {
+  pthread_mutex_lock(&utilTimerMutex);
+  utilTimerActive = false;
+  pthread_cond_signal(&utilTimerCond);
+  pthread_mutex_unlock(&utilTimerMutex);
 }
 
 void jshUtilTimerReschedule(JsSysTime period) {
+  pthread_mutex_lock(&utilTimerMutex);
+  /* When called from the handler, period is from when it started (like
+   * a hardware timer reloading) so time taken by the handler isn't added */
+  JsSysTime base = pthread_equal(pthread_self(), utilTimerThread) ? utilTimerFiredTime : jshGetSystemTime();
+  utilTimerDeadline = base + period;
+  utilTimerActive = true;
+  pthread_cond_signal(&utilTimerCond);
+  pthread_mutex_unlock(&utilTimerMutex);
 }
 
 void jshUtilTimerStart(JsSysTime period) {
+  jshUtilTimerReschedule(period);
 }
 
 JshPinFunction jshGetCurrentPinFunction(Pin pin) {
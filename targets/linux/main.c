@@ -4,6 +4,11 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <dirent.h> // for readdir
+#include <unistd.h> // for dup
+#include <fcntl.h>
+#ifndef __MINGW32__
+#include <sys/wait.h>
+#endif
 
 #include "jslex.h"
 #include "jsvar.h"
@@ -13,6 +18,8 @@
 #include "jsinteractive.h"
 #include "jshardware.h"
 #include "jswrapper.h"
+#include "jsprofiler.h"
+#include "jswrap_flash.h"
 
 
 #define TEST_DIR "tests/"
@@ -61,6 +68,9 @@ bool run_test(const char *filename) {
 
   jshInit();
   jsvInit();
+#ifdef USE_PROFILER_ALLOC_TRACE
+  jsprTraceAllocations(true); // so we can say where any leaked memory came from
+#endif
   jsiInit(false /* do not autoload!!! */);
 
   addNativeFunction("quit", nativeQuit);
@@ -94,6 +104,14 @@ bool run_test(const char *filename) {
   unsigned int unfreed = jsvGetMemoryUsage();
   printf("AFTER GC: %d Memory Records Used (should be 0!)\r\n", unfreed);
   jsvShowAllocated();
+#ifdef USE_PROFILER_ALLOC_TRACE
+  if (unfreed) {
+    jsprTraceAllocations(false);
+    printf("UNFREED MEMORY ALLOCATED BY:\r\n");
+    jsprDumpAllocations((vcbprintf_callback)jsiConsolePrintString, 0);
+  }
+  jsprKillAllocationTrace();
+#endif
   jsvKill();
   jshKill();
 
@@ -218,6 +236,12 @@ void show_help() {
     printf("   --test-mem-all          Run all Exhaustive Memory crash tests\n");
     printf("   --test-mem test.js      Run the supplied Exhaustive Memory crash test\n");
     printf("   --test-mem-n test.js #  Run the supplied Exhaustive Memory crash test with # vars\n");
+    printf("   --bench # a.js b.js     Run each script # times and write timings and counters as CSV\n");
+    printf("   --bench-json # a.js     As --bench, but write JSON\n");
+    printf("   --bench-state #         Time saving and loading state # times for different memory sizes, as CSV\n");
+#ifdef USE_PROFILER_SAMPLING
+    printf("   --sample hz out.txt     Sample what's running hz times a second, and write the busiest lines to out.txt on exit\n");
+#endif
 }
 
 void die(const char *txt) {
@@ -243,8 +267,250 @@ int handleErrors() {
   return e;
 }
 
+typedef struct {
+  const char *filename;
+  int runs;
+  int errors; ///< runs that ended with an exception
+  double timeMin, timeTotal; ///< milliseconds
+  JsStats stats; ///< totals for all runs
+  unsigned int memoryUsed; ///< jsvGetMemoryUsage after the last run (before it was killed)
+} BenchResult;
+
+/// Send stdout to /dev/null, and return what it was so it can be restored with restore_stdout
+int hide_stdout() {
+  fflush(stdout);
+  int savedStdout = dup(STDOUT_FILENO);
+  int devNull = open("/dev/null", O_WRONLY);
+  dup2(devNull, STDOUT_FILENO);
+  close(devNull);
+  return savedStdout;
+}
+
+void restore_stdout(int savedStdout) {
+  fflush(stdout);
+  dup2(savedStdout, STDOUT_FILENO);
+  close(savedStdout);
+}
+
+/// Run the script the given number of times, with its console output sent to /dev/null
+bool run_benchmark(const char *filename, int runs, BenchResult *r) {
+  memset(r, 0, sizeof(BenchResult));
+  r->filename = filename;
+  char *buffer = read_file(filename);
+  if (!buffer) return false;
+
+  int savedStdout = hide_stdout();
+
+  int i;
+  for (i=0;i<runs;i++) {
+    jshInit();
+    jsvInit();
+    jsiInit(false /* do not autoload!!! */);
+    addNativeFunction("quit", nativeQuit);
+
+    memset(&jsStats, 0, sizeof(jsStats));
+    jsStats.varsUsed = jsStats.varsPeak = jsvGetMemoryUsage();
+    JsSysTime startTime = jshGetSystemTime();
+    jsvUnLock(jspEvaluate(buffer));
+    if (handleErrors()) r->errors++;
+    isRunning = true;
+    bool isBusy = true;
+    while (isRunning && (jsiHasTimers() || isBusy))
+      isBusy = jsiLoop();
+    double time = jshGetMillisecondsFromTime(jshGetSystemTime() - startTime);
+
+    if (!i || time < r->timeMin) r->timeMin = time;
+    r->timeTotal += time;
+    r->stats.varsAllocated += jsStats.varsAllocated;
+    r->stats.varsFreed += jsStats.varsFreed;
+    if (jsStats.varsPeak > r->stats.varsPeak) r->stats.varsPeak = jsStats.varsPeak;
+    r->stats.gcPasses += jsStats.gcPasses;
+    r->stats.gcTime += jsStats.gcTime;
+    r->stats.tokens += jsStats.tokens;
+    r->memoryUsed = jsvGetMemoryUsage();
+    r->runs++;
+
+    jsiKill();
+    jsvKill();
+    jshKill();
+  }
+
+  restore_stdout(savedStdout);
+  free(buffer);
+  return true;
+}
+
+/** Run the benchmark in a child process, so that if the script makes the
+ * interpreter exit (eg. a failed assert) we can still carry on with the rest.
+ * Returns false if the child didn't report back */
+bool run_benchmark_isolated(const char *filename, int runs, BenchResult *r) {
+#ifndef __MINGW32__
+  int fds[2];
+  if (pipe(fds)) return run_benchmark(filename, runs, r);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid==0) {
+    close(fds[0]);
+    if (run_benchmark(filename, runs, r))
+      if (write(fds[1], r, sizeof(BenchResult)) != sizeof(BenchResult))
+        _exit(1);
+    _exit(0);
+  }
+  close(fds[1]);
+  size_t got = 0;
+  ssize_t n = 1;
+  while (pid>0 && got<sizeof(BenchResult) && n>0) {
+    n = read(fds[0], ((char*)r)+got, sizeof(BenchResult)-got);
+    if (n>0) got += (size_t)n;
+  }
+  close(fds[0]);
+  if (pid>0) waitpid(pid, 0, 0);
+  r->filename = filename;
+  return got==sizeof(BenchResult);
+#else
+  return run_benchmark(filename, runs, r);
+#endif
+}
+
+/// Print a string as a JSON string literal, with quotes
+void print_json_string(const char *str) {
+  putchar('"');
+  for (;*str;str++) {
+    unsigned char ch = (unsigned char)*str;
+    if (ch=='"' || ch=='\\') printf("\\%c", ch);
+    else if (ch<' ') printf("\\u%04x", ch);
+    else putchar(ch);
+  }
+  putchar('"');
+}
+
+/** Run each script 'runs' times and write the results as CSV or JSON. Counters
+ * are the mean for one run, except for peak memory which is the maximum.
+ * 'status' is 'ok', 'error' (an exception was thrown) or 'failed' (the
+ * script couldn't be loaded or the interpreter exited) */
+bool run_benchmarks(char **filenames, int count, int runs, bool json) {
+  if (runs<1) die("Number of runs must be at least 1\n");
+  if (json) printf("[\n");
+  else printf("script,status,runs,time_min_ms,time_mean_ms,vars_allocated,vars_freed,vars_peak,vars_used,gc_passes,gc_ms,tokens\n");
+  bool ok = true;
+  int i;
+  for (i=0;i<count;i++) {
+    BenchResult r;
+    const char *status = "ok";
+    if (!run_benchmark_isolated(filenames[i], runs, &r)) {
+      memset(&r, 0, sizeof(r));
+      r.filename = filenames[i];
+      status = "failed";
+    } else if (r.errors)
+      status = "error";
+    if (r.errors || !r.runs) ok = false;
+    double n = r.runs ? r.runs : 1;
+    if (json) {
+      printf("  {\"script\":");
+      print_json_string(r.filename);
+      printf(", \"status\":\"%s\", \"runs\":%d, \"time_min_ms\":%.3f, \"time_mean_ms\":%.3f, "
+             "\"vars_allocated\":%.0f, \"vars_freed\":%.0f, \"vars_peak\":%u, \"vars_used\":%u, "
+             "\"gc_passes\":%.1f, \"gc_ms\":%.3f, \"tokens\":%.0f}%s\n",
+             status, r.runs, r.timeMin, r.timeTotal/n,
+             r.stats.varsAllocated/n, r.stats.varsFreed/n, r.stats.varsPeak, r.memoryUsed,
+             r.stats.gcPasses/n, jshGetMillisecondsFromTime(r.stats.gcTime)/n, r.stats.tokens/n,
+             (i+1<count)?",":"");
+    } else {
+      printf("%s,%s,%d,%.3f,%.3f,%.0f,%.0f,%u,%u,%.1f,%.3f,%.0f\n",
+             r.filename, status, r.runs, r.timeMin, r.timeTotal/n,
+             r.stats.varsAllocated/n, r.stats.varsFreed/n, r.stats.varsPeak, r.memoryUsed,
+             r.stats.gcPasses/n, jshGetMillisecondsFromTime(r.stats.gcTime)/n, r.stats.tokens/n);
+    }
+    fflush(stdout);
+  }
+  if (json) printf("]\n");
+  return ok;
+}
+
+/** Fill the variables up to a range of sizes, and time saving and loading
+ * them as a snapshot and in the older RLE format, 'runs' times each. Writes
+ * the mean times as CSV */
+bool run_state_benchmark(int runs) {
+  static const unsigned int sizes[] = { 4096, 16384, 65536, 262144 };
+  const char *filename = "/tmp/espruino_bench.state";
+  if (runs<1) die("Number of runs must be at least 1\n");
+  printf("vars_total,vars_used,format,file_bytes,save_ms,load_ms\n");
+  bool ok = true;
+  unsigned int s;
+  for (s=0;s<sizeof(sizes)/sizeof(sizes[0]);s++) {
+    int savedStdout = hide_stdout();
+    jshInit();
+    jsvInit();
+    jsiInit(false /* do not autoload!!! */);
+    /* Use about 3/4 of the variables with a mix of objects, arrays, numbers
+     * and strings - each item is about 10 vars, and memory doubles when full */
+    char js[256];
+    snprintf(js, sizeof(js),
+        "var items=[];for (var i=0;i<%u;i++) items.push({n:i,f:i/3,s:'item number '+i,a:[i,i+1]});",
+        sizes[s]*3/4/10);
+    jsvUnLock(jspEvaluate(js));
+    if (handleErrors()) ok = false;
+    restore_stdout(savedStdout);
+    jsvGarbageCollect();
+    unsigned int used = jsvGetMemoryUsage();
+    jspSoftKill();
+    jsvSoftKill();
+    int format;
+    for (format=0;format<2;format++) {
+      bool rle = format==1;
+      double saveTime = 0, loadTime = 0;
+      int r;
+      for (r=0;r<runs;r++) {
+        JsSysTime t = jshGetSystemTime();
+        if (!jsfSaveToFile(filename, rle)) ok = false;
+        saveTime += jshGetMillisecondsFromTime(jshGetSystemTime() - t);
+        t = jshGetSystemTime();
+        if (!jsfLoadFromFile(filename)) ok = false;
+        loadTime += jshGetMillisecondsFromTime(jshGetSystemTime() - t);
+      }
+      struct stat st;
+      if (stat(filename, &st)) st.st_size = 0;
+      printf("%u,%u,%s,%ld,%.3f,%.3f\n", jsvGetMemoryTotal(), used,
+             rle ? "rle" : "snapshot", (long)st.st_size, saveTime/runs, loadTime/runs);
+      fflush(stdout);
+    }
+    jsvSoftInit();
+    jspSoftInit();
+    if (jsvGetMemoryUsage()!=used) ok = false;
+    jsiKill();
+    jsvKill();
+    jshKill();
+  }
+  unlink(filename);
+  return ok;
+}
+
+#ifdef USE_PROFILER_SAMPLING
+int sampleRate = 0;
+const char *sampleFile = 0;
+#endif
+
+/// If we were asked to with --sample, start sampling
+void start_sampling() {
+#ifdef USE_PROFILER_SAMPLING
+  if (sampleFile) jsprStartSampling(sampleRate);
+#endif
+}
+
+/// If we were sampling, write the results out (must be called before jsiKill)
+void finish_sampling() {
+#ifdef USE_PROFILER_SAMPLING
+  if (sampleFile) {
+    jsprStartSampling(0);
+    if (!jsprWriteSamples(sampleFile))
+      fprintf(stderr, "Unable to write samples to %s\n", sampleFile);
+  }
+#endif
+}
+
 int main(int argc, char **argv) {
   int i;
+  int fileArg = 0, fileArgs = 0;
   for (i=1;i<argc;i++) {
     if (argv[i][0]=='-') {
       // option
@@ -286,19 +552,37 @@ int main(int argc, char **argv) {
         if (i+2>=argc) die("Expecting an extra 2 arguments\n");
         bool ok = run_memory_test(argv[i+1], atoi(argv[i+2]));
         exit(ok ? 0 : 1);
+      } else if (!strcmp(a,"--bench") || !strcmp(a,"--bench-json")) {
+        if (i+2>=argc) die("Expecting a number of runs and at least one script\n");
+        bool ok = run_benchmarks(&argv[i+2], argc-(i+2), atoi(argv[i+1]), !strcmp(a,"--bench-json"));
+        exit(ok ? 0 : 1);
+      } else if (!strcmp(a,"--bench-state")) {
+        if (i+1>=argc) die("Expecting a number of runs\n");
+        bool ok = run_state_benchmark(atoi(argv[i+1]));
+        exit(ok ? 0 : 1);
+#ifdef USE_PROFILER_SAMPLING
+      } else if (!strcmp(a,"--sample")) {
+        if (i+2>=argc) die("Expecting an extra 2 arguments\n");
+        sampleRate = atoi(argv[i+1]);
+        sampleFile = argv[i+2];
+        i += 2;
+#endif
       } else {
         printf("Unknown Argument %s\n", a);
         show_help();
         exit(1);
       }
+    } else {
+      fileArg = i;
+      fileArgs++;
     }
   }
 
-  if (argc==1) {
+  if (!fileArgs) {
     printf("Interactive mode.\n");
-  } else if (argc==2) {
+  } else if (fileArgs==1) {
     // single file - just run it
-    char *buffer = read_file(argv[1]);
+    char *buffer = read_file(argv[fileArg]);
     if (!buffer) exit(1);
     // check for '#' as the first char, and if so, skip the first line
     char *cmd = buffer;
@@ -310,6 +594,7 @@ int main(int argc, char **argv) {
     jsvInit();
     jsiInit(false /* do not autoload!!! */);
     addNativeFunction("quit", nativeQuit);
+    start_sampling();
     jsvUnLock(jspEvaluate(cmd));
     int errCode = handleErrors();
     free(buffer);
@@ -317,6 +602,7 @@ int main(int argc, char **argv) {
     bool isBusy = true;
     while (isRunning && (jsiHasTimers() || isBusy))
       isBusy = jsiLoop();
+    finish_sampling();
     jsiKill();
     jsvKill();
     jshKill();
@@ -355,11 +641,13 @@ int main(int argc, char **argv) {
 
   addNativeFunction("quit", nativeQuit);
   addNativeFunction("interrupt", nativeInterrupt);
+  start_sampling();
 
   while (isRunning) {
     jsiLoop();
   }
   jsiConsolePrint("\n");
+  finish_sampling();
   jsiKill();
   jsvGarbageCollect();
   jsvShowAllocated();
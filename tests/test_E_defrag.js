@@ -0,0 +1,34 @@
+// Check that E.defrag compacts memory without breaking any references
+var keep = [];
+var junk = [];
+for (var i=0;i<550;i++) {
+  keep.push("A longer string number "+i);
+  junk.push("Junk string that will be freed "+i);
+}
+var buf = new Uint8Array(100);
+for (i=0;i<buf.length;i++) buf[i]=i;
+var obj = { a : 1, b : "Hello", c : [1,2,3] };
+var x = 42;
+function fn(y) { return x+y; }
+junk = undefined;
+
+var m = process.memory();
+var fragBefore = m.fragmentation;
+// A flat string that's bigger than the largest free area now, but should fit once compacted
+var largest = m.free*(100-m.fragmentation)/100;
+var blockSize = 1600/(E.getSizeOf(E.toString(new Uint8Array(1600)))-1);
+var bigBytes = Math.floor((largest + (m.free-largest)/3)*blockSize);
+var bigBefore = E.toString({data:0,count:bigBytes});
+E.defrag();
+var fragAfter = process.memory().fragmentation;
+var bigAfter = E.toString({data:0,count:bigBytes});
+
+var ok = keep.length==550;
+for (i=0;i<keep.length;i++)
+  if (keep[i]!="A longer string number "+i) ok = false;
+for (i=0;i<buf.length;i++)
+  if (buf[i]!=i) ok = false;
+
+result = ok && fn(1)==43 && obj.b=="Hello" && obj.c[2]==3 &&
+         fragAfter < fragBefore &&
+         bigBefore===undefined && typeof bigAfter=="string" && bigAfter.length==bigBytes;
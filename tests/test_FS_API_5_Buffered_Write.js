@@ -0,0 +1,31 @@
+// Check buffered writes, flush, and large reads/writes
+var fname = './tests/FS_API_Buffered_Test.txt';
+var fd = E.openFile(fname, 'w', { bufferSize : 64 });
+var expected = "";
+for (var i=0;i<50;i++) {
+  var line = "Log line "+i+"\n";
+  fd.write(line);
+  expected += line;
+}
+fd.flush();
+var afterFlush = require("fs").readFileSync(fname);
+
+// writes bigger than the buffer go straight through
+var arr = new Uint8Array(300);
+for (i=0;i<arr.length;i++) arr[i] = 65 + (i%26);
+fd.write("x");
+fd.write(arr);
+fd.close();
+
+fd = E.openFile(fname, 'r');
+var start = fd.read(expected.length);
+var x = fd.read(1);
+var big = fd.read(1000); // more than is left
+var end = fd.read(10);
+fd.close();
+
+var bigOk = big.length==arr.length;
+for (i=0;i<arr.length;i++)
+  if (big.charCodeAt(i)!=arr[i]) bigOk = false;
+
+result = afterFlush==expected && start==expected && x=="x" && bigOk && end===undefined;
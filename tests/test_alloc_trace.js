@@ -0,0 +1,32 @@
+// E.getAllocations should say where the variables that are still in use were allocated
+
+E.traceAllocations();
+var keep = [];
+function make(n) {
+  for (var i=0;i<n;i++)
+    keep.push({a:i});
+}
+make(10);
+var str = JSON.stringify(keep);
+// JS called from a native function is blamed on the JS, not the native function
+var lists = [1,2].map(function(n) { return [n]; });
+var temp = {a:1,b:2};
+temp = undefined;
+
+var allocs = E.getAllocations();
+E.traceAllocations(false);
+
+function find(type, code) {
+  return allocs.filter(function(a) { return a.type==type && a.code==code; });
+}
+var objects = find("Object", "keep.push({a:i});");
+var pushed = find("Name", "keep.push({a:i});").filter(function(a) { return a.site.indexOf("push()")==0; });
+var json = find("String", "var str = JSON.stringif"); // code is cut short
+var mapped = find("Array", "[n];");
+var freed = find("Object", "var temp = {a:1,b:2};");
+
+result = objects.length==1 && objects[0].count==10 && objects[0].site.indexOf("line ")==0 &&
+         pushed.length==1 && pushed[0].count==10 &&
+         json.length==1 && json[0].site=="stringify() line 10" &&
+         mapped.length==1 && mapped[0].count==2 && mapped[0].site=="line 1" &&
+         freed.length==0;
@@ -0,0 +1,40 @@
+// Array.sort is stable, copes with large and already ordered arrays, and compares by string unless given a function
+
+var recs = [];
+for (var i=0;i<200;i++) recs.push({key:i%7, idx:i});
+recs.sort(function(a,b) { return a.key-b.key; });
+var stable = recs.every(function(r,i) {
+  var p = recs[i-1];
+  return !p || p.key<r.key || (p.key==r.key && p.idx<r.idx);
+});
+
+var up = [], down = [];
+for (i=0;i<500;i++) { up.push(i); down.push(500-i); }
+up.sort(function(a,b) { return a-b; });
+down.sort(function(a,b) { return a-b; });
+var ordered = up[0]==0 && up[499]==499 && down[0]==1 && down[499]==500;
+
+var a = [10,9,1,2.5,-1,-10,-2,100].sort().join(",");
+var b = ["b","a","ab","","B"].sort().join(",");
+var d = [0.5,0.25,0.75,0.3].sort(function(x,y) { return x-y; }).join(",");
+var e = [2,"10",true,null,1].sort().join(",");
+var f = new Uint32Array([4000000000,5,3000000000,40]).sort().join(",");
+var g = new Float32Array([1.5,-2,10,0.25]).sort(function(x,y) { return x-y; }).join(",");
+var h = new Int8Array([-5,3,-20,10]).sort().join(",");
+
+// if compareFn changes the array, the sort can't finish - so it should say so
+var m = [3,1,2], modifiedError = false;
+try {
+  m.sort(function(x,y) { m[0] = 7; return x-y; });
+} catch (err) {
+  modifiedError = err instanceof Error;
+}
+
+result = stable && ordered && modifiedError &&
+         a=="-1,-10,-2,1,10,100,2.5,9" &&
+         b==",B,a,ab,b" &&
+         d=="0.25,0.3,0.5,0.75" &&
+         e=="1,10,2,,true" &&
+         f=="3000000000,40,4000000000,5" &&
+         g=="-2,0.25,1.5,10" &&
+         h=="-20,-5,10,3";
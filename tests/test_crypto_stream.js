@@ -0,0 +1,67 @@
+// Check that crypto.createHash/createCipher give the same results as doing it all at once
+var crypto = require("crypto");
+
+function toHex(a) {
+  var s = "";
+  for (var i=0;i<a.length;i++)
+    s += (256+a[i]).toString(16).substr(-2);
+  return s;
+}
+
+var tests = 0;
+var testPass = 0;
+function test(a, b) {
+  tests++;
+  if (a!=b) {
+    console.log("Test "+tests+" failed: "+a+" != "+b);
+  } else {
+    testPass++;
+  }
+}
+
+test(toHex(crypto.createHash("SHA1").update("abc").digest()), "a9993e364706816aba3e25717850c26c9cd0d89d");
+
+var msg = "";
+for (var i=0;i<100;i++) msg += "Line "+i+" of a long message. ";
+
+["SHA1","SHA224","SHA256","SHA384","SHA512"].forEach(function(alg) {
+  var h = crypto.createHash(alg);
+  for (var i=0;i<msg.length;i+=37)
+    h.update(msg.substr(i,37));
+  test(toHex(h.digest()), toHex(crypto[alg](msg)));
+  // digest doesn't stop us adding more data
+  h.update(E.toUint8Array(" more"));
+  test(toHex(h.digest()), toHex(crypto[alg](msg+" more")));
+});
+
+var key = E.toUint8Array("0123456789abcdef");
+var iv = "Hello World 1234";
+var plain = msg.substr(0,1600); // whole number of blocks for CBC
+
+["CBC","CFB","CTR","ECB"].forEach(function(mode) {
+  var opts = {iv:iv, mode:mode};
+  var whole = crypto.AES.encrypt(plain, key, opts);
+  var c = crypto.createCipher(key, opts);
+  var enc = "";
+  for (var i=0;i<plain.length;i+=23)
+    enc += toHex(c.update(plain.substr(i,23)));
+  c.final();
+  test(enc, toHex(whole));
+  var d = crypto.createDecipher(key, opts);
+  var dec = E.toString(d.update(new Uint8Array(whole,0,100)))+E.toString(d.update(new Uint8Array(whole,100,whole.length-100)));
+  d.final();
+  test(dec, plain);
+});
+
+// ECB pads the result of a partial block with zeros, as it always has
+var ecb = crypto.AES.encrypt(plain.substr(0,20), key, {mode:"ECB"});
+test(ecb.length, 20);
+test(toHex(new Uint8Array(ecb,0,16)), toHex(crypto.AES.encrypt(plain.substr(0,16), key, {mode:"ECB"})));
+test(toHex(new Uint8Array(ecb,16,4)), "00000000");
+
+var h = require("hashlib").sha256();
+h.update(msg.substr(0,500));
+h.update(msg.substr(500));
+test(h.hexdigest(), toHex(crypto.SHA256(msg)));
+
+result = tests==testPass;
@@ -0,0 +1,46 @@
+// Event listeners on objects with lots of properties, added before and after the properties -
+// which shouldn't change the order of the properties
+
+var o = {}, got = [];
+o.on('first', function(a) { got.push("first "+a); });
+for (var i=0;i<50;i++) o["prop"+i] = i;
+o.on('last', function() { got.push("last "+[].slice.call(arguments).join(",")); });
+o.on('first', function(a) { got.push("first again "+a); });
+o["#onraw"] = function() { got.push("raw"); };
+o.prop50 = 50;
+o.on('gone', function() { got.push("gone"); });
+o.removeAllListeners('gone');
+
+o.emit('first', 1);
+o.emit('last', 1, 2, 3, 4, 5, 6);
+o.emit('raw');
+o.emit('gone');
+o.emit('nothing');
+o.emit('firs');
+o.emit('first!');
+
+// listeners on an array
+var a = [1,2,3];
+a.on('data', function(d) { got.push("array "+d+" "+this.length); });
+a.push(4);
+a.emit('data', 5);
+
+// adding listeners doesn't change the order of an object's keys
+var p = {a:1};
+p.on('x', function() { got.push("x"); });
+p.b = 2;
+p["#onuser"] = 3;
+p.c = 4;
+var forIn = [];
+for (var k in p) forIn.push(k);
+p.emit('x');
+
+setTimeout(function() {
+  var keys = Object.keys(o);
+  result = got.join(";")=="first 1;first again 1;last 1,2,3,4,5,6;raw;array 5 4;x" &&
+           keys.length==54 && keys[0]=="#onfirst" && keys[1]=="prop0" &&
+           keys[51]=="#onlast" && keys[52]=="#onraw" && keys[53]=="prop50" &&
+           Object.keys(p).join()=="a,#onx,b,#onuser,c" && forIn.join()=="a,#onx,b,#onuser,c" &&
+           JSON.stringify(p)=='{"a":1,"b":2,"#onuser":3,"c":4}' &&
+           o.prop10==10 && a.length==4;
+}, 1);
@@ -0,0 +1,27 @@
+// Events should run in the order they were queued, even when there are too many for the native queue
+
+var o = {}, got = [];
+var arg = {x:1}; // passed with every event, so it gets locked many times
+o.on('data', function(a,b) { got.push(b===arg ? a : -1); });
+o.on('sum', function(a,b,c,d) { got.push(a+b+c+d); });
+o.on('nested', function(a) {
+  got.push(a);
+  // queued while events are executing - these go last
+  if (a<3) o.emit('nested', a+1);
+});
+
+o.emit('nested', 0);
+for (var i=0;i<200;i++) {
+  if (i==100) o.emit('sum', 1000,2000,3000,4000);
+  o.emit('data', i, arg);
+}
+
+setTimeout(function() {
+  var expected = [0];
+  for (var i=0;i<200;i++) {
+    if (i==100) expected.push(10000);
+    expected.push(i);
+  }
+  expected.push(1,2,3);
+  result = JSON.stringify(got)==JSON.stringify(expected);
+}, 10);
@@ -0,0 +1,29 @@
+// HTTP headers that arrive over many receive chunks, followed by a body
+
+var result = 0;
+var http = require("http");
+
+var headers = { "Content-Length" : 11 };
+for (var i=0;i<40;i++) headers["X-Header-"+i] = "Value number "+i;
+var gotHeaders = false;
+
+var server = http.createServer(function (req, res) {
+  var h = req.headers;
+  gotHeaders = req.method=="POST" && req.url=="/post" &&
+               h["X-Header-0"]=="Value number 0" && h["X-Header-39"]=="Value number 39" &&
+               h["Content-Length"]=="11";
+  var body = "";
+  req.on('data', function(data) { body += data; });
+  req.on('close', function() {
+    result = gotHeaders && body=="Hello World";
+    server.close();
+  });
+  res.writeHead(200, {'Content-Type': 'text/plain'});
+  res.end("OK");
+});
+server.listen(8080);
+
+var req = http.request({ host: "localhost", port: 8080, path: "/post", method: "POST", headers: headers }, function(res) {
+  res.on('data', function(data) { console.log(">" + data); });
+});
+req.end("Hello World");
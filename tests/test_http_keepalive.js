@@ -0,0 +1,32 @@
+// HTTP keep-alive - two requests in a row should go over the same connection
+
+var result = 0;
+var http = require("http");
+
+var sockets = [];
+var server = http.createServer(function (req, res) {
+  sockets.push(req.sckt); // the server's socket for this connection
+  var body = "Reply "+sockets.length;
+  res.writeHead(200, {'Content-Type': 'text/plain', 'Content-Length': body.length});
+  res.end(body);
+});
+server.listen(8080);
+
+function get(callback) {
+  var data = "";
+  http.request({ host: "localhost", port: 8080, path: "/", method: "GET", keepAlive: true }, function(res) {
+    res.on('data', function(d) { data += d; });
+    res.on('close', function() { callback(data, res.headers); });
+  }).end();
+}
+
+get(function(first, headers) {
+  console.log(first, headers);
+  get(function(second) {
+    console.log(second, sockets);
+    result = first=="Reply 1" && second=="Reply 2" &&
+             headers.Connection=="keep-alive" &&
+             sockets.length==2 && sockets[0]==sockets[1];
+    server.close();
+  });
+});
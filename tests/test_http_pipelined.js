@@ -0,0 +1,29 @@
+// HTTP keep-alive - two requests sent at once over one connection should both be answered
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+var urls = [];
+var server = http.createServer(function (req, res) {
+  urls.push(req.url);
+  var body = "Reply "+req.url;
+  res.writeHead(200, {'Content-Length': body.length});
+  res.end(body);
+});
+server.listen(8080);
+
+var received = "";
+var client = net.connect({port: 8080}, function() {
+  client.write("GET /a HTTP/1.0\r\nConnection: keep-alive\r\n\r\n"+
+               "GET /b HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+  client.on('data', function(data) {
+    received += data;
+    if (received.indexOf("Reply /b")>=0) {
+      result = urls.join()=="/a,/b" && received.indexOf("Reply /a")>=0 &&
+               received.indexOf("Reply /a") < received.indexOf("Reply /b");
+      client.end();
+      server.close();
+    }
+  });
+});
@@ -0,0 +1,50 @@
+// ++, -- and += may modify a number in place - make sure that never
+// changes a value that something else can see
+
+var r = [];
+var i = 5;
+r.push(i++ == 5 && i == 6);
+r.push(++i == 7 && i-- == 7 && i == 6);
+i += 10; i -= 3;
+r.push(i == 13);
+// floats
+var f = 1.5;
+r.push(f++ == 1.5 && f == 2.5);
+f += 0.25;
+r.push(f == 2.75);
+// two variables referencing the same value
+var a = 1.5, b;
+b = a;
+a += 1;
+r.push(a == 2.5 && b == 1.5);
+var o = { x : 0.5 }, p = { y : o.x };
+o.x++;
+r.push(o.x == 1.5 && p.y == 0.5);
+// value still in use as an argument while it's changed
+var g = 0.5;
+function two(x, y) { return [x, y]; }
+var t = two(g, g++);
+r.push(t[0] == 0.5 && t[1] == 0.5 && g == 1.5);
+t = two(g, g+=1);
+r.push(t[0] == 1.5 && t[1] == 2.5 && g == 2.5);
+// x += x
+var h = 2.5;
+h += h;
+r.push(h == 5);
+// overflow into a float
+var big = 2147483647;
+big++;
+r.push(big == 2147483648);
+var nbig = -2147483648;
+nbig -= 1;
+r.push(nbig == -2147483649);
+// strings still append
+var s = "a";
+s += 1;
+r.push(s === "a1");
+// array elements
+var arr = [1, 2.5];
+arr[0]++; arr[1]++; arr[0] += 2;
+r.push(arr[0] == 4 && arr[1] == 3.5);
+
+result = r.every(function(x) { return x; });
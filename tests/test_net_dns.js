@@ -0,0 +1,49 @@
+// Host names are resolved in the background (and cached), so connecting by
+// name shouldn't stop other things from running, and a second connection
+// to the same name shouldn't have to look it up again
+
+var result = 0;
+var net = require("net");
+
+var server = net.createServer(function(c) {
+  c.end("Hi");
+});
+server.listen(4446);
+
+var replies = [];
+var client;
+var tickedWhileWaiting = false;
+// 'dns' is set on a socket while its host name lookup is outstanding
+var interval = setInterval(function() {
+  if (client && client.dns===true) tickedWhileWaiting = true;
+}, 0);
+
+function connect(callback) {
+  client = net.connect({host: "localhost", port: 4446}, function() {
+    client.on('data', function(data) { replies.push(data); });
+    client.on('close', callback);
+  });
+}
+
+/* localhost resolves very quickly, so the lookup may finish before the
+ * interval gets a chance to run. Keep trying (without the cache) until it does */
+function lookup(attempts) {
+  delete global["\xFF"].DNS;
+  connect(function() {
+    if (!tickedWhileWaiting && attempts>1) {
+      replies = [];
+      lookup(attempts-1);
+      return;
+    }
+    var cached = global["\xFF"].DNS.localhost!==undefined;
+    connect(function() {
+      clearInterval(interval);
+      server.close();
+      result = tickedWhileWaiting && cached && replies.join()=="Hi,Hi";
+    });
+    // the second lookup comes from the cache, so we connect straight away
+    if (client.dns) cached = false;
+  });
+}
+
+lookup(20);
@@ -0,0 +1,31 @@
+// 'drain' should only fire once after write() returns false, even if the
+// queue drops below the low watermark before it is completely sent
+
+var result = 0;
+var net = require("net");
+
+var data = "";
+while (data.length<2200) data += "0123456789";
+var wroteFalse = 0;
+var drained = 0;
+
+var server = net.createServer(function(c) { //'connection' listener
+  c.on('drain', function() {
+    drained++;
+  });
+  if (!c.write(data)) wroteFalse++;
+  setTimeout(function() { c.end(); }, 100);
+});
+server.listen(4447);
+
+var received = "";
+var client = net.connect({port: 4447}, function() { //'connect' listener
+  client.on('data', function(d) {
+    received += d;
+  });
+  client.on('close', function() {
+    console.log("received "+received.length+", drained "+drained+", wroteFalse "+wroteFalse);
+    result = received==data && wroteFalse==1 && drained==1;
+    server.close();
+  });
+});
@@ -0,0 +1,45 @@
+// Socket send queue - big writes should arrive intact, write() should return
+// false once the queue is full and 'drain' should fire (once) before it empties
+
+var result = 0;
+var net = require("net");
+
+var chunk = "";
+for (var i=0;i<64;i++) chunk += String.fromCharCode(48+(i%40));
+var CHUNKS = 64;
+var wroteFalse = 0;
+var drained = 0;
+
+var server = net.createServer(function(c) { //'connection' listener
+  var n = 0;
+  function send() {
+    while (n<CHUNKS) {
+      n++;
+      if (!c.write(chunk)) {
+        wroteFalse++;
+        return;
+      }
+    }
+    c.end();
+  }
+  c.on('drain', function() {
+    drained++;
+    send();
+  });
+  send();
+});
+server.listen(4445);
+
+var received = "";
+var client = net.connect({port: 4445}, function() { //'connect' listener
+  client.on('data', function(data) {
+    received += data;
+  });
+  client.on('close', function() {
+    var expected = "";
+    for (var i=0;i<CHUNKS;i++) expected += chunk;
+    console.log("received "+received.length+", drained "+drained+", wroteFalse "+wroteFalse);
+    result = received==expected && wroteFalse>0 && drained==wroteFalse;
+    server.close();
+  });
+});
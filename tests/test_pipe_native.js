@@ -0,0 +1,66 @@
+// Pipe between two Files (copied natively), from a File to Serial and to an HTTP response, and from a File to a JS object
+var data = "";
+for (var i=0;i<200;i++) data += "Line "+i+" of the pipe test\n";
+require("fs").writeFileSync("./tests/FS_API_Pipe_Native_In.txt", data);
+
+var jsChunks = 0, jsData = "";
+var jsDest = { write : function(d) { jsChunks++; jsData += d; } };
+var fileOk = false, serialOk = false, httpOk = false;
+
+function open() { return E.openFile("./tests/FS_API_Pipe_Native_In.txt", "r"); }
+
+function testFile(next) {
+  var fdw = E.openFile("./tests/FS_API_Pipe_Native_Out.txt", "w");
+  open().pipe(fdw, { complete : function() {
+    fileOk = require("fs").readFileSync("./tests/FS_API_Pipe_Native_Out.txt") == data;
+    next();
+  }});
+}
+
+function testSerial(next) {
+  var got = "";
+  LoopbackB.on('data', function(d) { got += d; });
+  open().pipe(LoopbackA, { end : false, complete : function() {
+    setTimeout(function() {
+      serialOk = got == data;
+      next();
+    }, 10);
+  }});
+}
+
+function testHTTP(next) {
+  var http = require("http");
+  var server = http.createServer(function (req, res) {
+    res.writeHead(200, {'Content-Type': 'text/plain'});
+    var fd = open();
+    fd.pipe(res, { chunkSize : 100, end : false, complete : function() {
+      fd.close();
+      res.end();
+    }});
+  });
+  server.listen(8081);
+  http.get("http://localhost:8081/", function(res) {
+    var got = "";
+    res.on('data', function(d) { got += d; });
+    res.on('close', function() {
+      httpOk = got == data;
+      server.close();
+      next();
+    });
+  });
+}
+
+function testJS() {
+  var fd2 = open();
+  fd2.pipe(jsDest, { end : false, complete : function() {
+    fd2.close();
+    // JS destinations still get the default 64 byte chunks
+    result = fileOk && serialOk && httpOk && jsData == data && jsChunks == Math.ceil(data.length/64);
+  }});
+}
+
+testFile(function() {
+  testSerial(function() {
+    testHTTP(testJS);
+  });
+});
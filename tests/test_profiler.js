@@ -0,0 +1,19 @@
+// E.getProfile should count calls and time for JS functions and parts of the interpreter
+E.resetProfile();
+function add(a,b) { return a+b; }
+function outer() { var s=0; for (var i=0;i<10;i++) s=add(s,i); return s; }
+outer(); outer();
+var p = E.getProfile();
+var folded = E.getProfile("folded");
+E.resetProfile(false);
+
+var fns = {};
+p.functions.forEach(function(f) { fns[f.name]=f; });
+var total = 0;
+["other","lex","scope","alloc","gc","native"].forEach(function(s) { total += p[s].time; });
+
+result = fns.outer.calls==2 && fns.add.calls==20 && fns.outer.time>=fns.add.time &&
+         p.lex.count>0 && p.scope.count>0 && p.alloc.count>0 && p.native.count>0 &&
+         Math.abs(p.time-total)<0.5 &&
+         folded.indexOf("outer;add ")>=0 &&
+         E.getProfile().functions.length==0;
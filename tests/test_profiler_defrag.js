@@ -0,0 +1,24 @@
+// The profiler and sampler should still find a function's code after E.defrag() has moved things
+var junk = [];
+for (var i=0;i<100;i++) junk.push("junk "+i);
+function add(a,b) { for (var j=0;j<10;j++) a+=b; return a; }
+function run(ms) {
+  var end = getTime()+ms/1000;
+  while (getTime()<end) add(1,2);
+}
+E.resetProfile();
+E.startSampling(1000);
+run(50);
+junk = undefined; // leave a gap below add's code, so it would be moved
+E.defrag();
+run(50);
+E.startSampling(0);
+var p = E.getProfile();
+E.resetProfile(false);
+var samples = E.getSamples();
+
+var addRows = p.functions.filter(function(f) { return f.name=="add"; });
+var addSamples = samples.filter(function(s) { return s.function=="add"; });
+// add is all on one line, so its samples should all be counted together
+result = addRows.length==1 &&
+         addSamples.length==1 && add.toString().indexOf(addSamples[0].code)>=0;
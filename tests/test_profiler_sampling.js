@@ -0,0 +1,22 @@
+// E.startSampling should find which lines of code are busiest
+E.startSampling(1000);
+function busy() {
+  var n = 0;
+  for (var i=0;i<3000;i++) n += i;
+  return n;
+}
+var end = getTime()+0.1;
+while (getTime()<end) busy();
+E.startSampling(0);
+
+var samples = E.getSamples();
+var folded = E.getSamples("folded");
+var total = 0, inBusy = 0;
+samples.forEach(function(s) {
+  total += s.samples;
+  if (s.function=="busy") inBusy += s.samples;
+});
+
+result = samples.length>0 && inBusy > total/2 &&
+         samples[0].samples >= samples[samples.length-1].samples &&
+         folded.indexOf("busy ")>=0;
@@ -0,0 +1,57 @@
+// require() caches a minified copy of node_modules/name.js as name.jsc
+// Run from the repository root - node_modules/ holds the fixtures
+var fs = require("fs");
+
+var src =
+  '// leading comment\n'+
+  '/* block\n   comment */\n'+
+  'var s1 = "a  b // not a comment";\n'+
+  "var s2 = 'c /* nor this */  d';\n"+
+  'var s3 = "e\\t  \\"f\\"";\n'+
+  'function f(a, b) {\n'+
+  '  var x = a - -b, y = a + +b; // trailing comment\n'+
+  '  var z = a\n'+
+  '  ++b\n'+
+  '  return x * 10 + y + z + b + 1 .toString().length;\n'+
+  '}\n'+
+  'function g() {\n'+
+  '  return\n'+
+  '  42;\n'+
+  '}\n'+
+  'exports.s = [s1,s2,s3];\n'+
+  'exports.f = f;\n'+
+  'exports.g = g;\n'+
+  'exports.half = function(a) { return a / 2; };\n';
+fs.writeFileSync("node_modules/test_min.js", src);
+var m = require("test_min");
+Modules.addCached("test_min_orig", src); // the same module, not minified
+var o = require("test_min_orig");
+var jsc = fs.readFileSync("node_modules/test_min.jsc");
+var minifyOk = JSON.stringify(m.s)==JSON.stringify(o.s) && m.s[0]=="a  b // not a comment" &&
+  m.f(3,4)==o.f(3,4) && m.g()===o.g() && m.half(5)==2.5 &&
+  jsc.length < src.length && jsc.indexOf("comment */")<0 &&
+  // newlines are kept (after the '//cache' line), so line numbers still match
+  jsc.split("\n").indexOf("function g(){") == src.split("\n").indexOf("function g() {")+1;
+
+// the lexer doesn't understand regular expressions, so they mustn't be minified
+fs.writeFileSync("node_modules/test_min_re.js", 'exports.re = function(s) { return s.split(/ +/); };\n');
+var regexOk = require("test_min_re").re.toString().indexOf("/ +/")>=0 &&
+  fs.statSync("node_modules/test_min_re.jsc")===undefined;
+
+// the cached copy is recreated when the source changes
+fs.writeFileSync("node_modules/test_min_v.js", "exports.v = 1;\n");
+var v1 = require("test_min_v").v;
+Modules.removeCached("test_min_v");
+fs.writeFileSync("node_modules/test_min_v.js", "exports.v = 22;\n");
+var v2 = require("test_min_v").v;
+var cacheOk = v1==1 && v2==22 && fs.readFileSync("node_modules/test_min_v.jsc").indexOf("//cache 16 ")==0;
+
+// if the copy can't be written (test_min_ro.jsc is a directory), the module still loads
+var roOk = require("test_min_ro").v==3 && fs.statSync("node_modules/test_min_ro.jsc").dir;
+
+["test_min","test_min_re","test_min_v"].forEach(function(n) {
+  fs.unlink("node_modules/"+n+".js");
+  if (fs.statSync("node_modules/"+n+".jsc")) fs.unlink("node_modules/"+n+".jsc");
+});
+
+result = minifyOk && regexOk && cacheOk && roOk;
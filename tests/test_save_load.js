@@ -0,0 +1,38 @@
+// save() and load() should bring back exactly what was saved
+
+var fs = require("fs");
+var MARKER = "test_save_load.marker";
+var data = { str : "Hello World, this string is long enough for several blocks",
+             arr : [1,2.5,"three",[4]], typed : new Uint8Array([1,2,3,4,5]),
+             fn : function(a) { return a*2; } };
+var big = E.toString(new Uint8Array(100).fill(65)); // flat string
+// enough that memory has to grow past the first block of variables
+var many = [];
+for (var i=0;i<600;i++) many.push({i:i, s:"item "+i});
+
+function check() {
+  return data.str=="Hello World, this string is long enough for several blocks" &&
+         JSON.stringify(data.arr)=='[1,2.5,"three",[4]]' &&
+         data.typed.join()=="1,2,3,4,5" && data.fn(21)==42 &&
+         big.length==100 && big[99]=="A" &&
+         many.length==600 && many.every(function(m,i) { return m.i==i && m.s=="item "+i; });
+}
+
+// onInit is called after saving and after loading
+function onInit() {
+  if (!fs.readFile(MARKER)) {
+    // just saved - mess everything up, then load
+    fs.writeFile(MARKER, "1");
+    data = undefined;
+    big = undefined;
+    many = undefined;
+    load();
+  } else {
+    fs.unlink(MARKER);
+    fs.unlink("espruino.state");
+    result = check();
+  }
+}
+
+fs.unlink(MARKER);
+save();
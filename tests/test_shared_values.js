@@ -0,0 +1,15 @@
+// Results of maths/comparisons may be shared between expressions - make sure
+// using one as an array index or property name doesn't change its value
+
+var a = [];
+a[1+1] = "x";
+a[1+1] = "y";
+var o = {};
+o[3>2] = 1;
+o[3>2]++;
+var n = 0;
+for (var i=0;i<20;i++) n += (i&3)==1;
+
+result = a[2]=="y" && a.length==3 && (1+1)==2 &&
+         o["true"]==2 && (3>2)===true &&
+         n==5 && 0+0===0;
@@ -0,0 +1,64 @@
+// set/fill/copyWithin/subarray on typed arrays, both on small (non-flat) and large (flat) buffers
+
+var ok = true;
+function check(a, expected) {
+  if (a.length != expected.length) ok = false;
+  for (var i=0;i<expected.length;i++) if (a[i]!==expected[i]) ok = false;
+}
+function seq(T, n) { var a = new T(n); for (var i=0;i<n;i++) a[i] = i; return a; }
+function seqArr(n) { var a = []; for (var i=0;i<n;i++) a.push(i); return a; }
+
+[4, 200].forEach(function(n) {
+  // subarray shares data
+  var a = seq(Int16Array, n);
+  var s = a.subarray(1, -1);
+  check(s, seqArr(n).slice(1,n-1));
+  s[0] = 42;
+  if (a[1]!=42) ok = false;
+  var s2 = s.subarray(1);
+  if (s2.byteOffset != 4 || s2[0] != 2) ok = false;
+  if (a.subarray(3,1).length != 0) ok = false;
+
+  // copyWithin, overlapping both ways
+  var e = seqArr(n);
+  a = seq(Int16Array, n);
+  a.copyWithin(1, 0, n-1);
+  check(a, [0].concat(e.slice(0,n-1)));
+  a = seq(Int16Array, n);
+  a.copyWithin(0, 1);
+  check(a, e.slice(1).concat([n-1]));
+  a = seq(Uint8Array, n);
+  a.copyWithin(-2, 0);
+  check(a, e.slice(0,n-2).concat([0,1]));
+
+  // fill
+  a = seq(Float32Array, n);
+  a.fill(1.5, 1, -1);
+  e = [0]; for (var i=1;i<n-1;i++) e.push(1.5); e.push(n-1);
+  check(a, e);
+  a = new Int32Array(n).fill(-7);
+  if (a[0]!=-7 || a[n-1]!=-7) ok = false;
+  a = new Uint8ClampedArray(n).fill(300);
+  if (a[0]!=255 || a[n-1]!=255) ok = false;
+
+  // set, between types of the same size and converting
+  a = seq(Uint16Array, n);
+  var b = new Int16Array(n);
+  b.set(a.subarray(1), 1);
+  check(b, [0].concat(seqArr(n).slice(1)));
+  b = new Int16Array([-1,-2]);
+  a.set(b, 2);
+  if (a[2]!=65535 || a[3]!=65534) ok = false;
+  var c = new Uint8ClampedArray(n);
+  c.set(new Int8Array([-5, 5]));
+  if (c[0]!=0 || c[1]!=5) ok = false;
+  var f = new Float64Array(n);
+  f.set(new Float32Array([0.5, 1.5]));
+  if (f[0]!=0.5 || f[1]!=1.5) ok = false;
+  // a copied view doesn't share data
+  var d = new Int16Array(a);
+  d[0] = 99;
+  if (a[0]!=0 || d[1]!=1) ok = false;
+});
+
+result = ok;
@@ -0,0 +1,37 @@
+// Typed array map/forEach/reduce, including callbacks that keep hold of their arguments
+
+var ok = true;
+function check(a, expected) {
+  if (a.length != expected.length) ok = false;
+  for (var i=0;i<expected.length;i++) if (a[i]!==expected[i]) ok = false;
+}
+
+var a = new Int16Array([1,-2,300]);
+var m = a.map(function(v,i,arr) { if (arr!==a) ok = false; return v*2+i; });
+if (!(m instanceof Int16Array)) ok = false;
+check(m, [2,-3,602]);
+check(new Uint8Array([1,2,128]).map(E.reverseByte), [128,64,1]);
+check(new Float32Array([4,9]).map(Math.sqrt), [2,3]);
+check(new Uint8Array([4,9]).map(Math.sqrt), [2,3]);
+check(new Uint32Array([4294967295]).map(Math.abs), [4294967295]);
+check(new Float64Array([0.5,-1.5]).map(function(v) { return v; }), [0.5,-1.5]);
+var o = { z : 3 };
+check(new Uint8Array([1,2]).map(function(v) { return v*this.z; }, o), [3,6]);
+
+// keeping hold of the value/index shouldn't see them change afterwards
+var vals = [], idxs = [];
+new Float32Array([1.5,2.5,3.5]).forEach(function(v,i) { vals.push(v); idxs.push(i); });
+check(vals, [1.5,2.5,3.5]);
+check(idxs, [0,1,2]);
+var fns = [];
+new Uint32Array([1,4294967295,3]).forEach(function(v,i) { fns.push(function() { return v+":"+i; }); });
+check(fns.map(function(f) { return f(); }), ["1:0","4294967295:1","3:2"]);
+
+// reduce
+if (new Int8Array([1,2,3,4]).reduce(function(p,v) { return p+v; }) !== 10) ok = false;
+if (new Int8Array([1,2,3,4]).reduce(function(p,v) { return p+v; }, 10) !== 20) ok = false;
+if (new Int8Array([5,6,7]).reduce(function(p,v,i) { return v; }) !== 7) ok = false;
+var kept = new Int8Array([5,6,7]).reduce(function(p,v,i) { p.push(v,i); return p; }, []);
+check(kept, [5,0,6,1,7,2]);
+
+result = ok;
@@ -0,0 +1,38 @@
+// E.sum/variance/convolve/FFT on typed arrays should match plain Arrays
+
+var ok = true;
+function same(a,b,tol) { if (!(Math.abs(a-b)<=(tol||0.001))) ok = false; }
+
+var plain = [], plainB = [];
+for (var i=0;i<37;i++) plain.push((i*37)%23-7);
+for (i=0;i<11;i++) plainB.push((i*5)%7-2);
+
+[[Int8Array,1],[Int16Array,2],[Int32Array,4],[Float32Array,4],[Float64Array,8]].forEach(function(t) {
+  var T = t[0];
+  var a = new T(plain), b = new T(plainB);
+  same(E.sum(a), E.sum(plain));
+  same(E.variance(a,3), E.variance(plain,3));
+  [3,-30,40].forEach(function(o) {
+    same(E.convolve(a,b,o), E.convolve(plain,plainB,o));
+    same(E.convolve(a,new Float32Array(b),o), E.convolve(plain,plainB,o));
+  });
+  // view into the middle of a buffer
+  var sub = new T(a.buffer, 4*t[1], 8);
+  same(E.sum(sub), E.sum(plain.slice(4,12)));
+});
+
+[Uint8Array,Uint16Array,Uint8ClampedArray].forEach(function(T) {
+  var a = new T(plain), s = 0;
+  for (i=0;i<a.length;i++) s += a[i];
+  same(E.sum(a), s);
+});
+
+[Float32Array,Float64Array,Int16Array].forEach(function(T) {
+  var r = new T(16), im = new T(16), pr = [], pi = [];
+  for (i=0;i<16;i++) { r[i] = pr[i] = Math.round(Math.sin(i)*10); im[i] = pi[i] = 0; }
+  E.FFT(r, im);
+  E.FFT(pr, pi);
+  for (i=0;i<16;i++) same(r[i], pr[i], T==Int16Array ? 1 : 0.001);
+});
+
+result = ok;
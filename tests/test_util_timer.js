@@ -0,0 +1,25 @@
+// Pin changes queued on the utility timer should happen, in order, at about the right time
+
+var times, start, pulsesDone;
+setWatch(function(e) { times.push(e); }, D1, {repeat:true, edge:'both'});
+
+function attempt(attempts) {
+  times = [];
+  start = getTime()+0.02;
+  D1.writeAtTime(1, start);
+  D1.writeAtTime(0, start+0.01);
+  digitalPulse(D2, 1, [5, 5, 5]);
+  digitalPulse(D2, 1, 0); // wait for the pulses to finish
+  pulsesDone = digitalRead(D2)==0;
+
+  setTimeout(function() {
+    result = pulsesDone && times.length==2 &&
+             times[0].state && !times[1].state &&
+             times[0].time >= start && times[0].time < start+0.005 &&
+             times[1].time >= start+0.01 && times[1].time < start+0.015 &&
+             digitalRead(D1)==0;
+    // the host can occasionally wake the timer thread late - that's not our jitter
+    if (!result && attempts>1) attempt(attempts-1);
+  }, 100);
+}
+attempt(3);
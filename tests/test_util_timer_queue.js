@@ -0,0 +1,43 @@
+// Lots of utility timer tasks, queued out of order, should still happen in time order
+
+var pins = [D1, D2, D3, D4];
+var start = getTime()+0.05;
+var schedule = [[],[],[],[]], events = [[],[],[],[]];
+// pseudo-random but repeatable times
+var seed = 1;
+function rand() { seed = (seed*1103515245 + 12345) & 0x7FFFFFFF; return seed / 0x7FFFFFFF; }
+for (var i=0;i<100;i++) schedule[i&3].push(start + rand()*0.05);
+
+pins.forEach(function(pin, p) {
+  setWatch(function(e) { events[p].push(e); }, pin, {repeat:true, edge:'both'});
+  // alternate values in time order, so every task changes the pin
+  var times = schedule[p].slice().sort(function(a,b) { return a<b ? -1 : a>b ? 1 : 0; });
+  schedule[p].forEach(function(t) { pin.writeAtTime(times.indexOf(t)&1 ? 0 : 1, t); });
+});
+
+// tasks at the same time happen in the order they were queued
+D5.writeAtTime(0, start);
+D5.writeAtTime(1, start);
+
+// waveforms use the timer too
+var finished = [];
+var w1 = new Waveform(32), w2 = new Waveform(32);
+w1.on("finish", function() { finished.push(1); });
+w2.on("finish", function() { finished.push(2); });
+w1.startInput(D6, 1000);
+w2.startInput(D7, 1000, {repeat:true});
+var bothRunning = w1.running && w2.running;
+
+setTimeout(function() {
+  var ok = bothRunning && !w1.running && w2.running;
+  w2.stop();
+  pins.forEach(function(pin, p) {
+    var times = schedule[p].sort(function(a,b) { return a<b ? -1 : a>b ? 1 : 0; });
+    ok = ok && events[p].length == times.length;
+    events[p].forEach(function(e, i) {
+      // times are rounded to the nearest microsecond when the task is queued
+      ok = ok && e.state == !(i&1) && e.time > times[i]-0.000001 && (i==0 || e.time >= events[p][i-1].time);
+    });
+  });
+  result = ok && digitalRead(D5)==1 && finished.length==1 && finished[0]==1;
+}, 150);